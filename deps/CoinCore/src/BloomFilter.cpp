@@ -126,3 +126,15 @@ bool BloomFilter::match(const uchar_vector& data) const
     }
     return true;
 }
+
+double BloomFilter::estimatedFalsePositiveRate() const
+{
+    if (!bSet || filter.empty()) return 0.0;
+    if (bFull) return 1.0;
+
+    uint bitsSet = 0;
+    for (unsigned char byte: filter) {
+        for (; byte; byte &= byte - 1) { bitsSet++; }
+    }
+    return pow((double)bitsSet / (filter.size() * 8), nHashFuncs);
+}
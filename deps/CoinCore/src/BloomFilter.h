@@ -44,6 +44,9 @@ public:
     void insert(const uchar_vector& data);
     bool match(const uchar_vector& data) const;
 
+    // Chance that an item never inserted matches, estimated from the fraction of bits set.
+    double estimatedFalsePositiveRate() const;
+
     const uchar_vector& getFilter() const { return filter; }
     uint32_t getNHashFuncs() const { return nHashFuncs; }
     uint32_t getNTweak() const { return nTweak; }
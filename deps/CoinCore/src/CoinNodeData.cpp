@@ -25,6 +25,7 @@
 #include <algorithm>
 
 #include <assert.h>
+#include <string.h>
 
 using namespace Coin;
 using namespace std;
@@ -1657,6 +1658,7 @@ void Transaction::resetSigHash()
 
 hashfunc_t CoinBlockHeader::hashfunc_ = &sha256_2; // use Hashcash as default. Change with CoinBlockHeader::setHashFunc(<hash function>).
 hashfunc_t CoinBlockHeader::powhashfunc_ = &sha256_2;
+batchhashfunc_t CoinBlockHeader::powbatchhashfunc_ = nullptr;
 
 CoinBlockHeader::CoinBlockHeader(const string& hex)
 {
@@ -1752,6 +1754,32 @@ const BigInt CoinBlockHeader::getWork() const
     return (BigInt(1) << 256) / (getTarget() + 1);
 }
 
+bool CoinBlockHeader::checkProofOfWork() const
+{
+    const uchar_vector& hash = getPOWHashLittleEndian();
+    if (hash.size() != 32) return !(BigInt(hash) > getTarget());
+
+    // Lay out the target as 32 big endian bytes: the mantissa shifted left by (exponent - 3) bytes.
+    unsigned char target[32] = { 0 };
+    int nExp = bits_ >> 24;
+    uint32_t nMantissa = bits_ & 0x007fffff;
+    for (int i = 0; i < 3; i++)
+    {
+        unsigned char byte = (nMantissa >> (8 * (2 - i))) & 0xff;
+        int pos = 32 - nExp + i;
+        if (pos < 0)
+        {
+            if (byte) return true; // target does not fit in 256 bits
+        }
+        else if (pos < 32)
+        {
+            target[pos] = byte;
+        }
+    }
+
+    return memcmp(&hash[0], target, 32) <= 0;
+}
+
 string CoinBlockHeader::toString() const
 {
     stringstream ss;
@@ -1796,11 +1824,12 @@ const uchar_vector& CoinBlockHeader::getHashLittleEndian() const
     return hashLittleEndian_; 
 }
 
+// Not through CoinNodeStructure::getHash(), which would overwrite the cached block hash.
 const uchar_vector& CoinBlockHeader::getPOWHash() const
 {
     if (!isPOWHashSet_)
     {
-        POWHash_ = CoinNodeStructure::getHash(powhashfunc_);
+        POWHash_ = powhashfunc_(getSerialized());
         POWHashLittleEndian_ = POWHash_.getReverse();
         isPOWHashSet_ = true;
     }
@@ -1811,13 +1840,44 @@ const uchar_vector& CoinBlockHeader::getPOWHashLittleEndian() const
 {
     if (!isPOWHashSet_)
     {
-        POWHash_ = CoinNodeStructure::getHash(powhashfunc_);
+        POWHash_ = powhashfunc_(getSerialized());
         POWHashLittleEndian_ = POWHash_.getReverse();
         isPOWHashSet_ = true;
     }
     return POWHashLittleEndian_; 
 }
 
+// static
+void CoinBlockHeader::computePOWHashes(std::vector<CoinBlockHeader>::const_iterator begin, std::vector<CoinBlockHeader>::const_iterator end)
+{
+    if (!powbatchhashfunc_)
+    {
+        for (auto it = begin; it != end; ++it) { it->getPOWHash(); }
+        return;
+    }
+
+    std::vector<const CoinBlockHeader*> pending;
+    std::vector<uchar_vector> data;
+    for (auto it = begin; it != end; ++it)
+    {
+        if (it->isPOWHashSet_) continue;
+        pending.push_back(&*it);
+        data.push_back(it->getSerialized());
+    }
+    if (pending.empty()) return;
+
+    std::vector<uchar_vector> hashes = powbatchhashfunc_(data);
+    if (hashes.size() != pending.size()) throw runtime_error("CoinBlockHeader::computePOWHashes - batch hash function returned wrong number of hashes.");
+
+    for (std::size_t i = 0; i < pending.size(); i++)
+    {
+        const CoinBlockHeader& header = *pending[i];
+        header.POWHash_ = hashes[i];
+        header.POWHashLittleEndian_ = header.POWHash_.getReverse();
+        header.isPOWHashSet_ = true;
+    }
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 //
 // class CoinBlock implementation
@@ -91,6 +91,7 @@ enum HashType
 };
 
 typedef std::function<uchar_vector(const uchar_vector&)> hashfunc_t;
+typedef std::function<std::vector<uchar_vector>(const std::vector<uchar_vector>&)> batchhashfunc_t;
 
 class CoinNodeStructure
 {
@@ -770,8 +771,17 @@ public:
 
     const BigInt getWork() const;
 
+    // Same as comparing the POW hash with getTarget(), but on fixed-width bytes instead of BigInts.
+    bool checkProofOfWork() const;
+
     static void setHashFunc(hashfunc_t hashfunc) { hashfunc_ = hashfunc; }
-    static void setPOWHashFunc(hashfunc_t hashfunc) { powhashfunc_ = hashfunc; }
+    // batchhashfunc is optional. It must give the same results as hashfunc.
+    static void setPOWHashFunc(hashfunc_t hashfunc, batchhashfunc_t batchhashfunc = nullptr) { powhashfunc_ = hashfunc; powbatchhashfunc_ = batchhashfunc; }
+
+    // Computes and caches the POW hashes of all headers that don't have them yet, in one call to the
+    // batch hash function if there is one. Safe to call from several threads on disjoint headers.
+    static void computePOWHashes(std::vector<CoinBlockHeader>::const_iterator begin, std::vector<CoinBlockHeader>::const_iterator end);
+    static void computePOWHashes(const std::vector<CoinBlockHeader>& headers) { computePOWHashes(headers.begin(), headers.end()); }
 
     const uchar_vector& getHash() const;
     const uchar_vector& getHashLittleEndian() const;
@@ -785,6 +795,7 @@ private:
 
     static hashfunc_t hashfunc_;
     static hashfunc_t powhashfunc_;
+    static batchhashfunc_t powbatchhashfunc_;
 
 /*
     // Inherited from CoinNodeStructure
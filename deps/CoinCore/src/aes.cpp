@@ -31,7 +31,7 @@ uint64_t random_salt()
     uint64_t salt;
     do
     {
-        secure_bytes_t bytes = random_bytes(8);
+        bytes_t bytes = random_bytes(8);
         memcpy((void*)&salt, (const void*)&bytes[0], 8);
     }
     while (salt == 0);
@@ -107,7 +107,7 @@ bytes_t encrypt(const secure_bytes_t& key, const secure_bytes_t& plaintext, bool
     int len = plaintext.size();
     unsigned char* ciphertext_ = encrypt(&en, (unsigned char*)&plaintext[0], &len);
 
-    secure_bytes_t ciphertext(ciphertext_, ciphertext_ + len);
+    bytes_t ciphertext(ciphertext_, ciphertext_ + len);
 
     free(ciphertext_);
     EVP_CIPHER_CTX_cleanup(&en);
@@ -169,6 +169,7 @@ secure_bytes_t decrypt(const secure_bytes_t& key, const bytes_t& ciphertext, boo
 
     secure_bytes_t plaintext(plaintext_, plaintext_ + len);
 
+    OPENSSL_cleanse(plaintext_, len);
     free(plaintext_);
     EVP_CIPHER_CTX_cleanup(&en);
     EVP_CIPHER_CTX_cleanup(&de);
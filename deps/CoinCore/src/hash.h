@@ -18,6 +18,12 @@
 
 #include <stdutils/uchar_vector.h>
 
+#include "typedefs.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
 #include "hashblock.h" // for Hash9
 #include "scrypt/scrypt.h" // for scrypt_1024_1_1_256
 
@@ -48,6 +54,25 @@ inline uchar_vector sha256_2(const uchar_vector& data)
     return rval;
 }
 
+#ifdef USE_SECURE_ALLOCATOR
+// Keep hashes of secrets, such as passphrases, in secure memory.
+inline secure_bytes_t sha256(const secure_bytes_t& data)
+{
+    secure_bytes_t hash(SHA256_DIGEST_LENGTH);
+    SHA256_CTX sha256;
+    SHA256_Init(&sha256);
+    SHA256_Update(&sha256, data.data(), data.size());
+    SHA256_Final(hash.data(), &sha256);
+    stdutils::secure_cleanse(&sha256, sizeof(sha256));
+    return hash;
+}
+
+inline secure_bytes_t sha256_2(const secure_bytes_t& data)
+{
+    return sha256(sha256(data));
+}
+#endif
+
 inline uchar_vector ripemd160(const uchar_vector& data)
 {
     unsigned char hash[RIPEMD160_DIGEST_LENGTH];
@@ -115,4 +140,44 @@ inline uchar_vector scrypt_1024_1_1_256(const uchar_vector& data)
     return uchar_vector((unsigned char*)&hash, (unsigned char*)&hash + 32);
 }
 
+// Batch versions for proof-of-work checks on many headers. Each call keeps its own scratch state,
+// so batches can be hashed on several threads at once.
+inline std::vector<uchar_vector> hash9_batch(const std::vector<uchar_vector>& data)
+{
+    Hash9Context ctx;
+    std::vector<uchar_vector> hashes;
+    hashes.reserve(data.size());
+    for (auto& item: data)
+    {
+        uint256 hash = Hash9((unsigned char*)&item[0], (unsigned char*)&item[0] + item.size(), ctx);
+        hashes.push_back(uchar_vector((unsigned char*)&hash, (unsigned char*)&hash + 32));
+    }
+    return hashes;
+}
+
+// Inputs must be 80 bytes long, like for scrypt_1024_1_1_256. Throws std::invalid_argument otherwise.
+inline std::vector<uchar_vector> scrypt_1024_1_1_256_batch(const std::vector<uchar_vector>& data)
+{
+    std::vector<uchar_vector> hashes;
+    if (data.empty()) return hashes;
+
+    std::vector<char> input(80 * data.size());
+    for (std::size_t i = 0; i < data.size(); i++)
+    {
+        if (data[i].size() != 80) throw std::invalid_argument("scrypt_1024_1_1_256_batch - inputs must be 80 bytes.");
+        std::copy(data[i].begin(), data[i].end(), input.begin() + 80 * i);
+    }
+
+    std::vector<char> output(32 * data.size());
+    std::vector<char> scratchpad(scrypt_1024_1_1_256_lanes_scratchpad_size());
+    scrypt_1024_1_1_256_batch_(&input[0], &output[0], data.size(), &scratchpad[0]);
+
+    hashes.reserve(data.size());
+    for (std::size_t i = 0; i < data.size(); i++)
+    {
+        hashes.push_back(uchar_vector((unsigned char*)&output[32 * i], (unsigned char*)&output[32 * i] + 32));
+    }
+    return hashes;
+}
+
 #endif
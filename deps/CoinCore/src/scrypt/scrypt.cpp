@@ -34,6 +34,12 @@
 #include <string.h>
 #include <openssl/sha.h>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 static inline uint32_t be32dec(const void *pp)
 {
 	const uint8_t *p = (uint8_t const *)pp;
@@ -276,6 +282,137 @@ void scrypt_1024_1_1_256_sp_generic(const char *input, char *output, char *scrat
 	PBKDF2_SHA256((const uint8_t *)input, 80, B, 128, 1, (uint8_t *)output, 32);
 }
 
+/*
+ * Multi-lane kernel: SCRYPT_LANES independent hashes are interleaved word by
+ * word (X[k * SCRYPT_LANES + lane]) so each salsa20/8 step runs on one vector
+ * register holding the same word of every lane. Only the data-dependent reads
+ * from V are done per lane.
+ */
+#if defined(__AVX2__)
+#define SCRYPT_LANES 8
+typedef __m256i scrypt_vec_t;
+#define VLOAD(p)	_mm256_load_si256((const __m256i *)(p))
+#define VSTORE(p, v)	_mm256_store_si256((__m256i *)(p), (v))
+#define VADD(a, b)	_mm256_add_epi32((a), (b))
+#define VXOR(a, b)	_mm256_xor_si256((a), (b))
+#define VROTL(a, b)	_mm256_or_si256(_mm256_slli_epi32((a), (b)), _mm256_srli_epi32((a), 32 - (b)))
+#elif defined(__SSE2__)
+#define SCRYPT_LANES 4
+typedef __m128i scrypt_vec_t;
+#define VLOAD(p)	_mm_load_si128((const __m128i *)(p))
+#define VSTORE(p, v)	_mm_store_si128((__m128i *)(p), (v))
+#define VADD(a, b)	_mm_add_epi32((a), (b))
+#define VXOR(a, b)	_mm_xor_si128((a), (b))
+#define VROTL(a, b)	_mm_or_si128(_mm_slli_epi32((a), (b)), _mm_srli_epi32((a), 32 - (b)))
+#else
+#define SCRYPT_LANES 1
+#endif
+
+#if SCRYPT_LANES > 1
+static inline void xor_salsa8_lanes(uint32_t *B, const uint32_t *Bx)
+{
+	scrypt_vec_t x[16];
+	int i;
+
+	for (i = 0; i < 16; i++) {
+		x[i] = VXOR(VLOAD(&B[i * SCRYPT_LANES]), VLOAD(&Bx[i * SCRYPT_LANES]));
+		VSTORE(&B[i * SCRYPT_LANES], x[i]);
+	}
+
+#define R(a, b, c, s)	x[a] = VXOR(x[a], VROTL(VADD(x[b], x[c]), s))
+	for (i = 0; i < 8; i += 2) {
+		/* Operate on columns. */
+		R( 4,  0, 12,  7);  R( 9,  5,  1,  7);  R(14, 10,  6,  7);  R( 3, 15, 11,  7);
+		R( 8,  4,  0,  9);  R(13,  9,  5,  9);  R( 2, 14, 10,  9);  R( 7,  3, 15,  9);
+		R(12,  8,  4, 13);  R( 1, 13,  9, 13);  R( 6,  2, 14, 13);  R(11,  7,  3, 13);
+		R( 0, 12,  8, 18);  R( 5,  1, 13, 18);  R(10,  6,  2, 18);  R(15, 11,  7, 18);
+
+		/* Operate on rows. */
+		R( 1,  0,  3,  7);  R( 6,  5,  4,  7);  R(11, 10,  9,  7);  R(12, 15, 14,  7);
+		R( 2,  1,  0,  9);  R( 7,  6,  5,  9);  R( 8, 11, 10,  9);  R(13, 12, 15,  9);
+		R( 3,  2,  1, 13);  R( 4,  7,  6, 13);  R( 9,  8, 11, 13);  R(14, 13, 12, 13);
+		R( 0,  3,  2, 18);  R( 5,  4,  7, 18);  R(10,  9,  8, 18);  R(15, 14, 13, 18);
+	}
+#undef R
+
+	for (i = 0; i < 16; i++)
+		VSTORE(&B[i * SCRYPT_LANES], VADD(VLOAD(&B[i * SCRYPT_LANES]), x[i]));
+}
+#endif
+
+unsigned int scrypt_1024_1_1_256_lanes(void)
+{
+	return SCRYPT_LANES;
+}
+
+size_t scrypt_1024_1_1_256_lanes_scratchpad_size(void)
+{
+	return SCRYPT_LANES * 131072 + 63;
+}
+
+void scrypt_1024_1_1_256_sp_lanes(const char *input, char *output, char *scratchpad)
+{
+#if SCRYPT_LANES > 1
+	uint8_t B[128];
+	alignas(32) uint32_t X[32 * SCRYPT_LANES];
+	uint32_t *V;
+	uint32_t i, j, k, l;
+
+	V = (uint32_t *)(((uintptr_t)(scratchpad) + 63) & ~ (uintptr_t)(63));
+
+	for (l = 0; l < SCRYPT_LANES; l++) {
+		PBKDF2_SHA256((const uint8_t *)input + 80 * l, 80, (const uint8_t *)input + 80 * l, 80, 1, B, 128);
+		for (k = 0; k < 32; k++)
+			X[k * SCRYPT_LANES + l] = le32dec(&B[4 * k]);
+	}
+
+	for (i = 0; i < 1024; i++) {
+		memcpy(&V[i * 32 * SCRYPT_LANES], X, 128 * SCRYPT_LANES);
+		xor_salsa8_lanes(&X[0], &X[16 * SCRYPT_LANES]);
+		xor_salsa8_lanes(&X[16 * SCRYPT_LANES], &X[0]);
+	}
+	for (i = 0; i < 1024; i++) {
+		for (l = 0; l < SCRYPT_LANES; l++) {
+			j = 32 * SCRYPT_LANES * (X[16 * SCRYPT_LANES + l] & 1023) + l;
+			for (k = 0; k < 32; k++)
+				X[k * SCRYPT_LANES + l] ^= V[j + k * SCRYPT_LANES];
+		}
+		xor_salsa8_lanes(&X[0], &X[16 * SCRYPT_LANES]);
+		xor_salsa8_lanes(&X[16 * SCRYPT_LANES], &X[0]);
+	}
+
+	for (l = 0; l < SCRYPT_LANES; l++) {
+		for (k = 0; k < 32; k++)
+			le32enc(&B[4 * k], X[k * SCRYPT_LANES + l]);
+		PBKDF2_SHA256((const uint8_t *)input + 80 * l, 80, B, 128, 1, (uint8_t *)output + 32 * l, 32);
+	}
+#else
+	scrypt_1024_1_1_256_sp_generic(input, output, scratchpad);
+#endif
+}
+
+void scrypt_1024_1_1_256_batch_(const char *input, char *output, size_t count, char *scratchpad)
+{
+	char *allocated = NULL;
+	size_t i = 0;
+
+	if (!scratchpad)
+		scratchpad = allocated = (char *)malloc(scrypt_1024_1_1_256_lanes_scratchpad_size());
+
+	if (scratchpad) {
+		for (; i + SCRYPT_LANES <= count; i += SCRYPT_LANES)
+			scrypt_1024_1_1_256_sp_lanes(input + 80 * i, output + 32 * i, scratchpad);
+		for (; i < count; i++)
+			scrypt_1024_1_1_256_sp_generic(input + 80 * i, output + 32 * i, scratchpad);
+	} else {
+		/* Out of memory: fall back to the stack scratchpad. */
+		for (; i < count; i++)
+			scrypt_1024_1_1_256_(input + 80 * i, output + 32 * i);
+	}
+
+	free(allocated);
+}
+
 #if defined(USE_SSE2)
 #if defined(_M_X64) || defined(__x86_64__) || defined(_M_AMD64) || (defined(MAC_OSX) && defined(__i386__))
 /* Always SSE2 */
@@ -7,6 +7,19 @@ static const int SCRYPT_SCRATCHPAD_SIZE = 131072 + 63;
 void scrypt_1024_1_1_256_(const char *input, char *output);
 void scrypt_1024_1_1_256_sp_generic(const char *input, char *output, char *scratchpad);
 
+/* Number of 80-byte inputs scrypt_1024_1_1_256_sp_lanes() hashes at once: 8 when built
+ * with AVX2, 4 with SSE2, otherwise 1. Its scratchpad must hold
+ * scrypt_1024_1_1_256_lanes_scratchpad_size() bytes. */
+unsigned int scrypt_1024_1_1_256_lanes(void);
+size_t scrypt_1024_1_1_256_lanes_scratchpad_size(void);
+void scrypt_1024_1_1_256_sp_lanes(const char *input, char *output, char *scratchpad);
+
+/* Hashes count consecutive 80-byte inputs into count consecutive 32-byte outputs.
+ * Pass a scratchpad of scrypt_1024_1_1_256_lanes_scratchpad_size() bytes to reuse it
+ * across calls, or NULL to allocate one for this call. Reentrant as long as each
+ * thread has its own scratchpad. */
+void scrypt_1024_1_1_256_batch_(const char *input, char *output, size_t count, char *scratchpad);
+
 #if defined(USE_SSE2)
 extern void scrypt_detect_sse2(unsigned int cpuid_edx);
 void scrypt_1024_1_1_256_sp_sse2(const char *input, char *output, char *scratchpad);
@@ -17,7 +17,19 @@
 #include <string>
 
 typedef std::vector<unsigned char> bytes_t;
+
+// Build with SECURE_ALLOCATOR=1 to keep key material in locked, zeroed-on-free memory.
+#ifdef USE_SECURE_ALLOCATOR
+#include <stdutils/secure_allocator.h>
+typedef stdutils::secure_vector secure_bytes_t;
+#else
 typedef std::vector<unsigned char> secure_bytes_t;
+#endif
+
+// Explicit copies for key material that has to cross between the two, since they are distinct types
+// in secure builds.
+inline secure_bytes_t to_secure_bytes(const bytes_t& bytes) { return secure_bytes_t(bytes.begin(), bytes.end()); }
+inline bytes_t to_bytes(const secure_bytes_t& bytes) { return bytes_t(bytes.begin(), bytes.end()); }
 
 typedef std::vector<bytes_t> hashvector_t;
 typedef std::set<bytes_t> hashset_t;
@@ -27,6 +39,6 @@ typedef std::string secure_string_t;
 typedef std::vector<int> ints_t;
 typedef std::vector<int> secure_ints_t;
 
-// TODO: use custom allocators for secure types
+// TODO: use custom allocators for the other secure types
 
 #endif // __TYPEDEFS_H__
@@ -0,0 +1,288 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// bench.h
+//
+// Copyright (c) 2011-2016 Ciphrex Corp.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+//
+// Minimal benchmark harness with the same command line flags and JSON output
+// format as Google Benchmark, so results can be compared with the same tools.
+//
+
+#pragma once
+
+#include <boost/regex.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+#include <unistd.h>
+
+namespace Bench
+{
+
+// Keeps the compiler from discarding a result that is never used.
+template<typename T>
+inline void DoNotOptimize(const T& value)
+{
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+class State
+{
+public:
+    explicit State(uint64_t max_iterations) : max_iterations_(max_iterations), iterations_(0), bytes_processed_(0), items_processed_(0) { }
+
+    // Starts the clocks on the first call. Returns false once all iterations have run.
+    bool KeepRunning()
+    {
+        if (iterations_ == 0) start();
+        if (iterations_ < max_iterations_) { iterations_++; return true; }
+        stop();
+        return false;
+    }
+
+    // Excludes per-iteration setup from the measurement.
+    void PauseTiming()  { real_ += std::chrono::steady_clock::now() - real_start_; cpu_ += std::clock() - cpu_start_; }
+    void ResumeTiming() { real_start_ = std::chrono::steady_clock::now(); cpu_start_ = std::clock(); }
+
+    void SetBytesProcessed(uint64_t bytes) { bytes_processed_ = bytes; }
+    void SetItemsProcessed(uint64_t items) { items_processed_ = items; }
+
+    uint64_t iterations() const { return iterations_; }
+    uint64_t bytesProcessed() const { return bytes_processed_; }
+    uint64_t itemsProcessed() const { return items_processed_; }
+    double realSeconds() const { return std::chrono::duration<double>(real_).count(); }
+    double cpuSeconds() const { return (double)cpu_ / CLOCKS_PER_SEC; }
+
+private:
+    uint64_t max_iterations_;
+    uint64_t iterations_;
+    uint64_t bytes_processed_;
+    uint64_t items_processed_;
+
+    std::chrono::steady_clock::time_point real_start_;
+    std::chrono::steady_clock::duration real_ = std::chrono::steady_clock::duration::zero();
+    std::clock_t cpu_start_ = 0;
+    std::clock_t cpu_ = 0;
+
+    void start() { ResumeTiming(); }
+    void stop() { PauseTiming(); }
+};
+
+typedef std::function<void(State&)> benchmark_t;
+
+struct Benchmark
+{
+    std::string name;
+    benchmark_t fn;
+};
+
+inline std::vector<Benchmark>& registry()
+{
+    static std::vector<Benchmark> benchmarks;
+    return benchmarks;
+}
+
+struct Registrar
+{
+    Registrar(const std::string& name, benchmark_t fn) { registry().push_back(Benchmark{name, fn}); }
+};
+
+#define BENCHMARK_CONCAT_(a, b) a ## b
+#define BENCHMARK_CONCAT(a, b) BENCHMARK_CONCAT_(a, b)
+#define BENCHMARK(fn) static Bench::Registrar BENCHMARK_CONCAT(bench_registrar_, __LINE__)(#fn, fn)
+
+struct Result
+{
+    std::string name;
+    uint64_t iterations;
+    double real_ns;
+    double cpu_ns;
+    double bytes_per_second;
+    double items_per_second;
+};
+
+// Grows the iteration count until a run takes at least min_time seconds.
+inline Result run(const Benchmark& benchmark, double min_time)
+{
+    const uint64_t MAX_ITERATIONS = 1000000000;
+
+    uint64_t iterations = 1;
+    while (true)
+    {
+        State state(iterations);
+        benchmark.fn(state);
+        if (state.iterations() == 0) throw std::runtime_error(benchmark.name + " did not call KeepRunning().");
+
+        double seconds = state.realSeconds();
+        if (seconds >= min_time || iterations >= MAX_ITERATIONS)
+        {
+            Result result;
+            result.name = benchmark.name;
+            result.iterations = state.iterations();
+            result.real_ns = seconds * 1e9 / state.iterations();
+            result.cpu_ns = state.cpuSeconds() * 1e9 / state.iterations();
+            result.bytes_per_second = seconds > 0 ? state.bytesProcessed() / seconds : 0;
+            result.items_per_second = seconds > 0 ? state.itemsProcessed() / seconds : 0;
+            return result;
+        }
+
+        // Aim 40% past min_time, but never grow more than tenfold in one step.
+        double multiplier = seconds > 0 ? min_time * 1.4 / seconds : 10.0;
+        if (multiplier > 10.0) multiplier = 10.0;
+        uint64_t next = (uint64_t)(iterations * multiplier);
+        iterations = next > iterations ? next : iterations + 1;
+        if (iterations > MAX_ITERATIONS) iterations = MAX_ITERATIONS;
+    }
+}
+
+inline std::string jsonEscape(const std::string& s)
+{
+    std::string escaped;
+    for (char c: s)
+    {
+        if (c == '"' || c == '\\') escaped += '\\';
+        escaped += c;
+    }
+    return escaped;
+}
+
+inline void writeJson(std::ostream& os, const std::vector<Result>& results)
+{
+    std::time_t now = std::time(nullptr);
+    char date[32];
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+
+    os << "{" << std::endl
+       << "  \"context\": {" << std::endl
+       << "    \"date\": \"" << date << "\"," << std::endl
+       << "    \"num_cpus\": " << sysconf(_SC_NPROCESSORS_ONLN) << std::endl
+       << "  }," << std::endl
+       << "  \"benchmarks\": [";
+
+    for (std::size_t i = 0; i < results.size(); i++)
+    {
+        const Result& r = results[i];
+        os << (i ? "," : "") << std::endl
+           << "    {" << std::endl
+           << "      \"name\": \"" << jsonEscape(r.name) << "\"," << std::endl
+           << "      \"iterations\": " << r.iterations << "," << std::endl
+           << std::fixed << std::setprecision(2)
+           << "      \"real_time\": " << r.real_ns << "," << std::endl
+           << "      \"cpu_time\": " << r.cpu_ns << "," << std::endl
+           << "      \"time_unit\": \"ns\"";
+        if (r.bytes_per_second > 0) os << "," << std::endl << "      \"bytes_per_second\": " << r.bytes_per_second;
+        if (r.items_per_second > 0) os << "," << std::endl << "      \"items_per_second\": " << r.items_per_second;
+        os << std::endl << "    }";
+        os.unsetf(std::ios::floatfield);
+    }
+
+    os << std::endl << "  ]" << std::endl << "}" << std::endl;
+}
+
+inline void writeConsole(std::ostream& os, const Result& r)
+{
+    std::stringstream rate;
+    if (r.bytes_per_second > 0)      { rate << std::fixed << std::setprecision(2) << r.bytes_per_second / (1024 * 1024) << " MB/s"; }
+    else if (r.items_per_second > 0) { rate << std::fixed << std::setprecision(2) << r.items_per_second << " items/s"; }
+
+    os << std::left << std::setw(44) << r.name << std::right
+       << std::fixed << std::setprecision(0)
+       << std::setw(14) << r.real_ns << " ns"
+       << std::setw(14) << r.cpu_ns << " ns"
+       << std::setw(12) << r.iterations
+       << "  " << rate.str() << std::endl;
+    os.unsetf(std::ios::floatfield);
+}
+
+// Supports --benchmark_filter=<regex>, --benchmark_min_time=<seconds>,
+// --benchmark_format=<console|json>, --benchmark_out=<file> and --benchmark_list_tests.
+inline int main(int argc, char* argv[])
+{
+    std::string filter = ".";
+    double min_time = 0.5;
+    std::string format = "console";
+    std::string outfile;
+    bool list = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg(argv[i]);
+        std::size_t pos = arg.find('=');
+        std::string flag = arg.substr(0, pos);
+        std::string value = pos == std::string::npos ? std::string() : arg.substr(pos + 1);
+
+        if (flag == "--benchmark_filter")           { filter = value; }
+        else if (flag == "--benchmark_min_time")    { min_time = strtod(value.c_str(), nullptr); }
+        else if (flag == "--benchmark_format")      { format = value; }
+        else if (flag == "--benchmark_out")         { outfile = value; }
+        else if (flag == "--benchmark_list_tests")  { list = true; }
+        else
+        {
+            std::cerr << "# Usage: " << argv[0] << " [--benchmark_filter=<regex>] [--benchmark_min_time=<seconds>] [--benchmark_format=<console|json>] [--benchmark_out=<file>] [--benchmark_list_tests]" << std::endl;
+            return -1;
+        }
+    }
+
+    if (format != "console" && format != "json")
+    {
+        std::cerr << "Invalid format: " << format << std::endl;
+        return -1;
+    }
+
+    try
+    {
+        boost::regex re(filter);
+        std::vector<Result> results;
+
+        if (!list && format == "console")
+        {
+            std::cout << std::left << std::setw(44) << "Benchmark" << std::right
+                      << std::setw(17) << "Time" << std::setw(17) << "CPU" << std::setw(12) << "Iterations" << std::endl
+                      << std::string(90, '-') << std::endl;
+        }
+
+        for (auto& benchmark: registry())
+        {
+            if (!boost::regex_search(benchmark.name, re)) continue;
+            if (list) { std::cout << benchmark.name << std::endl; continue; }
+
+            Result result = run(benchmark, min_time);
+            results.push_back(result);
+            if (format == "console") writeConsole(std::cout, result);
+        }
+
+        if (format == "json") writeJson(std::cout, results);
+
+        if (!outfile.empty())
+        {
+            std::ofstream ofs(outfile);
+            if (!ofs) throw std::runtime_error("Failed to open " + outfile + ".");
+            writeJson(ofs, results);
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return -2;
+    }
+
+    return 0;
+}
+
+}
+
+#define BENCHMARK_MAIN() int main(int argc, char* argv[]) { return Bench::main(argc, argv); }
@@ -0,0 +1,495 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// coincore_bench.cpp
+//
+// Copyright (c) 2011-2016 Ciphrex Corp.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+//
+// Benchmarks for the CoinCore primitives on the sync and signing hot paths.
+//
+// Fixtures are generated deterministically at startup: a 2-of-3 multisig
+// transaction spending 100 P2SH outputs, the same transaction spending P2WSH
+// outputs, and a full block of about 2500 mixed P2PKH and multisig transactions.
+//
+
+#include "bench.h"
+
+#include <CoinNodeData.h>
+#include <MerkleTree.h>
+#include <BloomFilter.h>
+#include <hdkeys.h>
+#include <secp256k1_openssl.h>
+#include <Base58Check.h>
+#include <hash.h>
+#include <numericdata.h>
+
+using namespace Coin;
+using namespace CoinCrypto;
+using namespace std;
+
+namespace
+{
+
+const uchar_vector SEED("000102030405060708090a0b0c0d0e0f");
+
+const unsigned int MULTISIG_TX_INPUTS = 100;
+const unsigned int BLOCK_TXS = 2500;
+
+// Deterministic pseudorandom bytes.
+uchar_vector fixtureBytes(size_t size, uint32_t n)
+{
+    uchar_vector bytes;
+    uchar_vector block = sha256(uint_to_vch(n, LITTLE_ENDIAN_));
+    while (bytes.size() < size)
+    {
+        bytes += block;
+        block = sha256(block);
+    }
+    bytes.resize(size);
+    return bytes;
+}
+
+// DER-shaped placeholder with the size of a typical signature plus hashtype byte.
+uchar_vector fixtureSignature(uint32_t n)
+{
+    uchar_vector sig;
+    sig.push_back(0x30); sig.push_back(0x44);
+    sig.push_back(0x02); sig.push_back(0x20); sig += fixtureBytes(32, 2 * n);
+    sig.push_back(0x02); sig.push_back(0x20); sig += fixtureBytes(32, 2 * n + 1);
+    sig.push_back(SIGHASH_ALL);
+    return sig;
+}
+
+uchar_vector pushData(const uchar_vector& data)
+{
+    uchar_vector script;
+    if (data.size() >= 0x4c) script.push_back(0x4c); // OP_PUSHDATA1
+    script.push_back(data.size());
+    script += data;
+    return script;
+}
+
+struct Fixtures
+{
+    HDKeychain keychain;
+    secp256k1_key key;
+    uchar_vector sighash;
+    uchar_vector signature;
+
+    uchar_vector redeemScript;
+    uchar_vector p2shScript;
+    uchar_vector p2pkhScript;
+
+    Transaction multisigTx;
+    uchar_vector multisigTxBytes;
+    Transaction witnessTx;
+
+    CoinBlock block;
+    uchar_vector blockBytes;
+    vector<uchar_vector> txHashes;
+
+    PartialMerkleTree partialTree;
+
+    vector<uchar_vector> bloomItems;
+    BloomFilter bloomFilter;
+
+    bytes_t address;
+    string addressBase58;
+    bytes_t extkey;
+    string extkeyBase58;
+
+    Fixtures()
+    {
+        HDSeed seed(SEED);
+        keychain = HDKeychain(seed.getMasterKey(), seed.getMasterChainCode());
+
+        key.setPrivKey(keychain.getChild(0).privkey());
+        sighash = sha256_2(fixtureBytes(256, 0));
+        signature = secp256k1_sign(key, sighash);
+
+        // 2-of-3 multisig
+        redeemScript.push_back(0x52);
+        for (uint32_t i = 0; i < 3; i++) { redeemScript += pushData(keychain.getPublic().getChild(i).pubkey()); }
+        redeemScript.push_back(0x53);
+        redeemScript.push_back(0xae);
+
+        p2shScript = uchar_vector("a914") + hash160(redeemScript) + uchar_vector("87");
+        p2pkhScript = uchar_vector("76a914") + hash160(keychain.getChild(0).pubkey()) + uchar_vector("88ac");
+
+        uchar_vector multisigScriptSig("00");
+        multisigScriptSig += pushData(fixtureSignature(0));
+        multisigScriptSig += pushData(fixtureSignature(1));
+        multisigScriptSig += pushData(redeemScript);
+
+        for (uint32_t i = 0; i < MULTISIG_TX_INPUTS; i++)
+        {
+            multisigTx.addInput(TxIn(OutPoint(fixtureBytes(32, 1000 + i), i % 4), multisigScriptSig, 0xffffffff));
+
+            TxIn witnessIn(OutPoint(fixtureBytes(32, 1000 + i), i % 4), uchar_vector(), 0xffffffff);
+            witnessIn.scriptWitness.push(uchar_vector());
+            witnessIn.scriptWitness.push(fixtureSignature(0));
+            witnessIn.scriptWitness.push(fixtureSignature(1));
+            witnessIn.scriptWitness.push(redeemScript);
+            witnessTx.addInput(witnessIn);
+        }
+        multisigTx.addOutput(TxOut(250000000, p2shScript));
+        multisigTx.addOutput(TxOut(12345678, p2pkhScript));
+        witnessTx.outputs = multisigTx.outputs;
+        multisigTxBytes = multisigTx.getSerialized();
+
+        // Full block
+        block = CoinBlock(4, 1451606400, 0x1d00ffff, fixtureBytes(32, 1));
+
+        Transaction coinbase;
+        coinbase.addInput(TxIn(OutPoint(g_zero32bytes, 0xffffffff), uchar_vector("03e0c206") + fixtureBytes(32, 2), 0xffffffff));
+        coinbase.addOutput(TxOut(2500000000ull, p2pkhScript));
+        block.addTransaction(coinbase);
+
+        for (uint32_t i = 1; i < BLOCK_TXS; i++)
+        {
+            Transaction tx;
+            if (i % 4 == 0)
+            {
+                // Multisig spend
+                for (uint32_t j = 0; j < 2; j++) { tx.addInput(TxIn(OutPoint(fixtureBytes(32, 10000 + 2 * i + j), j), multisigScriptSig, 0xffffffff)); }
+                tx.addOutput(TxOut(100000 + i, p2shScript));
+            }
+            else
+            {
+                // P2PKH spend
+                uchar_vector scriptSig = pushData(fixtureSignature(i)) + pushData(keychain.getChild(0).pubkey());
+                tx.addInput(TxIn(OutPoint(fixtureBytes(32, 10000 + 2 * i), 0), scriptSig, 0xffffffff));
+                tx.addOutput(TxOut(100000 + i, p2pkhScript));
+            }
+            tx.addOutput(TxOut(5000000 + i, uchar_vector("76a914") + fixtureBytes(20, 20000 + i) + uchar_vector("88ac")));
+            block.addTransaction(tx);
+        }
+        block.updateMerkleRoot();
+        blockBytes = block.getSerialized();
+
+        for (auto& tx: block.txs) { txHashes.push_back(tx.getHash()); }
+
+        // A handful of matched transactions, as in a typical merkleblock
+        vector<MerkleLeaf> leaves;
+        for (size_t i = 0; i < txHashes.size(); i++) { leaves.push_back(make_pair(txHashes[i], i % 500 == 7)); }
+        partialTree.setUncompressed(leaves);
+
+        for (uint32_t i = 0; i < 1000; i++) { bloomItems.push_back(fixtureBytes(20, 30000 + i)); }
+        bloomFilter = BloomFilter(bloomItems.size(), 0.0001, 0, 0);
+        for (auto& item: bloomItems) { bloomFilter.insert(item); }
+
+        address = hash160(keychain.getChild(0).pubkey());
+        addressBase58 = toBase58Check(address, 0x05);
+        extkey = keychain.extkey();
+        extkeyBase58 = toBase58Check(extkey);
+    }
+};
+
+const Fixtures& fixtures()
+{
+    static Fixtures f;
+    return f;
+}
+
+}
+
+////////////
+// HASHES //
+////////////
+void BM_sha256_2_32B(Bench::State& state)
+{
+    uchar_vector data = fixtureBytes(32, 0);
+    while (state.KeepRunning()) { Bench::DoNotOptimize(sha256_2(data)); }
+    state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_sha256_2_32B);
+
+void BM_sha256_2_80B(Bench::State& state)
+{
+    uchar_vector data = fixtureBytes(80, 0);
+    while (state.KeepRunning()) { Bench::DoNotOptimize(sha256_2(data)); }
+    state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_sha256_2_80B);
+
+void BM_sha256_2_block(Bench::State& state)
+{
+    const uchar_vector& data = fixtures().blockBytes;
+    while (state.KeepRunning()) { Bench::DoNotOptimize(sha256_2(data)); }
+    state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_sha256_2_block);
+
+void BM_hash160_pubkey(Bench::State& state)
+{
+    uchar_vector data = fixtures().keychain.pubkey();
+    while (state.KeepRunning()) { Bench::DoNotOptimize(hash160(data)); }
+    state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_hash160_pubkey);
+
+void BM_hash160_redeemscript(Bench::State& state)
+{
+    const uchar_vector& data = fixtures().redeemScript;
+    while (state.KeepRunning()) { Bench::DoNotOptimize(hash160(data)); }
+    state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_hash160_redeemscript);
+
+//////////////////
+// TRANSACTIONS //
+//////////////////
+void BM_Transaction_setSerialized_multisig(Bench::State& state)
+{
+    const uchar_vector& data = fixtures().multisigTxBytes;
+    while (state.KeepRunning())
+    {
+        Transaction tx;
+        tx.setSerialized(data);
+        Bench::DoNotOptimize(tx);
+    }
+    state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_Transaction_setSerialized_multisig);
+
+void BM_Transaction_getSerialized_multisig(Bench::State& state)
+{
+    const Transaction& tx = fixtures().multisigTx;
+    while (state.KeepRunning()) { Bench::DoNotOptimize(tx.getSerialized()); }
+    state.SetBytesProcessed(state.iterations() * fixtures().multisigTxBytes.size());
+}
+BENCHMARK(BM_Transaction_getSerialized_multisig);
+
+// Signing or verifying a transaction needs the sighash of every input.
+void BM_Transaction_getSigHash_multisig(Bench::State& state)
+{
+    const Transaction& tx = fixtures().multisigTx;
+    const uchar_vector& script = fixtures().redeemScript;
+    while (state.KeepRunning())
+    {
+        for (uint i = 0; i < tx.inputs.size(); i++) { Bench::DoNotOptimize(tx.getSigHash(SIGHASH_ALL, i, script)); }
+    }
+    state.SetItemsProcessed(state.iterations() * tx.inputs.size());
+}
+BENCHMARK(BM_Transaction_getSigHash_multisig);
+
+void BM_Transaction_getSigHash_witness(Bench::State& state)
+{
+    Transaction tx = fixtures().witnessTx;
+    const uchar_vector& script = fixtures().redeemScript;
+    while (state.KeepRunning())
+    {
+        tx.resetSigHash();
+        for (uint i = 0; i < tx.inputs.size(); i++) { Bench::DoNotOptimize(tx.getSigHash(SIGHASH_ALL, i, script, 250000000)); }
+    }
+    state.SetItemsProcessed(state.iterations() * tx.inputs.size());
+}
+BENCHMARK(BM_Transaction_getSigHash_witness);
+
+void BM_CoinBlock_setSerialized(Bench::State& state)
+{
+    const uchar_vector& data = fixtures().blockBytes;
+    while (state.KeepRunning())
+    {
+        CoinBlock block;
+        block.setSerialized(data);
+        Bench::DoNotOptimize(block);
+    }
+    state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_CoinBlock_setSerialized);
+
+void BM_CoinBlock_getSerialized(Bench::State& state)
+{
+    const CoinBlock& block = fixtures().block;
+    while (state.KeepRunning()) { Bench::DoNotOptimize(block.getSerialized()); }
+    state.SetBytesProcessed(state.iterations() * fixtures().blockBytes.size());
+}
+BENCHMARK(BM_CoinBlock_getSerialized);
+
+//////////////////
+// MERKLE TREES //
+//////////////////
+void BM_MerkleTree_getRoot_block(Bench::State& state)
+{
+    MerkleTree tree(fixtures().txHashes);
+    while (state.KeepRunning()) { Bench::DoNotOptimize(tree.getRoot()); }
+    state.SetItemsProcessed(state.iterations() * fixtures().txHashes.size());
+}
+BENCHMARK(BM_MerkleTree_getRoot_block);
+
+void BM_PartialMerkleTree_setCompressed_block(Bench::State& state)
+{
+    const PartialMerkleTree& source = fixtures().partialTree;
+    unsigned int nTxs = source.getNTxs();
+    vector<uchar_vector> hashes = source.getMerkleHashesVector();
+    uchar_vector flags = source.getFlags();
+    uchar_vector root = source.getRootLittleEndian();
+    while (state.KeepRunning())
+    {
+        PartialMerkleTree tree;
+        tree.setCompressed(nTxs, hashes, flags, root);
+        Bench::DoNotOptimize(tree);
+    }
+    state.SetItemsProcessed(state.iterations() * nTxs);
+}
+BENCHMARK(BM_PartialMerkleTree_setCompressed_block);
+
+///////////////////
+// BLOOM FILTERS //
+///////////////////
+void BM_BloomFilter_insert(Bench::State& state)
+{
+    const vector<uchar_vector>& items = fixtures().bloomItems;
+    while (state.KeepRunning())
+    {
+        BloomFilter filter(items.size(), 0.0001, 0, 0);
+        for (auto& item: items) { filter.insert(item); }
+        Bench::DoNotOptimize(filter);
+    }
+    state.SetItemsProcessed(state.iterations() * items.size());
+}
+BENCHMARK(BM_BloomFilter_insert);
+
+// Matching the output scripts of a full block, as a wallet does for every block it sees.
+void BM_BloomFilter_match_block(Bench::State& state)
+{
+    const BloomFilter& filter = fixtures().bloomFilter;
+    const CoinBlock& block = fixtures().block;
+    uint64_t items = 0;
+    while (state.KeepRunning())
+    {
+        for (auto& tx: block.txs)
+        {
+            for (auto& txout: tx.outputs) { Bench::DoNotOptimize(filter.match(txout.scriptPubKey)); items++; }
+        }
+    }
+    state.SetItemsProcessed(items);
+}
+BENCHMARK(BM_BloomFilter_match_block);
+
+/////////////////
+// HD KEYCHAIN //
+/////////////////
+void BM_HDKeychain_getChild_private(Bench::State& state)
+{
+    const HDKeychain& keychain = fixtures().keychain;
+    uint32_t i = 0;
+    while (state.KeepRunning()) { Bench::DoNotOptimize(keychain.getChild(i++)); }
+}
+BENCHMARK(BM_HDKeychain_getChild_private);
+
+void BM_HDKeychain_getChild_hardened(Bench::State& state)
+{
+    const HDKeychain& keychain = fixtures().keychain;
+    uint32_t i = 0;
+    while (state.KeepRunning()) { Bench::DoNotOptimize(keychain.getChild(0x80000000 | i++)); }
+}
+BENCHMARK(BM_HDKeychain_getChild_hardened);
+
+void BM_HDKeychain_getChild_public(Bench::State& state)
+{
+    HDKeychain keychain = fixtures().keychain.getPublic();
+    uint32_t i = 0;
+    while (state.KeepRunning()) { Bench::DoNotOptimize(keychain.getChild(i++)); }
+}
+BENCHMARK(BM_HDKeychain_getChild_public);
+
+///////////////
+// SECP256K1 //
+///////////////
+void BM_secp256k1_sign(Bench::State& state)
+{
+    const secp256k1_key& key = fixtures().key;
+    const uchar_vector& sighash = fixtures().sighash;
+    while (state.KeepRunning()) { Bench::DoNotOptimize(secp256k1_sign(key, sighash)); }
+}
+BENCHMARK(BM_secp256k1_sign);
+
+void BM_secp256k1_sign_rfc6979(Bench::State& state)
+{
+    const secp256k1_key& key = fixtures().key;
+    const uchar_vector& sighash = fixtures().sighash;
+    while (state.KeepRunning()) { Bench::DoNotOptimize(secp256k1_sign_rfc6979(key, sighash)); }
+}
+BENCHMARK(BM_secp256k1_sign_rfc6979);
+
+void BM_secp256k1_verify(Bench::State& state)
+{
+    const secp256k1_key& key = fixtures().key;
+    const uchar_vector& sighash = fixtures().sighash;
+    const uchar_vector& signature = fixtures().signature;
+    while (state.KeepRunning())
+    {
+        if (!secp256k1_verify(key, sighash, signature)) throw runtime_error("Signature fixture is invalid.");
+    }
+}
+BENCHMARK(BM_secp256k1_verify);
+
+/////////////////
+// BASE58CHECK //
+/////////////////
+void BM_Base58Check_encode_address(Bench::State& state)
+{
+    const bytes_t& address = fixtures().address;
+    while (state.KeepRunning()) { Bench::DoNotOptimize(toBase58Check(address, 0x05)); }
+}
+BENCHMARK(BM_Base58Check_encode_address);
+
+void BM_Base58Check_decode_address(Bench::State& state)
+{
+    const string& base58 = fixtures().addressBase58;
+    bytes_t payload;
+    unsigned int version;
+    while (state.KeepRunning())
+    {
+        if (!fromBase58Check(base58, payload, version)) throw runtime_error("Address fixture is invalid.");
+    }
+}
+BENCHMARK(BM_Base58Check_decode_address);
+
+void BM_Base58Check_encode_extkey(Bench::State& state)
+{
+    const bytes_t& extkey = fixtures().extkey;
+    while (state.KeepRunning()) { Bench::DoNotOptimize(toBase58Check(extkey)); }
+}
+BENCHMARK(BM_Base58Check_encode_extkey);
+
+void BM_Base58Check_decode_extkey(Bench::State& state)
+{
+    const string& base58 = fixtures().extkeyBase58;
+    bytes_t payload;
+    while (state.KeepRunning())
+    {
+        if (!fromBase58Check(base58, payload)) throw runtime_error("Extended key fixture is invalid.");
+    }
+}
+BENCHMARK(BM_Base58Check_decode_extkey);
+
+/////////
+// HEX //
+/////////
+void BM_hex_encode_multisig_tx(Bench::State& state)
+{
+    const uchar_vector& data = fixtures().multisigTxBytes;
+    while (state.KeepRunning()) { Bench::DoNotOptimize(data.getHex()); }
+    state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_hex_encode_multisig_tx);
+
+void BM_hex_decode_multisig_tx(Bench::State& state)
+{
+    string hex = fixtures().multisigTxBytes.getHex();
+    while (state.KeepRunning())
+    {
+        uchar_vector data;
+        data.setHex(hex);
+        Bench::DoNotOptimize(data);
+    }
+    state.SetBytesProcessed(state.iterations() * hex.size() / 2);
+}
+BENCHMARK(BM_hex_decode_multisig_tx);
+
+BENCHMARK_MAIN()
@@ -0,0 +1,296 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// pow_test.cpp
+//
+// Copyright (c) 2011-2016 Ciphrex Corp.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+//
+// Known-answer tests for the proof-of-work hashes. The multi-lane scrypt kernel
+// (SSE2 or AVX2, depending on the build) and the batch functions must give the
+// same results as the generic kernel for every input.
+//
+// The scrypt answers were computed independently with Python's hashlib.scrypt
+// (N = 1024, r = 1, p = 1, salt = input). The first input is the Litecoin
+// genesis block header. The Hash9 answers come from the implementation before
+// it was made reentrant.
+//
+// CoinBlockHeader::checkProofOfWork() must agree with comparing the hash against
+// getTarget() as BigInts for all compact targets, including ones that underflow,
+// overflow or have the sign bit set.
+//
+
+#include <hash.h>
+#include <BigInt.h>
+#include <CoinNodeData.h>
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+
+const uchar_vector GENESIS_HEADER(
+    "01000000"
+    "0000000000000000000000000000000000000000000000000000000000000000"
+    "d9ced4ed1130f7b7faad9be25323ffafa33232a17c3edf6cfd97bee6bafbdd97"
+    "b9aa8e4e"
+    "f0ff0f1e"
+    "cd513f7c");
+
+// Hashes of GENESIS_HEADER followed by input(1, 80) to input(19, 80).
+const char* SCRYPT_ANSWERS[] = {
+    "001e67b013726fd7382e9acb69165b4b6316227fb3156b5b414ba6340c050000",
+    "27af3b0d3eb09c18a9d23a09075ade6aebd2a2f81a0eb27f8611d93f94a5edee",
+    "cdcf114e4d3d54211147f24f49c99cbc0957fa3f65bef11132c4bd406a0043b8",
+    "fc3ea2dd2578446f538d2e5d7c9119f24cc03bc4f257f82e2417d7ed22ad635c",
+    "7bf94bfb5984eb80f9b1ac5ea698741a43da1532f43304d279b6d635c5a3d99d",
+    "7479359a75235c3fb76052d62f21d9ac956aa640078338d14d1236dc84f0bd47",
+    "b135699f4b0aebd77754e014a9a02eabb197b697e315b2052baa11e273b95aeb",
+    "97ecfe0a1936221fb257f4f156bf11574510a71832cf5e9f070cc96b0919cfed",
+    "57f5f8b995e3c5ee8af53e3a5396f50b36a3ab8603fbc0360d2c05de669e2a7c",
+    "b02ff536c3d184c803e88901c31e73cb7a10f332707ab2fa069727973e768b71",
+    "1faafc06ebafd7755e99cab7b7fd31a6da9f14aa4738de6eea2a3642a1b50fc0",
+    "24b3f5ca94fe5fc57f178a3b15ea2cb8d3948b52c48a36c079996cba08edb31a",
+    "1a1e888ef613e032e8220c168c43ad35474baffb96786fe6dbed94bac164c937",
+    "17e554825c324c5af02fa10d00fe061ac56c33ea207b77a5f41a4debde0de8b5",
+    "8eb045fc68c7973e620bf0e8b64cbdcc475349487f4e8af290a6d6ca95a20687",
+    "4341b678969a38d96ad884a1e2f76c6424e07f77546073897f43803ce8c9619a",
+    "24c673d4f8fc709066515abd0544e9dafe0aaa7e69deb804c3f0914f6385e3ab",
+    "b00f17c82a0b97c0ef82a969794cbeaa7e490a9065e196639a6908c7f98f9205",
+    "5fe1ea9ecfff3cd5677f32a0ba6ee8069aba6a284965c3eb355f1911c45d6b3f",
+    "ea12fb5ba362e77ea3d4078596900460a7beae331092c1fc2d416f5800d3dba0"
+};
+const unsigned int SCRYPT_ANSWER_COUNT = sizeof(SCRYPT_ANSWERS) / sizeof(SCRYPT_ANSWERS[0]);
+
+// Hashes of GENESIS_HEADER followed by input(k, HASH9_LENGTHS[k - 1]) for k = 1 to 5.
+const unsigned int HASH9_LENGTHS[] = { 1, 33, 80, 128, 200 };
+const char* HASH9_ANSWERS[] = {
+    "16b84643dc5aa80c7a6f4d933db6a9bbe1666aee511c24611980e13c13b33e4d",
+    "dd8b9379db7a62d32ee732325193fbc91d53866e1f132fc3a5a50198c1c3535b",
+    "f9724a21de03431f8f84be6513b0aed53202450d805fc473c3e14903c3379e3f",
+    "a27318794d829b5df92b5ac52f1b2f23c3ddabcc92ae6122068162fa03977e9b",
+    "3631b1463dcbeca16377a6350ee22a50ab272befc09527d122270fa38af63c98",
+    "6a1dd85733a0291b06de38e73c51d9ac795616bb0fd8577bf15dd02d2cb035c4"
+};
+const unsigned int HASH9_ANSWER_COUNT = sizeof(HASH9_ANSWERS) / sizeof(HASH9_ANSWERS[0]);
+
+uchar_vector input(unsigned int k, unsigned int length)
+{
+    uchar_vector data(length);
+    for (unsigned int j = 0; j < length; j++) { data[j] = (j * 7 + k * 13 + 1) & 0xff; }
+    return data;
+}
+
+unsigned int g_failed = 0;
+unsigned int g_passed = 0;
+
+void check(bool condition, const string& name)
+{
+    if (condition)
+    {
+        g_passed++;
+        return;
+    }
+
+    g_failed++;
+    cerr << "FAILED: " << name << endl;
+}
+
+string label(const string& name, unsigned int i)
+{
+    return name + " " + to_string(i);
+}
+
+void testScrypt()
+{
+    vector<uchar_vector> inputs;
+    vector<uchar_vector> answers;
+    inputs.push_back(GENESIS_HEADER);
+    for (unsigned int k = 1; k < SCRYPT_ANSWER_COUNT; k++) { inputs.push_back(input(k, 80)); }
+    for (auto& answer: SCRYPT_ANSWERS) { answers.push_back(uchar_vector(answer)); }
+
+    // Single hashes, through whatever kernel scrypt_1024_1_1_256_ dispatches to and through the generic one.
+    vector<char> scratchpad(scrypt_1024_1_1_256_lanes_scratchpad_size());
+    for (unsigned int i = 0; i < inputs.size(); i++)
+    {
+        check(scrypt_1024_1_1_256(inputs[i]) == answers[i], label("scrypt_1024_1_1_256", i));
+
+        uchar_vector hash(32);
+        scrypt_1024_1_1_256_sp_generic((const char*)&inputs[i][0], (char*)&hash[0], &scratchpad[0]);
+        check(hash == answers[i], label("scrypt_1024_1_1_256_sp_generic", i));
+    }
+
+    // One pass of the multi-lane kernel at each offset, so every input goes through every lane.
+    unsigned int lanes = scrypt_1024_1_1_256_lanes();
+    cout << "scrypt lanes: " << lanes << endl;
+    for (unsigned int offset = 0; offset + lanes <= inputs.size(); offset++)
+    {
+        uchar_vector in;
+        for (unsigned int l = 0; l < lanes; l++) { in += inputs[offset + l]; }
+
+        uchar_vector out(32 * lanes);
+        scrypt_1024_1_1_256_sp_lanes((const char*)&in[0], (char*)&out[0], &scratchpad[0]);
+        for (unsigned int l = 0; l < lanes; l++)
+        {
+            check(uchar_vector(out.begin() + 32 * l, out.begin() + 32 * (l + 1)) == answers[offset + l], label("scrypt_1024_1_1_256_sp_lanes offset " + to_string(offset) + " lane", l));
+        }
+    }
+
+    // Batches of every size up to all inputs cover full passes plus every remainder.
+    for (unsigned int count = 1; count <= inputs.size(); count++)
+    {
+        vector<uchar_vector> batch(inputs.begin(), inputs.begin() + count);
+        vector<uchar_vector> hashes = scrypt_1024_1_1_256_batch(batch);
+        bool bMatch = hashes.size() == count;
+        for (unsigned int i = 0; bMatch && i < count; i++) { bMatch = hashes[i] == answers[i]; }
+        check(bMatch, label("scrypt_1024_1_1_256_batch count", count));
+    }
+
+    // Without a scratchpad the batch function allocates its own.
+    uchar_vector in;
+    for (auto& data: inputs) { in += data; }
+    uchar_vector out(32 * inputs.size());
+    scrypt_1024_1_1_256_batch_((const char*)&in[0], (char*)&out[0], inputs.size(), NULL);
+    bool bMatch = true;
+    for (unsigned int i = 0; bMatch && i < inputs.size(); i++) { bMatch = uchar_vector(out.begin() + 32 * i, out.begin() + 32 * (i + 1)) == answers[i]; }
+    check(bMatch, "scrypt_1024_1_1_256_batch_ without scratchpad");
+
+    check(scrypt_1024_1_1_256_batch(vector<uchar_vector>()).empty(), "scrypt_1024_1_1_256_batch empty");
+
+    // Inputs of the wrong length are rejected rather than padded or cut.
+    for (unsigned int length: { 0, 79, 81 })
+    {
+        vector<uchar_vector> batch(inputs.begin(), inputs.begin() + 2);
+        batch.push_back(input(1, length));
+        bool bThrew = false;
+        try
+        {
+            scrypt_1024_1_1_256_batch(batch);
+        }
+        catch (const invalid_argument&)
+        {
+            bThrew = true;
+        }
+        check(bThrew, label("scrypt_1024_1_1_256_batch rejects length", length));
+    }
+}
+
+void testHash9()
+{
+    vector<uchar_vector> inputs;
+    vector<uchar_vector> answers;
+    inputs.push_back(GENESIS_HEADER);
+    for (unsigned int k = 1; k < HASH9_ANSWER_COUNT; k++) { inputs.push_back(input(k, HASH9_LENGTHS[k - 1])); }
+    for (auto& answer: HASH9_ANSWERS) { answers.push_back(uchar_vector(answer)); }
+
+    for (unsigned int i = 0; i < inputs.size(); i++)
+    {
+        check(hash9(inputs[i]) == answers[i], label("hash9", i));
+    }
+
+    // The context is reused across inputs of different lengths.
+    vector<uchar_vector> hashes = hash9_batch(inputs);
+    check(hashes.size() == answers.size(), "hash9_batch size");
+    for (unsigned int i = 0; i < hashes.size() && i < answers.size(); i++)
+    {
+        check(hashes[i] == answers[i], label("hash9_batch", i));
+    }
+
+    // Reversed order, so no input follows the one it followed above.
+    vector<uchar_vector> reversed(inputs.rbegin(), inputs.rend());
+    hashes = hash9_batch(reversed);
+    for (unsigned int i = 0; i < hashes.size(); i++)
+    {
+        check(hashes[i] == answers[answers.size() - 1 - i], label("hash9_batch reversed", i));
+    }
+}
+
+// checkProofOfWork() reads the hash from the POW hash function, so have it return a chosen value.
+uchar_vector g_powHash;
+
+uchar_vector powHash(const uchar_vector& /*data*/)
+{
+    return g_powHash;
+}
+
+// 32 big endian bytes, or empty if the value does not fit.
+uchar_vector toHash(const BigInt& value)
+{
+    if (value < 0 || value.numBytes() > 32) return uchar_vector();
+    uchar_vector bytes = value > 0 ? uchar_vector(value.getBytes()) : uchar_vector();
+    return uchar_vector(32 - bytes.size(), 0) + bytes;
+}
+
+void testCheckProofOfWork()
+{
+    Coin::CoinBlockHeader::setPOWHashFunc(&powHash);
+
+    uint32_t seed = 1;
+    auto next = [&]() { seed = seed * 1103515245 + 12345; return (unsigned char)(seed >> 16); };
+
+    const uint32_t MANTISSAS[] = { 0x000000, 0x000001, 0x000080, 0x0000ff, 0x00ffff, 0x123456, 0x7fffff, 0x800000, 0x800001, 0xffffff };
+    for (uint32_t nExp = 0; nExp <= 36; nExp++)
+    {
+        for (auto nMantissa: MANTISSAS)
+        {
+            uint32_t bits = (nExp << 24) | nMantissa;
+            Coin::CoinBlockHeader header(1, 0, bits);
+            BigInt target = header.getTarget();
+
+            // At, just below and just above the target, plus the extremes and some random hashes.
+            vector<uchar_vector> hashes;
+            hashes.push_back(toHash(target));
+            hashes.push_back(toHash(target - 1));
+            hashes.push_back(toHash(target + 1));
+            hashes.push_back(uchar_vector(32, 0));
+            hashes.push_back(uchar_vector(32, 0xff));
+            for (int i = 0; i < 4; i++)
+            {
+                uchar_vector hash(32);
+                for (auto& byte: hash) { byte = next(); }
+                // Zeros above the target's top byte so some of them land below the target.
+                for (uint32_t j = 0; j + nExp < 32; j++) { hash[j] = 0; }
+                hashes.push_back(hash);
+            }
+
+            for (auto& hash: hashes)
+            {
+                if (hash.empty()) continue;
+
+                // The POW hash is the reverse of the big endian byte order that the target is compared in.
+                g_powHash = hash.getReverse();
+                header.nonce(0);
+                bool bBigInt = !(BigInt(header.getPOWHashLittleEndian()) > header.getTarget());
+                check(header.checkProofOfWork() == bBigInt, "checkProofOfWork bits " + to_string(bits) + " hash " + hash.getHex());
+            }
+        }
+    }
+
+    Coin::CoinBlockHeader::setPOWHashFunc(&sha256_2);
+}
+
+}
+
+int main()
+{
+    try
+    {
+        testScrypt();
+        testHash9();
+        testCheckProofOfWork();
+    }
+    catch (const exception& e)
+    {
+        cerr << "Error: " << e.what() << endl;
+        return -2;
+    }
+
+    cout << g_passed << " passed, " << g_failed << " failed." << endl;
+    return g_failed ? -1 : 0;
+}
@@ -0,0 +1,307 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// BlockFileRescan.cpp
+//
+// Copyright (c) 2011-2016 Ciphrex Corp.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+//
+
+#include "BlockFileRescan.h"
+
+#include <CoinCore/MerkleTree.h>
+
+#include <logger/logger.h>
+
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+
+using namespace CoinDB;
+
+namespace
+{
+    // Exact set of bloom filter elements, looked up in place.
+    class ElementSet
+    {
+    public:
+        void clear() { elements_.clear(); }
+
+        void insert(const bytes_t& element)
+        {
+            if (contains(element.data(), element.size())) return;
+            elements_.insert(std::make_pair(key(element.data(), element.size()), element));
+        }
+
+        bool contains(const unsigned char* data, std::size_t size) const
+        {
+            auto range = elements_.equal_range(key(data, size));
+            for (auto it = range.first; it != range.second; ++it)
+            {
+                if (it->second.size() == size && std::equal(data, data + size, it->second.begin())) return true;
+            }
+            return false;
+        }
+
+    private:
+        // Elements are hashes or start with one, so their leading bytes are already well spread.
+        static uint64_t key(const unsigned char* data, std::size_t size)
+        {
+            uint64_t k = size;
+            for (std::size_t i = 0; i < size && i < 8; i++) { k ^= (uint64_t)data[i] << (8 * i); }
+            return k;
+        }
+
+        std::unordered_multimap<uint64_t, bytes_t> elements_;
+    };
+
+    // The test a bloom filter applies to an output script: any data it pushes, or the whole script.
+    bool matchScript(const ElementSet& elements, const unsigned char* p, std::size_t size)
+    {
+        if (elements.contains(p, size)) return true;
+
+        const unsigned char* end = p + size;
+        while (p < end)
+        {
+            unsigned char opcode = *p++;
+            std::size_t len;
+            if (opcode >= 0x01 && opcode <= 0x4b)
+            {
+                len = opcode;
+            }
+            else if (opcode == 0x4c)
+            {
+                if (end - p < 1) break;
+                len = p[0];
+                p += 1;
+            }
+            else if (opcode == 0x4d)
+            {
+                if (end - p < 2) break;
+                len = p[0] | (p[1] << 8);
+                p += 2;
+            }
+            else if (opcode == 0x4e)
+            {
+                if (end - p < 4) break;
+                len = p[0] | (p[1] << 8) | (p[2] << 16) | ((std::size_t)p[3] << 24);
+                p += 4;
+            }
+            else
+            {
+                continue;
+            }
+
+            if ((std::size_t)(end - p) < len) break;
+            if (elements.contains(p, len)) return true;
+            p += len;
+        }
+        return false;
+    }
+
+    struct ParsedBlock
+    {
+        CoinQ::RawBlock block;
+        std::vector<bool> matchedOutputs;   // by index into block.scripts()
+        unsigned int generation;            // of the elements they were matched against
+    };
+
+    void matchOutputs(ParsedBlock& parsed, const ElementSet& elements, unsigned int generation)
+    {
+        const std::vector<CoinQ::RawBlock::Script>& scripts = parsed.block.scripts();
+        parsed.matchedOutputs.assign(scripts.size(), false);
+        for (std::size_t i = 0; i < scripts.size(); i++)
+        {
+            if (matchScript(elements, scripts[i].begin, scripts[i].size)) { parsed.matchedOutputs[i] = true; }
+        }
+        parsed.generation = generation;
+    }
+}
+
+BlockFileRescan::BlockFileRescan(Vault& vault, const CoinQ::CoinParams& coinParams) :
+    m_vault(vault),
+    m_coinParams(coinParams),
+    m_nThreads(0),
+    m_batchSize(DEFAULT_BATCH_SIZE)
+{
+}
+
+void BlockFileRescan::setBatchSize(unsigned int batchSize)
+{
+    if (batchSize == 0) throw std::runtime_error("BlockFileRescan - batch size must be positive.");
+    m_batchSize = batchSize;
+}
+
+unsigned int BlockFileRescan::rescan(const std::string& blocksdir, callback_t callback)
+{
+    CoinQ::BlockFiles blockFiles;
+    blockFiles.open(blocksdir, m_coinParams, m_nThreads);
+    return rescan(blockFiles, callback);
+}
+
+unsigned int BlockFileRescan::rescan(const CoinQ::BlockFiles& blockFiles, callback_t callback)
+{
+    if (!blockFiles.isOpen()) throw std::runtime_error("BlockFileRescan - block files are not open.");
+
+    int bestHeight = blockFiles.getBestHeight();
+
+    // Start where a network sync would.
+    int startHeight = -1;
+    std::vector<bytes_t> locatorHashes = m_vault.getLocatorHashes();
+    for (auto& hash: locatorHashes)
+    {
+        int height = blockFiles.getHeight(hash);
+        if (height >= 0)
+        {
+            startHeight = height + 1;
+            break;
+        }
+    }
+
+    if (startHeight < 0)
+    {
+        if (!locatorHashes.empty()) throw std::runtime_error("BlockFileRescan - vault blocks are not in the best chain of the block files.");
+
+        uint32_t startTime = m_vault.getMaxFirstBlockTimestamp();
+        if (startTime == 0) return 0; // no accounts yet
+
+        // The vault does not take height 0 as its first block.
+        startHeight = std::max(blockFiles.getHeightBefore(startTime), 1);
+    }
+
+    LOGGER(debug) << "BlockFileRescan::rescan() - from height " << startHeight << " to " << bestHeight << std::endl;
+
+    unsigned int nThreads = m_nThreads ? m_nThreads : boost::thread::hardware_concurrency();
+    nThreads = std::max<unsigned int>(1, std::min<unsigned int>(nThreads, m_batchSize));
+
+    // Elements come from the vault and are reloaded whenever it takes new transactions. Outpoints of
+    // matched outputs are kept separately, as a filter with BLOOM_UPDATE_ALL would.
+    ElementSet elements;
+    ElementSet outpoints;
+    unsigned int generation = 0;
+    auto loadElements = [&]()
+    {
+        elements.clear();
+        for (auto& element: m_vault.getBloomFilterElements()) { elements.insert(element); }
+        generation++;
+    };
+    loadElements();
+
+    unsigned int txTotal = 0;
+    std::vector<ParsedBlock> parsed;
+    std::vector<Vault::merkle_block_txs_t> merkleBlocks;
+    for (int batchStart = startHeight; batchStart <= bestHeight; batchStart += parsed.size())
+    {
+        parsed.resize(std::min(m_batchSize, (unsigned int)(bestHeight + 1 - batchStart)));
+
+        // Parse and match outputs in parallel.
+        std::vector<std::exception_ptr> errors(nThreads);
+        auto parseBlocks = [&](unsigned int thread)
+        {
+            try
+            {
+                for (std::size_t i = thread; i < parsed.size(); i += nThreads)
+                {
+                    std::size_t size;
+                    const unsigned char* data = blockFiles.getBlock(batchStart + i, size);
+                    parsed[i].block.parse(data, size);
+                    matchOutputs(parsed[i], elements, generation);
+                }
+            }
+            catch (...)
+            {
+                errors[thread] = std::current_exception();
+            }
+        };
+
+        boost::thread_group threads;
+        for (unsigned int thread = 1; thread < nThreads; thread++) { threads.create_thread(std::bind(parseBlocks, thread)); }
+        parseBlocks(0);
+        threads.join_all();
+
+        for (auto& error: errors) { if (error) std::rethrow_exception(error); }
+
+        // Match inputs, which depends on everything before, and insert in height order.
+        for (std::size_t b = 0; b < parsed.size(); b++)
+        {
+            int height = batchStart + b;
+            ParsedBlock& item = parsed[b];
+            if (item.generation != generation) { matchOutputs(item, elements, generation); }
+
+            const CoinQ::RawBlock& block = item.block;
+            const std::vector<CoinQ::RawBlock::Tx>& txs = block.txs();
+            std::vector<bool> matchedTxs(txs.size(), false);
+            bool bMatched = false;
+            for (std::size_t i = 0; i < txs.size(); i++)
+            {
+                const CoinQ::RawBlock::Tx& tx = txs[i];
+                bool bTxMatched = false;
+                uchar_vector txhash;
+                for (uint32_t j = 0; j < tx.outputCount; j++)
+                {
+                    if (!item.matchedOutputs[tx.firstOutput + j]) continue;
+                    if (!bTxMatched) { txhash = tx.hash(); }
+                    bTxMatched = true;
+                    outpoints.insert(Coin::OutPoint(txhash, j).getSerialized());
+                }
+
+                for (uint32_t j = 0; !bTxMatched && j < tx.inputCount; j++)
+                {
+                    const unsigned char* outpoint = block.outpoints()[tx.firstInput + j];
+                    bTxMatched = outpoints.contains(outpoint, 36) || elements.contains(outpoint, 36);
+                }
+
+                matchedTxs[i] = bTxMatched;
+                bMatched = bMatched || bTxMatched;
+            }
+
+            const ChainHeader& header = blockFiles.getHeader(height);
+            std::vector<Coin::Transaction> cointxs;
+            Coin::MerkleBlock merkleBlock;
+            if (bMatched)
+            {
+                std::vector<Coin::MerkleLeaf> leaves;
+                for (std::size_t i = 0; i < txs.size(); i++)
+                {
+                    leaves.push_back(Coin::MerkleLeaf(txs[i].hash().getReverse(), matchedTxs[i]));
+                    if (matchedTxs[i]) { cointxs.push_back(txs[i].toTransaction()); }
+                }
+
+                Coin::PartialMerkleTree tree;
+                tree.setUncompressed(leaves);
+                if (tree.getRootLittleEndian() != header.merkleRoot())
+                {
+                    std::stringstream err;
+                    err << "BlockFileRescan - merkle root mismatch at height " << height << ".";
+                    throw std::runtime_error(err.str());
+                }
+                merkleBlock = Coin::MerkleBlock(header, tree.getNTxs(), tree.getMerkleHashesVector(), tree.getFlags());
+            }
+            else
+            {
+                // With nothing matched the partial tree is just the root.
+                merkleBlock = Coin::MerkleBlock(header, txs.size(), std::vector<uchar_vector>(1, header.merkleRoot().getReverse()), uchar_vector(1, 0));
+            }
+
+            merkleBlocks.push_back(Vault::merkle_block_txs_t(ChainMerkleBlock(merkleBlock, true, height, header.chainWork), cointxs));
+
+            if (bMatched || b + 1 == parsed.size())
+            {
+                unsigned int count = m_vault.insertMerkleBlocks(merkleBlocks);
+                merkleBlocks.clear();
+                txTotal += count;
+
+                // The vault may have issued new scripts.
+                if (count > 0) { loadElements(); }
+
+                if (callback && !callback(height, bestHeight, txTotal)) return txTotal;
+            }
+        }
+    }
+
+    return txTotal;
+}
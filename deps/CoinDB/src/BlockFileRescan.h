@@ -0,0 +1,59 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// BlockFileRescan.h
+//
+// Copyright (c) 2011-2016 Ciphrex Corp.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+//
+
+#pragma once
+
+#include "Vault.h"
+
+#include <CoinQ/CoinQ_blockfiles.h>
+#include <CoinQ/CoinQ_coinparams.h>
+
+#include <functional>
+#include <string>
+
+namespace CoinDB
+{
+
+// Brings a vault up to date from a local copy of the block chain, such as a full node's blocks
+// directory, instead of requesting filtered blocks from a peer.
+//
+// Blocks are parsed in parallel a batch at a time. Output scripts are matched against the vault's
+// bloom filter elements exactly, and inputs against its unspent outpoints plus those of outputs
+// matched along the way. Blocks go into the vault as merkle blocks. Blocks without matches are
+// collected and inserted with the next block that has matches, or at the end of the batch, in one
+// database transaction. The vault may issue new scripts once it has seen a match, so after such an
+// insert the elements are reloaded and the rest of the batch is matched again against them.
+class BlockFileRescan
+{
+public:
+    static const unsigned int DEFAULT_BATCH_SIZE = 1000;
+
+    BlockFileRescan(Vault& vault, const CoinQ::CoinParams& coinParams = CoinQ::getBitcoinParams());
+
+    // Pass 0 to use one thread per core.
+    void setThreads(unsigned int nThreads) { m_nThreads = nThreads; }
+    void setBatchSize(unsigned int batchSize);
+
+    // Called after each database transaction. Return false to stop.
+    typedef std::function<bool(uint32_t /*height*/, uint32_t /*best_height*/, unsigned int /*tx_count*/)> callback_t;
+
+    // Resumes after the most recent vault block in the best chain of the block files, or starts at the
+    // vault's horizon if it has no blocks. Returns the number of transactions inserted or updated.
+    unsigned int rescan(const std::string& blocksdir, callback_t callback = nullptr);
+    unsigned int rescan(const CoinQ::BlockFiles& blockFiles, callback_t callback = nullptr);
+
+private:
+    Vault& m_vault;
+    CoinQ::CoinParams m_coinParams;
+    unsigned int m_nThreads;
+    unsigned int m_batchSize;
+};
+
+}
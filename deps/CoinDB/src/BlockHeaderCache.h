@@ -0,0 +1,184 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// BlockHeaderCache.h
+//
+// Copyright (c) 2011-2016 Ciphrex Corp.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+//
+
+#pragma once
+
+#include "Schema.h"
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/lock_guard.hpp>
+
+#include <map>
+#include <memory>
+
+namespace CoinDB
+{
+
+// Vault-lifetime cache of stored block headers, looked up by hash or by height. Headers never change
+// once stored. They only disappear in a reorg or when merkle blocks are deleted, which invalidates the
+// whole cache. Callers get their own copies, so nothing handed out is shared between threads.
+//
+// Readers take generation() before querying the database and pass it to put(). A header read from a
+// snapshot older than the last invalidation is then dropped and not cached.
+//
+// The chain tip is kept as well. Writers stage it as soon as they store a new best header, and it is
+// published when their transaction commits, so the best height never needs a query while blocks are
+// only being appended and never runs ahead of what readers can see in the database.
+class BlockHeaderCache
+{
+public:
+    enum { DEFAULT_CAPACITY = 4096 };
+
+    explicit BlockHeaderCache(std::size_t capacity = DEFAULT_CAPACITY) : capacity_(capacity), generation_(0), bestknown_(false), stagedknown_(false) { }
+
+    uint64_t generation() const
+    {
+        boost::lock_guard<boost::mutex> lock(mutex_);
+        return generation_;
+    }
+
+    std::shared_ptr<BlockHeader> get(const bytes_t& hash) const
+    {
+        boost::lock_guard<boost::mutex> lock(mutex_);
+        auto it = byhash_.find(hash);
+        return it == byhash_.end() ? nullptr : std::make_shared<BlockHeader>(*it->second);
+    }
+
+    std::shared_ptr<BlockHeader> get(uint32_t height) const
+    {
+        boost::lock_guard<boost::mutex> lock(mutex_);
+        auto it = byheight_.find(height);
+        return it == byheight_.end() ? nullptr : std::make_shared<BlockHeader>(*it->second);
+    }
+
+    void put(std::shared_ptr<BlockHeader> blockheader, uint64_t generation)
+    {
+        if (!blockheader) return;
+
+        boost::lock_guard<boost::mutex> lock(mutex_);
+        if (generation != generation_) return;
+        put_unwrapped(blockheader);
+    }
+
+    // Returns false if the tip is not known. Otherwise sets blockheader to a copy of the tip, or to
+    // nullptr if there are no blocks.
+    bool getBest(std::shared_ptr<BlockHeader>& blockheader) const
+    {
+        boost::lock_guard<boost::mutex> lock(mutex_);
+        if (!bestknown_) return false;
+        blockheader = best_ ? std::make_shared<BlockHeader>(*best_) : nullptr;
+        return true;
+    }
+
+    // For readers. Ignored if a writer has set the tip or the cache was invalidated since generation was read.
+    void putBest(std::shared_ptr<BlockHeader> blockheader, uint64_t generation)
+    {
+        boost::lock_guard<boost::mutex> lock(mutex_);
+        if (bestknown_ || generation != generation_) return;
+        setBest_unwrapped(blockheader);
+    }
+
+    // For writers, right after storing a header that extends the chain. Readers keep getting the old
+    // tip until the writer's WriteGuard commits.
+    void stageBest(std::shared_ptr<BlockHeader> blockheader)
+    {
+        boost::lock_guard<boost::mutex> lock(mutex_);
+        staged_ = blockheader ? std::make_shared<BlockHeader>(*blockheader) : nullptr;
+        stagedknown_ = true;
+    }
+
+    void invalidate()
+    {
+        boost::lock_guard<boost::mutex> lock(mutex_);
+        invalidate_unwrapped();
+    }
+
+    // Held by writers across their database transaction, with commit() called right after the
+    // transaction commits. That publishes a tip staged during the transaction. If the cache was
+    // invalidated while the transaction was open, it is invalidated again first, so readers that
+    // repopulated it from the old snapshot in the meantime don't leave stale headers behind. If the
+    // guard goes away without commit(), a staged tip is discarded and the cache invalidated.
+    class WriteGuard
+    {
+    public:
+        explicit WriteGuard(BlockHeaderCache& cache) : cache_(cache), generation_(cache.generation()), committed_(false) { }
+        ~WriteGuard() { if (!committed_) cache_.endWrite(generation_, false); }
+
+        void commit()
+        {
+            committed_ = true;
+            cache_.endWrite(generation_, true);
+        }
+
+    private:
+        BlockHeaderCache& cache_;
+        uint64_t generation_;
+        bool committed_;
+    };
+
+private:
+    std::size_t capacity_;
+
+    mutable boost::mutex mutex_;
+    uint64_t generation_;
+    std::map<bytes_t, std::shared_ptr<const BlockHeader>> byhash_;
+    std::map<uint32_t, std::shared_ptr<const BlockHeader>> byheight_;
+
+    bool bestknown_;
+    std::shared_ptr<const BlockHeader> best_;
+
+    // Set by the writer holding a WriteGuard.
+    bool stagedknown_;
+    std::shared_ptr<BlockHeader> staged_;
+
+    void endWrite(uint64_t generation, bool committed)
+    {
+        boost::lock_guard<boost::mutex> lock(mutex_);
+        if (generation != generation_ || (stagedknown_ && !committed)) { invalidate_unwrapped(); }
+        if (stagedknown_ && committed) { setBest_unwrapped(staged_); }
+        staged_.reset();
+        stagedknown_ = false;
+    }
+
+    void invalidate_unwrapped()
+    {
+        byhash_.clear();
+        byheight_.clear();
+        best_.reset();
+        bestknown_ = false;
+        generation_++;
+    }
+
+    std::shared_ptr<const BlockHeader> put_unwrapped(std::shared_ptr<BlockHeader> blockheader)
+    {
+        std::shared_ptr<const BlockHeader> copy = std::make_shared<BlockHeader>(*blockheader);
+        if (capacity_ == 0) return copy;
+
+        // Keep the tip. Older headers are requested less often.
+        if (byheight_.size() >= capacity_ && !byheight_.count(copy->height()))
+        {
+            auto oldest = byheight_.begin();
+            byhash_.erase(oldest->second->hash());
+            byheight_.erase(oldest);
+        }
+
+        byhash_[copy->hash()] = copy;
+        byheight_[copy->height()] = copy;
+        return copy;
+    }
+
+    void setBest_unwrapped(std::shared_ptr<BlockHeader> blockheader)
+    {
+        best_ = blockheader ? put_unwrapped(blockheader) : nullptr;
+        bestknown_ = true;
+    }
+};
+
+}
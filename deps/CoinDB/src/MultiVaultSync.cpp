@@ -0,0 +1,580 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// MultiVaultSync.cpp
+//
+// Copyright (c) 2011-2016 Ciphrex Corp.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+//
+
+#include "MultiVaultSync.h"
+
+#include <CoinQ/CoinQ_script.h>
+
+#include <logger/logger.h>
+
+#include <limits>
+
+using namespace CoinDB;
+using namespace CoinQ;
+
+// Same element checks a peer applies when matching a transaction against a filter.
+static bool matchesScript(const Coin::BloomFilter& filter, const bytes_t& script)
+{
+    try
+    {
+        for (auto& op: Script::ScriptTokenizer(script))
+        {
+            if (op.isPush() && !op.data.empty() && filter.match(op.data.bytes())) return true;
+        }
+    }
+    catch (const std::exception& e)
+    {
+        // Malformed scripts are simply not matched.
+    }
+    return false;
+}
+
+static bool matchesFilter(const Coin::BloomFilter& filter, const Coin::Transaction& cointx)
+{
+    if (!filter.isSet()) return false;
+    if (filter.match(cointx.hash())) return true;
+
+    for (auto& txout: cointx.outputs)
+    {
+        if (filter.match(txout.scriptPubKey) || matchesScript(filter, txout.scriptPubKey)) return true;
+    }
+
+    for (auto& txin: cointx.inputs)
+    {
+        if (filter.match(txin.previousOut.getSerialized())) return true;
+        if (matchesScript(filter, txin.scriptSig)) return true;
+        for (auto& item: txin.scriptWitness.stack) { if (filter.match(item)) return true; }
+    }
+
+    return false;
+}
+
+// Constructor
+MultiVaultSync::MultiVaultSync(const CoinQ::CoinParams& coinParams) :
+    m_status(SynchedVault::STOPPED),
+    m_bestHeight(0),
+    m_filterFalsePositiveRate(0.001),
+    m_filterTweak(0),
+    m_filterFlags(0),
+    m_networkSync(coinParams),
+    m_bBlockTreeLoaded(false),
+    m_bConnected(false),
+    m_bGotMempool(false),
+    m_bInsertMerkleBlocks(false)
+{
+    LOGGER(trace) << "MultiVaultSync::MultiVaultSync()" << std::endl;
+
+    m_networkSync.subscribeStatus([this](const std::string& message)
+    {
+        LOGGER(trace) << "MultiVaultSync - Status: " << message << std::endl;
+    });
+
+    m_networkSync.subscribeProtocolError([this](const std::string& error, int code)
+    {
+        LOGGER(trace) << "MultiVaultSync - Protocol error: " << error << std::endl;
+        m_notifyProtocolError(error, code);
+    });
+
+    m_networkSync.subscribeConnectionError([this](const std::string& error, int code)
+    {
+        LOGGER(trace) << "MultiVaultSync - Connection error: " << error << std::endl;
+        m_notifyConnectionError(error, code);
+    });
+
+    m_networkSync.subscribeBlockTreeError([this](const std::string& error, int code)
+    {
+        LOGGER(trace) << "MultiVaultSync - Blocktree error: " << error << std::endl;
+        m_notifyBlockTreeError(error, code);
+    });
+
+    m_networkSync.subscribeOpen([this]()
+    {
+        LOGGER(trace) << "MultiVaultSync - connection opened." << std::endl;
+        m_bConnected = true;
+        m_notifyPeerConnected();
+    });
+
+    m_networkSync.subscribeClose([this]()
+    {
+        LOGGER(trace) << "MultiVaultSync - connection closed." << std::endl;
+        m_bConnected = false;
+        m_notifyPeerDisconnected();
+    });
+
+    m_networkSync.subscribeStopped([this]()
+    {
+        LOGGER(trace) << "MultiVaultSync - Sync stopped." << std::endl;
+        updateStatus(SynchedVault::STOPPED);
+    });
+
+    m_networkSync.subscribeTimeout([this]()
+    {
+        LOGGER(trace) << "MultiVaultSync - Sync timeout." << std::endl;
+        m_notifyConnectionError("Network timed out.", -1);
+    });
+
+    m_networkSync.subscribeSynchingHeaders([this]()
+    {
+        LOGGER(trace) << "MultiVaultSync - Synching headers." << std::endl;
+        updateStatus(SynchedVault::SYNCHING_HEADERS);
+    });
+
+    m_networkSync.subscribeHeadersSynched([this]()
+    {
+        LOGGER(trace) << "MultiVaultSync - Headers sync complete." << std::endl;
+        updateBestHeader(m_networkSync.getBestHeight(), m_networkSync.getBestHash());
+
+        if (!m_networkSync.connected())
+        {
+            updateStatus(SynchedVault::STOPPED);
+        }
+        else if (getVaultCount() == 0)
+        {
+            updateStatus(SynchedVault::SYNCHED);
+        }
+        else
+        {
+            try
+            {
+                syncBlocks();
+            }
+            catch (const std::exception& e)
+            {
+                LOGGER(error) << e.what() << std::endl;
+            }
+        }
+    });
+
+    m_networkSync.subscribeSynchingBlocks([this]()
+    {
+        LOGGER(trace) << "MultiVaultSync - Synching blocks." << std::endl;
+        updateStatus(SynchedVault::SYNCHING_BLOCKS);
+    });
+
+    m_networkSync.subscribeBlocksSynched([this]()
+    {
+        LOGGER(trace) << "MultiVaultSync - Block sync complete." << std::endl;
+
+        if (m_networkSync.connected())
+        {
+            updateStatus(SynchedVault::SYNCHED);
+
+            if (!m_bGotMempool && getVaultCount() > 0)
+            {
+                LOGGER(info) << "MultiVaultSync - Fetching mempool." << std::endl;
+                m_networkSync.getMempool();
+                m_bGotMempool = true;
+            }
+        }
+    });
+
+    m_networkSync.subscribeAddBestChain([this](const chain_header_t& header)
+    {
+        LOGGER(trace) << "MultiVaultSync - Added best chain. New best height: " << header.height << std::endl;
+        updateBestHeader(header.height, header.hash());
+    });
+
+    m_networkSync.subscribeRemoveBestChain([this](const chain_header_t& /*header*/)
+    {
+        LOGGER(trace) << "MultiVaultSync - removed best chain." << std::endl;
+        updateBestHeader(m_networkSync.getBestHeight(), m_networkSync.getBestHash());
+    });
+
+    m_networkSync.subscribeBlockTreeChanged([this]()
+    {
+        LOGGER(trace) << "MultiVaultSync - block tree changed." << std::endl;
+        updateBestHeader(m_networkSync.getBestHeight(), m_networkSync.getBestHash());
+    });
+
+    // Unconfirmed transactions only go to the vaults they match.
+    m_networkSync.subscribeNewTx([this](const Coin::Transaction& cointx)
+    {
+        LOGGER(trace) << "MultiVaultSync - Received new transaction " << cointx.hash().getHex() << std::endl;
+
+        dispatch(getVaultEntries(), [&](VaultEntry& entry)
+        {
+            if (!matchesFilter(entry.filter, cointx)) return;
+            entry.vault->insertNewTx(cointx);
+        });
+    });
+
+    // Every synching vault needs each merkle block transaction to connect and complete the block, but vaults
+    // the transaction does not match only get the cheaper confirmation.
+    m_networkSync.subscribeMerkleTx([this](const ChainMerkleBlock& chainmerkleblock, const Coin::Transaction& cointx, unsigned int txindex, unsigned int txcount)
+    {
+        LOGGER(trace) << "MultiVaultSync - Received merkle transaction " << cointx.hash().getHex() << " in block " << chainmerkleblock.hash().getHex() << std::endl;
+
+        dispatch(getVaultEntries(), [&](VaultEntry& entry)
+        {
+            if (!entry.bSynching || chainmerkleblock.height < entry.startHeight) return;
+
+            if (matchesFilter(entry.filter, cointx))
+            {
+                entry.vault->insertMerkleTx(chainmerkleblock, cointx, txindex, txcount);
+            }
+            else
+            {
+                entry.vault->confirmMerkleTx(chainmerkleblock, cointx.hash(), txindex, txcount);
+            }
+        });
+    });
+
+    m_networkSync.subscribeTxConfirmed([this](const ChainMerkleBlock& chainmerkleblock, const bytes_t& txhash, unsigned int txindex, unsigned int txcount)
+    {
+        LOGGER(trace) << "MultiVaultSync - Received transaction confirmation " << uchar_vector(txhash).getHex() << " in block " << chainmerkleblock.hash().getHex() << std::endl;
+
+        dispatch(getVaultEntries(), [&](VaultEntry& entry)
+        {
+            if (!entry.bSynching || chainmerkleblock.height < entry.startHeight) return;
+            entry.vault->confirmMerkleTx(chainmerkleblock, txhash, txindex, txcount);
+        });
+    });
+
+    m_networkSync.subscribeMerkleBlock([this](const ChainMerkleBlock& chainmerkleblock)
+    {
+        LOGGER(trace) << "MultiVaultSync - received merkle block " << chainmerkleblock.hash().getHex() << " height: " << chainmerkleblock.height << std::endl;
+
+        if (!m_bInsertMerkleBlocks) return;
+
+        dispatch(getVaultEntries(), [&](VaultEntry& entry)
+        {
+            if (!entry.bSynching || chainmerkleblock.height < entry.startHeight) return;
+
+            // Each vault persists its own copy.
+            std::shared_ptr<MerkleBlock> merkleblock(new MerkleBlock(chainmerkleblock));
+            merkleblock->txsinserted(true);
+            entry.vault->insertMerkleBlock(merkleblock);
+        });
+    });
+}
+
+// Destructor
+MultiVaultSync::~MultiVaultSync()
+{
+    LOGGER(trace) << "MultiVaultSync::~MultiVaultSync()" << std::endl;
+    stopSync();
+
+    std::lock_guard<std::mutex> lock(m_vaultsMutex);
+    for (auto& item: m_vaults)
+    {
+        std::lock_guard<std::mutex> entryLock(item.second->mutex);
+        item.first->unsubscribeTxUpdated(item.second->txUpdatedConnection);
+        item.second->vault = nullptr;
+    }
+    m_vaults.clear();
+}
+
+// Block tree operations
+void MultiVaultSync::loadHeaders(const std::string& blockTreeFile, bool bCheckProofOfWork, CoinQBlockTreeMem::callback_t callback)
+{
+    LOGGER(trace) << "MultiVaultSync::loadHeaders(" << blockTreeFile << ", " << (bCheckProofOfWork ? "true" : "false") << ")" << std::endl;
+
+    m_bBlockTreeLoaded = false;
+    m_networkSync.loadHeaders(blockTreeFile, bCheckProofOfWork, callback);
+    m_bBlockTreeLoaded = true;
+}
+
+// Vault registration
+void MultiVaultSync::registerVault(Vault* vault)
+{
+    LOGGER(trace) << "MultiVaultSync::registerVault(" << vault->getName() << ")" << std::endl;
+
+    vault_entry_t entry(new VaultEntry());
+    entry->vault = vault;
+    entry->startHeight = 0;
+    entry->bSynching = false;
+    entry->txUpdatedConnection = vault->subscribeTxUpdated([this](std::shared_ptr<Tx> tx)
+    {
+        if (tx->status() == Tx::PROPAGATED) { m_networkSync.addToMempool(tx->hash()); }
+    });
+
+    {
+        std::lock_guard<std::mutex> lock(m_vaultsMutex);
+        if (!m_vaults.insert(std::make_pair(vault, entry)).second)
+        {
+            vault->unsubscribeTxUpdated(entry->txUpdatedConnection);
+            throw std::runtime_error("Vault is already registered.");
+        }
+    }
+
+    // Catch the new vault up. Vaults already past the blocks it needs will ignore them.
+    if (m_bConnected && m_networkSync.headersSynched()) { syncBlocks(); }
+}
+
+void MultiVaultSync::unregisterVault(Vault* vault)
+{
+    LOGGER(trace) << "MultiVaultSync::unregisterVault(" << vault->getName() << ")" << std::endl;
+
+    vault_entry_t entry;
+    {
+        std::lock_guard<std::mutex> lock(m_vaultsMutex);
+        auto it = m_vaults.find(vault);
+        if (it == m_vaults.end()) return;
+        entry = it->second;
+        m_vaults.erase(it);
+    }
+
+    // Wait for any call into the vault that is in progress.
+    {
+        std::lock_guard<std::mutex> lock(entry->mutex);
+        vault->unsubscribeTxUpdated(entry->txUpdatedConnection);
+        entry->vault = nullptr;
+    }
+
+    if (m_bConnected) { updateBloomFilter(); }
+}
+
+std::size_t MultiVaultSync::getVaultCount() const
+{
+    std::lock_guard<std::mutex> lock(m_vaultsMutex);
+    return m_vaults.size();
+}
+
+MultiVaultSync::vault_entries_t MultiVaultSync::getVaultEntries() const
+{
+    std::lock_guard<std::mutex> lock(m_vaultsMutex);
+    vault_entries_t entries;
+    for (auto& item: m_vaults) { entries.push_back(item.second); }
+    return entries;
+}
+
+// Peer to peer network operations
+void MultiVaultSync::startSync(const std::string& host, const std::string& port)
+{
+    LOGGER(trace) << "MultiVaultSync::startSync(" << host << ", " << port << ")" << std::endl;
+    m_bInsertMerkleBlocks = false;
+    updateStatus(SynchedVault::STARTING);
+    m_networkSync.start(host, port);
+}
+
+void MultiVaultSync::startSync(const std::string& host, int port)
+{
+    std::stringstream ss;
+    ss << port;
+    startSync(host, ss.str());
+}
+
+void MultiVaultSync::stopSync()
+{
+    LOGGER(trace) << "MultiVaultSync::stopSync()" << std::endl;
+    m_networkSync.stop();
+}
+
+void MultiVaultSync::suspendBlockUpdates()
+{
+    LOGGER(trace) << "MultiVaultSync::suspendBlockUpdates()" << std::endl;
+    m_bInsertMerkleBlocks = false;
+}
+
+void MultiVaultSync::syncBlocks()
+{
+    LOGGER(trace) << "MultiVaultSync::syncBlocks()" << std::endl;
+
+    if (!m_bConnected) throw std::runtime_error("Not connected.");
+
+    vault_entries_t entries = getVaultEntries();
+    if (entries.empty()) throw std::runtime_error("No vaults are registered.");
+
+    updateBloomFilter();
+
+    // Start from whichever vault is furthest behind and remember where each vault's own chain begins.
+    std::vector<bytes_t> locatorHashes;
+    uint32_t startTime = 0;
+    int minStartHeight = std::numeric_limits<int>::max();
+    for (auto& entry: entries)
+    {
+        std::lock_guard<std::mutex> lock(entry->mutex);
+        if (!entry->vault) continue;
+
+        uint32_t vaultStartTime = entry->vault->getMaxFirstBlockTimestamp();
+        entry->bSynching = (vaultStartTime != 0);
+        if (!entry->bSynching) continue;
+
+        std::vector<bytes_t> vaultLocatorHashes = entry->vault->getLocatorHashes();
+        int startHeight = -1;
+        for (auto& hash: vaultLocatorHashes)
+        {
+            try
+            {
+                const ChainHeader& header = m_networkSync.getHeader(hash);
+                if (header.inBestChain)
+                {
+                    startHeight = header.height + 1;
+                    break;
+                }
+            }
+            catch (const std::exception& e)
+            {
+                // Not in our tree. Try the next one.
+            }
+        }
+
+        int horizonHeight = 0;
+        try
+        {
+            horizonHeight = m_networkSync.getHeaderBefore(vaultStartTime).height;
+        }
+        catch (const std::exception& e)
+        {
+            LOGGER(debug) << "MultiVaultSync::syncBlocks - no header before vault start time: " << e.what() << std::endl;
+        }
+
+        if (startHeight < 0) { startHeight = horizonHeight; }
+        entry->startHeight = vaultLocatorHashes.empty() ? horizonHeight : (int)entry->vault->getHorizonHeight();
+
+        if (startHeight < minStartHeight)
+        {
+            minStartHeight = startHeight;
+            locatorHashes = vaultLocatorHashes;
+            startTime = vaultStartTime;
+        }
+    }
+
+    if (startTime == 0)
+    {
+        m_bInsertMerkleBlocks = false;
+        return;
+    }
+
+    m_bGotMempool = false;
+    m_bInsertMerkleBlocks = true;
+    m_networkSync.syncBlocks(locatorHashes, startTime);
+}
+
+void MultiVaultSync::setFilterParams(double falsePositiveRate, uint32_t nTweak, uint8_t nFlags)
+{
+    m_filterFalsePositiveRate = falsePositiveRate;
+    m_filterTweak = nTweak;
+    m_filterFlags = nFlags;
+}
+
+void MultiVaultSync::updateBloomFilter()
+{
+    LOGGER(trace) << "MultiVaultSync::updateBloomFilter()" << std::endl;
+
+    std::vector<bytes_t> allElements;
+    for (auto& entry: getVaultEntries())
+    {
+        std::lock_guard<std::mutex> lock(entry->mutex);
+        if (!entry->vault) continue;
+
+        std::vector<bytes_t> elements = entry->vault->getBloomFilterElements();
+        if (elements.empty())
+        {
+            entry->filter = Coin::BloomFilter();
+            continue;
+        }
+
+        Coin::BloomFilter filter(elements.size(), m_filterFalsePositiveRate, m_filterTweak, m_filterFlags);
+        for (auto& element: elements) { filter.insert(element); }
+        entry->filter = filter;
+
+        allElements.insert(allElements.end(), elements.begin(), elements.end());
+    }
+
+    if (allElements.empty())
+    {
+        m_networkSync.clearBloomFilter();
+        return;
+    }
+
+    Coin::BloomFilter filter(allElements.size(), m_filterFalsePositiveRate, m_filterTweak, m_filterFlags);
+    for (auto& element: allElements) { filter.insert(element); }
+    m_networkSync.setBloomFilter(filter);
+}
+
+std::shared_ptr<Tx> MultiVaultSync::sendTx(Vault* vault, const bytes_t& hash)
+{
+    LOGGER(trace) << "MultiVaultSync::sendTx(" << vault->getName() << ", " << uchar_vector(hash).getHex() << ")" << std::endl;
+    if (!m_bConnected) throw std::runtime_error("Not connected.");
+
+    vault_entry_t entry;
+    {
+        std::lock_guard<std::mutex> lock(m_vaultsMutex);
+        auto it = m_vaults.find(vault);
+        if (it == m_vaults.end()) throw std::runtime_error("Vault is not registered.");
+        entry = it->second;
+    }
+
+    std::lock_guard<std::mutex> lock(entry->mutex);
+    if (!entry->vault) throw std::runtime_error("Vault is not registered.");
+
+    std::shared_ptr<Tx> tx = vault->getTx(hash);
+    recursiveSendTx(*vault, m_networkSync, tx);
+    return tx;
+}
+
+void MultiVaultSync::sendTx(Coin::Transaction& coin_tx)
+{
+    uchar_vector hash = coin_tx.hash();
+    LOGGER(trace) << "MultiVaultSync::sendTx(" << hash.getHex() << ")" << std::endl;
+    if (!m_bConnected) throw std::runtime_error("Not connected.");
+
+    m_networkSync.sendTx(coin_tx);
+    m_networkSync.getTx(hash);
+}
+
+void MultiVaultSync::dispatch(const vault_entries_t& entries, std::function<void(VaultEntry&)> handler)
+{
+    for (auto& entry: entries)
+    {
+        std::lock_guard<std::mutex> lock(entry->mutex);
+        if (!entry->vault) continue;
+
+        try
+        {
+            handler(*entry);
+        }
+        catch (const VaultException& e)
+        {
+            LOGGER(error) << e.what() << std::endl;
+            m_notifyVaultError(entry->vault, e.what(), e.code());
+        }
+        catch (const std::exception& e)
+        {
+            LOGGER(error) << e.what() << std::endl;
+            m_notifyVaultError(entry->vault, e.what(), -1);
+        }
+    }
+}
+
+// Event subscriptions
+void MultiVaultSync::clearAllSlots()
+{
+    LOGGER(trace) << "MultiVaultSync::clearAllSlots()" << std::endl;
+
+    m_notifyVaultError.clear();
+    m_notifyStatusChanged.clear();
+    m_notifyBestHeaderChanged.clear();
+    m_notifyConnectionError.clear();
+    m_notifyBlockTreeError.clear();
+    m_notifyProtocolError.clear();
+    m_notifyPeerConnected.clear();
+    m_notifyPeerDisconnected.clear();
+}
+
+void MultiVaultSync::updateStatus(status_t newStatus)
+{
+    if (m_status != newStatus)
+    {
+        m_status = newStatus;
+        m_notifyStatusChanged(newStatus);
+    }
+}
+
+void MultiVaultSync::updateBestHeader(uint32_t bestHeight, const bytes_t& bestHash)
+{
+    if (m_bestHeight != bestHeight || m_bestHash != bestHash)
+    {
+        m_bestHeight = bestHeight;
+        m_bestHash = bestHash;
+        m_notifyBestHeaderChanged(bestHeight, bestHash);
+    }
+}
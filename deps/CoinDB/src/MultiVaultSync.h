@@ -0,0 +1,138 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// MultiVaultSync.h
+//
+// Copyright (c) 2011-2016 Ciphrex Corp.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+//
+
+#pragma once
+
+#include "SynchedVault.h"
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace CoinDB
+{
+
+// Serves many open vaults from a single header tree and peer connection. Each registered vault
+// contributes its own bloom filter elements to a combined filter loaded on the peer, and
+// transactions received from the network are routed only to the vaults whose own elements match.
+//
+// Registered vaults are owned by the caller and must be unregistered before they are closed.
+class MultiVaultSync
+{
+public:
+    typedef SynchedVault::status_t status_t;
+
+    MultiVaultSync(const CoinQ::CoinParams& coinParams = CoinQ::getBitcoinParams());
+    ~MultiVaultSync();
+
+    const CoinQ::CoinParams& getCoinParams() const { return m_networkSync.getCoinParams(); }
+
+    // Set before loadHeaders() to start from a header snapshot when there is no block tree file yet.
+    void setHeaderSnapshotFile(const std::string& snapshotFile) { m_networkSync.setHeaderSnapshotFile(snapshotFile); }
+    void loadHeaders(const std::string& blockTreeFile, bool bCheckProofOfWork = false, CoinQBlockTreeMem::callback_t callback = nullptr);
+    bool areHeadersLoaded() const { return m_bBlockTreeLoaded; }
+
+    void registerVault(Vault* vault);
+    void unregisterVault(Vault* vault);
+    std::size_t getVaultCount() const;
+
+    void startSync(const std::string& host, const std::string& port);
+    void startSync(const std::string& host, int port);
+    void stopSync();
+    bool isConnected() const { return m_networkSync.connected(); }
+    void suspendBlockUpdates();
+
+    // Restarts block sync from the registered vault that is furthest behind.
+    void syncBlocks();
+
+    void setFilterParams(double falsePositiveRate, uint32_t nTweak, uint8_t nFlags);
+
+    // Rebuilds the per-vault and combined filters. Call after any registered vault issues new scripts.
+    void updateBloomFilter();
+
+    status_t getStatus() const { return m_status; }
+    uint32_t getBestHeight() const { return m_bestHeight; }
+    const bytes_t& getBestHash() const { return m_bestHash; }
+
+    std::shared_ptr<Tx> sendTx(Vault* vault, const bytes_t& hash);
+    void sendTx(Coin::Transaction& coin_tx);
+
+    // For testing. Routes a transaction as if the peer had relayed it, without a connection.
+    void insertTx(const Coin::Transaction& cointx) { m_networkSync.insertTx(cointx); }
+
+    // Signal types
+    typedef Signals::Signal<>                                   VoidSignal;
+    typedef Signals::Signal<const std::string&, int>            ErrorSignal;
+    typedef Signals::Signal<Vault*, const std::string&, int>    VaultErrorSignal;
+    typedef Signals::Signal<status_t>                           StatusSignal;
+    typedef Signals::Signal<uint32_t, const bytes_t&>           HeaderSignal;
+
+    // Per-vault transaction and block events are available directly from each Vault.
+    Signals::Connection subscribeVaultError(VaultErrorSignal::Slot slot) { return m_notifyVaultError.connect(slot); }
+    Signals::Connection subscribeStatusChanged(StatusSignal::Slot slot) { return m_notifyStatusChanged.connect(slot); }
+    Signals::Connection subscribeBestHeaderChanged(HeaderSignal::Slot slot) { return m_notifyBestHeaderChanged.connect(slot); }
+    Signals::Connection subscribeConnectionError(ErrorSignal::Slot slot) { return m_notifyConnectionError.connect(slot); }
+    Signals::Connection subscribeBlockTreeError(ErrorSignal::Slot slot) { return m_notifyBlockTreeError.connect(slot); }
+    Signals::Connection subscribeProtocolError(ErrorSignal::Slot slot) { return m_notifyProtocolError.connect(slot); }
+    Signals::Connection subscribePeerConnected(VoidSignal::Slot slot) { return m_notifyPeerConnected.connect(slot); }
+    Signals::Connection subscribePeerDisconnected(VoidSignal::Slot slot) { return m_notifyPeerDisconnected.connect(slot); }
+
+    void clearAllSlots();
+
+private:
+    struct VaultEntry
+    {
+        Vault*              vault;
+        std::mutex          mutex;          // serializes calls into the vault from the sync thread
+        Coin::BloomFilter   filter;         // this vault's elements only, used for routing
+        int                 startHeight;    // blocks below the vault's horizon are not delivered
+        bool                bSynching;      // false if the vault has no accounts yet
+        Signals::Connection txUpdatedConnection;
+    };
+
+    typedef std::shared_ptr<VaultEntry> vault_entry_t;
+    typedef std::vector<vault_entry_t>  vault_entries_t;
+
+    mutable std::mutex                  m_vaultsMutex;
+    std::map<Vault*, vault_entry_t>     m_vaults;
+    vault_entries_t                     getVaultEntries() const;
+
+    status_t                            m_status;
+    void                                updateStatus(status_t newStatus);
+
+    uint32_t                            m_bestHeight;
+    bytes_t                             m_bestHash;
+    void                                updateBestHeader(uint32_t bestHeight, const bytes_t& bestHash);
+
+    double                              m_filterFalsePositiveRate;
+    uint32_t                            m_filterTweak;
+    uint8_t                             m_filterFlags;
+
+    CoinQ::Network::NetworkSync         m_networkSync;
+    bool                                m_bBlockTreeLoaded;
+    bool                                m_bConnected;
+    bool                                m_bGotMempool;
+    bool                                m_bInsertMerkleBlocks;
+
+    // Each vault handler catches and reports its own errors so one vault can't stall the rest.
+    void                                dispatch(const vault_entries_t& entries, std::function<void(VaultEntry&)> handler);
+
+    VaultErrorSignal                    m_notifyVaultError;
+    StatusSignal                        m_notifyStatusChanged;
+    HeaderSignal                        m_notifyBestHeaderChanged;
+    ErrorSignal                         m_notifyConnectionError;
+    ErrorSignal                         m_notifyBlockTreeError;
+    ErrorSignal                         m_notifyProtocolError;
+    VoidSignal                          m_notifyPeerConnected;
+    VoidSignal                          m_notifyPeerDisconnected;
+};
+
+}
@@ -0,0 +1,138 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// PartialTx.cpp
+//
+// Copyright (c) 2011-2016 Ciphrex Corp.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+//
+
+#include "PartialTx.h"
+
+#include <boost/archive/text_oarchive.hpp>
+#include <boost/archive/text_iarchive.hpp>
+
+#include <sstream>
+#include <stdexcept>
+
+using namespace CoinDB;
+
+/*
+ * class PartialTxIn
+ */
+PartialTxIn::PartialTxIn(const CoinQ::Script::SignableTxIn& signabletxin, uint64_t amount) :
+    type_(signabletxin.type()),
+    minsigs_(signabletxin.minsigs()),
+    amount_(amount),
+    redeemscript_(signabletxin.redeemscript()),
+    pubkeys_(signabletxin.pubkeys()),
+    sigs_(signabletxin.sigs())
+{
+    sigs_.resize(pubkeys_.size());
+}
+
+unsigned int PartialTxIn::sigcount() const
+{
+    unsigned int count = 0;
+    for (auto& sig: sigs_) { if (!sig.empty()) count++; }
+    return count;
+}
+
+unsigned int PartialTxIn::sigsneeded() const
+{
+    unsigned int count = sigcount();
+    return count < minsigs_ ? minsigs_ - count : 0;
+}
+
+bool PartialTxIn::addsig(const bytes_t& pubkey, const bytes_t& sig)
+{
+    if (sig.empty() || sigsneeded() == 0) return false;
+
+    for (std::size_t i = 0; i < pubkeys_.size(); i++)
+    {
+        if (pubkeys_[i] != pubkey) continue;
+        if (!sigs_[i].empty()) return false;
+        sigs_[i] = sig;
+        return true;
+    }
+
+    return false;
+}
+
+unsigned int PartialTxIn::merge(const PartialTxIn& other)
+{
+    if (type_ != other.type_) throw std::runtime_error("PartialTxIn::merge(...) - cannot merge two different script types.");
+    if (minsigs_ != other.minsigs_) throw std::runtime_error("PartialTxIn::merge(...) - cannot merge two scripts with different minimum signatures.");
+    if (redeemscript_ != other.redeemscript_) throw std::runtime_error("PartialTxIn::merge(...) - cannot merge two different redeem scripts.");
+    if (pubkeys_ != other.pubkeys_) throw std::runtime_error("PartialTxIn::merge(...) - cannot merge two scripts with different public keys.");
+    if (sigs_.size() != pubkeys_.size() || other.sigs_.size() != sigs_.size()) throw std::runtime_error("PartialTxIn::merge(...) - signature count does not match public key count.");
+
+    unsigned int sigsadded = 0;
+    for (std::size_t i = 0; i < sigs_.size() && sigsneeded() > 0; i++)
+    {
+        if (sigs_[i].empty() && !other.sigs_[i].empty())
+        {
+            sigs_[i] = other.sigs_[i];
+            sigsadded++;
+        }
+    }
+    if (!amount_) { amount_ = other.amount_; }
+    return sigsadded;
+}
+
+
+/*
+ * class PartialTx
+ */
+unsigned int PartialTx::sigsneeded() const
+{
+    unsigned int total = 0;
+    for (auto& txin: txins_) { total += txin.sigsneeded(); }
+    return total;
+}
+
+unsigned int PartialTx::merge(const PartialTx& other, std::vector<std::size_t>& updated)
+{
+    if (unsigned_hash_ != other.unsigned_hash_) throw std::runtime_error("PartialTx::merge(...) - cannot merge two different transactions.");
+    if (txins_.size() != other.txins_.size()) throw std::runtime_error("PartialTx::merge(...) - input counts differ.");
+
+    unsigned int sigsadded = 0;
+    for (std::size_t i = 0; i < txins_.size(); i++)
+    {
+        // Skip inputs the other side has nothing new for without comparing scripts.
+        if (txins_[i].sigsneeded() == 0 || other.txins_[i].sigcount() == 0) continue;
+
+        unsigned int added = txins_[i].merge(other.txins_[i]);
+        if (added)
+        {
+            updated.push_back(i);
+            sigsadded += added;
+        }
+    }
+
+    if (rawtx_.empty()) { rawtx_ = other.rawtx_; }
+    return sigsadded;
+}
+
+unsigned int PartialTx::merge(const PartialTx& other)
+{
+    std::vector<std::size_t> updated;
+    return merge(other, updated);
+}
+
+std::string PartialTx::toSerialized() const
+{
+    std::stringstream ss;
+    boost::archive::text_oarchive oa(ss);
+    oa << *this;
+    return ss.str();
+}
+
+void PartialTx::fromSerialized(const std::string& serialized)
+{
+    std::stringstream ss;
+    ss << serialized;
+    boost::archive::text_iarchive ia(ss);
+    ia >> *this;
+}
@@ -0,0 +1,124 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// PartialTx.h
+//
+// Copyright (c) 2011-2016 Ciphrex Corp.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+//
+
+#pragma once
+
+#include <CoinQ/CoinQ_typedefs.h>
+#include <CoinQ/CoinQ_script.h>
+
+#include <boost/serialization/access.hpp>
+#include <boost/serialization/version.hpp>
+#include <boost/serialization/vector.hpp>
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace CoinDB
+{
+
+// Signing state for a single input: the redeem script, the amount being spent, the pubkeys
+// the redeem script expects and one signature slot per pubkey (empty if the signature is missing).
+class PartialTxIn
+{
+public:
+    PartialTxIn() : type_(CoinQ::Script::SignableTxIn::UNKNOWN), minsigs_(0), amount_(0) { }
+    PartialTxIn(const CoinQ::Script::SignableTxIn& signabletxin, uint64_t amount);
+
+    CoinQ::Script::SignableTxIn::type_t type() const { return (CoinQ::Script::SignableTxIn::type_t)type_; }
+    unsigned int minsigs() const { return minsigs_; }
+    uint64_t amount() const { return amount_; }
+    const bytes_t& redeemscript() const { return redeemscript_; }
+    const std::vector<bytes_t>& pubkeys() const { return pubkeys_; }
+    const std::vector<bytes_t>& sigs() const { return sigs_; }
+
+    unsigned int sigcount() const;
+    unsigned int sigsneeded() const;
+
+    // Returns true iff the slot for pubkey was empty and sig has been placed in it.
+    bool addsig(const bytes_t& pubkey, const bytes_t& sig);
+
+    // Copies signatures present in other but missing here. Throws if the inputs differ in anything
+    // but their signatures. Returns number of signatures added.
+    unsigned int merge(const PartialTxIn& other);
+
+private:
+    unsigned int type_;
+    unsigned int minsigs_;
+    uint64_t amount_;
+    bytes_t redeemscript_;
+    std::vector<bytes_t> pubkeys_;
+    std::vector<bytes_t> sigs_;
+
+    friend class boost::serialization::access;
+    template<class Archive>
+    void serialize(Archive& ar, const unsigned int /*version*/)
+    {
+        ar & type_;
+        ar & minsigs_;
+        ar & amount_;
+        ar & redeemscript_;
+        ar & pubkeys_;
+        ar & sigs_;
+
+        // Every other method indexes sigs_ by pubkey, so don't trust the archive on this.
+        if (Archive::is_loading::value && sigs_.size() != pubkeys_.size())
+            throw std::runtime_error("PartialTxIn - signature count does not match public key count.");
+    }
+};
+
+typedef std::vector<PartialTxIn> partialtxins_t;
+
+// Compact partially signed transaction exchanged between cosigners. Signatures are kept per input
+// so merging two containers or applying one to a stored transaction only touches the inputs whose
+// signatures changed, and nothing needs to be reparsed from raw scripts.
+class PartialTx
+{
+public:
+    PartialTx() { }
+    PartialTx(const bytes_t& unsigned_hash, const partialtxins_t& txins, const bytes_t& rawtx = bytes_t()) :
+        unsigned_hash_(unsigned_hash), txins_(txins), rawtx_(rawtx) { }
+
+    const bytes_t& unsigned_hash() const { return unsigned_hash_; }
+    const partialtxins_t& txins() const { return txins_; }
+    partialtxins_t& txins() { return txins_; }
+
+    // Only needed by cosigners that have not seen the transaction yet. Empty unless requested.
+    const bytes_t& rawtx() const { return rawtx_; }
+
+    unsigned int sigsneeded() const;
+
+    // Merges signatures from another container for the same transaction. The indices of the inputs
+    // that gained signatures are appended to updated. Returns number of signatures added.
+    unsigned int merge(const PartialTx& other, std::vector<std::size_t>& updated);
+    unsigned int merge(const PartialTx& other);
+
+    std::string toSerialized() const;
+    void fromSerialized(const std::string& serialized);
+
+private:
+    bytes_t unsigned_hash_;
+    partialtxins_t txins_;
+    bytes_t rawtx_;
+
+    friend class boost::serialization::access;
+    template<class Archive>
+    void serialize(Archive& ar, const unsigned int /*version*/)
+    {
+        ar & unsigned_hash_;
+        ar & txins_;
+        ar & rawtx_;
+    }
+};
+
+}
+
+BOOST_CLASS_VERSION(CoinDB::PartialTxIn, 1)
+BOOST_CLASS_VERSION(CoinDB::PartialTx, 1)
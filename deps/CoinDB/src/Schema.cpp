@@ -12,6 +12,7 @@
 #include "Schema.h"
 
 #include <stdutils/stringutils.h>
+#include <stdutils/jsonwriter.h>
 
 #include <CoinCore/hash.h>
 #include <CoinCore/CoinNodeData.h>
@@ -42,7 +43,7 @@ Keychain::Keychain(const std::string& name, const secure_bytes_t& entropy, const
     if (name.empty() || name[0] == '@') throw std::runtime_error("Invalid keychain name.");
     if (entropy.size() < 16) throw std::runtime_error("At least 128 bits of entropy must be supplied.");
 
-    Coin::HDSeed hdSeed(entropy);
+    Coin::HDSeed hdSeed(to_bytes(entropy));
     Coin::HDKeychain hdKeychain(hdSeed.getMasterKey(), hdSeed.getMasterChainCode());
 
     depth_ = (uint32_t)hdKeychain.depth();
@@ -50,15 +51,15 @@ Keychain::Keychain(const std::string& name, const secure_bytes_t& entropy, const
     child_num_ = hdKeychain.child_num();
     chain_code_ = hdKeychain.chain_code();
     pubkey_ = hdKeychain.pubkey();
-    privkey_ = hdKeychain.privkey();
+    privkey_ = to_secure_bytes(hdKeychain.privkey());
     seed_ = entropy;
     if (lock_key.empty())
     {
         privkey_salt_ = 0;
-        privkey_ciphertext_ = privkey_;
+        privkey_ciphertext_ = to_bytes(privkey_);
 
         seed_salt_ = 0;
-        seed_ciphertext_ = seed_;
+        seed_ciphertext_ = to_bytes(seed_);
     }
     else
     {
@@ -111,21 +112,21 @@ std::shared_ptr<Keychain> Keychain::child(uint32_t i, bool get_private, const se
     if (get_private)
     {
         if (privkey_.empty()) throw std::runtime_error("Private key is locked.");
-        Coin::HDKeychain hdkeychain(privkey_, chain_code_, child_num_, parent_fp_, depth_);
+        Coin::HDKeychain hdkeychain(to_bytes(privkey_), chain_code_, child_num_, parent_fp_, depth_);
         hdkeychain = hdkeychain.getChild(i);
         std::shared_ptr<Keychain> child(new Keychain());
         child->parent_ = get_shared_ptr();
         child->pubkey_ = hdkeychain.pubkey();
         child->chain_code_ = hdkeychain.chain_code();
 
-        child->privkey_ = hdkeychain.privkey();
+        child->privkey_ = to_secure_bytes(hdkeychain.privkey());
         if (lock_key.empty())
         {
             child->privkey_salt_ = 0;
-            child->privkey_ciphertext_ = privkey_;
+            child->privkey_ciphertext_ = to_bytes(privkey_);
 
             child->seed_salt_ = 0;
-            child->seed_ciphertext_ = seed_;
+            child->seed_ciphertext_ = to_bytes(seed_);
         }
         else
         {
@@ -181,7 +182,7 @@ void Keychain::unlock(const secure_bytes_t& lock_key) const
     if (!isPrivate()) throw std::runtime_error("Cannot unlock a nonprivate keychain.");
     if (privkey_salt_ == 0)
     {
-        privkey_ = privkey_ciphertext_;
+        privkey_ = to_secure_bytes(privkey_ciphertext_);
     }
     else
     {
@@ -190,7 +191,7 @@ void Keychain::unlock(const secure_bytes_t& lock_key) const
 
     if (seed_salt_ == 0 || seed_ciphertext_.empty())
     {
-        seed_ = seed_ciphertext_;
+        seed_ = to_secure_bytes(seed_ciphertext_);
     }
     else
     {
@@ -224,10 +225,10 @@ void Keychain::decrypt()
     if (isLocked()) throw std::runtime_error("Keychain is locked.");
 
     privkey_salt_ = 0;
-    privkey_ciphertext_ = privkey_;
+    privkey_ciphertext_ = to_bytes(privkey_);
 
     seed_salt_ = 0;
-    seed_ciphertext_ = seed_;
+    seed_ciphertext_ = to_bytes(seed_);
 }
 
 secure_bytes_t Keychain::getSigningPrivateKey(uint32_t i, const std::vector<uint32_t>& derivation_path) const
@@ -237,9 +238,9 @@ secure_bytes_t Keychain::getSigningPrivateKey(uint32_t i, const std::vector<uint
 
     // Remove initial zero from privkey if necessary
     secure_bytes_t stripped_privkey = (privkey_.size() > 32) ? secure_bytes_t(privkey_.begin() + 1, privkey_.end()) : privkey_;
-    Coin::HDKeychain hdkeychain(stripped_privkey, chain_code_, child_num_, parent_fp_, depth_);
+    Coin::HDKeychain hdkeychain(to_bytes(stripped_privkey), chain_code_, child_num_, parent_fp_, depth_);
     for (auto k: derivation_path) { hdkeychain = hdkeychain.getChild(k); }
-    return hdkeychain.getPrivateSigningKey(i);
+    return to_secure_bytes(hdkeychain.getPrivateSigningKey(i));
 }
 
 bytes_t Keychain::getSigningPublicKey(uint32_t i, bool get_compressed, const std::vector<uint32_t>& derivation_path) const
@@ -277,7 +278,7 @@ void Keychain::importPrivateKey(const Keychain& source)
 
 void Keychain::importBIP32(const secure_bytes_t& extkey, const secure_bytes_t& lock_key)
 {
-    Coin::HDKeychain hdKeychain(extkey);
+    Coin::HDKeychain hdKeychain(to_bytes(extkey));
 
     depth_ = (uint32_t)hdKeychain.depth();
     parent_fp_ = hdKeychain.parent_fp();
@@ -289,7 +290,7 @@ void Keychain::importBIP32(const secure_bytes_t& extkey, const secure_bytes_t& l
         if (!lock_key.empty())
         {
             privkey_salt_ = AES::random_salt();
-            privkey_ciphertext_ = AES::encrypt(lock_key, hdKeychain.key(), true, privkey_salt_);
+            privkey_ciphertext_ = AES::encrypt(lock_key, to_secure_bytes(hdKeychain.key()), true, privkey_salt_);
         }
         else
         {
@@ -321,10 +322,10 @@ secure_bytes_t Keychain::exportBIP32(bool export_private) const
     }
     else
     {
-        key = pubkey_;
+        key = to_secure_bytes(pubkey_);
     }
 
-    return Coin::HDKeychain(key, chain_code_, child_num_, parent_fp_, depth_).extkey();
+    return to_secure_bytes(Coin::HDKeychain(to_bytes(key), chain_code_, child_num_, parent_fp_, depth_).extkey());
 }
 
 void Keychain::clearPrivateKey()
@@ -808,6 +809,12 @@ Coin::TxIn TxIn::toCoinCore() const
     return coin_txin;
 }
 
+void TxIn::script(const bytes_t& script)
+{
+    script_ = script;
+    invalidateTxSignatureState();
+}
+
 bytes_t TxIn::unsigned_script() const
 {
     using namespace CoinQ::Script;
@@ -817,6 +824,18 @@ bytes_t TxIn::unsigned_script() const
     return signabletxin.txinscript();
 }
 
+void TxIn::scriptwitnessstack(const std::vector<bytes_t>& scriptwitnessstack)
+{
+    scriptwitnessstack_ = scriptwitnessstack;
+    invalidateTxSignatureState();
+}
+
+void TxIn::invalidateTxSignatureState() const
+{
+    std::shared_ptr<Tx> tx(tx_.lock());
+    if (tx) { tx->invalidateSignatureState(); }
+}
+
 bytes_t TxIn::raw() const
 {
     return toCoinCore().getSerialized();
@@ -825,6 +844,7 @@ bytes_t TxIn::raw() const
 void TxIn::outpoint(std::shared_ptr<TxOut> outpoint)
 {
     outpoint_ = outpoint;
+    invalidateTxSignatureState();
     if (!outpoint) return;
 
     std::shared_ptr<Tx> tx = outpoint->tx();
@@ -920,6 +940,24 @@ TxOut::TxOut(const bytes_t& raw)
     status_ = UNSPENT;
 }
 
+void TxOut::value(uint64_t value)
+{
+    value_ = value;
+    invalidateTxSignatureState();
+}
+
+void TxOut::script(const bytes_t& script)
+{
+    script_ = script;
+    invalidateTxSignatureState();
+}
+
+void TxOut::invalidateTxSignatureState() const
+{
+    std::shared_ptr<Tx> tx(tx_.lock());
+    if (tx) { tx->invalidateSignatureState(); }
+}
+
 void TxOut::spent(std::shared_ptr<TxIn> spent)
 {
     spent_ = spent;
@@ -931,6 +969,7 @@ void TxOut::signingscript(std::shared_ptr<SigningScript> signingscript)
     if (!signingscript) throw std::runtime_error("TxOut::signingscript - null signingscript.");
 
     script_ = signingscript->txoutscript();
+    invalidateTxSignatureState();
     receiving_account_ = signingscript->account();
     if (receiving_label_.empty()) { receiving_label_ = signingscript->label(); }
     account_bin_ = signingscript->account_bin();
@@ -952,20 +991,21 @@ bytes_t TxOut::raw() const
 
 std::string TxOut::toJson() const
 {
-    std::stringstream ss;
-    ss << "{"
-       << "\"value\":" << value_ << ","
-       << "\"script\":\"" << uchar_vector(script_).getHex() << "\","
-       << "\"sending_label\":\"" << sending_label_ << "\","
-       << "\"receiving_label\":\"" << receiving_label_ << "\"";
+    // Labels are user input and must be escaped.
+    stdutils::JsonWriter json(256);
+    json.beginObject()
+        .field("value", value_)
+        .hexField("script", script_)
+        .field("sending_label", sending_label_)
+        .field("receiving_label", receiving_label_);
 
     if (signingscript_ && signingscript_->contact())
     {
-        ss << ",\"sender_username\":\"" << signingscript_->contact()->username() << "\"";
+        json.field("sender_username", signingscript_->contact()->username());
     }
 
-    ss << "}";
-    return ss.str(); 
+    json.endObject();
+    return json.release();
 }
 
 
@@ -1002,6 +1042,7 @@ std::vector<Tx::status_t> Tx::getStatusFlags(int status)
 
 void Tx::set(uint32_t version, const txins_t& txins, const txouts_t& txouts, uint32_t locktime, uint32_t timestamp, status_t status, bool conflicting, bool checksigs)
 {
+    signaturestate_.reset();
     version_ = version;
 
     int i = 0;
@@ -1171,6 +1212,7 @@ void Tx::updateTotals()
 
 void Tx::shuffle_txins()
 {
+    signaturestate_.reset();
     int i = 0;
     std::random_shuffle(txins_.begin(), txins_.end());
     for (auto& txin: txins_) { txin->txindex(i++); }
@@ -1178,6 +1220,7 @@ void Tx::shuffle_txins()
 
 void Tx::shuffle_txouts()
 {
+    signaturestate_.reset();
     int i = 0;
     std::random_shuffle(txouts_.begin(), txouts_.end());
     for (auto& txout: txouts_) { txout->txindex(i++); }
@@ -1185,6 +1228,7 @@ void Tx::shuffle_txouts()
 
 void Tx::fromCoinCore(const Coin::Transaction& coin_tx)
 {
+    signaturestate_.reset();
     version_ = coin_tx.version;
 
     int i = 0;
@@ -1216,61 +1260,55 @@ void Tx::fromCoinCore(const Coin::Transaction& coin_tx)
     locktime_ = coin_tx.lockTime;
 }
 
-unsigned int Tx::missingSigCount() const
+std::shared_ptr<const Tx::SignatureState> Tx::signatureState() const
 {
+    if (signaturestate_) return signaturestate_;
+
     // Assume for now all inputs belong to the same account.
     using namespace CoinQ::Script;
-    unsigned int count = 0;
-    Coin::Transaction cointx(toCoinCore());
+    std::vector<uint64_t> outpointvalues;
     for (auto& txin: txins_)
     {
-        uint64_t outpointvalue = txin->outpoint() ? txin->outpoint()->value() : 0;
-        SignableTxIn signabletxin(cointx, txin->txindex(), outpointvalue);
+        outpointvalues.push_back(txin->outpoint() ? txin->outpoint()->value() : 0);
+    }
+
+    std::shared_ptr<SignatureState> state(new SignatureState());
+    state->signer.setTx(toCoinCore(), outpointvalues);
+    state->missingsigcount = 0;
+    for (auto& signabletxin: state->signer.getSignableTxIns())
+    {
         unsigned int sigsneeded = signabletxin.sigsneeded();
-        if (sigsneeded > count) count = sigsneeded;
+        if (sigsneeded > state->missingsigcount) state->missingsigcount = sigsneeded;
+
+        std::vector<bytes_t> missingpubkeys = signabletxin.missingsigs();
+        state->missingsigpubkeys.insert(missingpubkeys.begin(), missingpubkeys.end());
+
+        std::vector<bytes_t> presentpubkeys = signabletxin.presentsigs();
+        state->presentsigpubkeys.insert(presentpubkeys.begin(), presentpubkeys.end());
     }
-    return count;
+
+    signaturestate_ = state;
+    return signaturestate_;
+}
+
+unsigned int Tx::missingSigCount() const
+{
+    return signatureState()->missingsigcount;
 }
 
 std::set<bytes_t> Tx::missingSigPubkeys() const
 {
-    using namespace CoinQ::Script;
-    std::set<bytes_t> pubkeys;
-    Coin::Transaction cointx = toCoinCore();
-    for (auto& txin: txins_)
-    {
-        uint64_t outpointvalue = txin->outpoint() ? txin->outpoint()->value() : 0;
-        SignableTxIn signabletxin(cointx, txin->txindex(), outpointvalue);
-        std::vector<bytes_t> txinpubkeys = signabletxin.missingsigs();
-        for (auto& txinpubkey: txinpubkeys) { pubkeys.insert(txinpubkey); }
-    } 
-    return pubkeys;
+    return signatureState()->missingsigpubkeys;
 }
 
 std::set<bytes_t> Tx::presentSigPubkeys() const
 {
-    std::set<bytes_t> pubkeys;
-
-    using namespace CoinQ::Script;
-    Signer signer_(signer());
-    for (auto& signabletxin: signer_.getSignableTxIns())
-    {
-        std::vector<bytes_t> txinpubkeys = signabletxin.presentsigs();
-        for (auto& txinpubkey: txinpubkeys) { pubkeys.insert(txinpubkey); }
-    } 
-    return pubkeys;
+    return signatureState()->presentsigpubkeys;
 }
 
 CoinQ::Script::Signer Tx::signer() const
 {
-    using namespace CoinQ::Script;
-    std::vector<uint64_t> outpointvalues;
-    for (auto& txin: txins_)
-    {
-        outpointvalues.push_back(txin->outpoint() ? txin->outpoint()->value() : 0);
-    }
-
-    return Signer(toCoinCore(), outpointvalues);
+    return signatureState()->signer;
 }
 
 std::string Tx::toJson(bool includeRawHex, bool includeSerialized) const
@@ -1335,3 +1373,49 @@ void Tx::fromSerialized(const std::string& serialized)
     ia >> *this;
 }
 
+
+/*
+ * class ChangeLogEntry
+ */
+
+// static
+std::string ChangeLogEntry::getTypeString(type_t type)
+{
+    switch (type)
+    {
+    case TX_INSERTED:           return "tx_inserted";
+    case TX_UPDATED:            return "tx_updated";
+    case TX_DELETED:            return "tx_deleted";
+    case BLOCK_CONNECTED:       return "block_connected";
+    case BLOCK_DISCONNECTED:    return "block_disconnected";
+    case SCRIPT_ISSUED:         return "script_issued";
+    default:                    return "unknown";
+    }
+}
+
+std::string ChangeLogEntry::toJson() const
+{
+    stdutils::JsonWriter json(256);
+    json.beginObject()
+        .field("sequence", sequence_)
+        .field("type", getTypeString(type_))
+        .hexField("hash", hash_)
+        .field("height", height_)
+        .field("timestamp", timestamp_)
+        .field("info", info_)
+        .endObject();
+    return json.release();
+}
+
+std::string changesToJson(const changelog_t& changes)
+{
+    std::stringstream ss;
+    bool bNewLine = false;
+    for (auto& change: changes)
+    {
+        if (bNewLine)   { ss << std::endl; }
+        else            { bNewLine = true; }
+        ss << change->toJson();
+    }
+    return ss.str();
+}
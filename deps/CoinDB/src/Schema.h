@@ -57,7 +57,7 @@ typedef odb::nullable<unsigned long> null_id_t;
 ////////////////////
 
 #define SCHEMA_BASE_VERSION 12
-#define SCHEMA_VERSION      22
+#define SCHEMA_VERSION      23
 
 #ifdef ODB_COMPILER
 #pragma db model version(SCHEMA_BASE_VERSION, SCHEMA_VERSION, open)
@@ -1102,7 +1102,8 @@ public:
     const bytes_t& outhash() const { return outhash_; }
     uint32_t outindex() const { return outindex_; }
 
-    void script(const bytes_t& script) { script_ = script; }
+    // Setters that change signing state invalidate the parent tx's cached signature state.
+    void script(const bytes_t& script);
     const bytes_t& script() const { return script_; }
     bytes_t unsigned_script() const; // throws exception if script type is not recognized
 
@@ -1118,7 +1119,7 @@ public:
     void outpoint(std::shared_ptr<TxOut> outpoint);
     const std::shared_ptr<TxOut> outpoint() const { return outpoint_.lock(); }
 
-    void scriptwitnessstack(const std::vector<bytes_t>& scriptwitnessstack) { scriptwitnessstack_ = scriptwitnessstack; }
+    void scriptwitnessstack(const std::vector<bytes_t>& scriptwitnessstack);
     const std::vector<bytes_t>& scriptwitnessstack() const { return scriptwitnessstack_; }
 
     std::string toJson() const;
@@ -1126,6 +1127,8 @@ public:
 private:
     friend class odb::access;
 
+    void invalidateTxSignatureState() const;
+
     #pragma db id auto
     unsigned long id_;
 
@@ -1231,10 +1234,11 @@ public:
 
     unsigned long id() const { return id_; }
 
-    void value(uint64_t value) { value_ = value; }
+    // Setters that change the signing hash invalidate the parent tx's cached signature state.
+    void value(uint64_t value);
     uint64_t value() const { return value_; }
 
-    void script(const bytes_t& script) { script_ = script; }
+    void script(const bytes_t& script);
     const bytes_t& script() const { return script_; }
 
     bytes_t raw() const;
@@ -1247,6 +1251,7 @@ public:
 
     void spent(std::shared_ptr<TxIn> spent);
     const std::shared_ptr<TxIn> spent() const { return spent_; }
+    void detachSpent() { spent_.reset(); } // Status stays SPENT. Used once the spending transaction is archived.
 
     void sending_account(std::shared_ptr<Account> sending_account) { sending_account_ = sending_account; }
     const std::shared_ptr<Account> sending_account() const { return sending_account_; }
@@ -1271,6 +1276,8 @@ public:
 private:
     friend class odb::access;
 
+    void invalidateTxSignatureState() const;
+
     #pragma db id auto
     unsigned long id_;
 
@@ -1299,7 +1306,7 @@ private:
     #pragma db null
     std::shared_ptr<SigningScript> signingscript_;
 
-    // status == SPENT if spent_ is not null. Otherwise UNSPENT.
+    // status == SPENT if spent_ is not null or the spending transaction was archived. Otherwise UNSPENT.
     // Redundant but convenient for view queries.
     status_t status_;
 
@@ -1381,6 +1388,7 @@ public:
     bool conflicting() const { return conflicting_; }
 
     void updateTotals();
+    void totals(bool have_all_outpoints, uint64_t txin_total) { updateTotals(); have_all_outpoints_ = have_all_outpoints; txin_total_ = txin_total; } // For archived transactions whose outpoints are gone.
     bool have_all_outpoints() const { return have_all_outpoints_; }
     uint64_t txin_total() const { return txin_total_; }
     uint64_t txout_total() const { return txout_total_; }
@@ -1400,12 +1408,16 @@ public:
     void shuffle_txins();
     void shuffle_txouts();
 
+    // Signature state is parsed from the txin scripts once and cached until the txins,
+    // txouts, their scripts, values or outpoints change.
     unsigned int missingSigCount() const;
     std::set<bytes_t> missingSigPubkeys() const;
     std::set<bytes_t> presentSigPubkeys() const;
 
     CoinQ::Script::Signer signer() const;
 
+    void invalidateSignatureState() const { signaturestate_.reset(); }
+
     std::string toJson(bool includeRawHex = false, bool includeSerialized = false) const;
 
     std::string toSerialized() const;
@@ -1416,6 +1428,17 @@ private:
 
     void fromCoinCore(const Coin::Transaction& coin_tx);
 
+    struct SignatureState
+    {
+        CoinQ::Script::Signer signer;
+        unsigned int missingsigcount;
+        std::set<bytes_t> missingsigpubkeys;
+        std::set<bytes_t> presentsigpubkeys;
+    };
+
+    // Callers hold the returned pointer so the state outlives any invalidation while in use.
+    std::shared_ptr<const SignatureState> signatureState() const;
+
     #pragma db id auto
     unsigned long id_;
 
@@ -1461,6 +1484,9 @@ private:
 
     std::string propagation_protocol_;
 
+    #pragma db transient
+    mutable std::shared_ptr<const SignatureState> signaturestate_;
+
     friend class boost::serialization::access;
     template<class Archive>
     void save(Archive& ar, const unsigned int v) const
@@ -1509,6 +1535,7 @@ private:
 
         uint32_t n;
         ar & n;
+        signaturestate_.reset();
         txins_.clear();
         for (uint32_t i = 0; i < n; i++)
         {
@@ -1580,6 +1607,62 @@ private:
 typedef std::vector<std::shared_ptr<Tx>> txs_t;
 
 
+////////////////
+// CHANGE LOG //
+////////////////
+
+// Appended in the same database transaction as the change it records, so the sequence numbers give
+// external mirrors a gapless, ordered feed of vault mutations.
+#pragma db object pointer(std::shared_ptr)
+class ChangeLogEntry
+{
+public:
+    enum type_t
+    {
+        TX_INSERTED = 1,
+        TX_UPDATED,
+        TX_DELETED,
+        BLOCK_CONNECTED,
+        BLOCK_DISCONNECTED,
+        SCRIPT_ISSUED
+    };
+
+    static std::string getTypeString(type_t type);
+
+    // hash is the transaction's unsigned hash, the block hash or the txout script.
+    // info is the transaction status, or the account name for scripts.
+    ChangeLogEntry(type_t type, const bytes_t& hash, uint32_t height = 0, const std::string& info = std::string())
+        : sequence_(0), type_(type), hash_(hash), height_(height), timestamp_(time(NULL)), info_(info) { }
+
+    unsigned long sequence() const { return sequence_; }
+    type_t type() const { return type_; }
+    const bytes_t& hash() const { return hash_; }
+    uint32_t height() const { return height_; }
+    uint32_t timestamp() const { return timestamp_; }
+    const std::string& info() const { return info_; }
+
+    std::string toJson() const;
+
+private:
+    ChangeLogEntry() { }
+    friend class odb::access;
+
+    #pragma db id auto
+    unsigned long sequence_;
+
+    type_t type_;
+    bytes_t hash_;
+    uint32_t height_;
+    uint32_t timestamp_;
+    std::string info_;
+};
+
+typedef std::vector<std::shared_ptr<ChangeLogEntry>> changelog_t;
+
+// One JSON object per line, the format of the change feed served by coindb and vaultd.
+std::string changesToJson(const changelog_t& changes);
+
+
 // Views
 #pragma db view \
     object(Keychain) \
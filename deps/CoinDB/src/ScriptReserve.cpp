@@ -0,0 +1,194 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ScriptReserve.cpp
+//
+// Copyright (c) 2011-2016 Ciphrex Corp.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+//
+
+#include "ScriptReserve.h"
+
+#include <logger/logger.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace CoinDB;
+
+ScriptReserve::ScriptReserve(Vault& vault, const std::string& account_name, const std::string& bin_name, uint32_t batchSize) :
+    m_vault(vault),
+    m_accountName(account_name),
+    m_binName(bin_name),
+    m_batchSize(batchSize),
+    m_lowWater(std::max<uint32_t>(1, batchSize / 2)),
+    m_flushInterval(DEFAULT_FLUSH_INTERVAL),
+    m_bLabelsFailed(false),
+    m_bStopping(true)
+{
+    if (batchSize == 0) throw std::runtime_error("ScriptReserve - batch size must be positive.");
+}
+
+ScriptReserve::~ScriptReserve()
+{
+    try
+    {
+        stop();
+    }
+    catch (const std::exception& e)
+    {
+        LOGGER(error) << "ScriptReserve - labels not written: " << e.what() << std::endl;
+    }
+}
+
+void ScriptReserve::start()
+{
+    if (m_thread.joinable()) throw std::runtime_error("ScriptReserve - already started.");
+
+    {
+        boost::unique_lock<boost::mutex> lock(m_mutex);
+        m_error = nullptr;
+        refill(lock);
+        if (m_error)
+        {
+            std::exception_ptr error = m_error;
+            m_error = nullptr;
+            std::rethrow_exception(error);
+        }
+        m_bStopping = false;
+    }
+
+    m_thread = boost::thread(&ScriptReserve::run, this);
+}
+
+void ScriptReserve::stop()
+{
+    {
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+        m_bStopping = true;
+    }
+    m_workCond.notify_all();
+    m_readyCond.notify_all();
+    if (m_thread.joinable()) { m_thread.join(); }
+
+    // In case the worker's last write failed.
+    flush();
+}
+
+ScriptReserve::Reservation ScriptReserve::reserve(const std::string& label)
+{
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    while (m_queue.empty() || m_bStopping)
+    {
+        if (m_bStopping) throw std::runtime_error("ScriptReserve - not started.");
+        if (m_error) std::rethrow_exception(m_error);
+        m_workCond.notify_one();
+        m_readyCond.wait(lock);
+    }
+
+    Reservation reservation = m_queue.front();
+    m_queue.pop_front();
+    reservation.label = label;
+    if (!label.empty()) { m_labels.push_back(std::make_pair(reservation.id, label)); }
+
+    if (m_queue.size() < m_lowWater || m_labels.size() >= m_batchSize) { m_workCond.notify_one(); }
+    return reservation;
+}
+
+void ScriptReserve::flush()
+{
+    labels_t labels;
+    {
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+        labels.swap(m_labels);
+    }
+    if (labels.empty()) return;
+
+    try
+    {
+        m_vault.setSigningScriptLabels(labels);
+    }
+    catch (...)
+    {
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+        m_labels.insert(m_labels.begin(), labels.begin(), labels.end());
+        throw;
+    }
+}
+
+std::size_t ScriptReserve::available() const
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    return m_queue.size();
+}
+
+std::size_t ScriptReserve::pendingLabels() const
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    return m_labels.size();
+}
+
+// Called with the lock held. The vault is called without it so reserve() is never held up.
+void ScriptReserve::refill(boost::unique_lock<boost::mutex>& lock)
+{
+    lock.unlock();
+    std::vector<Reservation> reservations;
+    std::exception_ptr error;
+    try
+    {
+        for (auto& script: m_vault.issueSigningScripts(m_accountName, m_binName, m_batchSize))
+        {
+            reservations.push_back(Reservation{script->id(), script->index(), script->txoutscript(), std::string()});
+        }
+    }
+    catch (const std::exception& e)
+    {
+        LOGGER(error) << "ScriptReserve - cannot issue scripts for " << m_accountName << "/" << m_binName << ": " << e.what() << std::endl;
+        error = std::current_exception();
+    }
+    lock.lock();
+
+    m_queue.insert(m_queue.end(), reservations.begin(), reservations.end());
+    m_error = error;
+    m_readyCond.notify_all();
+}
+
+// Called with the lock held. Labels that fail to write are kept for the next attempt.
+void ScriptReserve::writeLabels(boost::unique_lock<boost::mutex>& lock)
+{
+    if (m_labels.empty()) return;
+
+    labels_t labels;
+    labels.swap(m_labels);
+    lock.unlock();
+    bool bFailed = false;
+    try
+    {
+        m_vault.setSigningScriptLabels(labels);
+    }
+    catch (const std::exception& e)
+    {
+        LOGGER(error) << "ScriptReserve - cannot write labels for " << m_accountName << "/" << m_binName << ": " << e.what() << std::endl;
+        bFailed = true;
+    }
+    lock.lock();
+
+    if (bFailed) { m_labels.insert(m_labels.begin(), labels.begin(), labels.end()); }
+    m_bLabelsFailed = bFailed;
+}
+
+void ScriptReserve::run()
+{
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    while (!m_bStopping)
+    {
+        // After a failure, wait out the interval before trying again.
+        m_workCond.timed_wait(lock, boost::posix_time::milliseconds(m_flushInterval), [this]() {
+            return m_bStopping || (m_queue.size() < m_lowWater && !m_error) || (m_labels.size() >= m_batchSize && !m_bLabelsFailed);
+        });
+
+        if (!m_bStopping && m_queue.size() < m_lowWater) { refill(lock); }
+        writeLabels(lock);
+    }
+}
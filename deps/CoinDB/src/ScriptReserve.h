@@ -0,0 +1,95 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ScriptReserve.h
+//
+// Copyright (c) 2011-2016 Ciphrex Corp.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+//
+
+#pragma once
+
+#include "Vault.h"
+
+#include <boost/thread.hpp>
+
+#include <deque>
+#include <exception>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace CoinDB
+{
+
+// Hands out receive scripts for one account bin from a queue held in memory, so issuing one does not
+// touch the database or wait on the vault mutex.
+//
+// A background thread keeps the queue topped up. It issues scripts from the vault a batch at a time,
+// in one database transaction, before they are queued, so a script is never handed out twice, even
+// after a crash. Scripts still queued when the process exits stay issued without a label. Labels
+// passed to reserve() are written by the same thread, also in batches.
+class ScriptReserve
+{
+public:
+    static const uint32_t DEFAULT_BATCH_SIZE = 100;
+    static const unsigned int DEFAULT_FLUSH_INTERVAL = 1000; // milliseconds
+
+    struct Reservation
+    {
+        unsigned long id;       // database id of the SigningScript
+        uint32_t index;
+        bytes_t txoutscript;
+        std::string label;
+    };
+
+    // The queue is refilled with batchSize scripts whenever it falls below half of that.
+    ScriptReserve(Vault& vault, const std::string& account_name, const std::string& bin_name = DEFAULT_BIN_NAME, uint32_t batchSize = DEFAULT_BATCH_SIZE);
+    ~ScriptReserve();
+
+    // Longest time a label waits before it is written.
+    void setFlushInterval(unsigned int milliseconds) { m_flushInterval = milliseconds; }
+
+    // Fills the queue before returning. Throws if the vault cannot issue scripts for the bin.
+    void start();
+
+    // Writes any pending labels.
+    void stop();
+    bool isStarted() const { return m_thread.joinable(); }
+
+    // Only blocks if the queue has run dry. Throws the last refill error if it stays dry.
+    Reservation reserve(const std::string& label = "");
+
+    // Writes pending labels from the calling thread.
+    void flush();
+
+    std::size_t available() const;
+    std::size_t pendingLabels() const;
+
+private:
+    typedef std::vector<std::pair<unsigned long, std::string>> labels_t;
+
+    Vault& m_vault;
+    std::string m_accountName;
+    std::string m_binName;
+    uint32_t m_batchSize;
+    std::size_t m_lowWater;
+    unsigned int m_flushInterval;
+
+    mutable boost::mutex m_mutex;
+    boost::condition_variable m_workCond;     // wakes the worker
+    boost::condition_variable m_readyCond;    // wakes reserve() when scripts arrive
+    std::deque<Reservation> m_queue;
+    labels_t m_labels;
+    std::exception_ptr m_error;             // from the last refill
+    bool m_bLabelsFailed;                   // the last label write failed
+    bool m_bStopping;
+    boost::thread m_thread;
+
+    void refill(boost::unique_lock<boost::mutex>& lock);
+    void writeLabels(boost::unique_lock<boost::mutex>& lock);
+    void run();
+};
+
+}
@@ -0,0 +1,406 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ShardedVault.cpp
+//
+// Copyright (c) 2011-2016 Ciphrex Corp.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+//
+
+#include "ShardedVault.h"
+
+#include <logger/logger.h>
+
+#include <boost/archive/text_oarchive.hpp>
+#include <boost/archive/text_iarchive.hpp>
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <exception>
+#include <fstream>
+#include <set>
+#include <sstream>
+
+using namespace CoinDB;
+
+ShardedVault::ShardedVault(const std::string& dbuser, const std::string& dbpasswd, const std::string& dbname, bool create, unsigned int shard_count, const std::string& network)
+{
+    open(dbuser, dbpasswd, dbname, create, shard_count, network);
+}
+
+ShardedVault::~ShardedVault()
+{
+    close();
+}
+
+void ShardedVault::open(const std::string& dbuser, const std::string& dbpasswd, const std::string& dbname, bool create, unsigned int shard_count, const std::string& network)
+{
+    LOGGER(trace) << "ShardedVault::open(" << dbuser << ", ..., " << dbname << ", " << (create ? "true" : "false") << ", " << shard_count << ", " << network << ")" << std::endl;
+
+    close();
+
+    boost::lock_guard<boost::mutex> lock(catalogmutex_);
+    name_ = dbname;
+    catalogpath_ = dbname + ".catalog";
+    catalog_ = Catalog();
+
+    bool catalogExists = boost::filesystem::exists(catalogpath_);
+    if (create)
+    {
+        if (catalogExists) throw VaultFailedToOpenDatabaseException(name_, "Shard catalog already exists.");
+        if (shard_count == 0) throw VaultFailedToOpenDatabaseException(name_, "Shard count must be at least one.");
+
+        for (unsigned int i = 0; i < shard_count; i++)
+        {
+            std::stringstream ss;
+            ss << dbname << "-shard" << i;
+            catalog_.shards.push_back(ss.str());
+        }
+    }
+    else
+    {
+        if (!catalogExists) throw VaultFailedToOpenDatabaseException(name_, "Shard catalog not found.");
+
+        try
+        {
+            std::ifstream ifs(catalogpath_);
+            boost::archive::text_iarchive ia(ifs);
+            ia >> catalog_;
+        }
+        catch (const std::exception& e)
+        {
+            throw VaultFailedToOpenDatabaseException(name_, e.what());
+        }
+        if (catalog_.shards.empty()) throw VaultFailedToOpenDatabaseException(name_, "Shard catalog is empty.");
+    }
+
+    try
+    {
+        for (auto& shardname: catalog_.shards)
+        {
+            std::unique_ptr<Vault> shard(new Vault(dbuser, dbpasswd, shardname, create, SCHEMA_VERSION, network));
+            shards_.push_back(std::move(shard));
+        }
+    }
+    catch (...)
+    {
+        shards_.clear();
+        throw;
+    }
+
+    workers_.reset(new CoinQ::WorkerPool(shards_.size() - 1));
+
+    if (create) { saveCatalog_unwrapped(); }
+}
+
+void ShardedVault::close()
+{
+    LOGGER(trace) << "ShardedVault::close()" << std::endl;
+
+    workers_.reset();
+    shards_.clear();
+}
+
+Vault* ShardedVault::getShard(unsigned int index) const
+{
+    if (index >= shards_.size()) throw std::runtime_error("ShardedVault::getShard(...) - index out of range.");
+    return shards_[index].get();
+}
+
+Vault* ShardedVault::getAccountShard(const std::string& account_name) const
+{
+    boost::lock_guard<boost::mutex> lock(catalogmutex_);
+    auto it = catalog_.accounts.find(account_name);
+    if (it == catalog_.accounts.end()) throw AccountNotFoundException(account_name);
+    return getShard(it->second);
+}
+
+void ShardedVault::forEachShard(std::function<void(Vault&)> fn) const
+{
+    if (shards_.size() == 1)
+    {
+        fn(*shards_[0]);
+        return;
+    }
+
+    std::vector<std::exception_ptr> errors(shards_.size());
+    workers_->run(shards_.size(), [&](std::size_t i)
+    {
+        try
+        {
+            fn(*shards_[i]);
+        }
+        catch (...)
+        {
+            errors[i] = std::current_exception();
+        }
+    });
+
+    for (auto& error: errors)
+    {
+        if (error) std::rethrow_exception(error);
+    }
+}
+
+
+/////////////////////////
+// KEYCHAIN OPERATIONS //
+/////////////////////////
+std::shared_ptr<Keychain> ShardedVault::newKeychain(const std::string& keychain_name, const secure_bytes_t& entropy, const secure_bytes_t& lockKey)
+{
+    LOGGER(trace) << "ShardedVault::newKeychain(" << keychain_name << ", ...)" << std::endl;
+
+    // Keychain generation is not deterministic across vaults, so create it once and copy it over.
+    std::shared_ptr<Keychain> keychain = getShard(0)->newKeychain(keychain_name, entropy, lockKey);
+    if (shards_.size() > 1) { replicateKeychain(keychain_name); }
+    return keychain;
+}
+
+std::shared_ptr<Keychain> ShardedVault::importKeychain(const std::string& filepath, bool& importprivkeys)
+{
+    LOGGER(trace) << "ShardedVault::importKeychain(" << filepath << ", " << (importprivkeys ? "true" : "false") << ")" << std::endl;
+
+    bool requestedprivkeys = importprivkeys;
+    std::shared_ptr<Keychain> keychain = getShard(0)->importKeychain(filepath, importprivkeys);
+    for (std::size_t i = 1; i < shards_.size(); i++)
+    {
+        bool shardprivkeys = requestedprivkeys;
+        shards_[i]->importKeychain(filepath, shardprivkeys);
+    }
+    return keychain;
+}
+
+void ShardedVault::lockAllKeychains()
+{
+    forEachShard([](Vault& shard) { shard.lockAllKeychains(); });
+}
+
+void ShardedVault::lockKeychain(const std::string& keychain_name)
+{
+    forEachShard([&](Vault& shard) { shard.lockKeychain(keychain_name); });
+}
+
+void ShardedVault::unlockKeychain(const std::string& keychain_name, const secure_bytes_t& unlock_key)
+{
+    forEachShard([&](Vault& shard) { shard.unlockKeychain(keychain_name, unlock_key); });
+}
+
+std::shared_ptr<Keychain> ShardedVault::replicateKeychain(const std::string& keychain_name)
+{
+    using namespace boost::filesystem;
+
+    path tmpfile = temp_directory_path() / unique_path("%%%%-%%%%-%%%%-%%%%.keychain");
+    Vault* source = getShard(0);
+    bool exportprivkeys = source->getKeychain(keychain_name)->isPrivate();
+
+    std::shared_ptr<Keychain> keychain;
+    try
+    {
+        source->exportKeychain(keychain_name, tmpfile.string(), exportprivkeys);
+        for (std::size_t i = 1; i < shards_.size(); i++)
+        {
+            bool importprivkeys = exportprivkeys;
+            keychain = shards_[i]->importKeychain(tmpfile.string(), importprivkeys);
+        }
+    }
+    catch (...)
+    {
+        remove(tmpfile);
+        throw;
+    }
+    remove(tmpfile);
+    return keychain;
+}
+
+
+////////////////////////
+// ACCOUNT OPERATIONS //
+////////////////////////
+bool ShardedVault::accountExists(const std::string& account_name) const
+{
+    boost::lock_guard<boost::mutex> lock(catalogmutex_);
+    return catalog_.accounts.count(account_name) > 0;
+}
+
+void ShardedVault::newAccount(const std::string& account_name, unsigned int minsigs, const std::vector<std::string>& keychain_names, uint32_t unused_pool_size, uint32_t time_created, bool compressed_keys, bool use_witness, bool use_witness_p2sh)
+{
+    LOGGER(trace) << "ShardedVault::newAccount(" << account_name << ", " << minsigs << " of [...], " << unused_pool_size << ", " << time_created << ")" << std::endl;
+
+    boost::lock_guard<boost::mutex> lock(catalogmutex_);
+    if (catalog_.accounts.count(account_name)) throw AccountAlreadyExistsException(account_name);
+
+    unsigned int index = getLeastLoadedShard_unwrapped();
+    getShard(index)->newAccount(account_name, minsigs, keychain_names, unused_pool_size, time_created, compressed_keys, use_witness, use_witness_p2sh);
+    catalog_.accounts[account_name] = index;
+    saveCatalog_unwrapped();
+}
+
+std::shared_ptr<Account> ShardedVault::importAccount(const std::string& filepath, unsigned int& privkeysimported)
+{
+    LOGGER(trace) << "ShardedVault::importAccount(" << filepath << ", " << privkeysimported << ")" << std::endl;
+
+    boost::lock_guard<boost::mutex> lock(catalogmutex_);
+    unsigned int index = getLeastLoadedShard_unwrapped();
+    Vault* shard = getShard(index);
+    std::shared_ptr<Account> account = shard->importAccount(filepath, privkeysimported);
+
+    // The shard only avoids names it holds itself. Resolve conflicts with other shards the same way.
+    std::string account_name = account->name();
+    unsigned int append_num = 1;
+    while (catalog_.accounts.count(account_name))
+    {
+        std::stringstream ss;
+        ss << account->name() << "_" << append_num++;
+        account_name = ss.str();
+    }
+    if (account_name != account->name())
+    {
+        shard->renameAccount(account->name(), account_name);
+        account->name(account_name);
+    }
+
+    catalog_.accounts[account_name] = index;
+    saveCatalog_unwrapped();
+    return account;
+}
+
+void ShardedVault::renameAccount(const std::string& old_name, const std::string& new_name)
+{
+    LOGGER(trace) << "ShardedVault::renameAccount(" << old_name << ", " << new_name << ")" << std::endl;
+
+    boost::lock_guard<boost::mutex> lock(catalogmutex_);
+    auto it = catalog_.accounts.find(old_name);
+    if (it == catalog_.accounts.end()) throw AccountNotFoundException(old_name);
+    if (catalog_.accounts.count(new_name)) throw AccountAlreadyExistsException(new_name);
+
+    unsigned int index = it->second;
+    getShard(index)->renameAccount(old_name, new_name);
+    catalog_.accounts.erase(it);
+    catalog_.accounts[new_name] = index;
+    saveCatalog_unwrapped();
+}
+
+AccountInfo ShardedVault::getAccountInfo(const std::string& account_name) const
+{
+    return getAccountShard(account_name)->getAccountInfo(account_name);
+}
+
+std::vector<AccountInfo> ShardedVault::getAllAccountInfo() const
+{
+    std::vector<AccountInfo> accountInfoVector;
+    for (auto& shard: shards_)
+    {
+        std::vector<AccountInfo> shardInfo = shard->getAllAccountInfo();
+        accountInfoVector.insert(accountInfoVector.end(), shardInfo.begin(), shardInfo.end());
+    }
+    std::sort(accountInfoVector.begin(), accountInfoVector.end(), [](const AccountInfo& a, const AccountInfo& b) { return a.name() < b.name(); });
+    return accountInfoVector;
+}
+
+
+///////////////////
+// TX OPERATIONS //
+///////////////////
+std::shared_ptr<Tx> ShardedVault::getTx(const bytes_t& hash) const
+{
+    for (auto& shard: shards_)
+    {
+        try
+        {
+            return shard->getTx(hash);
+        }
+        catch (const TxNotFoundException&)
+        {
+        }
+    }
+    throw TxNotFoundException(hash);
+}
+
+std::vector<TxView> ShardedVault::getTxViews(int tx_status_flags, unsigned long start, int count, uint32_t minheight) const
+{
+    // Every shard has to contribute its first start + count rows for the merged window to be right.
+    int shardcount = count < 0 ? -1 : (int)(start + count);
+
+    std::vector<std::vector<TxView>> shardViews(shards_.size());
+    std::size_t i = 0;
+    for (auto& shard: shards_) { shardViews[i++] = shard->getTxViews(tx_status_flags, 0, shardcount, minheight); }
+
+    std::vector<TxView> merged;
+    for (auto& views: shardViews) { merged.insert(merged.end(), views.begin(), views.end()); }
+    std::stable_sort(merged.begin(), merged.end(), [](const TxView& a, const TxView& b)
+    {
+        if (a.height != b.height) return a.height > b.height;
+        return a.timestamp > b.timestamp;
+    });
+
+    std::vector<TxView> txViews;
+    std::set<bytes_t> seen;
+    unsigned long skipped = 0;
+    for (auto& view: merged)
+    {
+        if (!seen.insert(view.unsigned_hash).second) continue;
+        if (skipped < start) { skipped++; continue; }
+        if (count >= 0 && txViews.size() >= (std::size_t)count) break;
+        txViews.push_back(view);
+    }
+    return txViews;
+}
+
+std::vector<TxOutView> ShardedVault::getTxOutViews(const std::string& account_name, const std::string& bin_name, int role_flags, int txout_status_flags, int tx_status_flags, bool hide_change) const
+{
+    if (!account_name.empty())
+        return getAccountShard(account_name)->getTxOutViews(account_name, bin_name, role_flags, txout_status_flags, tx_status_flags, hide_change);
+
+    std::vector<TxOutView> txOutViews;
+    for (auto& shard: shards_)
+    {
+        std::vector<TxOutView> views = shard->getTxOutViews(account_name, bin_name, role_flags, txout_status_flags, tx_status_flags, hide_change);
+        txOutViews.insert(txOutViews.end(), views.begin(), views.end());
+    }
+    return txOutViews;
+}
+
+std::shared_ptr<Tx> ShardedVault::insertTx(std::shared_ptr<Tx> tx, bool replace_labels)
+{
+    LOGGER(trace) << "ShardedVault::insertTx(" << uchar_vector(tx->hash()).getHex() << ", " << (replace_labels ? "true" : "false") << ")" << std::endl;
+
+    // Each shard attaches its own database objects to the transaction, so give each one a copy.
+    std::string serialized = tx->toSerialized();
+    std::vector<std::shared_ptr<Tx>> results(shards_.size());
+    forEachShard([&](Vault& shard)
+    {
+        std::shared_ptr<Tx> shardtx(new Tx());
+        shardtx->fromSerialized(serialized);
+
+        std::size_t index = 0;
+        while (shards_[index].get() != &shard) { index++; }
+        results[index] = shard.insertTx(shardtx, replace_labels);
+    });
+
+    for (auto& result: results) { if (result) return result; }
+    return nullptr;
+}
+
+
+/////////////////////
+// PRIVATE METHODS //
+/////////////////////
+void ShardedVault::saveCatalog_unwrapped() const
+{
+    // Write to a temporary file first so a crash never leaves a truncated catalog behind.
+    std::string tmppath = catalogpath_ + ".tmp";
+    {
+        std::ofstream ofs(tmppath, std::ios::trunc);
+        boost::archive::text_oarchive oa(ofs);
+        oa << catalog_;
+    }
+    boost::filesystem::rename(tmppath, catalogpath_);
+}
+
+unsigned int ShardedVault::getLeastLoadedShard_unwrapped() const
+{
+    std::vector<unsigned int> loads(shards_.size(), 0);
+    for (auto& account: catalog_.accounts) { if (account.second < loads.size()) loads[account.second]++; }
+    return std::min_element(loads.begin(), loads.end()) - loads.begin();
+}
@@ -0,0 +1,116 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ShardedVault.h
+//
+// Copyright (c) 2011-2016 Ciphrex Corp.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+//
+
+#pragma once
+
+#include "Vault.h"
+
+#include <CoinQ/CoinQ_workerpool.h>
+
+#include <boost/serialization/map.hpp>
+
+#include <functional>
+#include <map>
+#include <memory>
+
+namespace CoinDB
+{
+
+// Spreads accounts across several vault databases so that independent accounts do not share
+// tables or a writer lock. Each shard is an ordinary Vault named <dbname>-shard<N>, and a small
+// catalog file (<dbname>.catalog) records which shard holds each account.
+//
+// Keychains are replicated to every shard so any shard can host an account that uses them.
+// Account-scoped work should go straight to getAccountShard(). Calls on different shards run
+// and commit in parallel. To keep shards synched, register each one with a MultiVaultSync.
+class ShardedVault
+{
+public:
+    enum { DEFAULT_SHARD_COUNT = 4 };
+
+    ShardedVault() { }
+    ShardedVault(const std::string& dbuser, const std::string& dbpasswd, const std::string& dbname, bool create = false, unsigned int shard_count = DEFAULT_SHARD_COUNT, const std::string& network = "");
+    ~ShardedVault();
+
+    ///////////////////////
+    // GLOBAL OPERATIONS //
+    ///////////////////////
+    // shard_count is only used when creating. An existing catalog keeps its shards.
+    void                                    open(const std::string& dbuser, const std::string& dbpasswd, const std::string& dbname, bool create = false, unsigned int shard_count = DEFAULT_SHARD_COUNT, const std::string& network = "");
+    void                                    close();
+    bool                                    isOpen() const { return !shards_.empty(); }
+
+    const std::string&                      getName() const { return name_; }
+    unsigned int                            getShardCount() const { return shards_.size(); }
+    Vault*                                  getShard(unsigned int index) const;
+    Vault*                                  getAccountShard(const std::string& account_name) const; // Throws AccountNotFoundException.
+
+    // Runs fn on every shard in parallel on threads kept while the vault is open, and rethrows the
+    // first exception thrown.
+    void                                    forEachShard(std::function<void(Vault&)> fn) const;
+
+    /////////////////////////
+    // KEYCHAIN OPERATIONS //
+    /////////////////////////
+    std::shared_ptr<Keychain>               newKeychain(const std::string& keychain_name, const secure_bytes_t& entropy, const secure_bytes_t& lockKey = secure_bytes_t());
+    std::shared_ptr<Keychain>               importKeychain(const std::string& filepath, bool& importprivkeys);
+    void                                    lockAllKeychains();
+    void                                    lockKeychain(const std::string& keychain_name);
+    void                                    unlockKeychain(const std::string& keychain_name, const secure_bytes_t& unlock_key = secure_bytes_t());
+
+    ////////////////////////
+    // ACCOUNT OPERATIONS //
+    ////////////////////////
+    // New accounts go to the shard holding the fewest accounts.
+    bool                                    accountExists(const std::string& account_name) const;
+    void                                    newAccount(const std::string& account_name, unsigned int minsigs, const std::vector<std::string>& keychain_names, uint32_t unused_pool_size = DEFAULT_UNUSED_POOL_SIZE, uint32_t time_created = time(NULL), bool compressed_keys = true, bool use_witness = false, bool use_witness_p2sh = false);
+    std::shared_ptr<Account>                importAccount(const std::string& filepath, unsigned int& privkeysimported);
+    void                                    renameAccount(const std::string& old_name, const std::string& new_name);
+    AccountInfo                             getAccountInfo(const std::string& account_name) const;
+    std::vector<AccountInfo>                getAllAccountInfo() const;
+
+    ///////////////////
+    // TX OPERATIONS //
+    ///////////////////
+    // A transaction involving accounts on several shards is stored in each of them. Cross-shard
+    // views list it once.
+    std::shared_ptr<Tx>                     getTx(const bytes_t& hash) const; // Tries both signed and unsigned hashes. Throws TxNotFoundException.
+    std::vector<TxView>                     getTxViews(int tx_status_flags = Tx::ALL, unsigned long start = 0, int count = -1, uint32_t minheight = 0) const;
+    std::vector<TxOutView>                  getTxOutViews(const std::string& account_name = "", const std::string& bin_name = "", int role_flags = TxOut::ROLE_BOTH, int txout_status_flags = TxOut::BOTH, int tx_status_flags = Tx::ALL, bool hide_change = true) const;
+    std::shared_ptr<Tx>                     insertTx(std::shared_ptr<Tx> tx, bool replace_labels = false); // Returns the first shard's stored transaction if any shard changed.
+
+private:
+    struct Catalog
+    {
+        std::vector<std::string>                shards;
+        std::map<std::string, unsigned int>     accounts;
+
+        template<class Archive>
+        void serialize(Archive& ar, const unsigned int /*version*/)
+        {
+            ar & shards;
+            ar & accounts;
+        }
+    };
+
+    std::string                             name_;
+    std::string                             catalogpath_;
+    std::vector<std::unique_ptr<Vault>>     shards_;
+    std::unique_ptr<CoinQ::WorkerPool>      workers_;   // one thread fewer than shards, the caller runs the first
+
+    mutable boost::mutex                    catalogmutex_;
+    Catalog                                 catalog_;
+
+    void                                    saveCatalog_unwrapped() const;
+    unsigned int                            getLeastLoadedShard_unwrapped() const;
+    std::shared_ptr<Keychain>               replicateKeychain(const std::string& keychain_name);
+};
+
+}
@@ -402,6 +402,14 @@ void SynchedVault::startSync(const std::string& host, int port)
     startSync(host, ss.str());
 }
 
+void SynchedVault::startReplay(const std::string& filepath, bool bRealtime)
+{
+    LOGGER(trace) << "SynchedVault::startReplay(" << filepath << ", " << (bRealtime ? "true" : "false") << ")" << std::endl;
+    m_bInsertMerkleBlocks = false;
+    updateStatus(STARTING);
+    m_networkSync.startReplay(filepath, bRealtime);
+}
+
 void SynchedVault::stopSync()
 {
     LOGGER(trace) << "SynchedVault::stopSync()" << std::endl;
@@ -464,7 +472,7 @@ void SynchedVault::updateBloomFilter()
 
 // This function recursively tries to send dependencies.
 // TODO: We might want to make recursive sending optional and allowing an exception to be thrown instead if any dependency is still unpropagated.
-void recursiveSendTx(Vault& vault, CoinQ::Network::NetworkSync& networkSync, std::shared_ptr<Tx>& tx)
+void CoinDB::recursiveSendTx(Vault& vault, CoinQ::Network::NetworkSync& networkSync, std::shared_ptr<Tx>& tx)
 {
     if (tx->status() == Tx::UNSIGNED)
         throw std::runtime_error("Transaction is missing signatures.");
@@ -41,6 +41,8 @@ public:
 
     const CoinQ::CoinParams& getCoinParams() const { return m_networkSync.getCoinParams(); }
 
+    // Set before loadHeaders() to start from a header snapshot when there is no block tree file yet.
+    void setHeaderSnapshotFile(const std::string& snapshotFile) { m_networkSync.setHeaderSnapshotFile(snapshotFile); }
     void loadHeaders(const std::string& blockTreeFile, bool bCheckProofOfWork = false, CoinQBlockTreeMem::callback_t callback = nullptr);
     bool areHeadersLoaded() const { return m_bBlockTreeLoaded; }
 
@@ -53,6 +55,10 @@ public:
     void startSync(const std::string& host, const std::string& port);
     void startSync(const std::string& host, int port);
     void stopSync();
+
+    // Capture and replay of the peer's messages. See CoinQ::Network::NetworkSync.
+    void setCaptureFile(const std::string& filepath) { m_networkSync.setCaptureFile(filepath); }
+    void startReplay(const std::string& filepath, bool bRealtime = false);
     bool isConnected() const { return m_networkSync.connected(); }
     void suspendBlockUpdates();
     void syncBlocks();
@@ -60,6 +66,11 @@ public:
     void setFilterParams(double falsePositiveRate, uint32_t nTweak, uint8_t nFlags);
     void updateBloomFilter();
 
+    // Network statistics. See CoinQ::Network::NetworkSync.
+    CoinQ::PeerStats getPeerStats() const { return m_networkSync.getPeerStats(); }
+    CoinQ::Network::NetworkSync::BloomFilterStats getBloomFilterStats() const { return m_networkSync.getBloomFilterStats(); }
+    CoinQ::Network::MempoolTracker::Stats getMempoolStats() const { return m_networkSync.getMempoolStats(); }
+
     status_t getStatus() const { return m_status; }
     uint32_t getBestHeight() const { return m_bestHeight; }
     const bytes_t& getBestHash() const { return m_bestHash; }
@@ -178,4 +189,7 @@ private:
     std::lock_guard<std::mutex> m_lock;
 };
 
+// Sends tx along with any of its dependencies in the vault that have not confirmed yet.
+void recursiveSendTx(Vault& vault, CoinQ::Network::NetworkSync& networkSync, std::shared_ptr<Tx>& tx);
+
 }
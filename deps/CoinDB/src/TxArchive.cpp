@@ -0,0 +1,195 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// TxArchive.cpp
+//
+// Copyright (c) 2011-2016 Ciphrex Corp.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+//
+
+#include "TxArchive.h"
+
+#include <boost/filesystem.hpp>
+
+#include <stdexcept>
+
+using namespace CoinDB;
+
+namespace
+{
+    const char MAGIC[] = { 'C', 'D', 'B', 'T', 'X', 'A', '0', '1' };
+    const std::size_t MAGIC_SIZE = sizeof(MAGIC);
+
+    const std::size_t HASH_SIZE = 32;
+
+    // hash, unsigned hash, block hash, height, timestamp, flags, txin total, raw size
+    const std::size_t HEADER_SIZE = 3 * HASH_SIZE + 4 + 4 + 1 + 8 + 4;
+
+    void putUint(unsigned char* p, uint64_t value, std::size_t size)
+    {
+        for (std::size_t i = 0; i < size; i++) { p[i] = (value >> (8 * i)) & 0xff; }
+    }
+
+    uint64_t getUint(const unsigned char* p, std::size_t size)
+    {
+        uint64_t value = 0;
+        for (std::size_t i = 0; i < size; i++) { value |= (uint64_t)p[i] << (8 * i); }
+        return value;
+    }
+
+    // Decodes everything but the raw transaction. Returns the raw size.
+    uint32_t decodeHeader(const unsigned char* p, TxArchive::Record& record)
+    {
+        record.hash.assign(p, p + HASH_SIZE);                       p += HASH_SIZE;
+        record.unsigned_hash.assign(p, p + HASH_SIZE);              p += HASH_SIZE;
+        record.blockhash.assign(p, p + HASH_SIZE);                  p += HASH_SIZE;
+        record.height = getUint(p, 4);                              p += 4;
+        record.timestamp = getUint(p, 4);                           p += 4;
+        record.have_all_outpoints = (*p & 0x01);                    p += 1;
+        record.txin_total = getUint(p, 8);                          p += 8;
+        return getUint(p, 4);
+    }
+}
+
+TxArchive::TxArchive(const std::string& filepath) :
+    filepath_(filepath),
+    count_(0)
+{
+    if (!boost::filesystem::exists(filepath_))
+    {
+        std::ofstream ofs(filepath_, std::ios::binary);
+        ofs.write(MAGIC, MAGIC_SIZE);
+        if (!ofs) throw std::runtime_error("TxArchive - failed to create file.");
+    }
+
+    file_.open(filepath_, std::ios::in | std::ios::out | std::ios::binary);
+    if (!file_) throw std::runtime_error("TxArchive - failed to open file.");
+
+    char magic[MAGIC_SIZE];
+    if (!file_.read(magic, MAGIC_SIZE) || !std::equal(magic, magic + MAGIC_SIZE, MAGIC))
+        throw std::runtime_error("TxArchive - not a transaction archive.");
+
+    uint64_t filesize = boost::filesystem::file_size(filepath_);
+    uint64_t offset = MAGIC_SIZE;
+    unsigned char header[4 + HEADER_SIZE];
+    while (offset + sizeof(header) <= filesize)
+    {
+        file_.seekg(offset);
+        if (!file_.read((char*)header, sizeof(header))) break;
+
+        Record record;
+        uint32_t length = getUint(header, 4);
+        uint32_t rawsize = decodeHeader(header + 4, record);
+        if (length != HEADER_SIZE + rawsize) throw std::runtime_error("TxArchive - corrupt record.");
+        if (offset + 4 + length > filesize) break;
+
+        index(record, offset);
+        offset += 4 + length;
+    }
+
+    // Anything past the last complete record is left over from an interrupted append.
+    file_.clear();
+    if (offset < filesize)
+    {
+        file_.close();
+        boost::filesystem::resize_file(filepath_, offset);
+        file_.open(filepath_, std::ios::in | std::ios::out | std::ios::binary);
+        if (!file_) throw std::runtime_error("TxArchive - failed to reopen file.");
+    }
+}
+
+std::size_t TxArchive::size() const
+{
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    return count_;
+}
+
+bool TxArchive::contains(const bytes_t& hash) const
+{
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    return hashindex_.count(hash) > 0;
+}
+
+bool TxArchive::get(const bytes_t& hash, Record& record) const
+{
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    auto it = hashindex_.find(hash);
+    if (it == hashindex_.end()) return false;
+
+    record = read_unwrapped(it->second);
+    return true;
+}
+
+std::vector<TxArchive::Record> TxArchive::getByHeight(uint32_t minheight, uint32_t maxheight) const
+{
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    std::vector<Record> records;
+    auto end = heightindex_.upper_bound(maxheight);
+    for (auto it = heightindex_.lower_bound(minheight); it != end; ++it)
+    {
+        records.push_back(read_unwrapped(it->second));
+    }
+    return records;
+}
+
+void TxArchive::append(const Record& record)
+{
+    if (record.hash.size() != HASH_SIZE || record.unsigned_hash.size() != HASH_SIZE || record.blockhash.size() != HASH_SIZE)
+        throw std::runtime_error("TxArchive::append - invalid hash size.");
+
+    std::vector<unsigned char> data(4 + HEADER_SIZE + record.raw.size());
+    unsigned char* p = &data[0];
+    putUint(p, HEADER_SIZE + record.raw.size(), 4);                 p += 4;
+    std::copy(record.hash.begin(), record.hash.end(), p);           p += HASH_SIZE;
+    std::copy(record.unsigned_hash.begin(), record.unsigned_hash.end(), p); p += HASH_SIZE;
+    std::copy(record.blockhash.begin(), record.blockhash.end(), p); p += HASH_SIZE;
+    putUint(p, record.height, 4);                                   p += 4;
+    putUint(p, record.timestamp, 4);                                p += 4;
+    *p = record.have_all_outpoints ? 0x01 : 0x00;                   p += 1;
+    putUint(p, record.txin_total, 8);                               p += 8;
+    putUint(p, record.raw.size(), 4);                               p += 4;
+    std::copy(record.raw.begin(), record.raw.end(), p);
+
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    file_.seekp(0, std::ios::end);
+    uint64_t offset = file_.tellp();
+    file_.write((const char*)&data[0], data.size());
+    file_.flush();
+    if (!file_)
+    {
+        file_.clear();
+        throw std::runtime_error("TxArchive::append - write failed.");
+    }
+
+    index(record, offset);
+}
+
+void TxArchive::index(const Record& record, uint64_t offset)
+{
+    hashindex_[record.hash] = offset;
+    hashindex_[record.unsigned_hash] = offset;
+    heightindex_.insert(std::make_pair(record.height, offset));
+    count_++;
+}
+
+TxArchive::Record TxArchive::read_unwrapped(uint64_t offset) const
+{
+    unsigned char header[4 + HEADER_SIZE];
+    file_.seekg(offset);
+    if (!file_.read((char*)header, sizeof(header)))
+    {
+        file_.clear();
+        throw std::runtime_error("TxArchive - read failed.");
+    }
+
+    Record record;
+    uint32_t rawsize = decodeHeader(header + 4, record);
+    record.raw.resize(rawsize);
+    if (rawsize && !file_.read((char*)&record.raw[0], rawsize))
+    {
+        file_.clear();
+        throw std::runtime_error("TxArchive - read failed.");
+    }
+    return record;
+}
@@ -0,0 +1,74 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// TxArchive.h
+//
+// Copyright (c) 2011-2016 Ciphrex Corp.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+//
+
+#pragma once
+
+#include <CoinQ/CoinQ_typedefs.h>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/lock_guard.hpp>
+
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace CoinDB
+{
+
+// Append-only file of binary transaction records for history moved out of the vault tables.
+// Records are never rewritten. Hash and height indices are built in memory when the file is opened,
+// by reading only the fixed-size record headers.
+class TxArchive
+{
+public:
+    struct Record
+    {
+        Record() : height(0), timestamp(0), have_all_outpoints(false), txin_total(0) { }
+
+        bytes_t hash;
+        bytes_t unsigned_hash;
+        bytes_t blockhash;
+        uint32_t height;
+        uint32_t timestamp;
+        bool have_all_outpoints;
+        uint64_t txin_total;
+        bytes_t raw;
+    };
+
+    // Creates the file if it does not exist. A partial record left at the end by an interrupted
+    // append is truncated. Throws std::runtime_error if the file is not a transaction archive.
+    explicit TxArchive(const std::string& filepath);
+
+    const std::string& filepath() const { return filepath_; }
+    std::size_t size() const;
+
+    // Both signed and unsigned hashes are indexed.
+    bool contains(const bytes_t& hash) const;
+    bool get(const bytes_t& hash, Record& record) const;
+    std::vector<Record> getByHeight(uint32_t minheight, uint32_t maxheight) const;
+
+    // Record is flushed to disk before returning.
+    void append(const Record& record);
+
+private:
+    std::string filepath_;
+    mutable std::fstream file_;
+    mutable boost::mutex mutex_;
+
+    std::map<bytes_t, uint64_t> hashindex_;
+    std::multimap<uint32_t, uint64_t> heightindex_;
+    std::size_t count_;
+
+    void index(const Record& record, uint64_t offset);
+    Record read_unwrapped(uint64_t offset) const;
+};
+
+}
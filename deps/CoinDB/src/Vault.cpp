@@ -27,6 +27,8 @@
 
 #include <odb/transaction.hxx>
 #include <odb/session.hxx>
+#include <odb/connection.hxx>
+#include <odb/prepared-query.hxx>
 
 #include <CoinCore/hash.h>
 #include <CoinCore/aes.h>
@@ -44,6 +46,35 @@
 
 using namespace CoinDB;
 
+/*
+ * prepared queries
+ *
+ * Hot lookups are prepared once per database connection and cached on it. Each cached query binds
+ * its parameters by reference to a params object owned by the connection, so callers just fill in
+ * the params and execute. Must be called inside a transaction.
+*/
+namespace
+{
+    struct HashQueryParams { bytes_t hash; };
+    struct HeightQueryParams { uint32_t height; };
+    struct NoQueryParams { };
+
+    template<typename T, typename P, typename F>
+    odb::prepared_query<T> getPreparedQuery(const char* name, P*& params, F buildQuery)
+    {
+        odb::connection& c(odb::transaction::current().connection());
+        odb::prepared_query<T> pq(c.lookup_query<T>(name, params));
+        if (!pq)
+        {
+            std::unique_ptr<P> p(new P());
+            params = p.get();
+            pq = c.prepare_query<T>(name, buildQuery(*p));
+            c.cache_query(pq, std::move(p));
+        }
+        return pq;
+    }
+}
+
 /*
  * data migration
 */
@@ -150,14 +181,16 @@ Vault::split_name_t Vault::getSplitObjectName(const std::string& name)
 void Vault::open(int argc, char** argv, bool create, uint32_t version, const std::string& network, bool migrate)
 {
     LOGGER(trace) << "Vault::open(..., " << (create ? "true" : "false") << ", " << version << ", " << network << ", " << (migrate ? "true" : "false") << ")" << std::endl;
+    VaultProfiler::Call profilerCall("open");
 
     if (argc >= 2) name_ = argv[1];
 
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 
     try
     {
         db_ = open_database(argc, argv, create);
+        db_->tracer(VaultProfiler::tracer());
     }
     catch (const std::exception& e)
     {
@@ -234,19 +267,23 @@ void Vault::open(int argc, char** argv, bool create, uint32_t version, const std
             }
         }
     }
+
+    openDefaultTxArchive_unwrapped();
 }
 
 void Vault::open(const std::string& dbuser, const std::string& dbpasswd, const std::string& dbname, bool create, uint32_t version, const std::string& network, bool migrate)
 {
     LOGGER(trace) << "Vault::open(" << dbuser << ", ..., " << dbname << ", " << (create ? "true" : "false") << ", " << version << ", " << network << ", " << (migrate ? "true" : "false") << ")" << std::endl;
+    VaultProfiler::Call profilerCall("open");
 
     name_ = dbname;
 
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 
     try
     {
         db_ = openDatabase(dbuser, dbpasswd, dbname, create);
+        db_->tracer(VaultProfiler::tracer());
     }
     catch (const std::exception& e)
     {
@@ -323,23 +360,29 @@ void Vault::open(const std::string& dbuser, const std::string& dbpasswd, const s
             }
         }
     }
+
+    openDefaultTxArchive_unwrapped();
 }
 
 void Vault::close()
 {
     LOGGER(trace) << "Vault::close()" << std::endl;
+    VaultProfiler::Call profilerCall("close");
 
     if (!db_) return;
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
+    txArchive_.reset();
+    blockHeaderCache_.invalidate();
     db_.reset();
 }
 
 uint32_t Vault::getSchemaVersion() const
 {
     LOGGER(trace) << "Vault::getSchemaVersion()" << std::endl;
+    VaultProfiler::Call profilerCall("getSchemaVersion");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::transaction t(db_->begin());
     return getSchemaVersion_unwrapped();
@@ -354,8 +397,9 @@ uint32_t Vault::getSchemaVersion_unwrapped() const
 void Vault::setSchemaVersion(uint32_t version)
 {
     LOGGER(trace) << "Vault::setSchemaVersion(" << version << ")" << std::endl;
+    VaultProfiler::Call profilerCall("setSchemaVersion");
 
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
     odb::core::transaction t(db_->begin());
     setSchemaVersion_unwrapped(version);
     t.commit();
@@ -380,9 +424,10 @@ void Vault::setSchemaVersion_unwrapped(uint32_t version)
 std::string Vault::getNetwork() const
 {
     LOGGER(trace) << "Vault::getNetwork()" << std::endl;
+    VaultProfiler::Call profilerCall("getNetwork");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::transaction t(db_->begin());
     return getNetwork_unwrapped();
@@ -397,8 +442,9 @@ std::string Vault::getNetwork_unwrapped() const
 void Vault::setNetwork(const std::string& network)
 {
     LOGGER(trace) << "Vault::setNetwork(" << network << ")" << std::endl;
+    VaultProfiler::Call profilerCall("setNetwork");
 
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
     odb::core::transaction t(db_->begin());
     setNetwork_unwrapped(network);
     t.commit();
@@ -426,9 +472,10 @@ void Vault::setNetwork_unwrapped(const std::string& network)
 uint32_t Vault::getHorizonTimestamp() const
 {
     LOGGER(trace) << "Vault::getHorizonTimestamp()" << std::endl;
+    VaultProfiler::Call profilerCall("getHorizonTimestamp");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::transaction t(db_->begin());
     return getHorizonTimestamp_unwrapped();
@@ -437,9 +484,10 @@ uint32_t Vault::getHorizonTimestamp() const
 uint32_t Vault::getMaxFirstBlockTimestamp() const
 {
     LOGGER(trace) << "Vault::getMaxFirstBlockTimestamp()" << std::endl;
+    VaultProfiler::Call profilerCall("getMaxFirstBlockTimestamp");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::transaction t(db_->begin());
     return getMaxFirstBlockTimestamp_unwrapped();
@@ -462,9 +510,10 @@ uint32_t Vault::getMaxFirstBlockTimestamp_unwrapped() const
 uint32_t Vault::getHorizonHeight() const
 {
     LOGGER(trace) << "Vault::getHorizonHeight()" << std::endl;
+    VaultProfiler::Call profilerCall("getHorizonHeight");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::transaction t(db_->begin());
     return getHorizonHeight_unwrapped();
@@ -479,9 +528,10 @@ uint32_t Vault::getHorizonHeight_unwrapped() const
 std::vector<bytes_t> Vault::getLocatorHashes() const
 {
     LOGGER(trace) << "Vault::getLocatorHashes()" << std::endl;
+    VaultProfiler::Call profilerCall("getLocatorHashes");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::transaction t(db_->begin());
     return getLocatorHashes_unwrapped();
@@ -515,16 +565,40 @@ std::vector<bytes_t> Vault::getLocatorHashes_unwrapped() const
 Coin::BloomFilter Vault::getBloomFilter(double falsePositiveRate, uint32_t nTweak, uint32_t nFlags) const
 {
     LOGGER(trace) << "Vault::getBloomFilter(" << falsePositiveRate << ", " << nTweak << ", " << nFlags << ")" << std::endl;
+    VaultProfiler::Call profilerCall("getBloomFilter");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::session s;
     odb::core::transaction t(db_->begin());
     return getBloomFilter_unwrapped(falsePositiveRate, nTweak, nFlags);
 }
 
+std::vector<bytes_t> Vault::getBloomFilterElements() const
+{
+    LOGGER(trace) << "Vault::getBloomFilterElements()" << std::endl;
+    VaultProfiler::Call profilerCall("getBloomFilterElements");
+
+#if defined(LOCK_ALL_CALLS)
+    VaultProfiler::Lock lock(mutex);
+#endif
+    odb::core::session s;
+    odb::core::transaction t(db_->begin());
+    return getBloomFilterElements_unwrapped();
+}
+
 Coin::BloomFilter Vault::getBloomFilter_unwrapped(double falsePositiveRate, uint32_t nTweak, uint32_t nFlags) const
+{
+    std::vector<bytes_t> elements = getBloomFilterElements_unwrapped();
+    if (elements.empty()) return Coin::BloomFilter();
+
+    Coin::BloomFilter filter(elements.size(), falsePositiveRate, nTweak, nFlags);
+    for (auto& element: elements) { filter.insert(element); }
+    return filter;
+}
+
+std::vector<bytes_t> Vault::getBloomFilterElements_unwrapped() const
 {
     using namespace CoinQ::Script;
 
@@ -580,19 +654,16 @@ Coin::BloomFilter Vault::getBloomFilter_unwrapped(double falsePositiveRate, uint
         }
     }
 
-    if (elements.empty()) return Coin::BloomFilter();
-
-    Coin::BloomFilter filter(elements.size(), falsePositiveRate, nTweak, nFlags);
-    for (auto& element: elements) { filter.insert(element); }
-    return filter;
+    return elements;
 }
 
 hashvector_t Vault::getIncompleteBlockHashes() const
 {
     LOGGER(trace) << "Vault::getIncompleteBlockHashes()" << std::endl;
+    VaultProfiler::Call profilerCall("getIncompleteBlockHashes");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::session s;
     odb::core::transaction t(db_->begin());
@@ -610,9 +681,10 @@ hashvector_t Vault::getIncompleteBlockHashes_unwrapped() const
 void Vault::exportVault(const std::string& filepath, bool exportprivkeys) const
 {
     LOGGER(trace) << "Vault::exportVault(" << filepath << ", " << (exportprivkeys ? "true" : "false") << std::endl;
+    VaultProfiler::Call profilerCall("exportVault");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     std::ofstream ofs(filepath);
     boost::archive::text_oarchive oa(ofs);
@@ -644,12 +716,14 @@ void Vault::exportVault(const std::string& filepath, bool exportprivkeys) const
 void Vault::importVault(const std::string& filepath, bool importprivkeys)
 {
     LOGGER(trace) << "Vault::importVault(" << filepath << ", " << (importprivkeys ? "true" : "false") << std::endl;
+    VaultProfiler::Call profilerCall("importVault");
 
     {
-        boost::lock_guard<boost::mutex> lock(mutex);
+        VaultProfiler::Lock lock(mutex);
         std::ifstream ifs(filepath);
         boost::archive::text_iarchive ia(ifs);
 
+        BlockHeaderCache::WriteGuard cacheGuard(blockHeaderCache_);
         odb::core::transaction t(db_->begin());
 
         uint32_t n;
@@ -674,6 +748,7 @@ void Vault::importVault(const std::string& filepath, bool importprivkeys)
             importTxs_unwrapped(ia); 
         }
         t.commit();
+        cacheGuard.commit();
     }
 
     signalQueue.flush();
@@ -686,8 +761,9 @@ void Vault::importVault(const std::string& filepath, bool importprivkeys)
 std::shared_ptr<Contact> Vault::newContact(const std::string& username)
 {
     LOGGER(trace) << "Vault::newContact(" << username << ")" << std::endl;
+    VaultProfiler::Call profilerCall("newContact");
 
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
     odb::core::transaction t(db_->begin());
     std::shared_ptr<Contact> contact = newContact_unwrapped(username);
     t.commit();
@@ -707,9 +783,10 @@ std::shared_ptr<Contact> Vault::newContact_unwrapped(const std::string& username
 std::shared_ptr<Contact> Vault::getContact(const std::string& username) const
 {
     LOGGER(trace) << "Vault::getContact(" << username << ")" << std::endl;
+    VaultProfiler::Call profilerCall("getContact");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::transaction t(db_->begin());
     return getContact_unwrapped(username);
@@ -729,9 +806,10 @@ std::shared_ptr<Contact> Vault::getContact_unwrapped(const std::string& username
 ContactVector Vault::getAllContacts() const
 {
     LOGGER(trace) << "Vault::getAllContacts()" << std::endl;
+    VaultProfiler::Call profilerCall("getAllContacts");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::transaction t(db_->begin());
     return getAllContacts_unwrapped();
@@ -750,9 +828,10 @@ ContactVector Vault::getAllContacts_unwrapped() const
 bool Vault::contactExists(const std::string& username) const
 {
     LOGGER(trace) << "Vault::contactExists(" << username << ")" << std::endl;
+    VaultProfiler::Call profilerCall("contactExists");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::transaction t(db_->begin());
     return contactExists_unwrapped(username);
@@ -769,8 +848,9 @@ bool Vault::contactExists_unwrapped(const std::string& username) const
 std::shared_ptr<Contact> Vault::renameContact(const std::string& old_username, const std::string& new_username)
 {
     LOGGER(trace) << "Vault::renameContact(" << old_username << ", " << new_username << ")" << std::endl;
+    VaultProfiler::Call profilerCall("renameContact");
 
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
     odb::core::transaction t(db_->begin());
     std::shared_ptr<Contact> contact = renameContact_unwrapped(old_username, new_username);
     t.commit();
@@ -799,9 +879,10 @@ std::shared_ptr<Contact> Vault::renameContact_unwrapped(const std::string& old_u
 void Vault::exportKeychain(const std::string& keychain_name, const std::string& filepath, bool exportprivkeys) const
 {
     LOGGER(trace) << "Vault::exportKeychain(" << keychain_name << ", " << filepath << ", " << (exportprivkeys ? "true" : "false") << std::endl;
+    VaultProfiler::Call profilerCall("exportKeychain");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::transaction t(db_->begin());
     std::shared_ptr<Keychain> keychain = getKeychain_unwrapped(keychain_name);
@@ -820,8 +901,9 @@ void Vault::exportKeychain_unwrapped(std::shared_ptr<Keychain> keychain, const s
 std::shared_ptr<Keychain> Vault::importKeychain(const std::string& filepath, bool& importprivkeys)
 {
     LOGGER(trace) << "Vault::importKeychain(" << filepath << ", " << (importprivkeys ? "true" : "false") << std::endl;
+    VaultProfiler::Call profilerCall("importKeychain");
 
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
     odb::core::session s;
     odb::core::transaction t(db_->begin());
     std::shared_ptr<Keychain> keychain = importKeychain_unwrapped(filepath, importprivkeys);
@@ -880,9 +962,10 @@ std::shared_ptr<Keychain> Vault::importKeychain_unwrapped(const std::string& fil
 bool Vault::keychainExists(const std::string& keychain_name) const
 {
     LOGGER(trace) << "Vault::keychainExists(" << keychain_name << ")" << std::endl;
+    VaultProfiler::Call profilerCall("keychainExists");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::transaction t(db_->begin());
     return keychainExists_unwrapped(keychain_name);
@@ -897,9 +980,10 @@ bool Vault::keychainExists_unwrapped(const std::string& keychain_name) const
 bool Vault::keychainExists(const bytes_t& keychain_hash) const
 {
     LOGGER(trace) << "Vault::keychainExists(@hash = " << uchar_vector(keychain_hash).getHex() << ")" << std::endl;
+    VaultProfiler::Call profilerCall("keychainExists");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::transaction t(db_->begin());
     return keychainExists_unwrapped(keychain_hash);
@@ -939,9 +1023,10 @@ std::string Vault::getNextAvailableKeychainName_unwrapped(const std::string& des
 bool Vault::isKeychainPrivate(const std::string& keychain_name) const
 {
     LOGGER(trace) << "Vault::isKeychainPrivate(" << keychain_name << ")" << std::endl;
+    VaultProfiler::Call profilerCall("isKeychainPrivate");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::transaction t(db_->begin());
     return isKeychainPrivate_unwrapped(keychain_name);
@@ -956,8 +1041,9 @@ bool Vault::isKeychainPrivate_unwrapped(const std::string& keychain_name) const
 std::shared_ptr<Keychain> Vault::newKeychain(const std::string& keychain_name, const secure_bytes_t& entropy, const secure_bytes_t& lock_key)
 {
     LOGGER(trace) << "Vault::newKeychain(" << keychain_name << ", ...)" << std::endl;
+    VaultProfiler::Call profilerCall("newKeychain");
 
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
     odb::core::session session;
     odb::core::transaction t(db_->begin());
     {
@@ -979,9 +1065,10 @@ std::shared_ptr<Keychain> Vault::newKeychain(const std::string& keychain_name, c
 void Vault::renameKeychain(const std::string& old_name, const std::string& new_name)
 {
     LOGGER(trace) << "Vault::renameKeychain(" << old_name << ", " << new_name << ")" << std::endl;
+    VaultProfiler::Call profilerCall("renameKeychain");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::session session;
     odb::core::transaction t(db_->begin());
@@ -1020,9 +1107,10 @@ void Vault::updateKeychain_unwrapped(std::shared_ptr<Keychain> keychain)
 std::vector<KeychainView> Vault::getRootKeychainViews(const std::string& account_name, bool get_hidden) const
 {
     LOGGER(trace) << "Vault::getRootKeychainViews(" << account_name << ", " << (get_hidden ? "true" : "false") << ")" << std::endl;
+    VaultProfiler::Call profilerCall("getRootKeychainViews");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::transaction t(db_->begin());
     return getRootKeychainViews_unwrapped(account_name, get_hidden);
@@ -1053,9 +1141,10 @@ std::vector<KeychainView> Vault::getRootKeychainViews_unwrapped(const std::strin
 secure_bytes_t Vault::exportBIP32(const std::string& keychain_name, bool export_private) const
 {
     LOGGER(trace) << "Vault::exportBIP32(" << keychain_name << ", " << (export_private ? "true" : "false") << ")" << std::endl;
+    VaultProfiler::Call profilerCall("exportBIP32");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::transaction t(db_->begin());
     std::shared_ptr<Keychain> keychain = getKeychain_unwrapped(keychain_name);
@@ -1072,8 +1161,9 @@ secure_bytes_t Vault::exportBIP32_unwrapped(std::shared_ptr<Keychain> keychain,
 std::shared_ptr<Keychain> Vault::importBIP32(const std::string& keychain_name, const secure_bytes_t& extkey, const secure_bytes_t& lock_key)
 {
     LOGGER(trace) << "Vault::importKeychainExtendedKey(" << keychain_name << ", ...)" << std::endl;
+    VaultProfiler::Call profilerCall("importBIP32");
 
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
     odb::core::session session;
     odb::core::transaction t(db_->begin());
     odb::result<Keychain> r(db_->query<Keychain>(odb::query<Keychain>::name == keychain_name));
@@ -1091,9 +1181,10 @@ std::shared_ptr<Keychain> Vault::importBIP32(const std::string& keychain_name, c
 secure_bytes_t Vault::exportBIP39(const std::string& keychain_name) const
 {
     LOGGER(trace) << "Vault::exportBIP39(" << keychain_name << ")" << std::endl;
+    VaultProfiler::Call profilerCall("exportBIP39");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::transaction t(db_->begin());
     std::shared_ptr<Keychain> keychain = getKeychain_unwrapped(keychain_name);
@@ -1104,8 +1195,9 @@ secure_bytes_t Vault::exportBIP39(const std::string& keychain_name) const
 void Vault::encryptKeychain(const std::string& keychain_name, const secure_bytes_t& lock_key)
 {
     LOGGER(trace) << "Vault::encryptKeychain(" << keychain_name << ", ...)" << std::endl;
+    VaultProfiler::Call profilerCall("encryptKeychain");
 
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
     odb::core::session s;
     odb::core::transaction t(db_->begin());
 
@@ -1119,8 +1211,9 @@ void Vault::encryptKeychain(const std::string& keychain_name, const secure_bytes
 void Vault::decryptKeychain(const std::string& keychain_name)
 {
     LOGGER(trace) << "Vault::unencryptKeychain(" << keychain_name << ")" << std::endl;
+    VaultProfiler::Call profilerCall("decryptKeychain");
 
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
     odb::core::session s;
     odb::core::transaction t(db_->begin());
 
@@ -1134,8 +1227,9 @@ void Vault::decryptKeychain(const std::string& keychain_name)
 void Vault::refillAccountPool(const std::string& account_name)
 {
     LOGGER(trace) << "Vault::refillAccountPool(" << account_name << ")" << std::endl;
+    VaultProfiler::Call profilerCall("refillAccountPool");
 
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
     odb::core::session s;
     odb::core::transaction t(db_->begin());
     std::shared_ptr<Account> account = getAccount_unwrapped(account_name);
@@ -1151,9 +1245,10 @@ void Vault::refillAccountPool_unwrapped(std::shared_ptr<Account> account)
 std::shared_ptr<Keychain> Vault::getKeychain(const std::string& keychain_name) const
 {
     LOGGER(trace) << "Vault::getKeychain(" << keychain_name << ")" << std::endl;
+    VaultProfiler::Call profilerCall("getKeychain");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::transaction t(db_->begin());
     return getKeychain_unwrapped(keychain_name);
@@ -1171,9 +1266,10 @@ std::shared_ptr<Keychain> Vault::getKeychain_unwrapped(const std::string& keycha
 std::vector<std::shared_ptr<Keychain>> Vault::getAllKeychains(bool root_only, bool get_hidden) const
 {
     LOGGER(trace) << "Vault::getAllKeychains()" << std::endl;
+    VaultProfiler::Call profilerCall("getAllKeychains");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::transaction t(db_->begin());
     odb::query<Keychain> query(1 == 1);
@@ -1191,8 +1287,9 @@ std::vector<std::shared_ptr<Keychain>> Vault::getAllKeychains(bool root_only, bo
 void Vault::lockAllKeychains()
 {
     LOGGER(trace) << "Vault::lockAllKeychains()" << std::endl;
+    VaultProfiler::Call profilerCall("lockAllKeychains");
 
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
     mapPrivateKeyUnlock.clear();
     for (auto& item: mapPrivateKeyUnlock)
     {
@@ -1203,8 +1300,9 @@ void Vault::lockAllKeychains()
 void Vault::lockKeychain(const std::string& keychain_name)
 {
     LOGGER(trace) << "Vault::lockKeychain(" << keychain_name << ")" << std::endl;
+    VaultProfiler::Call profilerCall("lockKeychain");
 
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
     mapPrivateKeyUnlock.erase(keychain_name);
     notifyKeychainLocked(keychain_name);
 }
@@ -1212,8 +1310,9 @@ void Vault::lockKeychain(const std::string& keychain_name)
 void Vault::unlockKeychain(const std::string& keychain_name, const secure_bytes_t& lock_key)
 {
     LOGGER(trace) << "Vault::unlockKeychain(" << keychain_name << ", ?)" << std::endl;
+    VaultProfiler::Call profilerCall("unlockKeychain");
 
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
     odb::core::session s;
     odb::core::transaction t(db_->begin());
 
@@ -1297,8 +1396,9 @@ bool Vault::isKeychainLocked(const std::string& keychainName) const
 bool Vault::isKeychainEncrypted(const std::string& keychain_name) const
 {
     LOGGER(trace) << "Vault::isKeychainEncrypted(" << keychain_name << ")" << std::endl;
+    VaultProfiler::Call profilerCall("isKeychainEncrypted");
 
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
     odb::core::session s;
     odb::core::transaction t(db_->begin());
 
@@ -1312,9 +1412,10 @@ bool Vault::isKeychainEncrypted(const std::string& keychain_name) const
 void Vault::exportAccount(const std::string& account_name, const std::string& filepath, bool exportprivkeys) const
 {
     LOGGER(trace) << "Vault::exportAccount(" << account_name << ", " << filepath << ", " << (exportprivkeys ? "true" : "false") << ", ?)" << std::endl;
+    VaultProfiler::Call profilerCall("exportAccount");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
 
     // TODO: disallow operation if file is already open
@@ -1339,17 +1440,20 @@ void Vault::exportAccount_unwrapped(Account& account, boost::archive::text_oarch
 std::shared_ptr<Account> Vault::importAccount(const std::string& filepath, unsigned int& privkeysimported)
 {
     LOGGER(trace) << "Vault::importAccount(" << filepath << ", " << privkeysimported << ")" << std::endl;
+    VaultProfiler::Call profilerCall("importAccount");
 
     std::ifstream ifs(filepath);
     boost::archive::text_iarchive ia(ifs);
 
     std::shared_ptr<Account> account;
     {
-        boost::lock_guard<boost::mutex> lock(mutex);
+        VaultProfiler::Lock lock(mutex);
+        BlockHeaderCache::WriteGuard cacheGuard(blockHeaderCache_);
         odb::core::session s;
         odb::core::transaction t(db_->begin());
         account = importAccount_unwrapped(ia, privkeysimported);
         t.commit();
+        cacheGuard.commit();
     }
 
     signalQueue.flush();
@@ -1463,9 +1567,10 @@ std::shared_ptr<Account> Vault::importAccount_unwrapped(boost::archive::text_iar
 bool Vault::accountExists(const std::string& account_name) const
 {
     LOGGER(trace) << "Vault::accountExists(" << account_name << ")" << std::endl;
+    VaultProfiler::Call profilerCall("accountExists");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::transaction t(db_->begin());
     return accountExists_unwrapped(account_name);
@@ -1506,8 +1611,9 @@ std::string Vault::getNextAvailableAccountName_unwrapped(const std::string& desi
 void Vault::newAccount(const std::string& account_name, unsigned int minsigs, const std::vector<std::string>& keychain_names, uint32_t unused_pool_size, uint32_t time_created, bool compressed_keys, bool use_witness, bool use_witness_p2sh)
 {
     LOGGER(trace) << "Vault::newAccount(" << account_name << ", " << minsigs << " of [" << stdutils::delimited_list(keychain_names, ", ") << "], " << unused_pool_size << ", " << time_created << (use_witness ? "true" : "false") << ", " << (use_witness_p2sh ? "true" : "false") << ")" << std::endl;
+    VaultProfiler::Call profilerCall("newAccount");
 
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
     odb::core::session s;
     odb::core::transaction t(db_->begin());
     odb::result<Account> r(db_->query<Account>(odb::query<Account>::name == account_name));
@@ -1558,9 +1664,10 @@ void Vault::newAccount(bool use_witness, bool use_witness_p2sh, const std::strin
 void Vault::renameAccount(const std::string& old_name, const std::string& new_name)
 {
     LOGGER(trace) << "Vault::renameAccount(" << old_name << ", " << new_name << ")" << std::endl;
+    VaultProfiler::Call profilerCall("renameAccount");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::session session;
     odb::core::transaction t(db_->begin());
@@ -1583,9 +1690,10 @@ void Vault::renameAccount(const std::string& old_name, const std::string& new_na
 std::shared_ptr<Account> Vault::getAccount(const std::string& account_name) const
 {
     LOGGER(trace) << "Vault::getAccount(" << account_name << ")" << std::endl;
+    VaultProfiler::Call profilerCall("getAccount");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::transaction t(db_->begin());
     return getAccount_unwrapped(account_name);
@@ -1603,9 +1711,10 @@ std::shared_ptr<Account> Vault::getAccount_unwrapped(const std::string& account_
 std::vector<TxOutView> Vault::getUnspentTxOutViews(const std::string& account_name, uint32_t min_confirmations) const
 {
     LOGGER(trace) << "Vault::getUnspentTxOutViews(" << account_name << ", " << min_confirmations << ")" << std::endl;
+    VaultProfiler::Call profilerCall("getUnspentTxOutViews");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::session s;
     odb::core::transaction t(db_->begin());
@@ -1634,9 +1743,10 @@ std::vector<TxOutView> Vault::getUnspentTxOutViews_unwrapped(std::shared_ptr<Acc
 AccountInfo Vault::getAccountInfo(const std::string& account_name) const
 {
     LOGGER(trace) << "Vault::getAccountInfo(" << account_name << ")" << std::endl;
+    VaultProfiler::Call profilerCall("getAccountInfo");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::session s;
     odb::core::transaction t(db_->begin());
@@ -1647,9 +1757,10 @@ AccountInfo Vault::getAccountInfo(const std::string& account_name) const
 std::vector<AccountInfo> Vault::getAllAccountInfo() const
 {
     LOGGER(trace) << "Vault::getAllAccountInfo()" << std::endl;
+    VaultProfiler::Call profilerCall("getAllAccountInfo");
  
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::session s;
     odb::core::transaction t(db_->begin());
@@ -1662,11 +1773,12 @@ std::vector<AccountInfo> Vault::getAllAccountInfo() const
 uint64_t Vault::getAccountBalance(const std::string& account_name, unsigned int min_confirmations, int tx_flags) const
 {
     LOGGER(trace) << "Vault::getAccountBalance(" << account_name << ", " << min_confirmations << ")" << std::endl;
+    VaultProfiler::Call profilerCall("getAccountBalance");
 
     std::vector<Tx::status_t> tx_statuses = Tx::getStatusFlags(tx_flags);
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::transaction t(db_->begin());
     typedef odb::query<BalanceView> query_t;
@@ -1684,11 +1796,12 @@ uint64_t Vault::getAccountBalance(const std::string& account_name, unsigned int
 std::shared_ptr<AccountBin> Vault::addAccountBin(const std::string& account_name, const std::string& bin_name)
 {
     LOGGER(trace) << "Vault::addAccountBin(" << account_name << ", " << bin_name << ")" << std::endl;
+    VaultProfiler::Call profilerCall("addAccountBin");
 
     if (bin_name.empty() || bin_name[0] == '@') throw std::runtime_error("Invalid account bin name.");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::session s;
     odb::core::transaction t(db_->begin());
@@ -1726,8 +1839,9 @@ std::shared_ptr<AccountBin> Vault::addAccountBin(const std::string& account_name
 std::shared_ptr<SigningScript> Vault::issueSigningScript(const std::string& account_name, const std::string& bin_name, const std::string& label, uint32_t index, const std::string& username)
 {
     LOGGER(trace) << "Vault::issueSigningScript(" << account_name << ", " << bin_name << ", " << label << ", " << index << ")" << std::endl;
+    VaultProfiler::Call profilerCall("issueSigningScript");
 
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
     odb::core::session s;
     odb::core::transaction t(db_->begin());
     if (!accountExists_unwrapped(account_name)) throw AccountNotFoundException(account_name);
@@ -1753,6 +1867,7 @@ std::shared_ptr<SigningScript> Vault::issueSigningScript(const std::string& acco
         db_->update(script);
     }
     t.commit();
+    signalQueue.flush();
     return script;
 }
 
@@ -1783,11 +1898,86 @@ std::shared_ptr<SigningScript> Vault::issueAccountBinSigningScript_unwrapped(std
     script->label(label);
     script->status(SigningScript::ISSUED);
     db_->update(script);
+    logScriptIssued_unwrapped(script, bin);
     bin->markSigningScriptIssued(script->index());
     db_->update(bin);
     return script;
 }
 
+std::vector<std::shared_ptr<SigningScript>> Vault::issueSigningScripts(const std::string& account_name, const std::string& bin_name, uint32_t count)
+{
+    LOGGER(trace) << "Vault::issueSigningScripts(" << account_name << ", " << bin_name << ", " << count << ")" << std::endl;
+    VaultProfiler::Call profilerCall("issueSigningScripts");
+
+    VaultProfiler::Lock lock(mutex);
+    odb::core::session s;
+    odb::core::transaction t(db_->begin());
+    if (!accountExists_unwrapped(account_name)) throw AccountNotFoundException(account_name);
+    std::shared_ptr<AccountBin> bin = getAccountBin_unwrapped(account_name, bin_name);
+    if (bin->isChange()) throw AccountCannotIssueChangeScriptException(account_name);
+    std::vector<std::shared_ptr<SigningScript>> scripts = issueAccountBinSigningScripts_unwrapped(bin, count);
+    t.commit();
+    signalQueue.flush();
+    return scripts;
+}
+
+std::vector<std::shared_ptr<SigningScript>> Vault::issueAccountBinSigningScripts_unwrapped(std::shared_ptr<AccountBin> bin, uint32_t count)
+{
+    std::vector<std::shared_ptr<SigningScript>> scripts;
+    if (count == 0) return scripts;
+
+    // Take the unused scripts with the lowest indices from the pool...
+    typedef odb::query<SigningScriptView> view_query_t;
+    std::stringstream limit;
+    limit << "LIMIT " << count;
+    odb::result<SigningScriptView> view_result(db_->query<SigningScriptView>(
+        (view_query_t::AccountBin::id == bin->id() && view_query_t::SigningScript::status == SigningScript::UNUSED) +
+        "ORDER BY" + view_query_t::SigningScript::index + limit.str()));
+
+    std::vector<unsigned long> ids;
+    for (auto& view: view_result) { ids.push_back(view.id); }
+    for (auto id: ids) { scripts.push_back(std::shared_ptr<SigningScript>(db_->load<SigningScript>(id))); }
+
+    // ...and derive whatever it is short of.
+    while (scripts.size() < count)
+    {
+        std::shared_ptr<SigningScript> script = bin->newSigningScript();
+        for (auto& key: script->keys()) { db_->persist(key); }
+        db_->persist(script);
+        scripts.push_back(script);
+    }
+
+    for (auto& script: scripts)
+    {
+        script->status(SigningScript::ISSUED);
+        db_->update(script);
+        logScriptIssued_unwrapped(script, bin);
+        bin->markSigningScriptIssued(script->index());
+    }
+
+    // One refill restores the lookahead past the whole batch.
+    refillAccountBinPool_unwrapped(bin);
+    return scripts;
+}
+
+void Vault::setSigningScriptLabels(const std::vector<std::pair<unsigned long, std::string>>& labels)
+{
+    LOGGER(trace) << "Vault::setSigningScriptLabels(" << labels.size() << " labels)" << std::endl;
+    VaultProfiler::Call profilerCall("setSigningScriptLabels");
+
+    VaultProfiler::Lock lock(mutex);
+    odb::core::session s;
+    odb::core::transaction t(db_->begin());
+    for (auto& item: labels)
+    {
+        std::shared_ptr<SigningScript> script(db_->find<SigningScript>(item.first));
+        if (!script) throw SigningScriptNotFoundException();
+        script->label(item.second);
+        db_->update(script);
+    }
+    t.commit();
+}
+
 void Vault::refillAccountBinPool_unwrapped(std::shared_ptr<AccountBin> bin, uint32_t index)
 {
     // get largest signing script index that is not unused
@@ -1807,6 +1997,7 @@ void Vault::refillAccountBinPool_unwrapped(std::shared_ptr<AccountBin> bin, uint
             std::shared_ptr<SigningScript> script(db_->load<SigningScript>(script_view.id));
             script->status(SigningScript::ISSUED);
             db_->update(script);
+            logScriptIssued_unwrapped(script, bin);
         }
     }
 
@@ -1821,6 +2012,7 @@ void Vault::refillAccountBinPool_unwrapped(std::shared_ptr<AccountBin> bin, uint
             script->status(SigningScript::ISSUED);
             for (auto& key: script->keys()) { db_->persist(key); }
             db_->persist(script); 
+            logScriptIssued_unwrapped(script, bin);
         }
     }
 
@@ -1841,6 +2033,7 @@ void Vault::refillAccountBinPool_unwrapped(std::shared_ptr<AccountBin> bin, uint
 std::vector<SigningScriptView> Vault::getSigningScriptViews(const std::string& account_name, const std::string& bin_name, int flags) const
 {
     LOGGER(trace) << "Vault::getSigningScriptViews(" << account_name << ", " << bin_name << ", " << SigningScript::getStatusString(flags) << ")" << std::endl;
+    VaultProfiler::Call profilerCall("getSigningScriptViews");
 
     std::vector<SigningScript::status_t> statusRange = SigningScript::getStatusFlags(flags);
 
@@ -1851,7 +2044,7 @@ std::vector<SigningScriptView> Vault::getSigningScriptViews(const std::string& a
     query += "ORDER BY" + query_t::Account::name + "ASC," + query_t::AccountBin::name + "ASC," + query_t::SigningScript::status + "DESC," + query_t::SigningScript::index + "ASC";
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::session s;
     odb::core::transaction t(db_->begin());
@@ -1865,6 +2058,7 @@ std::vector<SigningScriptView> Vault::getSigningScriptViews(const std::string& a
 std::vector<TxOutView> Vault::getTxOutViews(const std::string& account_name, const std::string& bin_name, int role_flags, int txout_status_flags, int tx_status_flags, bool hide_change) const
 {
     LOGGER(trace) << "Vault::getTxOutViews(" << account_name << ", " << bin_name << ", " << TxOut::getRoleString(role_flags) << ", " << TxOut::getStatusString(txout_status_flags) << ", " << ", " << Tx::getStatusString(tx_status_flags) << ")" << std::endl;
+    VaultProfiler::Call profilerCall("getTxOutViews");
 
     typedef odb::query<TxOutView> query_t;
     query_t query(query_t::receiving_account::id != 0 || query_t::sending_account::id != 0);
@@ -1890,7 +2084,7 @@ std::vector<TxOutView> Vault::getTxOutViews(const std::string& account_name, con
     query += "ORDER BY" + query_t::BlockHeader::height + "DESC," + query_t::Tx::timestamp + "DESC," + query_t::Tx::id + "DESC";
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::transaction t(db_->begin());
     std::vector<TxOutView> views;
@@ -1911,9 +2105,10 @@ std::vector<TxOutView> Vault::getTxOutViews(const std::string& account_name, con
 std::shared_ptr<AccountBin> Vault::getAccountBin(const std::string& account_name, const std::string& bin_name) const
 {
     LOGGER(trace) << "Vault::getAccountBin(" << account_name << ", " << bin_name << ")" << std::endl;
+    VaultProfiler::Call profilerCall("getAccountBin");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::session s;
     odb::core::transaction t(db_->begin());
@@ -1935,9 +2130,10 @@ std::shared_ptr<AccountBin> Vault::getAccountBin_unwrapped(const std::string& ac
 std::vector<AccountBinView> Vault::getAllAccountBinViews() const
 {
     LOGGER(trace) << "Vault::getAllAccountBinViews()" << std::endl;
+    VaultProfiler::Call profilerCall("getAllAccountBinViews");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::transaction t(db_->begin());
     odb::result<AccountBinView> r(db_->query<AccountBinView>());
@@ -1949,9 +2145,10 @@ std::vector<AccountBinView> Vault::getAllAccountBinViews() const
 void Vault::exportAccountBin(const std::string& account_name, const std::string& bin_name, const std::string& export_name, const std::string& filepath) const
 {
     LOGGER(trace) << "Vault::exportAccountBin(" << account_name << ", " << bin_name << ", " << filepath << ")" << std::endl;
+    VaultProfiler::Call profilerCall("exportAccountBin");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::session s;
     odb::core::transaction t(db_->begin());
@@ -1970,8 +2167,9 @@ void Vault::exportAccountBin_unwrapped(const std::shared_ptr<AccountBin> account
 std::shared_ptr<AccountBin> Vault::importAccountBin(const std::string& filepath)
 {
     LOGGER(trace) << "Vault::importAccountBin(" << filepath << ")" << std::endl;
+    VaultProfiler::Call profilerCall("importAccountBin");
 
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
     odb::core::session s;
     odb::core::transaction t(db_->begin());
     std::shared_ptr<AccountBin> bin = importAccountBin_unwrapped(filepath);
@@ -2052,6 +2250,7 @@ std::shared_ptr<AccountBin> Vault::importAccountBin_unwrapped(const std::string&
         script->status(SigningScript::ISSUED);
         for (auto& key: script->keys()) { db_->persist(key); }
         db_->persist(script);
+        logScriptIssued_unwrapped(script, bin);
     }
     for (unsigned int i = 0; i < DEFAULT_UNUSED_POOL_SIZE; i++)
     {
@@ -2071,18 +2270,35 @@ std::shared_ptr<AccountBin> Vault::importAccountBin_unwrapped(const std::string&
 std::shared_ptr<Tx> Vault::getTx(const bytes_t& hash) const
 {
     LOGGER(trace) << "Vault::getTx(" << uchar_vector(hash).getHex() << ")" << std::endl;
+    VaultProfiler::Call profilerCall("getTx");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::session s;
     odb::core::transaction t(db_->begin());
-    return getTx_unwrapped(hash);
+    try
+    {
+        return getTx_unwrapped(hash);
+    }
+    catch (const TxNotFoundException&)
+    {
+        std::shared_ptr<TxArchive> archive = txArchive_;
+        TxArchive::Record record;
+        if (!archive || !archive->get(hash, record)) throw;
+        return getArchivedTx_unwrapped(record);
+    }
 }
 
 std::shared_ptr<Tx> Vault::getTx_unwrapped(const bytes_t& hash) const
 {
-    odb::result<Tx> r(db_->query<Tx>(odb::query<Tx>::hash == hash || odb::query<Tx>::unsigned_hash == hash));
+    typedef odb::query<Tx> query_t;
+    HashQueryParams* params;
+    odb::prepared_query<Tx> pq(getPreparedQuery<Tx>("Vault::getTx_unwrapped(hash)", params, [](HashQueryParams& p) {
+        return query_t::hash == query_t::_ref(p.hash) || query_t::unsigned_hash == query_t::_ref(p.hash); }));
+    params->hash = hash;
+
+    odb::result<Tx> r(pq.execute());
     if (r.empty()) throw TxNotFoundException(hash);
 
     std::shared_ptr<Tx> tx(r.begin().load());
@@ -2092,9 +2308,10 @@ std::shared_ptr<Tx> Vault::getTx_unwrapped(const bytes_t& hash) const
 std::shared_ptr<Tx> Vault::getTx(unsigned long tx_id) const
 {
     LOGGER(trace) << "Vault::getTx(" << tx_id << ")" << std::endl;
+    VaultProfiler::Call profilerCall("getTx");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::session s;
     odb::core::transaction t(db_->begin());
@@ -2113,9 +2330,10 @@ std::shared_ptr<Tx> Vault::getTx_unwrapped(unsigned long tx_id) const
 txs_t Vault::getTxs(int tx_status_flags, unsigned long start, int count, uint32_t minheight) const
 {
     LOGGER(trace) << "Vault::getTxs(" << Tx::getStatusString(tx_status_flags) << ", " << start << ", " << count << ")" << std::endl;
+    VaultProfiler::Call profilerCall("getTxs");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::session s;
     odb::core::transaction t(db_->begin());
@@ -2155,9 +2373,10 @@ txs_t Vault::getTxs_unwrapped(int tx_status_flags, unsigned long start, int coun
 std::vector<std::string> Vault::getSerializedUnsignedTxs(const std::string& account_name) const
 {
     LOGGER(trace) << "Vault::getSerializedUnsignedTxs(" << account_name << ")" << std::endl;
+    VaultProfiler::Call profilerCall("getSerializedUnsignedTxs");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::session s;
     odb::core::transaction t(db_->begin());
@@ -2183,9 +2402,10 @@ std::vector<std::string> Vault::getSerializedUnsignedTxs_unwrapped(const std::st
 uint32_t Vault::getTxConfirmations(const bytes_t& hash) const
 {
     LOGGER(trace) << "Vault::getTxConfirmations(" << uchar_vector(hash).getHex() << ")" << std::endl;
+    VaultProfiler::Call profilerCall("getTxConfirmations");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::session s;
     odb::core::transaction t(db_->begin());
@@ -2196,9 +2416,10 @@ uint32_t Vault::getTxConfirmations(const bytes_t& hash) const
 uint32_t Vault::getTxConfirmations(unsigned long tx_id) const
 {
     LOGGER(trace) << "Vault::getTxConfirmations(" << tx_id << ")" << std::endl;
+    VaultProfiler::Call profilerCall("getTxConfirmations");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::session s;
     odb::core::transaction t(db_->begin());
@@ -2209,9 +2430,10 @@ uint32_t Vault::getTxConfirmations(unsigned long tx_id) const
 uint32_t Vault::getTxConfirmations(std::shared_ptr<Tx> tx) const
 {
     LOGGER(trace) << "Vault::getTxConfirmations(tx: " << uchar_vector(tx->hash()).getHex() << ")" << std::endl;
+    VaultProfiler::Call profilerCall("getTxConfirmations");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::session s;
     odb::core::transaction t(db_->begin());
@@ -2227,6 +2449,7 @@ uint32_t Vault::getTxConfirmations_unwrapped(std::shared_ptr<Tx> tx) const
 std::vector<TxView> Vault::getTxViews(int tx_status_flags, unsigned long start, int count, uint32_t minheight) const
 {
     LOGGER(trace) << "Vault::getTxViews(" << Tx::getStatusString(tx_status_flags) << ", " << start << ", " << count << ")" << std::endl;
+    VaultProfiler::Call profilerCall("getTxViews");
 
     typedef odb::query<TxView> query_t;
     query_t query (1 == 1);
@@ -2251,7 +2474,7 @@ std::vector<TxView> Vault::getTxViews(int tx_status_flags, unsigned long start,
     }
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::transaction t(db_->begin());
     std::vector<TxView> views;
@@ -2263,9 +2486,10 @@ std::vector<TxView> Vault::getTxViews(int tx_status_flags, unsigned long start,
 std::shared_ptr<Tx> Vault::insertTx(std::shared_ptr<Tx> tx, bool replace_labels)
 {
     LOGGER(trace) << "Vault::insertTx(...) - hash: " << uchar_vector(tx->hash()).getHex() << ", unsigned hash: " << uchar_vector(tx->unsigned_hash()).getHex() << ", replace_labels: " << (replace_labels ? "true" : "false") << std::endl;
+    VaultProfiler::Call profilerCall("insertTx");
 
     {
-        boost::lock_guard<boost::mutex> lock(mutex);
+        VaultProfiler::Lock lock(mutex);
         odb::core::session s;
         odb::core::transaction t(db_->begin());
         tx = insertTx_unwrapped(tx, replace_labels);
@@ -2289,14 +2513,18 @@ std::shared_ptr<Tx> Vault::insertTx_unwrapped(std::shared_ptr<Tx> tx, bool repla
 
         odb::result<Tx> tx_r(db_->query<Tx>(odb::query<Tx>::unsigned_hash == tx->unsigned_hash()));
 
+        if (tx_r.empty() && isTxArchived_unwrapped(tx->unsigned_hash()))
+        {
+            LOGGER(debug) << "Vault::insertTx_unwrapped - Transaction already archived: " << unsignedhashstr << std::endl;
+            return nullptr;
+        }
+
         // First handle situations where we have a duplicate
         if (!tx_r.empty())
         {
             LOGGER(debug) << "Vault::insertTx_unwrapped - We have a transaction with the same unsigned hash: " << unsignedhashstr << std::endl;
             std::shared_ptr<Tx> stored_tx(tx_r.begin().load());
 
-            Coin::Transaction stored_cointx(stored_tx->toCoinCore());
-
             // Sanity check: TxIn and TxOut counts should match
             if (tx->txins().size() != stored_tx->txins().size() ||
                 tx->txouts().size() != stored_tx->txouts().size())
@@ -2373,15 +2601,16 @@ std::shared_ptr<Tx> Vault::insertTx_unwrapped(std::shared_ptr<Tx> tx, bool repla
                 else
                 {
                     // The transaction we received is unsigned but might have more signatures. Merge signatures
+                    using namespace CoinQ::Script;
                     bool sigs_updated = false;
                     std::size_t i = 0;
-                    txins_t txins = tx->txins();
+                    // Both txs have the same outpoints so we can use their cached signing state.
+                    Signer stored_signer(stored_tx->signer());
+                    Signer new_signer(tx->signer());
                     for (auto& txin: stored_tx->txins())
                     {
-                        using namespace CoinQ::Script;
-                        uint64_t outpointvalue = txin->outpoint() ? txin->outpoint()->value() : 0;
-                        SignableTxIn stored_stxin(stored_cointx, i, outpointvalue);
-                        SignableTxIn new_stxin(cointx, i, outpointvalue); 
+                        SignableTxIn stored_stxin(stored_signer.getSignableTxIns()[i]);
+                        const SignableTxIn& new_stxin = new_signer.getSignableTxIns()[i];
                         unsigned int sigsadded = stored_stxin.mergesigs(new_stxin);
                         if (sigsadded > 0)
                         {
@@ -2431,6 +2660,7 @@ std::shared_ptr<Tx> Vault::insertTx_unwrapped(std::shared_ptr<Tx> tx, bool repla
             if (!updated) return nullptr;
 
             updateConfirmations_unwrapped(stored_tx);
+            logTxChange_unwrapped(ChangeLogEntry::TX_UPDATED, *stored_tx);
             signalQueue.push(notifyTxUpdated.bind(stored_tx));
             return stored_tx;
         }
@@ -2592,6 +2822,7 @@ LOGGER(trace) << "txoutscript!!! " << uchar_vector(txoutscript).getHex() << std:
                 {
                     conflicting_tx->conflicting(true);
                     db_->update(conflicting_tx);
+                    logTxChange_unwrapped(ChangeLogEntry::TX_UPDATED, *conflicting_tx);
                     signalQueue.push(notifyTxUpdated.bind(conflicting_tx));
                     //notifyTxUpdated(conflicting_tx);
                 }
@@ -2616,6 +2847,7 @@ LOGGER(trace) << "txoutscript!!! " << uchar_vector(txoutscript).getHex() << std:
             for (auto& tx:          updated_txs)    { db_->update(tx);          }
 
             if (tx->status() >= Tx::SENT) updateConfirmations_unwrapped(tx);
+            logTxChange_unwrapped(ChangeLogEntry::TX_INSERTED, *tx);
             signalQueue.push(notifyTxInserted.bind(tx));
             //notifyTxInserted(tx);
             return tx;
@@ -2639,10 +2871,11 @@ std::shared_ptr<Tx> Vault::insertNewTx(const Coin::Transaction& cointx, std::sha
     else                { ss << "null"; }
     ss << ", " << (verifysigs ? "true" : "false") << ")";
     LOGGER(trace) << ss.str() << std::endl;
+    VaultProfiler::Call profilerCall("insertNewTx");
 
     std::shared_ptr<Tx> tx;
     {
-        boost::lock_guard<boost::mutex> lock(mutex);
+        VaultProfiler::Lock lock(mutex);
         odb::core::session s;
         odb::core::transaction t(db_->begin());
         tx = insertNewTx_unwrapped(cointx, blockheader, verifysigs, isCoinbase);
@@ -2664,6 +2897,12 @@ std::shared_ptr<Tx> Vault::insertNewTx_unwrapped(const Coin::Transaction& cointx
 
         // If we already have it but it is unsent update to propagated and update confirmations.
         odb::result<Tx> r(db_->query<Tx>(odb::query<Tx>::hash == tx->hash() || odb::query<Tx>::unsigned_hash == tx->unsigned_hash()));
+        if (r.empty() && isTxArchived_unwrapped(tx->unsigned_hash()))
+        {
+            LOGGER(debug) << "Vault::insertNewTx_unwrapped - Transaction already archived: " << uchar_vector(tx->unsigned_hash()).getHex() << std::endl;
+            return nullptr;
+        }
+
         if (!r.empty())
         {
             std::shared_ptr<Tx> stored_tx(r.begin().load());
@@ -2698,6 +2937,7 @@ std::shared_ptr<Tx> Vault::insertNewTx_unwrapped(const Coin::Transaction& cointx
                 stored_tx->updateStatus(tx->status());
                 stored_tx->blockheader(blockheader);
                 db_->update(stored_tx);
+                logTxChange_unwrapped(ChangeLogEntry::TX_UPDATED, *stored_tx);
                 signalQueue.push(notifyTxUpdated.bind(stored_tx));
                 return stored_tx; 
             }
@@ -2802,6 +3042,7 @@ std::shared_ptr<Tx> Vault::insertNewTx_unwrapped(const Coin::Transaction& cointx
             for (auto& txout:   updated_txouts)         { db_->update(txout);                   }
             for (auto& tx:      updated_txs)            { tx->updateTotals(); db_->update(tx);  }
 
+            logTxChange_unwrapped(ChangeLogEntry::TX_INSERTED, *tx);
             signalQueue.push(notifyTxInserted.bind(tx));
             return tx;
         }
@@ -2818,14 +3059,17 @@ std::shared_ptr<Tx> Vault::insertNewTx_unwrapped(const Coin::Transaction& cointx
 std::shared_ptr<Tx> Vault::insertMerkleTx(const ChainMerkleBlock& chainmerkleblock, const Coin::Transaction& cointx, unsigned int txindex, unsigned int txcount, bool verifysigs, bool isCoinbase)
 {
     LOGGER(trace) << "Vault::insertMerkleTx(" << chainmerkleblock.hash().getHex() << ", " << cointx.hash().getHex() << ", " << txindex << ", " << txcount << ", " << (verifysigs ? "true" : "false") << ")" << std::endl;
+    VaultProfiler::Call profilerCall("insertMerkleTx");
 
     std::shared_ptr<Tx> tx;
     {
-        boost::lock_guard<boost::mutex> lock(mutex);
+        VaultProfiler::Lock lock(mutex);
+        BlockHeaderCache::WriteGuard cacheGuard(blockHeaderCache_);
         odb::core::session s;
         odb::core::transaction t(db_->begin());
         tx = insertMerkleTx_unwrapped(chainmerkleblock, cointx, txindex, txcount, verifysigs, isCoinbase);
         t.commit();
+        cacheGuard.commit();
     }
 
     signalQueue.flush();
@@ -2872,6 +3116,7 @@ std::shared_ptr<Tx> Vault::insertMerkleTx_unwrapped(const ChainMerkleBlock& chai
                         std::shared_ptr<Tx> tx(it.load());
                         tx->blockheader(nullptr);
                         db_->update(tx);
+                        logTxChange_unwrapped(ChangeLogEntry::TX_UPDATED, *tx);
                         signalQueue.push(notifyTxUpdated.bind(tx));
                     }
                 }
@@ -2885,7 +3130,14 @@ std::shared_ptr<Tx> Vault::insertMerkleTx_unwrapped(const ChainMerkleBlock& chai
                 {
                     // Delete any blockheaders with equal or larger height
                     odb::result<BlockHeader> r(db_->query<BlockHeader>(odb::query<BlockHeader>::height >= (unsigned int)chainmerkleblock.height));
-                    for (auto& blockheader: r) { db_->erase(blockheader); }
+                    bool erased = false;
+                    for (auto& blockheader: r)
+                    {
+                        logChange_unwrapped(ChangeLogEntry::BLOCK_DISCONNECTED, blockheader.hash(), blockheader.height());
+                        db_->erase(blockheader);
+                        erased = true;
+                    }
+                    if (erased) { blockHeaderCache_.invalidate(); }
                 }
 
                 // TODO: test and use the following instead of the above three code blocks
@@ -2895,6 +3147,8 @@ std::shared_ptr<Tx> Vault::insertMerkleTx_unwrapped(const ChainMerkleBlock& chai
                 merkleblock = std::make_shared<MerkleBlock>(chainmerkleblock);
                 db_->persist(merkleblock->blockheader());
                 db_->persist(merkleblock);
+                blockHeaderCache_.stageBest(merkleblock->blockheader());
+                logChange_unwrapped(ChangeLogEntry::BLOCK_CONNECTED, merkleblock->blockheader()->hash(), merkleblock->blockheader()->height());
             }
         }
 
@@ -2909,6 +3163,7 @@ std::shared_ptr<Tx> Vault::insertMerkleTx_unwrapped(const ChainMerkleBlock& chai
                 tx->status(Tx::CONFIRMED);
                 tx->conflicting(false);
                 db_->update(tx);
+                logTxChange_unwrapped(ChangeLogEntry::TX_UPDATED, *tx);
                 signalQueue.push(notifyTxUpdated.bind(tx));
             }
             else
@@ -2946,6 +3201,7 @@ std::shared_ptr<Tx> Vault::insertMerkleTx_unwrapped(const ChainMerkleBlock& chai
                     tx->status(Tx::CONFIRMED);
                     tx->conflicting(false);
                     db_->update(tx);
+                    logTxChange_unwrapped(ChangeLogEntry::TX_UPDATED, *tx);
                     signalQueue.push(notifyTxUpdated.bind(tx));
                 }
             } 
@@ -2984,14 +3240,17 @@ std::shared_ptr<Tx> Vault::insertMerkleTx_unwrapped(const ChainMerkleBlock& chai
 std::shared_ptr<Tx> Vault::confirmMerkleTx(const ChainMerkleBlock& chainmerkleblock, const bytes_t& txhash, unsigned int txindex, unsigned int txcount)
 {
     LOGGER(trace) << "Vault::confirmMerkleTx(" << chainmerkleblock.hash().getHex() << ", " << uchar_vector(txhash).getHex() << ", " << txindex << ", " << txcount << ")" << std::endl;
+    VaultProfiler::Call profilerCall("confirmMerkleTx");
 
     std::shared_ptr<Tx> tx;
     {
-        boost::lock_guard<boost::mutex> lock(mutex);
+        VaultProfiler::Lock lock(mutex);
+        BlockHeaderCache::WriteGuard cacheGuard(blockHeaderCache_);
         odb::core::session s;
         odb::core::transaction t(db_->begin());
         tx = confirmMerkleTx_unwrapped(chainmerkleblock, txhash, txindex, txcount);
         t.commit();
+        cacheGuard.commit();
     }
 
     signalQueue.flush();
@@ -3037,6 +3296,7 @@ std::shared_ptr<Tx> Vault::confirmMerkleTx_unwrapped(const ChainMerkleBlock& cha
                         std::shared_ptr<Tx> tx(it.load());
                         tx->status(Tx::PROPAGATED);
                         db_->update(tx);
+                        logTxChange_unwrapped(ChangeLogEntry::TX_UPDATED, *tx);
                         signalQueue.push(notifyTxUpdated.bind(tx));
                     }
                 }
@@ -3051,7 +3311,14 @@ std::shared_ptr<Tx> Vault::confirmMerkleTx_unwrapped(const ChainMerkleBlock& cha
                 {
                     // Delete any blockheaders with equal or larger height
                     odb::result<BlockHeader> r(db_->query<BlockHeader>(odb::query<BlockHeader>::height >= (unsigned int)chainmerkleblock.height));
-                    for (auto& blockheader: r) { db_->erase(blockheader); }
+                    bool erased = false;
+                    for (auto& blockheader: r)
+                    {
+                        logChange_unwrapped(ChangeLogEntry::BLOCK_DISCONNECTED, blockheader.hash(), blockheader.height());
+                        db_->erase(blockheader);
+                        erased = true;
+                    }
+                    if (erased) { blockHeaderCache_.invalidate(); }
                 }
 
                 // TODO: test and use the following instead of the above three code blocks
@@ -3061,6 +3328,8 @@ std::shared_ptr<Tx> Vault::confirmMerkleTx_unwrapped(const ChainMerkleBlock& cha
                 merkleblock = std::make_shared<MerkleBlock>(chainmerkleblock);
                 db_->persist(merkleblock->blockheader());
                 db_->persist(merkleblock);
+                blockHeaderCache_.stageBest(merkleblock->blockheader());
+                logChange_unwrapped(ChangeLogEntry::BLOCK_CONNECTED, merkleblock->blockheader()->hash(), merkleblock->blockheader()->height());
             }
         }
 
@@ -3073,6 +3342,7 @@ std::shared_ptr<Tx> Vault::confirmMerkleTx_unwrapped(const ChainMerkleBlock& cha
             tx->status(Tx::CONFIRMED);
             tx->conflicting(false);
             db_->update(tx);
+            logTxChange_unwrapped(ChangeLogEntry::TX_UPDATED, *tx);
             signalQueue.push(notifyTxUpdated.bind(tx));
         }
 
@@ -3095,10 +3365,11 @@ std::shared_ptr<Tx> Vault::confirmMerkleTx_unwrapped(const ChainMerkleBlock& cha
 std::shared_ptr<Tx> Vault::createTx(const std::string& account_name, uint32_t tx_version, uint32_t tx_locktime, txouts_t txouts, uint64_t fee, unsigned int maxchangeouts, bool insert)
 {
     LOGGER(trace) << "Vault::createTx(" << account_name << ", " << tx_version << ", " << tx_locktime << ", " << txouts.size() << " txout(s), " << fee << ", " << maxchangeouts << ", " << (insert ? "insert" : "no insert") << ")" << std::endl;
+    VaultProfiler::Call profilerCall("createTx");
 
     std::shared_ptr<Tx> tx;
     {
-        boost::lock_guard<boost::mutex> lock(mutex);
+        VaultProfiler::Lock lock(mutex);
         odb::core::session s;
         odb::core::transaction t(db_->begin());
         tx = createTx_unwrapped(account_name, tx_version, tx_locktime, txouts, fee, maxchangeouts);
@@ -3179,10 +3450,11 @@ std::shared_ptr<Tx> Vault::createTx_unwrapped(const std::string& account_name, u
 std::shared_ptr<Tx> Vault::createTx(const std::string& username, const std::string& account_name, uint32_t tx_version, uint32_t tx_locktime, txouts_t txouts, uint64_t fee, unsigned int maxchangeouts, bool insert)
 {
     LOGGER(trace) << "Vault::createTx(" << username << ", " << account_name << ", " << tx_version << ", " << tx_locktime << ", " << txouts.size() << " txout(s), " << fee << ", " << maxchangeouts << ", " << (insert ? "insert" : "no insert") << ")" << std::endl;
+    VaultProfiler::Call profilerCall("createTx");
 
     std::shared_ptr<Tx> tx;
     {
-        boost::lock_guard<boost::mutex> lock(mutex);
+        VaultProfiler::Lock lock(mutex);
         odb::core::session s;
         odb::core::transaction t(db_->begin());
         tx = createTx_unwrapped(username, account_name, tx_version, tx_locktime, txouts, fee, maxchangeouts);
@@ -3227,10 +3499,11 @@ std::shared_ptr<Tx> Vault::createTx_unwrapped(const std::string& username, const
 std::shared_ptr<Tx> Vault::createTx(const std::string& account_name, uint32_t tx_version, uint32_t tx_locktime, ids_t coin_ids, txouts_t txouts, uint64_t fee, uint32_t min_confirmations, bool insert)
 {
     LOGGER(trace) << "Vault::createTx(" << account_name << ", " << tx_version << ", " << tx_locktime << ", " << coin_ids.size() << " txin(s), " << txouts.size() << " txout(s), " << fee << ", " << min_confirmations << ", " << (insert ? "insert" : "no insert") << ")" << std::endl;
+    VaultProfiler::Call profilerCall("createTx");
 
     std::shared_ptr<Tx> tx;
     {
-        boost::lock_guard<boost::mutex> lock(mutex);
+        VaultProfiler::Lock lock(mutex);
         odb::core::session s;
         odb::core::transaction t(db_->begin());
         tx = createTx_unwrapped(account_name, tx_version, tx_locktime, coin_ids, txouts, fee, min_confirmations);
@@ -3353,10 +3626,11 @@ std::shared_ptr<Tx> Vault::createTx_unwrapped(const std::string& account_name, u
 std::shared_ptr<Tx> Vault::createTx(const std::string& username, const std::string& account_name, uint32_t tx_version, uint32_t tx_locktime, ids_t coin_ids, txouts_t txouts, uint64_t fee, uint32_t min_confirmations, bool insert)
 {
     LOGGER(trace) << "Vault::createTx(" << username << ", " << account_name << ", " << tx_version << ", " << tx_locktime << ", " << coin_ids.size() << " txin(s), " << txouts.size() << " txout(s), " << fee << ", " << min_confirmations << ", " << (insert ? "insert" : "no insert") << ")" << std::endl;
+    VaultProfiler::Call profilerCall("createTx");
 
     std::shared_ptr<Tx> tx;
     {
-        boost::lock_guard<boost::mutex> lock(mutex);
+        VaultProfiler::Lock lock(mutex);
         odb::core::session s;
         odb::core::transaction t(db_->begin());
         tx = createTx_unwrapped(username, account_name, tx_version, tx_locktime, coin_ids, txouts, fee, min_confirmations);
@@ -3391,10 +3665,11 @@ std::shared_ptr<Tx> Vault::createTx_unwrapped(const std::string& username, const
 txs_t Vault::consolidateTxOuts(const std::string& account_name, uint32_t max_tx_size, uint32_t tx_version, uint32_t tx_locktime, ids_t coin_ids, const bytes_t& txoutscript, uint64_t min_fee, uint32_t min_confirmations, bool insert)
 {
     LOGGER(trace) << "Vault::consolidateTxOuts(" << account_name << ", " << max_tx_size << ", " << tx_version << ", " << tx_locktime << ", " << coin_ids.size() << " txin(s), " << uchar_vector(txoutscript).getHex() << ", " << min_fee << ", " << min_confirmations << ", " << (insert ? "insert" : "no insert") << ")" << std::endl;
+    VaultProfiler::Call profilerCall("consolidateTxOuts");
 
     txs_t txs;
     {
-        boost::lock_guard<boost::mutex> lock(mutex);
+        VaultProfiler::Lock lock(mutex);
         odb::core::session s;
         odb::core::transaction t(db_->begin());
         txs = consolidateTxOuts_unwrapped(account_name, max_tx_size, tx_version, tx_locktime, coin_ids, txoutscript, min_fee, min_confirmations);
@@ -3417,12 +3692,13 @@ txs_t Vault::consolidateTxOuts(const std::string& account_name, uint32_t max_tx_
 txs_t Vault::consolidateTxOuts(const std::string& username, const std::string& account_name, uint32_t max_tx_size, uint32_t tx_version, uint32_t tx_locktime, ids_t coin_ids, const bytes_t& txoutscript, uint64_t min_fee, uint32_t min_confirmations, bool insert)
 {
     LOGGER(trace) << "Vault::consolidateTxOuts(" << username << ", " << account_name << ", " << max_tx_size << ", " << tx_version << ", " << tx_locktime << ", " << coin_ids.size() << " txin(s), " << uchar_vector(txoutscript).getHex() << ", " << min_fee << ", " << min_confirmations << ", " << (insert ? "insert" : "no insert") << ")" << std::endl;
+    VaultProfiler::Call profilerCall("consolidateTxOuts");
 
     std::shared_ptr<User> user = getUser_unwrapped(username);
 
     txs_t txs;
     {
-        boost::lock_guard<boost::mutex> lock(mutex);
+        VaultProfiler::Lock lock(mutex);
         odb::core::session s;
         odb::core::transaction t(db_->begin());
         txs = consolidateTxOuts_unwrapped(account_name, max_tx_size, tx_version, tx_locktime, coin_ids, txoutscript, min_fee, min_confirmations);
@@ -3540,8 +3816,9 @@ void Vault::updateTx_unwrapped(std::shared_ptr<Tx> tx)
 void Vault::deleteTx(const bytes_t& tx_hash)
 {
     LOGGER(trace) << "Vault::deleteTx(" << uchar_vector(tx_hash).getHex() << ")" << std::endl;
+    VaultProfiler::Call profilerCall("deleteTx");
 
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
     odb::core::session s;
     odb::core::transaction t(db_->begin());
     odb::result<Tx> r(db_->query<Tx>(odb::query<Tx>::hash == tx_hash || odb::query<Tx>::unsigned_hash == tx_hash));
@@ -3557,8 +3834,9 @@ void Vault::deleteTx(const bytes_t& tx_hash)
 void Vault::deleteTx(unsigned long tx_id)
 {
     LOGGER(trace) << "Vault::deleteTx(" << tx_id << ")" << std::endl;
+    VaultProfiler::Call profilerCall("deleteTx");
 
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
     odb::core::session s;
     odb::core::transaction t(db_->begin());
     odb::result<Tx> r(db_->query<Tx>(odb::query<Tx>::id == tx_id));
@@ -3601,6 +3879,7 @@ void Vault::deleteTx_unwrapped(std::shared_ptr<Tx> tx)
 
         // delete tx
         db_->erase(tx);
+        logTxChange_unwrapped(ChangeLogEntry::TX_DELETED, *tx);
         signalQueue.push(notifyTxDeleted.bind(tx));
     }
     catch (...)
@@ -3613,9 +3892,10 @@ void Vault::deleteTx_unwrapped(std::shared_ptr<Tx> tx)
 SigningRequest Vault::getSigningRequest(const bytes_t& hash, bool include_raw_tx) const
 {
     LOGGER(trace) << "Vault::getSigningRequest(" << uchar_vector(hash).getHex() << ")" << std::endl;
+    VaultProfiler::Call profilerCall("getSigningRequest");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::session s;
     odb::core::transaction t(db_->begin());
@@ -3629,9 +3909,10 @@ SigningRequest Vault::getSigningRequest(const bytes_t& hash, bool include_raw_tx
 SigningRequest Vault::getSigningRequest(unsigned long tx_id, bool include_raw_tx) const
 {
     LOGGER(trace) << "Vault::getSigningRequest(" << tx_id << ")" << std::endl;
+    VaultProfiler::Call profilerCall("getSigningRequest");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::session s;
     odb::core::transaction t(db_->begin());
@@ -3662,9 +3943,10 @@ SigningRequest Vault::getSigningRequest_unwrapped(std::shared_ptr<Tx> tx, bool i
 SignatureInfo Vault::getSignatureInfo(const bytes_t& hash) const
 {
     LOGGER(trace) << "Vault::getSignatureInfo(" << uchar_vector(hash).getHex() << ")" << std::endl;
+    VaultProfiler::Call profilerCall("getSignatureInfo");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::session s;
     odb::core::transaction t(db_->begin());
@@ -3678,9 +3960,10 @@ SignatureInfo Vault::getSignatureInfo(const bytes_t& hash) const
 SignatureInfo Vault::getSignatureInfo(unsigned long tx_id) const
 {
     LOGGER(trace) << "Vault::getSignatureInfo(" << tx_id << ")" << std::endl;
+    VaultProfiler::Call profilerCall("getSignatureInfo");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::session s;
     odb::core::transaction t(db_->begin());
@@ -3694,27 +3977,9 @@ SignatureInfo Vault::getSignatureInfo(unsigned long tx_id) const
 SignatureInfo Vault::getSignatureInfo_unwrapped(std::shared_ptr<Tx> tx) const
 {
     // Assume for now all inputs belong to the same account.
-    CoinQ::Script::Signer signer = tx->signer();
-
-    unsigned int sigsNeeded = 0;
-    std::set<bytes_t> missingpubkeys;
-    std::set<bytes_t> presentpubkeys;
- 
-    for (auto& signabletxin: signer.getSignableTxIns())
-    {
-        unsigned int n = signabletxin.sigsneeded();
-        if (n > sigsNeeded) sigsNeeded = n;
-
-        {
-            std::vector<bytes_t> pubkeys = signabletxin.missingsigs();
-            for (auto& pubkey: pubkeys) { missingpubkeys.insert(pubkey); }
-        }
-
-        {
-            std::vector<bytes_t> pubkeys = signabletxin.presentsigs();
-            for (auto& pubkey: pubkeys) { presentpubkeys.insert(pubkey); }
-        }
-    }
+    unsigned int sigsNeeded = tx->missingSigCount();
+    std::set<bytes_t> missingpubkeys = tx->missingSigPubkeys();
+    std::set<bytes_t> presentpubkeys = tx->presentSigPubkeys();
 
     SigningKeychainSet signingKeychainSet;
 
@@ -3739,11 +4004,64 @@ SignatureInfo Vault::getSignatureInfo_unwrapped(std::shared_ptr<Tx> tx) const
     return SignatureInfo(sigsNeeded, signingKeychainSet);
 }
 
+PartialTx Vault::getPartialTx(const bytes_t& hash, bool include_raw_tx) const
+{
+    LOGGER(trace) << "Vault::getPartialTx(" << uchar_vector(hash).getHex() << ", " << (include_raw_tx ? "true" : "false") << ")" << std::endl;
+    VaultProfiler::Call profilerCall("getPartialTx");
+
+#if defined(LOCK_ALL_CALLS)
+    VaultProfiler::Lock lock(mutex);
+#endif
+    odb::core::session s;
+    odb::core::transaction t(db_->begin());
+    odb::result<Tx> r(db_->query<Tx>(odb::query<Tx>::hash == hash || odb::query<Tx>::unsigned_hash == hash));
+    if (r.empty()) throw TxNotFoundException(hash);
+
+    std::shared_ptr<Tx> tx(r.begin().load());
+    return getPartialTx_unwrapped(tx, include_raw_tx);
+}
+
+PartialTx Vault::getPartialTx(unsigned long tx_id, bool include_raw_tx) const
+{
+    LOGGER(trace) << "Vault::getPartialTx(" << tx_id << ", " << (include_raw_tx ? "true" : "false") << ")" << std::endl;
+    VaultProfiler::Call profilerCall("getPartialTx");
+
+#if defined(LOCK_ALL_CALLS)
+    VaultProfiler::Lock lock(mutex);
+#endif
+    odb::core::session s;
+    odb::core::transaction t(db_->begin());
+    odb::result<Tx> r(db_->query<Tx>(odb::query<Tx>::id == tx_id));
+    if (r.empty()) throw TxNotFoundException();
+
+    std::shared_ptr<Tx> tx(r.begin().load());
+    return getPartialTx_unwrapped(tx, include_raw_tx);
+}
+
+PartialTx Vault::getPartialTx_unwrapped(std::shared_ptr<Tx> tx, bool include_raw_tx) const
+{
+    // Built from the cached signing state so no input scripts get reparsed.
+    CoinQ::Script::Signer signer(tx->signer());
+
+    txins_t txins = tx->txins();
+    partialtxins_t partialtxins(txins.size());
+    for (auto& txin: txins)
+    {
+        uint64_t amount = txin->outpoint() ? txin->outpoint()->value() : 0;
+        partialtxins[txin->txindex()] = PartialTxIn(signer.getSignableTxIns()[txin->txindex()], amount);
+    }
+
+    bytes_t rawtx;
+    if (include_raw_tx) rawtx = tx->raw();
+    return PartialTx(tx->unsigned_hash(), partialtxins, rawtx);
+}
+
 std::shared_ptr<Tx> Vault::signTx(const bytes_t& hash, std::vector<std::string>& keychain_names, bool update)
 {
     LOGGER(trace) << "Vault::signTx(" << uchar_vector(hash).getHex() << ", [" << stdutils::delimited_list(keychain_names, ", ") << "], " << (update ? "update" : "no update") << ")" << std::endl;
+    VaultProfiler::Call profilerCall("signTx");
 
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
     odb::core::session s;
     odb::core::transaction t(db_->begin());
 
@@ -3771,8 +4089,9 @@ std::shared_ptr<Tx> Vault::signTx(const bytes_t& hash, std::vector<std::string>&
 std::shared_ptr<Tx> Vault::signTx(unsigned long tx_id, std::vector<std::string>& keychain_names, bool update)
 {
     LOGGER(trace) << "Vault::signTx(" << tx_id << ", [" << stdutils::delimited_list(keychain_names, ", ") << "], " << (update ? "update" : "no update") << ")" << std::endl;
+    VaultProfiler::Call profilerCall("signTx");
 
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
     odb::core::session s;
     odb::core::transaction t(db_->begin());
 
@@ -3794,7 +4113,9 @@ unsigned int Vault::signTx_unwrapped(std::shared_ptr<Tx> tx, std::vector<std::st
     using namespace CoinQ::Script;
     using namespace CoinCrypto;
 
-    Coin::Transaction coin_tx = tx->toCoinCore();
+    // The cached signer already holds the parsed inputs so we don't need to parse them again here.
+    Signer signer(tx->signer());
+    const Coin::Transaction& coin_tx = signer.getTx();
 
     // No point in trying nonprivate keys
     odb::query<Key> privkey_query(odb::query<Key>::is_private != 0);
@@ -3809,7 +4130,7 @@ unsigned int Vault::signTx_unwrapped(std::shared_ptr<Tx> tx, std::vector<std::st
     for (auto& txin: tx->txins())
     {
         uint64_t outpointvalue = txin->outpoint() ? txin->outpoint()->value() : 0;
-        SignableTxIn signableTxIn(coin_tx, txin->txindex(), outpointvalue);
+        SignableTxIn signableTxIn(signer.getSignableTxIns()[txin->txindex()]);
 
         unsigned int sigsneeded = signableTxIn.sigsneeded();
         if (sigsneeded == 0) continue;
@@ -3837,7 +4158,7 @@ unsigned int Vault::signTx_unwrapped(std::shared_ptr<Tx> tx, std::vector<std::st
 
             // TODO: Better exception handling with secp256kl_key class
             secp256k1_key signingKey;
-            signingKey.setPrivKey(privkey);
+            signingKey.setPrivKey(to_bytes(privkey));
 
             // Try checking both compressed and uncompressed pubkeys
             if (signingKey.getPubKey() != key.pubkey() && signingKey.getPubKey(false) != key.pubkey()) throw KeychainInvalidPrivateKeyException(key.root_keychain()->name(), key.pubkey());
@@ -3869,9 +4190,10 @@ unsigned int Vault::signTx_unwrapped(std::shared_ptr<Tx> tx, std::vector<std::st
 std::shared_ptr<TxOut> Vault::getTxOut(const bytes_t& outhash, uint32_t outindex) const
 {
     LOGGER(trace) << "Vault::getTxOut(" << uchar_vector(outhash).getHex() << ", " << outindex << ")" << std::endl;
+    VaultProfiler::Call profilerCall("getTxOut");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::session s;
     odb::core::transaction t(db_->begin());
@@ -3889,8 +4211,9 @@ std::shared_ptr<TxOut> Vault::getTxOut_unwrapped(const bytes_t& outhash, uint32_
 std::shared_ptr<TxOut> Vault::setSendingLabel(const bytes_t& outhash, uint32_t outindex, const std::string& label)
 {
     LOGGER(trace) << "Vault::setSendingLabel(" << uchar_vector(outhash).getHex() << ", " << outindex << ", " << label << ")" << std::endl;
+    VaultProfiler::Call profilerCall("setSendingLabel");
 
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
     odb::core::session s;
     odb::core::transaction t(db_->begin());
     std::shared_ptr<TxOut> txout = setSendingLabel_unwrapped(outhash, outindex, label);
@@ -3909,8 +4232,9 @@ std::shared_ptr<TxOut> Vault::setSendingLabel_unwrapped(const bytes_t& outhash,
 std::shared_ptr<TxOut> Vault::setReceivingLabel(const bytes_t& outhash, uint32_t outindex, const std::string& label)
 {
     LOGGER(trace) << "Vault::setReceivingLabel(" << uchar_vector(outhash).getHex() << ", " << outindex << ", " << label << ")" << std::endl;
+    VaultProfiler::Call profilerCall("setReceivingLabel");
 
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
     odb::core::session s;
     odb::core::transaction t(db_->begin());
     std::shared_ptr<TxOut> txout = setReceivingLabel_unwrapped(outhash, outindex, label);
@@ -3930,9 +4254,10 @@ std::shared_ptr<TxOut> Vault::setReceivingLabel_unwrapped(const bytes_t& outhash
 std::shared_ptr<Tx> Vault::exportTx(const bytes_t& hash, const std::string& filepath) const
 {
     LOGGER(trace) << "Vault::exportTx(" << uchar_vector(hash).getHex() << ", " << filepath << ")" << std::endl;
+    VaultProfiler::Call profilerCall("exportTx");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
 
     std::shared_ptr<Tx> tx;
@@ -3948,9 +4273,10 @@ std::shared_ptr<Tx> Vault::exportTx(const bytes_t& hash, const std::string& file
 std::shared_ptr<Tx> Vault::exportTx(unsigned long tx_id, const std::string& filepath) const
 {
     LOGGER(trace) << "Vault::exportTx(" << tx_id << ", " << filepath << ")" << std::endl;
+    VaultProfiler::Call profilerCall("exportTx");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
 
     std::shared_ptr<Tx> tx;
@@ -3966,6 +4292,7 @@ std::shared_ptr<Tx> Vault::exportTx(unsigned long tx_id, const std::string& file
 void Vault::exportTx(std::shared_ptr<Tx> tx, const std::string& filepath) const
 {
     LOGGER(trace) << "Vault::exportTx(tx: " << uchar_vector(tx->hash()).getHex()  << ", " << filepath << ")" << std::endl;
+    VaultProfiler::Call profilerCall("exportTx");
 
     //TODO: disable opetation if file is already open
     std::ofstream ofs(filepath);
@@ -3976,9 +4303,10 @@ void Vault::exportTx(std::shared_ptr<Tx> tx, const std::string& filepath) const
 std::string Vault::exportTx(const bytes_t& hash) const
 {
     LOGGER(trace) << "Vault::exportTx(" << uchar_vector(hash).getHex() << ")" << std::endl;
+    VaultProfiler::Call profilerCall("exportTx");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
 
     std::shared_ptr<Tx> tx;
@@ -3993,9 +4321,10 @@ std::string Vault::exportTx(const bytes_t& hash) const
 std::string Vault::exportTx(unsigned long tx_id) const
 {
     LOGGER(trace) << "Vault::exportTx(" << tx_id << ")" << std::endl;
+    VaultProfiler::Call profilerCall("exportTx");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
 
     std::shared_ptr<Tx> tx;
@@ -4010,6 +4339,7 @@ std::string Vault::exportTx(unsigned long tx_id) const
 std::string Vault::exportTx(std::shared_ptr<Tx> tx) const
 {
     LOGGER(trace) << "Vault::exportTx(tx: " << uchar_vector(tx->hash()).getHex()  << ")" << std::endl;
+    VaultProfiler::Call profilerCall("exportTx");
 
     std::stringstream ss;
     boost::archive::text_oarchive oa(ss);
@@ -4020,13 +4350,14 @@ std::string Vault::exportTx(std::shared_ptr<Tx> tx) const
 std::shared_ptr<Tx> Vault::importTx(const std::string& filepath)
 {
     LOGGER(trace) << "Vault::importTx(" << filepath << ")" << std::endl;
+    VaultProfiler::Call profilerCall("importTx");
 
     std::ifstream ifs(filepath);
     boost::archive::text_iarchive ia(ifs);
 
     std::shared_ptr<Tx> tx(new Tx());
     {
-        boost::lock_guard<boost::mutex> lock(mutex);
+        VaultProfiler::Lock lock(mutex);
         odb::core::session s;
         odb::core::transaction t(db_->begin());
         ia >> *tx;
@@ -4041,6 +4372,7 @@ std::shared_ptr<Tx> Vault::importTx(const std::string& filepath)
 std::shared_ptr<Tx> Vault::importTxFromString(const std::string& txstr)
 {
     LOGGER(trace) << "Vault::importTxFromString(...)" << std::endl;
+    VaultProfiler::Call profilerCall("importTxFromString");
 
     std::stringstream ss;
     ss << txstr;
@@ -4048,7 +4380,7 @@ std::shared_ptr<Tx> Vault::importTxFromString(const std::string& txstr)
 
     std::shared_ptr<Tx> tx(new Tx());
     {
-        boost::lock_guard<boost::mutex> lock(mutex);
+        VaultProfiler::Lock lock(mutex);
         odb::core::session s;
         odb::core::transaction t(db_->begin());
         ia >> *tx;
@@ -4060,12 +4392,158 @@ std::shared_ptr<Tx> Vault::importTxFromString(const std::string& txstr)
     return tx;
 }
 
+std::string Vault::exportPartialTx(const bytes_t& hash, bool include_raw_tx) const
+{
+    LOGGER(trace) << "Vault::exportPartialTx(" << uchar_vector(hash).getHex() << ", " << (include_raw_tx ? "true" : "false") << ")" << std::endl;
+    VaultProfiler::Call profilerCall("exportPartialTx");
+
+    return getPartialTx(hash, include_raw_tx).toSerialized();
+}
+
+std::shared_ptr<Tx> Vault::importPartialTx(const PartialTx& partialtx)
+{
+    LOGGER(trace) << "Vault::importPartialTx(" << uchar_vector(partialtx.unsigned_hash()).getHex() << ")" << std::endl;
+    VaultProfiler::Call profilerCall("importPartialTx");
+
+    std::shared_ptr<Tx> tx;
+    {
+        VaultProfiler::Lock lock(mutex);
+        odb::core::session s;
+        odb::core::transaction t(db_->begin());
+        tx = insertPartialTx_unwrapped(partialtx);
+        if (tx) { t.commit(); }
+    }
+
+    signalQueue.flush();
+    return tx;
+}
+
+std::shared_ptr<Tx> Vault::importPartialTxFromString(const std::string& partialtxstr)
+{
+    LOGGER(trace) << "Vault::importPartialTxFromString(...)" << std::endl;
+    VaultProfiler::Call profilerCall("importPartialTxFromString");
+
+    PartialTx partialtx;
+    partialtx.fromSerialized(partialtxstr);
+    return importPartialTx(partialtx);
+}
+
+std::shared_ptr<Tx> Vault::insertPartialTx_unwrapped(const PartialTx& partialtx)
+{
+    using namespace CoinQ::Script;
+    using namespace CoinCrypto;
+
+    std::shared_ptr<Tx> tx;
+    bool inserted = false;
+
+    odb::result<Tx> tx_r(db_->query<Tx>(odb::query<Tx>::unsigned_hash == partialtx.unsigned_hash()));
+    if (tx_r.empty())
+    {
+        if (partialtx.rawtx().empty()) throw TxNotFoundException(partialtx.unsigned_hash());
+
+        std::shared_ptr<Tx> new_tx(new Tx());
+        new_tx->set(partialtx.rawtx(), time(NULL), Tx::UNSIGNED);
+        if (new_tx->unsigned_hash() != partialtx.unsigned_hash()) throw TxMismatchException(partialtx.unsigned_hash());
+
+        tx = insertTx_unwrapped(new_tx);
+        if (!tx) return nullptr;
+        inserted = true;
+    }
+    else
+    {
+        tx = tx_r.begin().load();
+    }
+
+    if (tx->status() != Tx::UNSIGNED)
+    {
+        LOGGER(debug) << "Vault::insertPartialTx_unwrapped - Stored transaction is already signed. Ignore signatures. hash: " << uchar_vector(tx->hash()).getHex() << std::endl;
+        return inserted ? tx : nullptr;
+    }
+
+    txins_t txins = tx->txins();
+    if (txins.size() != partialtx.txins().size()) throw TxMismatchException(tx->hash());
+
+    // The cached signer already holds the parsed and verified inputs. Only the signatures the
+    // container adds need to be verified here.
+    Signer signer(tx->signer());
+    const Coin::Transaction& coin_tx = signer.getTx();
+    unsigned int sigsneeded = signer.sigsneeded();
+
+    unsigned int sigsadded = 0;
+    for (auto& txin: txins)
+    {
+        std::size_t i = txin->txindex();
+        const PartialTxIn& partialtxin = partialtx.txins()[i];
+        const SignableTxIn& stored_stxin = signer.getSignableTxIns()[i];
+        if (partialtxin.sigcount() == 0 || stored_stxin.sigsneeded() == 0) continue;
+
+        if (partialtxin.type() != stored_stxin.type() ||
+            partialtxin.minsigs() != stored_stxin.minsigs() ||
+            partialtxin.redeemscript() != stored_stxin.redeemscript() ||
+            partialtxin.pubkeys() != stored_stxin.pubkeys() ||
+            partialtxin.sigs().size() != partialtxin.pubkeys().size())
+        {
+            throw TxMismatchException(tx->hash());
+        }
+
+        // Only script hash inputs are signed by the vault.
+        if (stored_stxin.redeemscript().empty()) continue;
+
+        // Prefer the amount on record. The container amount is for cosigners that lack the outpoint.
+        uint64_t amount = txin->outpoint() ? txin->outpoint()->value() : partialtxin.amount();
+        bytes_t signingHash = coin_tx.getSigHash(SIGHASH_ALL, i, stored_stxin.redeemscript(), amount);
+
+        SignableTxIn stxin(stored_stxin);
+        unsigned int added = 0;
+        for (std::size_t j = 0; j < partialtxin.pubkeys().size(); j++)
+        {
+            const bytes_t& sig = partialtxin.sigs()[j];
+            if (sig.empty() || !stxin.sigs()[j].empty()) continue;
+
+            // TODO: add support for other hash types.
+            if (sig.back() != SIGHASH_ALL) continue;
+
+            secp256k1_key key;
+            key.setPubKey(partialtxin.pubkeys()[j]);
+            if (!secp256k1_verify(key, signingHash, bytes_t(sig.begin(), sig.end() - 1)))
+            {
+                LOGGER(debug) << "Vault::insertPartialTx_unwrapped - INVALID SIGNATURE FOR INPUT " << i << ", PUBLIC KEY: " << uchar_vector(partialtxin.pubkeys()[j]).getHex() << std::endl;
+                continue;
+            }
+
+            if (stxin.addsig(partialtxin.pubkeys()[j], sig)) { added++; }
+        }
+
+        if (!added) continue;
+
+        LOGGER(debug) << "Vault::insertPartialTx_unwrapped - ADDED " << added << " NEW SIGNATURE(S) TO INPUT " << i << ", " << stxin.sigsneeded() << " STILL NEEDED." << std::endl;
+        txin->script(stxin.txinscript());
+        std::vector<bytes_t> stack;
+        for (auto& item: stxin.scriptwitness().stack) { stack.push_back(item); }
+        txin->scriptwitnessstack(stack);
+        db_->update(txin);
+        sigsadded += added;
+    }
+
+    if (!sigsadded) return inserted ? tx : nullptr;
+
+    // We already know how many signatures are still missing so we don't need to reverify every input.
+    if (sigsadded >= sigsneeded) { tx->updateStatus(); }
+    db_->update(tx);
+
+    updateConfirmations_unwrapped(tx);
+    logTxChange_unwrapped(ChangeLogEntry::TX_UPDATED, *tx);
+    signalQueue.push(notifyTxUpdated.bind(tx));
+    return tx;
+}
+
 unsigned int Vault::exportTxs(const std::string& filepath, uint32_t minheight) const
 {
     LOGGER(trace) << "Vault::exportTxs(" << filepath << ", " << minheight << ")" << std::endl;
+    VaultProfiler::Call profilerCall("exportTxs");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
 
     //TODO: disable opetation if file is already open
@@ -4101,13 +4579,14 @@ unsigned int Vault::exportTxs_unwrapped(boost::archive::text_oarchive& oa, uint3
 unsigned int Vault::importTxs(const std::string& filepath)
 {
     LOGGER(trace) << "Vault::importTxs(" << filepath << ")" << std::endl;
+    VaultProfiler::Call profilerCall("importTxs");
 
     std::ifstream ifs(filepath);
     boost::archive::text_iarchive ia(ifs);
 
     uint32_t n;
     {
-        boost::lock_guard<boost::mutex> lock(mutex);
+        VaultProfiler::Lock lock(mutex);
         odb::core::transaction t(db_->begin());
         n = importTxs_unwrapped(ia);
         t.commit();
@@ -4131,15 +4610,213 @@ unsigned int Vault::importTxs_unwrapped(boost::archive::text_iarchive& ia)
     return n;
 }
 
+///////////////////////////
+// TX ARCHIVE OPERATIONS //
+///////////////////////////
+void Vault::openTxArchive(const std::string& filepath)
+{
+    LOGGER(trace) << "Vault::openTxArchive(" << filepath << ")" << std::endl;
+    VaultProfiler::Call profilerCall("openTxArchive");
+
+    VaultProfiler::Lock lock(mutex);
+    txArchive_ = std::make_shared<TxArchive>(filepath.empty() ? name_ + ".archive" : filepath);
+}
+
+void Vault::openDefaultTxArchive_unwrapped()
+{
+    // Without its archive the vault would take archived transactions for new ones.
+    std::string filepath = name_ + ".archive";
+    if (std::ifstream(filepath).good()) { txArchive_ = std::make_shared<TxArchive>(filepath); }
+}
+
+void Vault::closeTxArchive()
+{
+    LOGGER(trace) << "Vault::closeTxArchive()" << std::endl;
+    VaultProfiler::Call profilerCall("closeTxArchive");
+
+    VaultProfiler::Lock lock(mutex);
+    txArchive_.reset();
+}
+
+unsigned int Vault::archiveTxs(uint32_t min_confirmations, unsigned int max_txs)
+{
+    LOGGER(trace) << "Vault::archiveTxs(" << min_confirmations << ", " << max_txs << ")" << std::endl;
+    VaultProfiler::Call profilerCall("archiveTxs");
+
+    VaultProfiler::Lock lock(mutex);
+    if (!txArchive_) throw std::runtime_error("Transaction archive is not open.");
+    if (min_confirmations < MIN_ARCHIVE_CONFIRMATIONS)
+    {
+        std::stringstream err;
+        err << "Transactions need at least " << MIN_ARCHIVE_CONFIRMATIONS << " confirmations to be archived.";
+        throw std::runtime_error(err.str());
+    }
+
+    odb::core::session s;
+    odb::core::transaction t(db_->begin());
+
+    uint32_t best_height = getBestHeight_unwrapped();
+    if (best_height < min_confirmations) return 0;
+    uint32_t maxheight = best_height + 1 - min_confirmations;
+
+    // Oldest first so parents go before the transactions spending them. Read a page at a time, resuming after
+    // the last row seen, since transactions that are not yet fully spent stay behind.
+    typedef odb::query<Tx> query_t;
+    const unsigned int page_size = max_txs ? max_txs : ARCHIVE_PAGE_SIZE;
+    std::stringstream limit;
+    limit << "LIMIT " << page_size;
+
+    uint32_t last_height = 0;
+    unsigned long last_id = 0;
+    unsigned int count = 0;
+    std::vector<TxArchive::Record> records;
+    while (!max_txs || count < max_txs)
+    {
+        query_t query(query_t::status == Tx::CONFIRMED && query_t::blockheader->height <= maxheight);
+        if (last_id) { query = query && (query_t::blockheader->height > last_height || (query_t::blockheader->height == last_height && query_t::id > last_id)); }
+
+        txs_t txs;
+        odb::result<Tx> r(db_->query<Tx>(query + "ORDER BY" + query_t::blockheader->height + "ASC," + query_t::id + "ASC" + limit.str()));
+        for (auto it = r.begin(); it != r.end(); ++it) { txs.push_back(it.load()); }
+
+        for (auto& tx: txs)
+        {
+            last_height = tx->blockheader()->height();
+            last_id = tx->id();
+
+            if (max_txs && count >= max_txs) break;
+            if (!isTxArchivable_unwrapped(tx, maxheight)) continue;
+            archiveTx_unwrapped(tx, records);
+            count++;
+        }
+
+        if (txs.size() < page_size) break;
+    }
+
+    t.commit();
+
+    // Only append once the rows are gone. Otherwise a failed commit would leave records that make
+    // insertTx skip transactions still in the vault. If an append fails instead, the transactions are
+    // missing from both and a rescan brings them back.
+    for (auto& record: records) { txArchive_->append(record); }
+
+    LOGGER(debug) << "Vault::archiveTxs(...) - archived " << count << " transaction(s) at or below height " << maxheight << "." << std::endl;
+    return count;
+}
+
+txs_t Vault::getArchivedTxs(uint32_t minheight, uint32_t maxheight) const
+{
+    LOGGER(trace) << "Vault::getArchivedTxs(" << minheight << ", " << maxheight << ")" << std::endl;
+    VaultProfiler::Call profilerCall("getArchivedTxs");
+
+    std::shared_ptr<TxArchive> archive = txArchive_;
+    if (!archive) throw std::runtime_error("Transaction archive is not open.");
+
+#if defined(LOCK_ALL_CALLS)
+    VaultProfiler::Lock lock(mutex);
+#endif
+    odb::core::session s;
+    odb::core::transaction t(db_->begin());
+
+    txs_t txs;
+    for (auto& record: archive->getByHeight(minheight, maxheight)) { txs.push_back(getArchivedTx_unwrapped(record)); }
+    return txs;
+}
+
+bool Vault::isTxArchived_unwrapped(const bytes_t& unsigned_hash) const
+{
+    return txArchive_ && txArchive_->contains(unsigned_hash);
+}
+
+bool Vault::isTxArchivable_unwrapped(std::shared_ptr<Tx> tx, uint32_t maxheight) const
+{
+    if (tx->conflicting()) return false;
+
+    for (auto& txout: tx->txouts())
+    {
+        // Outputs to other parties never get spent from our point of view.
+        if (!txout->receiving_account()) continue;
+        if (txout->status() != TxOut::SPENT) return false;
+
+        // A null spent() with SPENT status means the spending transaction is already archived.
+        std::shared_ptr<TxIn> spent = txout->spent();
+        if (!spent) continue;
+
+        std::shared_ptr<Tx> spending_tx = spent->tx();
+        if (!spending_tx || spending_tx->status() != Tx::CONFIRMED) return false;
+
+        std::shared_ptr<BlockHeader> blockheader = spending_tx->blockheader();
+        if (!blockheader || blockheader->height() > maxheight) return false;
+    }
+
+    return true;
+}
+
+void Vault::archiveTx_unwrapped(std::shared_ptr<Tx> tx, std::vector<TxArchive::Record>& records)
+{
+    if (!txArchive_->contains(tx->unsigned_hash()))
+    {
+        TxArchive::Record record;
+        record.hash = tx->hash();
+        record.unsigned_hash = tx->unsigned_hash();
+        record.blockhash = tx->blockheader()->hash();
+        record.height = tx->blockheader()->height();
+        record.timestamp = tx->timestamp();
+        record.have_all_outpoints = tx->have_all_outpoints();
+        record.txin_total = tx->txin_total();
+        record.raw = tx->raw();
+        records.push_back(record);
+    }
+
+    // Outputs we spend stay spent.
+    for (auto& txin: tx->txins())
+    {
+        odb::result<TxOut> txout_r(db_->query<TxOut>(odb::query<TxOut>::spent == txin->id()));
+        if (!txout_r.empty())
+        {
+            std::shared_ptr<TxOut> txout(txout_r.begin().load());
+            txout->detachSpent();
+            db_->update(txout);
+        }
+        db_->erase(txin);
+    }
+
+    // Transactions spending our outputs lose their outpoint links but keep their stored totals.
+    for (auto& txout: tx->txouts())
+    {
+        std::shared_ptr<TxIn> spent = txout->spent();
+        if (spent)
+        {
+            spent->outpoint(nullptr);
+            db_->update(spent);
+        }
+        db_->erase(txout);
+    }
+
+    db_->erase(tx);
+}
+
+std::shared_ptr<Tx> Vault::getArchivedTx_unwrapped(const TxArchive::Record& record) const
+{
+    std::shared_ptr<Tx> tx(new Tx());
+    tx->set(record.raw, record.timestamp, Tx::CONFIRMED);
+    tx->totals(record.have_all_outpoints, record.txin_total);
+
+    odb::result<BlockHeader> r(db_->query<BlockHeader>(odb::query<BlockHeader>::hash == record.blockhash));
+    if (!r.empty()) { tx->blockheader(r.begin().load()); }
+    return tx;
+}
+
 //////////////////////////////
 // SIGNINGSCRIPT OPERATIONS //
 //////////////////////////////
 std::shared_ptr<SigningScript> Vault::getSigningScript(const bytes_t& script) const
 {
     LOGGER(trace) << "Vault::getSigningScript(" << uchar_vector(script).getHex() << ")" << std::endl;
+    VaultProfiler::Call profilerCall("getSigningScript");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::session s;
     odb::core::transaction t(db_->begin());
@@ -4150,7 +4827,12 @@ std::shared_ptr<SigningScript> Vault::getSigningScript(const bytes_t& script) co
 std::shared_ptr<SigningScript> Vault::getSigningScript_unwrapped(const bytes_t& script) const
 {
     typedef odb::query<SigningScript> query_t;
-    odb::result<SigningScript> r(db_->query<SigningScript>(query_t::txoutscript == script));
+    HashQueryParams* params;
+    odb::prepared_query<SigningScript> pq(getPreparedQuery<SigningScript>("Vault::getSigningScript_unwrapped(script)", params, [](HashQueryParams& p) {
+        return query_t::txoutscript == query_t::_ref(p.hash); }));
+    params->hash = script;
+
+    odb::result<SigningScript> r(pq.execute());
     if (r.empty()) throw SigningScriptNotFoundException();
     return r.begin().load(); 
 }
@@ -4161,9 +4843,14 @@ std::shared_ptr<SigningScript> Vault::getSigningScript_unwrapped(const bytes_t&
 uint32_t Vault::getBestHeight() const
 {
     LOGGER(trace) << "Vault::getBestHeight()" << std::endl;
+    VaultProfiler::Call profilerCall("getBestHeight");
+
+    // The tip is usually cached, so skip the lock and the database transaction.
+    std::shared_ptr<BlockHeader> blockheader;
+    if (blockHeaderCache_.getBest(blockheader)) return blockheader ? blockheader->height() : 0;
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::transaction t(db_->begin());
     return getBestHeight_unwrapped();
@@ -4171,17 +4858,17 @@ uint32_t Vault::getBestHeight() const
 
 uint32_t Vault::getBestHeight_unwrapped() const
 {
-    odb::result<BestHeightView> r(db_->query<BestHeightView>());
-    uint32_t best_height = r.empty() ? 0 : r.begin()->height;
-    return best_height;
+    std::shared_ptr<BlockHeader> blockheader = getBestBlockHeader_unwrapped();
+    return blockheader ? blockheader->height() : 0;
 }
 
 std::shared_ptr<BlockHeader> Vault::getBlockHeader(const bytes_t& hash) const
 {
     LOGGER(trace) << "Vault::getBlockHeader(" << uchar_vector(hash).getHex() << ")" << std::endl;
+    VaultProfiler::Call profilerCall("getBlockHeader");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::transaction t(db_->begin());
     return getBlockHeader_unwrapped(hash);
@@ -4190,9 +4877,10 @@ std::shared_ptr<BlockHeader> Vault::getBlockHeader(const bytes_t& hash) const
 std::shared_ptr<BlockHeader> Vault::getBlockHeader(uint32_t height) const
 {
     LOGGER(trace) << "Vault::getBlockHeader(" << height << ")" << std::endl;
+    VaultProfiler::Call profilerCall("getBlockHeader");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::transaction t(db_->begin());
     return getBlockHeader_unwrapped(height);
@@ -4200,24 +4888,52 @@ std::shared_ptr<BlockHeader> Vault::getBlockHeader(uint32_t height) const
 
 std::shared_ptr<BlockHeader> Vault::getBlockHeader_unwrapped(const bytes_t& hash) const
 {
-    odb::result<BlockHeader> r(db_->query<BlockHeader>(odb::query<BlockHeader>::hash == hash));
+    std::shared_ptr<BlockHeader> blockheader = blockHeaderCache_.get(hash);
+    if (blockheader) return blockheader;
+
+    uint64_t generation = blockHeaderCache_.generation();
+    typedef odb::query<BlockHeader> query_t;
+    HashQueryParams* params;
+    odb::prepared_query<BlockHeader> pq(getPreparedQuery<BlockHeader>("Vault::getBlockHeader_unwrapped(hash)", params, [](HashQueryParams& p) {
+        return query_t::hash == query_t::_ref(p.hash); }));
+    params->hash = hash;
+
+    odb::result<BlockHeader> r(pq.execute());
     if (r.empty()) throw BlockHeaderNotFoundException(hash);
-    return r.begin().load();
+    blockheader = r.begin().load();
+    blockHeaderCache_.put(blockheader, generation);
+    return blockheader;
 }
 
 std::shared_ptr<BlockHeader> Vault::getBlockHeader_unwrapped(uint32_t height) const
 {
-    odb::result<BlockHeader> r(db_->query<BlockHeader>(odb::query<BlockHeader>::height == height));
+    std::shared_ptr<BlockHeader> blockheader = blockHeaderCache_.get(height);
+    if (blockheader) return blockheader;
+
+    uint64_t generation = blockHeaderCache_.generation();
+    typedef odb::query<BlockHeader> query_t;
+    HeightQueryParams* params;
+    odb::prepared_query<BlockHeader> pq(getPreparedQuery<BlockHeader>("Vault::getBlockHeader_unwrapped(height)", params, [](HeightQueryParams& p) {
+        return query_t::height == query_t::_ref(p.height); }));
+    params->height = height;
+
+    odb::result<BlockHeader> r(pq.execute());
     if (r.empty()) throw BlockHeaderNotFoundException(height);
-    return r.empty() ? nullptr : r.begin().load();
+    blockheader = r.begin().load();
+    blockHeaderCache_.put(blockheader, generation);
+    return blockheader;
 }
 
 std::shared_ptr<BlockHeader> Vault::getBestBlockHeader() const
 {
     LOGGER(trace) << "Vault::getBestBlockHeader()" << std::endl;
+    VaultProfiler::Call profilerCall("getBestBlockHeader");
+
+    std::shared_ptr<BlockHeader> blockheader;
+    if (blockHeaderCache_.getBest(blockheader)) return blockheader;
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::transaction t(db_->begin());
     return getBestBlockHeader_unwrapped();
@@ -4225,21 +4941,34 @@ std::shared_ptr<BlockHeader> Vault::getBestBlockHeader() const
 
 std::shared_ptr<BlockHeader> Vault::getBestBlockHeader_unwrapped() const
 {
-    odb::result<BlockHeader> r(db_->query<BlockHeader>("ORDER BY" + odb::query<BlockHeader>::height + "DESC LIMIT 1"));
-    if (r.empty()) return nullptr;
-    return r.begin().load();
+    std::shared_ptr<BlockHeader> blockheader;
+    if (blockHeaderCache_.getBest(blockheader)) return blockheader;
+
+    uint64_t generation = blockHeaderCache_.generation();
+    typedef odb::query<BlockHeader> query_t;
+    NoQueryParams* params;
+    odb::prepared_query<BlockHeader> pq(getPreparedQuery<BlockHeader>("Vault::getBestBlockHeader_unwrapped()", params, [](NoQueryParams&) {
+        return query_t("ORDER BY" + query_t::height + "DESC LIMIT 1"); }));
+
+    odb::result<BlockHeader> r(pq.execute());
+    if (!r.empty()) { blockheader = r.begin().load(); }
+    blockHeaderCache_.putBest(blockheader, generation);
+    return blockheader;
 }
 
 std::shared_ptr<MerkleBlock> Vault::insertMerkleBlock(std::shared_ptr<MerkleBlock> merkleblock)
 {
     LOGGER(trace) << "Vault::insertMerkleBlock(" << uchar_vector(merkleblock->blockheader()->hash()).getHex() << ")" << std::endl;
+    VaultProfiler::Call profilerCall("insertMerkleBlock");
 
     {
-        boost::lock_guard<boost::mutex> lock(mutex);
+        VaultProfiler::Lock lock(mutex);
+        BlockHeaderCache::WriteGuard cacheGuard(blockHeaderCache_);
         odb::core::session s;
         odb::core::transaction t(db_->begin());
         merkleblock = insertMerkleBlock_unwrapped(merkleblock);
         t.commit();
+        cacheGuard.commit();
     }
 
     signalQueue.flush();
@@ -4279,6 +5008,8 @@ std::shared_ptr<MerkleBlock> Vault::insertMerkleBlock_unwrapped(std::shared_ptr<
             LOGGER(debug) << "Vault::insertMerkleBlock_unwrapped - inserting horizon merkle block. hash: " << new_blockheader_hash << ", height: " << new_blockheader->height() << std::endl;
             db_->persist(new_blockheader);
             db_->persist(merkleblock);
+            blockHeaderCache_.stageBest(new_blockheader);
+            logChange_unwrapped(ChangeLogEntry::BLOCK_CONNECTED, new_blockheader->hash(), new_blockheader->height());
             signalQueue.push(notifyMerkleBlockInserted.bind(merkleblock));
             //notifyMerkleBlockInserted(merkleblock);
             return merkleblock;
@@ -4318,6 +5049,8 @@ std::shared_ptr<MerkleBlock> Vault::insertMerkleBlock_unwrapped(std::shared_ptr<
         LOGGER(debug) << "Vault::insertMerkleBlock_unwrapped - inserting merkle block. hash: " << new_blockheader_hash << ", height: " << new_blockheader->height() << std::endl;
         db_->persist(new_blockheader);
         db_->persist(merkleblock);
+        blockHeaderCache_.stageBest(new_blockheader);
+        logChange_unwrapped(ChangeLogEntry::BLOCK_CONNECTED, new_blockheader->hash(), new_blockheader->height());
         signalQueue.push(notifyMerkleBlockInserted.bind(merkleblock));
 
         // Confirm transactions
@@ -4335,6 +5068,7 @@ std::shared_ptr<MerkleBlock> Vault::insertMerkleBlock_unwrapped(std::shared_ptr<
             tx.blockheader(new_blockheader);
             db_->update(tx);
             confirmations_updated = true;
+            logTxChange_unwrapped(ChangeLogEntry::TX_UPDATED, tx);
             signalQueue.push(notifyTxUpdated.bind(std::make_shared<Tx>(tx)));
         }
 
@@ -4352,6 +5086,41 @@ std::shared_ptr<MerkleBlock> Vault::insertMerkleBlock_unwrapped(std::shared_ptr<
     }
 }
 
+unsigned int Vault::insertMerkleBlocks(const std::vector<merkle_block_txs_t>& blocks)
+{
+    LOGGER(trace) << "Vault::insertMerkleBlocks(" << blocks.size() << " blocks)" << std::endl;
+    VaultProfiler::Call profilerCall("insertMerkleBlocks");
+
+    unsigned int count = 0;
+    {
+        VaultProfiler::Lock lock(mutex);
+        BlockHeaderCache::WriteGuard cacheGuard(blockHeaderCache_);
+        odb::core::session s;
+        odb::core::transaction t(db_->begin());
+        for (auto& block: blocks)
+        {
+            const ChainMerkleBlock& chainmerkleblock = block.first;
+            const std::vector<Coin::Transaction>& cointxs = block.second;
+            if (cointxs.empty())
+            {
+                insertMerkleBlock_unwrapped(std::make_shared<MerkleBlock>(chainmerkleblock));
+                continue;
+            }
+
+            unsigned int txcount = cointxs.size();
+            for (unsigned int txindex = 0; txindex < txcount; txindex++)
+            {
+                if (insertMerkleTx_unwrapped(chainmerkleblock, cointxs[txindex], txindex, txcount)) { count++; }
+            }
+        }
+        t.commit();
+        cacheGuard.commit();
+    }
+
+    signalQueue.flush();
+    return count;
+}
+
 unsigned int Vault::deleteMerkleBlock(const bytes_t& hash)
 {
     return 0;
@@ -4360,14 +5129,17 @@ unsigned int Vault::deleteMerkleBlock(const bytes_t& hash)
 unsigned int Vault::deleteMerkleBlock(uint32_t height)
 {
     LOGGER(trace) << "Vault::deleteMerkleBlock(" << height << ")" << std::endl;
+    VaultProfiler::Call profilerCall("deleteMerkleBlock");
 
     unsigned int count;
     {
-        boost::lock_guard<boost::mutex> lock(mutex);
+        VaultProfiler::Lock lock(mutex);
+        BlockHeaderCache::WriteGuard cacheGuard(blockHeaderCache_);
         odb::core::session s;
         odb::core::transaction t(db_->begin());
         count = deleteMerkleBlock_unwrapped(height);
         t.commit();
+        cacheGuard.commit();
     }
 
     signalQueue.flush();
@@ -4422,6 +5194,7 @@ unsigned int Vault::deleteMerkleBlock_unwrapped(uint32_t height)
     //            LOGGER(debug) << "Vault::deleteMerkleBlock_unwrapped - unconfirming transaction. hash: " << uchar_vector(tx.hash()).getHex() << std::endl;
                 tx.blockheader(nullptr);
                 db_->update(tx);
+                logTxChange_unwrapped(ChangeLogEntry::TX_UPDATED, tx);
                 signalQueue.push(notifyTxUpdated.bind(std::make_shared<Tx>(tx)));
                 //notifyTxUpdated(std::make_shared<Tx>(tx));
             }
@@ -4430,11 +5203,13 @@ unsigned int Vault::deleteMerkleBlock_unwrapped(uint32_t height)
             db_->erase_query<MerkleBlock>(odb::query<MerkleBlock>::blockheader == blockheader.id());
 
             // Delete block header
+            logChange_unwrapped(ChangeLogEntry::BLOCK_DISCONNECTED, blockheader.hash(), blockheader.height());
             db_->erase(blockheader);
 
             count++;
         }
 
+        if (count > 0) { blockHeaderCache_.invalidate(); }
         return count;
     }
     catch (...)
@@ -4466,6 +5241,7 @@ unsigned int Vault::updateConfirmations_unwrapped(std::shared_ptr<Tx> tx)
 
             tx->blockheader(blockheader);
             db_->update(tx);
+            logTxChange_unwrapped(ChangeLogEntry::TX_UPDATED, *tx);
             signalQueue.push(notifyTxUpdated.bind(tx));
             count++;
             LOGGER(debug) << "Vault::updateConfirmations_unwrapped - transaction " << uchar_vector(tx->hash()).getHex() << " confirmed in block " << uchar_vector(tx->blockheader()->hash()).getHex() << " height: " << tx->blockheader()->height() << std::endl;
@@ -4483,9 +5259,10 @@ unsigned int Vault::updateConfirmations_unwrapped(std::shared_ptr<Tx> tx)
 void Vault::exportMerkleBlocks(const std::string& filepath) const
 {
     LOGGER(trace) << "Vault::exportMerkleBlocks(" << filepath << ")" << std::endl;
+    VaultProfiler::Call profilerCall("exportMerkleBlocks");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
 
     // TODO: Disable operation if file is already open
@@ -4511,16 +5288,19 @@ void Vault::exportMerkleBlocks_unwrapped(boost::archive::text_oarchive& oa) cons
 void Vault::importMerkleBlocks(const std::string& filepath)
 {
     LOGGER(trace) << "Vault::importMerkleBlocks(" << filepath << ")" << std::endl;
+    VaultProfiler::Call profilerCall("importMerkleBlocks");
 
     std::ifstream ifs(filepath);
     boost::archive::text_iarchive ia(ifs);
 
     {
-        boost::lock_guard<boost::mutex> lock(mutex);
+        VaultProfiler::Lock lock(mutex);
+        BlockHeaderCache::WriteGuard cacheGuard(blockHeaderCache_);
         odb::core::session s;
         odb::core::transaction t(db_->begin());
         importMerkleBlocks_unwrapped(ia);
         t.commit();
+        cacheGuard.commit();
     }
 
     signalQueue.flush();
@@ -4544,8 +5324,9 @@ void Vault::importMerkleBlocks_unwrapped(boost::archive::text_iarchive& ia)
 std::shared_ptr<User> Vault::addUser(const std::string& username, bool txoutscript_whitelist_enabled)
 {
     LOGGER(trace) << "Vault::addUser(" << username << ", " << (txoutscript_whitelist_enabled ? "true" : "false") << ")" << std::endl;
+    VaultProfiler::Call profilerCall("addUser");
 
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
     odb::core::transaction t(db_->begin());
     std::shared_ptr<User> user = addUser_unwrapped(username, txoutscript_whitelist_enabled);
     t.commit();
@@ -4567,9 +5348,10 @@ std::shared_ptr<User> Vault::addUser_unwrapped(const std::string& username, bool
 std::shared_ptr<User> Vault::getUser(const std::string& username) const
 {
     LOGGER(trace) << "Vault::getUser(" << username << ")" << std::endl;
+    VaultProfiler::Call profilerCall("getUser");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::transaction t(db_->begin());
     return getUser_unwrapped(username);
@@ -4587,9 +5369,10 @@ std::shared_ptr<User> Vault::getUser_unwrapped(const std::string& username) cons
 const std::set<bytes_t>& Vault::getTxOutScriptWhitelist(const std::string& username) const
 {
     LOGGER(trace) << "Vault::getTxOutScriptWhitelist(" << username << ")" << std::endl;
+    VaultProfiler::Call profilerCall("getTxOutScriptWhitelist");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::transaction t(db_->begin());
 
@@ -4600,8 +5383,9 @@ const std::set<bytes_t>& Vault::getTxOutScriptWhitelist(const std::string& usern
 std::shared_ptr<User> Vault::setTxOutScriptWhitelist(const std::string& username, const std::set<bytes_t>& txoutscripts)
 {
     LOGGER(trace) << "Vault::setTxOutScriptWhitelist(" << username << ", ...)" << std::endl;
+    VaultProfiler::Call profilerCall("setTxOutScriptWhitelist");
 
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
     odb::core::transaction t(db_->begin());
     std::shared_ptr<User> user = getUser_unwrapped(username);
     user->txoutscript_whitelist(txoutscripts);
@@ -4614,8 +5398,9 @@ std::shared_ptr<User> Vault::setTxOutScriptWhitelist(const std::string& username
 std::shared_ptr<User> Vault::addTxOutScriptToWhitelist(const std::string& username, const bytes_t& txoutscript)
 {
     LOGGER(trace) << "Vault::addTxOutScriptToWhitelist(" << username << ", " << uchar_vector(txoutscript).getHex() << ")" << std::endl;
+    VaultProfiler::Call profilerCall("addTxOutScriptToWhitelist");
 
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
     odb::core::transaction t(db_->begin());
     std::shared_ptr<User> user = getUser_unwrapped(username);
     user->addTxOutScriptToWhitelist(txoutscript);
@@ -4628,8 +5413,9 @@ std::shared_ptr<User> Vault::addTxOutScriptToWhitelist(const std::string& userna
 std::shared_ptr<User> Vault::removeTxOutScriptFromWhitelist(const std::string& username, const bytes_t& txoutscript)
 {
     LOGGER(trace) << "Vault::removeTxOutScriptToWhitelist(" << username << ", " << uchar_vector(txoutscript).getHex() << ")" << std::endl;
+    VaultProfiler::Call profilerCall("removeTxOutScriptFromWhitelist");
 
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
     odb::core::transaction t(db_->begin());
     std::shared_ptr<User> user = getUser_unwrapped(username);
     if (user->removeTxOutScriptFromWhitelist(txoutscript))
@@ -4644,8 +5430,9 @@ std::shared_ptr<User> Vault::removeTxOutScriptFromWhitelist(const std::string& u
 std::shared_ptr<User> Vault::clearTxOutScriptWhitelist(const std::string& username)
 {
     LOGGER(trace) << "Vault::clearTxOutScriptWhitelist()" << std::endl;
+    VaultProfiler::Call profilerCall("clearTxOutScriptWhitelist");
 
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
     odb::core::transaction t(db_->begin());
     std::shared_ptr<User> user = getUser_unwrapped(username);
     user->clearTxOutScriptWhitelist();
@@ -4658,8 +5445,9 @@ std::shared_ptr<User> Vault::clearTxOutScriptWhitelist(const std::string& userna
 std::shared_ptr<User> Vault::enableTxOutScriptWhitelist(const std::string& username, bool enable)
 {
     LOGGER(trace) << "Vault::enableTxOutScriptWhitelist(" << username << ", " << (enable ? "true" : "false") << ")" << std::endl;
+    VaultProfiler::Call profilerCall("enableTxOutScriptWhitelist");
 
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
     odb::core::transaction t(db_->begin());
     std::shared_ptr<User> user = getUser_unwrapped(username);
     if (user->isTxOutScriptWhitelistEnabled() != enable)
@@ -4675,12 +5463,113 @@ std::shared_ptr<User> Vault::enableTxOutScriptWhitelist(const std::string& usern
 bool Vault::isTxOutScriptWhitelistEnabled(const std::string& username) const
 {
     LOGGER(trace) << "Vault::isTxOutScriptWhitelistEnabled(" << username << ")" << std::endl;
+    VaultProfiler::Call profilerCall("isTxOutScriptWhitelistEnabled");
 
 #if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
+    VaultProfiler::Lock lock(mutex);
 #endif
     odb::core::transaction t(db_->begin());
 
     std::shared_ptr<User> user = getUser_unwrapped(username);
     return user->isTxOutScriptWhitelistEnabled();
 }
+
+
+///////////////////////////
+// CHANGE LOG OPERATIONS //
+///////////////////////////
+changelog_t Vault::getChangesSince(unsigned long sequence, unsigned int limit) const
+{
+    LOGGER(trace) << "Vault::getChangesSince(" << sequence << ", " << limit << ")" << std::endl;
+    VaultProfiler::Call profilerCall("getChangesSince");
+
+#if defined(LOCK_ALL_CALLS)
+    VaultProfiler::Lock lock(mutex);
+#endif
+    odb::core::transaction t(db_->begin());
+
+    typedef odb::query<ChangeLogEntry> query_t;
+    query_t query((query_t::sequence > sequence) + "ORDER BY" + query_t::sequence);
+    if (limit > 0)
+    {
+        std::stringstream ss;
+        ss << "LIMIT " << limit;
+        query = query + ss.str();
+    }
+
+    changelog_t changes;
+    odb::result<ChangeLogEntry> r(db_->query<ChangeLogEntry>(query));
+    for (auto& entry: r) { changes.push_back(std::make_shared<ChangeLogEntry>(entry)); }
+    return changes;
+}
+
+unsigned long Vault::getLastChangeSequence() const
+{
+    LOGGER(trace) << "Vault::getLastChangeSequence()" << std::endl;
+    VaultProfiler::Call profilerCall("getLastChangeSequence");
+
+#if defined(LOCK_ALL_CALLS)
+    VaultProfiler::Lock lock(mutex);
+#endif
+    odb::core::transaction t(db_->begin());
+    return getLastChangeSequence_unwrapped();
+}
+
+bool Vault::waitForChanges(unsigned long sequence, unsigned int timeout_ms) const
+{
+    LOGGER(trace) << "Vault::waitForChanges(" << sequence << ", " << timeout_ms << ")" << std::endl;
+    VaultProfiler::Call profilerCall("waitForChanges");
+
+    boost::chrono::steady_clock::time_point deadline = boost::chrono::steady_clock::now() + boost::chrono::milliseconds(timeout_ms);
+    while (true)
+    {
+        // Take the generation before checking so a commit in between still wakes us.
+        uint64_t generation;
+        {
+            boost::lock_guard<boost::mutex> lock(changeMutex_);
+            generation = changeGeneration_;
+        }
+
+        if (getLastChangeSequence() > sequence) return true;
+
+        boost::chrono::steady_clock::time_point now = boost::chrono::steady_clock::now();
+        if (now >= deadline) return false;
+
+        boost::chrono::steady_clock::time_point wakeup = std::min(deadline, now + boost::chrono::milliseconds(CHANGE_POLL_INTERVAL));
+        boost::unique_lock<boost::mutex> lock(changeMutex_);
+        changeCondition_.wait_until(lock, wakeup, [&]() { return changeGeneration_ != generation; });
+    }
+}
+
+void Vault::logChange_unwrapped(ChangeLogEntry::type_t type, const bytes_t& hash, uint32_t height, const std::string& info)
+{
+    std::shared_ptr<ChangeLogEntry> entry(new ChangeLogEntry(type, hash, height, info));
+    db_->persist(entry);
+
+    // Waiters are woken when the writer flushes its signals after committing.
+    signalQueue.push([this]() {
+        {
+            boost::lock_guard<boost::mutex> lock(changeMutex_);
+            changeGeneration_++;
+        }
+        changeCondition_.notify_all();
+    });
+}
+
+void Vault::logTxChange_unwrapped(ChangeLogEntry::type_t type, const Tx& tx)
+{
+    uint32_t height = tx.blockheader() ? tx.blockheader()->height() : 0;
+    logChange_unwrapped(type, tx.unsigned_hash(), height, Tx::getStatusString(tx.status(), true));
+}
+
+void Vault::logScriptIssued_unwrapped(std::shared_ptr<SigningScript> script, std::shared_ptr<AccountBin> bin)
+{
+    logChange_unwrapped(ChangeLogEntry::SCRIPT_ISSUED, script->txoutscript(), 0, bin->account_name());
+}
+
+unsigned long Vault::getLastChangeSequence_unwrapped() const
+{
+    typedef odb::query<ChangeLogEntry> query_t;
+    odb::result<ChangeLogEntry> r(db_->query<ChangeLogEntry>("ORDER BY" + query_t::sequence + "DESC LIMIT 1"));
+    return r.empty() ? 0 : r.begin()->sequence();
+}
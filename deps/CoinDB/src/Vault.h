@@ -15,6 +15,10 @@
 #include "VaultExceptions.h"
 #include "SigningRequest.h"
 #include "SignatureInfo.h"
+#include "PartialTx.h"
+#include "TxArchive.h"
+#include "BlockHeaderCache.h"
+#include "VaultProfiler.h"
 
 #include <Signals/Signals.h>
 #include <Signals/SignalQueue.h>
@@ -80,6 +84,7 @@ public:
     uint32_t                                getHorizonHeight() const;
     std::vector<bytes_t>                    getLocatorHashes() const;
     Coin::BloomFilter                       getBloomFilter(double falsePositiveRate, uint32_t nTweak, uint32_t nFlags) const;
+    std::vector<bytes_t>                    getBloomFilterElements() const; // Elements getBloomFilter inserts. Lets several vaults share one filter.
     hashvector_t                            getIncompleteBlockHashes() const;
 
     void                                    exportVault(const std::string& filepath, bool exportprivkeys = true) const;
@@ -142,6 +147,8 @@ public:
     uint64_t                                getAccountBalance(const std::string& account_name, unsigned int min_confirmations = 1, int tx_flags = Tx::ALL) const;
     std::shared_ptr<AccountBin>             addAccountBin(const std::string& account_name, const std::string& bin_name);
     std::shared_ptr<SigningScript>          issueSigningScript(const std::string& account_name, const std::string& bin_name = DEFAULT_BIN_NAME, const std::string& label = "", uint32_t index = 0, const std::string& username = std::string());
+    std::vector<std::shared_ptr<SigningScript>> issueSigningScripts(const std::string& account_name, const std::string& bin_name, uint32_t count); // Next count unused scripts in one transaction, unlabeled.
+    void                                    setSigningScriptLabels(const std::vector<std::pair<unsigned long, std::string>>& labels); // By database id, in one transaction.
     void                                    refillAccountPool(const std::string& account_name);
 
     // empty account_name or bin_name means do not filter on those fields
@@ -184,6 +191,8 @@ public:
     SigningRequest                          getSigningRequest(unsigned long tx_id, bool include_raw_tx = false) const; // Throws TxNotFoundException.
     SignatureInfo                           getSignatureInfo(const bytes_t& hash) const; // Tries both signed and unsigned hashes. Throws TxNotFoundException.
     SignatureInfo                           getSignatureInfo(unsigned long tx_id) const; // Throws TxNotFoundException.
+    PartialTx                               getPartialTx(const bytes_t& hash, bool include_raw_tx = false) const; // Tries both signed and unsigned hashes. Throws TxNotFoundException.
+    PartialTx                               getPartialTx(unsigned long tx_id, bool include_raw_tx = false) const; // Throws TxNotFoundException.
     // signTx tries only unsigned hashes for named keychains. If no keychains are named, tries all keychains. For signed hashes, signTx just returns the already signed transaction. Throws TxNotFoundException.
     std::shared_ptr<Tx>                     signTx(const bytes_t& hash, std::vector<std::string>& keychain_names, bool update = false);
     std::shared_ptr<Tx>                     signTx(unsigned long tx_id, std::vector<std::string>& keychain_names, bool update = false);
@@ -200,9 +209,32 @@ public:
     std::string                             exportTx(std::shared_ptr<Tx> tx) const;
     std::shared_ptr<Tx>                     importTx(const std::string& filepath);
     std::shared_ptr<Tx>                     importTxFromString(const std::string& txstr);
+    std::string                             exportPartialTx(const bytes_t& hash, bool include_raw_tx = false) const;
+    // Merges verified signatures into the stored transaction, touching only inputs that gain signatures. Returns nullptr if nothing changed.
+    // If the transaction is not in the vault the container's raw tx is inserted first. Throws TxNotFoundException if there is none.
+    std::shared_ptr<Tx>                     importPartialTx(const PartialTx& partialtx);
+    std::shared_ptr<Tx>                     importPartialTxFromString(const std::string& partialtxstr);
     unsigned int                            exportTxs(const std::string& filepath, uint32_t minheight = 0) const;
     unsigned int                            importTxs(const std::string& filepath);
 
+    ///////////////////////////
+    // TX ARCHIVE OPERATIONS //
+    ///////////////////////////
+    // Archived transactions leave the vault tables but getTx(hash) still finds them. Defaults to <dbname>.archive,
+    // which open() also opens if it exists.
+    void                                    openTxArchive(const std::string& filepath = "");
+    void                                    closeTxArchive();
+    bool                                    isTxArchiveOpen() const { return !!txArchive_; }
+    // Archived transactions cannot be put back, so a reorg must never reach them.
+    static const uint32_t                   MIN_ARCHIVE_CONFIRMATIONS = 100;
+    // Candidates archiveTxs reads per query when max_txs = 0.
+    static const unsigned int               ARCHIVE_PAGE_SIZE = 1000;
+    // Moves confirmed transactions with at least min_confirmations whose own outputs are all spent by transactions
+    // at least as deep. Throws if min_confirmations < MIN_ARCHIVE_CONFIRMATIONS. Pass max_txs = 0 for no limit.
+    // Returns number of transactions archived.
+    unsigned int                            archiveTxs(uint32_t min_confirmations, unsigned int max_txs = 0);
+    txs_t                                   getArchivedTxs(uint32_t minheight, uint32_t maxheight) const;
+
     //////////////////////////////
     // SIGNINGSCRIPT OPERATIONS //
     //////////////////////////////
@@ -216,6 +248,10 @@ public:
     std::shared_ptr<BlockHeader>            getBlockHeader(uint32_t height) const;
     std::shared_ptr<BlockHeader>            getBestBlockHeader() const;
     std::shared_ptr<MerkleBlock>            insertMerkleBlock(std::shared_ptr<MerkleBlock> merkleblock);
+    // Inserts consecutive merkle blocks in one database transaction. Each block's transactions are the ones it matched,
+    // in block order. Returns the number of transactions inserted or updated.
+    typedef std::pair<ChainMerkleBlock, std::vector<Coin::Transaction>> merkle_block_txs_t;
+    unsigned int                            insertMerkleBlocks(const std::vector<merkle_block_txs_t>& blocks);
     unsigned int                            deleteMerkleBlock(const bytes_t& hash);
     unsigned int                            deleteMerkleBlock(uint32_t height);
     void                                    exportMerkleBlocks(const std::string& filepath) const;
@@ -234,6 +270,27 @@ public:
     std::shared_ptr<User>                   enableTxOutScriptWhitelist(const std::string& username, bool enabled = true);
     bool                                    isTxOutScriptWhitelistEnabled(const std::string& username) const;
 
+    ///////////////////////////
+    // CHANGE LOG OPERATIONS //
+    ///////////////////////////
+    // Each mutation appends entries in its own database transaction. Mirrors keep the last sequence they
+    // processed and ask for what came after it.
+    changelog_t                             getChangesSince(unsigned long sequence, unsigned int limit = 0) const; // Pass limit = 0 for no limit.
+    unsigned long                           getLastChangeSequence() const;
+    // Returns false if nothing past sequence was committed within timeout_ms. Commits by other processes
+    // are picked up within CHANGE_POLL_INTERVAL milliseconds.
+    enum { CHANGE_POLL_INTERVAL = 1000 };
+    bool                                    waitForChanges(unsigned long sequence, unsigned int timeout_ms) const;
+
+    ///////////////
+    // PROFILING //
+    ///////////////
+    // Call counts and latencies of the public methods, shared by all vaults in the process. See VaultProfiler.
+    static void                             enableProfiling(bool enabled = true) { VaultProfiler::enable(enabled); }
+    static bool                             isProfilingEnabled() { return VaultProfiler::enabled(); }
+    static vault_stats_t                    getStats() { return VaultProfiler::getStats(); }
+    static void                             resetStats() { VaultProfiler::reset(); }
+
     ////////////////////////
     // SLOT SUBSCRIPTIONS //
     ////////////////////////
@@ -242,6 +299,7 @@ public:
 
     Signals::Connection subscribeTxInserted(TxSignal::Slot slot) { return notifyTxInserted.connect(slot); }
     Signals::Connection subscribeTxUpdated(TxSignal::Slot slot) { return notifyTxUpdated.connect(slot); }
+    void unsubscribeTxUpdated(Signals::Connection connection) { notifyTxUpdated.disconnect(connection); }
     Signals::Connection subscribeTxDeleted(TxSignal::Slot slot) { return notifyTxDeleted.connect(slot); }
     Signals::Connection subscribeMerkleBlockInserted(MerkleBlockSignal::Slot slot) { return notifyMerkleBlockInserted.connect(slot); }
 
@@ -281,6 +339,7 @@ protected:
     uint32_t                                getHorizonHeight_unwrapped() const;
     std::vector<bytes_t>                    getLocatorHashes_unwrapped() const;
     Coin::BloomFilter                       getBloomFilter_unwrapped(double falsePositiveRate, uint32_t nTweak, uint32_t nFlags) const;
+    std::vector<bytes_t>                    getBloomFilterElements_unwrapped() const;
     hashvector_t                            getIncompleteBlockHashes_unwrapped() const;
 
     ////////////////////////
@@ -333,6 +392,7 @@ protected:
     ////////////////////////////
     std::shared_ptr<AccountBin>             getAccountBin_unwrapped(const std::string& account_name, const std::string& bin_name) const;
     std::shared_ptr<SigningScript>          issueAccountBinSigningScript_unwrapped(std::shared_ptr<AccountBin> account_bin, const std::string& label = "", uint32_t index = 0);
+    std::vector<std::shared_ptr<SigningScript>> issueAccountBinSigningScripts_unwrapped(std::shared_ptr<AccountBin> account_bin, uint32_t count);
     void                                    refillAccountBinPool_unwrapped(std::shared_ptr<AccountBin> bin, uint32_t index = 0);
     void                                    exportAccountBin_unwrapped(const std::shared_ptr<AccountBin> account_bin, const std::string& export_name, const std::string& filepath) const;
     std::shared_ptr<AccountBin>             importAccountBin_unwrapped(const std::string& filepath); 
@@ -358,6 +418,8 @@ protected:
     void                                    updateTx_unwrapped(std::shared_ptr<Tx> tx);
     SigningRequest                          getSigningRequest_unwrapped(std::shared_ptr<Tx> tx, bool include_raw_tx = false) const;
     SignatureInfo                           getSignatureInfo_unwrapped(std::shared_ptr<Tx> tx) const;
+    PartialTx                               getPartialTx_unwrapped(std::shared_ptr<Tx> tx, bool include_raw_tx = false) const;
+    std::shared_ptr<Tx>                     insertPartialTx_unwrapped(const PartialTx& partialtx);
     unsigned int                            signTx_unwrapped(std::shared_ptr<Tx> tx, std::vector<std::string>& keychain_names); // Tries to sign as many as it can with the unlocked keychains.
 
     std::shared_ptr<TxOut>                  getTxOut_unwrapped(const bytes_t& outhash, uint32_t outindex) const;
@@ -367,6 +429,12 @@ protected:
     unsigned int                            exportTxs_unwrapped(boost::archive::text_oarchive& oa, uint32_t minheight) const;
     unsigned int                            importTxs_unwrapped(boost::archive::text_iarchive& ia);
 
+    bool                                    isTxArchived_unwrapped(const bytes_t& unsigned_hash) const;
+    bool                                    isTxArchivable_unwrapped(std::shared_ptr<Tx> tx, uint32_t maxheight) const;
+    void                                    openDefaultTxArchive_unwrapped();
+    void                                    archiveTx_unwrapped(std::shared_ptr<Tx> tx, std::vector<TxArchive::Record>& records);
+    std::shared_ptr<Tx>                     getArchivedTx_unwrapped(const TxArchive::Record& record) const;
+
     //////////////////////////////
     // SIGNINGSCRIPT OPERATIONS //
     //////////////////////////////
@@ -394,6 +462,14 @@ protected:
     std::shared_ptr<User>                   addUser_unwrapped(const std::string& username, bool txoutscript_whitelist_enabled = false);
     std::shared_ptr<User>                   getUser_unwrapped(const std::string& username) const;
 
+    ///////////////////////////
+    // CHANGE LOG OPERATIONS //
+    ///////////////////////////
+    void                                    logChange_unwrapped(ChangeLogEntry::type_t type, const bytes_t& hash, uint32_t height = 0, const std::string& info = std::string());
+    void                                    logTxChange_unwrapped(ChangeLogEntry::type_t type, const Tx& tx);
+    void                                    logScriptIssued_unwrapped(std::shared_ptr<SigningScript> script, std::shared_ptr<AccountBin> bin);
+    unsigned long                           getLastChangeSequence_unwrapped() const;
+
     /////////////
     // SIGNALS //
     /////////////
@@ -417,6 +493,15 @@ private:
     std::shared_ptr<odb::core::database> db_;
     std::string name_;
 
+    std::shared_ptr<TxArchive> txArchive_;
+
+    mutable BlockHeaderCache blockHeaderCache_;
+
+    // Bumped whenever a commit that logged changes is flushed, to wake waitForChanges().
+    mutable boost::mutex changeMutex_;
+    mutable boost::condition_variable changeCondition_;
+    uint64_t changeGeneration_ = 0;
+
     mutable std::map<std::string, secure_bytes_t> mapPrivateKeyUnlock;
 };
 
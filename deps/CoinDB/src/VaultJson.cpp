@@ -0,0 +1,153 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// VaultJson.cpp
+//
+// Copyright (c) 2011-2016 Ciphrex Corp.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+//
+
+#include "VaultJson.h"
+
+using namespace CoinDB;
+using namespace CoinQ::Script;
+using stdutils::JsonWriter;
+
+namespace
+{
+    inline uint32_t confirmations(uint32_t height, uint32_t best_height)
+    {
+        return height == 0 || height > best_height ? 0 : best_height - height + 1;
+    }
+
+    inline void writeHeight(JsonWriter& writer, uint32_t height)
+    {
+        writer.key("height");
+        if (height) { writer.value(height); }
+        else        { writer.null(); }
+    }
+}
+
+void CoinDB::writeJson(JsonWriter& writer, const Coin::Transaction& tx, const CoinQ::CoinParams& coinParams)
+{
+    writer.beginObject();
+    writer.hexField("hash", tx.getHashLittleEndian());
+    writer.field("version", tx.version);
+
+    writer.key("inputs").beginArray();
+    for (auto& txin: tx.inputs)
+    {
+        writer.beginObject();
+        writer.key("outpoint_hash").hex(txin.previousOut.hash, sizeof(txin.previousOut.hash));
+        writer.field("outpoint_index", txin.previousOut.index);
+        writer.hexField("script", txin.scriptSig);
+        writer.field("sequence", txin.sequence);
+        writer.endObject();
+    }
+    writer.endArray();
+
+    writer.key("outputs").beginArray();
+    for (auto& txout: tx.outputs)
+    {
+        writer.beginObject();
+        writer.field("value", txout.value);
+        writer.hexField("script", txout.scriptPubKey);
+        writer.field("address", getAddressForTxOutScript(txout.scriptPubKey, coinParams.address_versions()));
+        writer.endObject();
+    }
+    writer.endArray();
+
+    writer.field("locktime", tx.lockTime);
+    writer.endObject();
+}
+
+void CoinDB::writeJson(JsonWriter& writer, const TxView& view, uint32_t best_height)
+{
+    writer.beginObject();
+    writer.field("id", view.id);
+    writer.hexField("hash", view.status == Tx::UNSIGNED ? view.unsigned_hash : view.hash);
+    writer.hexField("unsignedhash", view.unsigned_hash);
+    writer.field("version", view.version);
+    writer.field("locktime", view.locktime);
+    writer.field("timestamp", view.timestamp);
+    writer.field("status", Tx::getStatusString(view.status));
+    writeHeight(writer, view.height);
+    writer.field("confirmations", confirmations(view.height, best_height));
+
+    // Input totals are only known once every outpoint is in the vault.
+    if (view.have_all_outpoints)
+    {
+        writer.field("txin_total", view.txin_total);
+        writer.field("fee", view.fee());
+    }
+    else
+    {
+        writer.nullField("txin_total");
+        writer.nullField("fee");
+    }
+    writer.field("txout_total", view.txout_total);
+    writer.endObject();
+}
+
+void CoinDB::writeJson(JsonWriter& writer, const TxOutView& view, uint32_t best_height, const CoinQ::CoinParams& coinParams)
+{
+    writer.beginObject();
+    writer.field("id", view.id);
+    writer.field("account", view.role_account());
+    writer.field("bin", view.role_bin());
+    writer.field("label", view.role_label());
+    writer.field("type", TxOut::getRoleString(view.role_flags));
+    writer.field("status", TxOut::getStatusString(view.status));
+    writer.field("value", view.value);
+    writer.hexField("script", view.script);
+    writer.field("address", getAddressForTxOutScript(view.script, coinParams.address_versions()));
+    writeHeight(writer, view.height);
+    writer.field("confirmations", confirmations(view.height, best_height));
+    writer.field("tx_id", view.tx_id);
+    writer.hexField("tx_hash", view.tx_status == Tx::UNSIGNED ? view.tx_unsigned_hash : view.tx_hash);
+    writer.field("tx_index", view.tx_index);
+    writer.field("tx_status", Tx::getStatusString(view.tx_status));
+    writer.field("tx_timestamp", view.tx_timestamp);
+    writer.endObject();
+}
+
+void CoinDB::writeJson(JsonWriter& writer, const SigningScriptView& view, const CoinQ::CoinParams& coinParams)
+{
+    writer.beginObject();
+    writer.field("id", view.id);
+    writer.field("account", view.account_name);
+    writer.field("bin", view.account_bin_name);
+    writer.field("index", view.index);
+    writer.field("label", view.label);
+    writer.field("status", SigningScript::getStatusString(view.status));
+    writer.hexField("redeemscript", view.redeemscript);
+    writer.hexField("txoutscript", view.txoutscript);
+    writer.field("address", getAddressForTxOutScript(view.txoutscript, coinParams.address_versions()));
+    writer.endObject();
+}
+
+void CoinDB::writeJson(JsonWriter& writer, const AccountInfo& info)
+{
+    writer.beginObject();
+    writer.field("id", info.id());
+    writer.field("name", info.name());
+    writer.field("minsigs", info.minsigs());
+
+    writer.key("keychains").beginArray();
+    for (auto& name: info.keychain_names()) { writer.value(name); }
+    writer.endArray();
+
+    writer.field("issued_script_count", info.issued_script_count());
+    writer.field("unused_pool_size", info.unused_pool_size());
+    writer.field("time_created", info.time_created());
+
+    writer.key("bins").beginArray();
+    for (auto& name: info.bin_names()) { writer.value(name); }
+    writer.endArray();
+
+    writer.field("compressed_keys", info.compressed_keys());
+    writer.field("use_witness", info.use_witness());
+    writer.field("use_witness_p2sh", info.use_witness_p2sh());
+    writer.endObject();
+}
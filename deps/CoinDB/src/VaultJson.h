@@ -0,0 +1,38 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// VaultJson.h
+//
+// Copyright (c) 2011-2016 Ciphrex Corp.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+//
+
+#pragma once
+
+#include "Schema.h"
+
+#include <CoinQ/CoinQ_coinparams.h>
+
+#include <stdutils/jsonwriter.h>
+
+namespace CoinDB
+{
+
+// Each call appends one JSON object to the writer. Values are in satoshis, hashes are hex and
+// confirmations are counted from best_height.
+
+// Inputs carry outpoint_hash, outpoint_index, script and sequence. Outputs carry value, script and
+// address.
+void writeJson(stdutils::JsonWriter& writer, const Coin::Transaction& tx, const CoinQ::CoinParams& coinParams);
+
+void writeJson(stdutils::JsonWriter& writer, const TxView& view, uint32_t best_height);
+
+// Expects the role to have been resolved with updateRole() or getSplitRoles().
+void writeJson(stdutils::JsonWriter& writer, const TxOutView& view, uint32_t best_height, const CoinQ::CoinParams& coinParams);
+
+void writeJson(stdutils::JsonWriter& writer, const SigningScriptView& view, const CoinQ::CoinParams& coinParams);
+
+void writeJson(stdutils::JsonWriter& writer, const AccountInfo& info);
+
+}
@@ -0,0 +1,96 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// VaultMetrics.cpp
+//
+// Copyright (c) 2011-2016 Ciphrex Corp.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+//
+
+#include "VaultMetrics.h"
+
+using namespace CoinDB;
+using CoinQ::MetricsWriter;
+
+namespace
+{
+    const double NS = 1e-9;
+}
+
+void CoinDB::writeVaultMetrics(MetricsWriter& writer)
+{
+    writer.gauge("coindb_vault_profiling_enabled", "Whether vault call latencies are being collected.", Vault::isProfilingEnabled() ? 1 : 0);
+
+    vault_stats_t stats = Vault::getStats();
+
+    writer.family("coindb_vault_calls_total", MetricsWriter::COUNTER, "Vault method calls.");
+    for (auto& s: stats) { writer.sample("coindb_vault_calls_total", s.calls, {{"method", s.method}}); }
+
+    writer.family("coindb_vault_errors_total", MetricsWriter::COUNTER, "Vault method calls that threw.");
+    for (auto& s: stats) { writer.sample("coindb_vault_errors_total", s.errors, {{"method", s.method}}); }
+
+    writer.family("coindb_vault_call_seconds_total", MetricsWriter::COUNTER, "Time spent in vault methods, split into waiting for the vault lock, database transactions and the rest.");
+    for (auto& s: stats)
+    {
+        writer.sample("coindb_vault_call_seconds_total", s.lock_wait_ns * NS, {{"method", s.method}, {"phase", "lock"}});
+        writer.sample("coindb_vault_call_seconds_total", s.db_ns * NS, {{"method", s.method}, {"phase", "db"}});
+        writer.sample("coindb_vault_call_seconds_total", s.compute_ns * NS, {{"method", s.method}, {"phase", "other"}});
+    }
+
+    writer.family("coindb_vault_call_latency_seconds", MetricsWriter::GAUGE, "Vault method latency quantiles since profiling started.");
+    for (auto& s: stats)
+    {
+        writer.sample("coindb_vault_call_latency_seconds", s.p50_ns * NS, {{"method", s.method}, {"quantile", "0.5"}});
+        writer.sample("coindb_vault_call_latency_seconds", s.p90_ns * NS, {{"method", s.method}, {"quantile", "0.9"}});
+        writer.sample("coindb_vault_call_latency_seconds", s.p99_ns * NS, {{"method", s.method}, {"quantile", "0.99"}});
+        writer.sample("coindb_vault_call_latency_seconds", s.max_ns * NS, {{"method", s.method}, {"quantile", "1"}});
+    }
+
+    writer.family("coindb_vault_statements_total", MetricsWriter::COUNTER, "SQL statements executed by vault methods.");
+    for (auto& s: stats)
+    {
+        writer.sample("coindb_vault_statements_total", s.statements_read, {{"method", s.method}, {"kind", "read"}});
+        writer.sample("coindb_vault_statements_total", s.statements_written, {{"method", s.method}, {"kind", "write"}});
+    }
+}
+
+void CoinDB::writeSynchedVaultMetrics(MetricsWriter& writer, const SynchedVault& synchedVault)
+{
+    SynchedVault::status_t status = synchedVault.getStatus();
+    writer.family("coindb_sync_status", MetricsWriter::GAUGE, "Sync state, 1 for the current one.");
+    for (int s = SynchedVault::STOPPED; s <= SynchedVault::SYNCHED; s++)
+    {
+        writer.sample("coindb_sync_status", s == status ? 1 : 0, {{"status", SynchedVault::getStatusString((SynchedVault::status_t)s)}});
+    }
+
+    uint32_t bestHeight = synchedVault.getBestHeight();
+    uint32_t syncHeight = synchedVault.getSyncHeight();
+    writer.gauge("coindb_sync_best_height", "Height of the best known header.", bestHeight);
+    writer.gauge("coindb_sync_height", "Height of the most recent block stored in the vault.", syncHeight);
+    writer.gauge("coindb_sync_blocks_behind", "Blocks between the vault and the best known header.", bestHeight > syncHeight ? bestHeight - syncHeight : 0);
+    writer.gauge("coindb_sync_vault_open", "Whether a vault is open.", synchedVault.isVaultOpen() ? 1 : 0);
+
+    CoinQ::PeerStats peer = synchedVault.getPeerStats();
+    writer.gauge("coinq_peer_connected", "Whether the peer connection is open.", synchedVault.isConnected() ? 1 : 0);
+    writer.counter("coinq_peer_messages_received_total", "Messages received from the peer.", peer.messagesReceived);
+    writer.counter("coinq_peer_bytes_received_total", "Bytes received from the peer.", peer.bytesReceived);
+    writer.counter("coinq_peer_messages_sent_total", "Messages sent to the peer.", peer.messagesSent);
+    writer.counter("coinq_peer_bytes_sent_total", "Bytes sent to the peer.", peer.bytesSent);
+    writer.gauge("coinq_peer_send_queue", "Messages waiting to be written to the peer.", peer.sendQueue);
+    writer.gauge("coinq_peer_last_received_timestamp_seconds", "Time the last message was received, 0 if none was.", peer.lastReceived);
+
+    CoinQ::Network::NetworkSync::BloomFilterStats filter = synchedVault.getBloomFilterStats();
+    writer.gauge("coinq_bloom_filter_loaded", "Whether a bloom filter was sent to the peer.", filter.loaded ? 1 : 0);
+    writer.gauge("coinq_bloom_filter_bytes", "Size of the bloom filter.", filter.size);
+    writer.gauge("coinq_bloom_filter_hash_funcs", "Hash functions used by the bloom filter.", filter.hashFuncs);
+    writer.gauge("coinq_bloom_filter_false_positive_rate", "False positive rate estimated from the bits set in the bloom filter.", filter.falsePositiveRate);
+
+    CoinQ::Network::MempoolTracker::Stats mempool = synchedVault.getMempoolStats();
+    writer.gauge("coinq_mempool_txs", "Transactions tracked in the mempool.", mempool.size);
+    writer.counter("coinq_mempool_inserted_total", "Transactions added to the mempool.", mempool.inserted);
+    writer.counter("coinq_mempool_confirmed_total", "Mempool transactions confirmed in a block.", mempool.confirmed);
+    writer.counter("coinq_mempool_erased_total", "Transactions removed from the mempool.", mempool.erased);
+    writer.counter("coinq_mempool_expired_total", "Transactions dropped for exceeding the age limit.", mempool.expired);
+    writer.counter("coinq_mempool_evicted_total", "Transactions dropped to stay within the size limit.", mempool.evicted);
+}
@@ -0,0 +1,27 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// VaultMetrics.h
+//
+// Copyright (c) 2011-2016 Ciphrex Corp.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+//
+
+#pragma once
+
+#include "SynchedVault.h"
+
+#include <CoinQ/CoinQ_metrics.h>
+
+namespace CoinDB
+{
+
+// Adds the per-method vault counters kept by VaultProfiler. Latencies are only collected while
+// profiling is enabled.
+void writeVaultMetrics(CoinQ::MetricsWriter& writer);
+
+// Adds sync status and heights, peer connection and traffic, bloom filter and mempool state.
+void writeSynchedVaultMetrics(CoinQ::MetricsWriter& writer, const SynchedVault& synchedVault);
+
+}
@@ -0,0 +1,289 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// VaultProfiler.cpp
+//
+// Copyright (c) 2011-2016 Ciphrex Corp.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+//
+
+#include "VaultProfiler.h"
+
+#include <odb/tracer.hxx>
+#include <odb/transaction.hxx>
+
+#include <boost/thread/lock_guard.hpp>
+#include <boost/thread/tss.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <exception>
+#include <map>
+#include <sstream>
+
+using namespace CoinDB;
+
+namespace
+{
+    // Latency histogram with four buckets per power of two nanoseconds.
+    const int BUCKETS_PER_OCTAVE = 4;
+    const int BUCKETS = 48 * BUCKETS_PER_OCTAVE;
+
+    int bucket(uint64_t ns)
+    {
+        if (ns < 1) return 0;
+        int b = (int)(std::log2((double)ns) * BUCKETS_PER_OCTAVE);
+        return std::min(b, BUCKETS - 1);
+    }
+
+    uint64_t bucketUpperBound(int b)
+    {
+        return (uint64_t)std::ceil(std::exp2((double)(b + 1) / BUCKETS_PER_OCTAVE));
+    }
+
+    struct MethodCounters
+    {
+        MethodCounters() : calls(0), errors(0), total_ns(0), lock_wait_ns(0), db_ns(0), max_ns(0), statements_read(0), statements_written(0) { histogram.fill(0); }
+
+        uint64_t calls;
+        uint64_t errors;
+        uint64_t total_ns;
+        uint64_t lock_wait_ns;
+        uint64_t db_ns;
+        uint64_t max_ns;
+        uint64_t statements_read;
+        uint64_t statements_written;
+        std::array<uint64_t, BUCKETS> histogram;
+
+        uint64_t percentile(double p) const
+        {
+            uint64_t rank = (uint64_t)std::ceil(p * calls);
+            uint64_t count = 0;
+            for (int b = 0; b < BUCKETS; b++)
+            {
+                count += histogram[b];
+                if (count >= rank) return std::min(bucketUpperBound(b), max_ns);
+            }
+            return max_ns;
+        }
+    };
+
+    struct MethodNameLess
+    {
+        bool operator()(const char* a, const char* b) const { return std::strcmp(a, b) < 0; }
+    };
+
+    boost::mutex countersMutex;
+    std::map<const char*, MethodCounters, MethodNameLess> counters;
+
+    // Calls live on the stack of the thread that made them, so there is nothing to delete at thread exit.
+    void noCleanup(VaultProfiler::Call*) { }
+    boost::thread_specific_ptr<VaultProfiler::Call> currentCall(&noCleanup);
+
+    uint64_t nanoseconds(VaultProfiler::clock_t::duration d)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+    }
+
+    bool startsWith(const char* text, const char* word)
+    {
+        while (std::isspace((unsigned char)*text)) { text++; }
+        for (; *word; text++, word++)
+        {
+            if (std::toupper((unsigned char)*text) != *word) return false;
+        }
+        return true;
+    }
+}
+
+namespace CoinDB
+{
+
+class VaultProfilerTracer : public odb::tracer
+{
+public:
+    virtual void execute(odb::connection& /*connection*/, const char* statement)
+    {
+        if (VaultProfiler::enabled()) { VaultProfiler::statement(statement); }
+    }
+};
+
+}
+
+std::atomic<bool> VaultProfiler::enabled_(false);
+
+void VaultProfiler::enable(bool enabled)
+{
+    enabled_.store(enabled);
+}
+
+vault_stats_t VaultProfiler::getStats()
+{
+    vault_stats_t stats;
+    boost::lock_guard<boost::mutex> lock(countersMutex);
+    for (auto& item: counters)
+    {
+        const MethodCounters& c = item.second;
+
+        VaultCallStats s;
+        s.method = item.first;
+        s.calls = c.calls;
+        s.errors = c.errors;
+        s.total_ns = c.total_ns;
+        s.lock_wait_ns = c.lock_wait_ns;
+        s.db_ns = c.db_ns;
+        s.compute_ns = c.total_ns > c.lock_wait_ns + c.db_ns ? c.total_ns - c.lock_wait_ns - c.db_ns : 0;
+        s.max_ns = c.max_ns;
+        s.p50_ns = c.percentile(0.50);
+        s.p90_ns = c.percentile(0.90);
+        s.p99_ns = c.percentile(0.99);
+        s.statements_read = c.statements_read;
+        s.statements_written = c.statements_written;
+        stats.push_back(s);
+    }
+
+    std::sort(stats.begin(), stats.end(), [](const VaultCallStats& a, const VaultCallStats& b) { return a.total_ns > b.total_ns; });
+    return stats;
+}
+
+void VaultProfiler::reset()
+{
+    boost::lock_guard<boost::mutex> lock(countersMutex);
+    counters.clear();
+}
+
+odb::tracer& VaultProfiler::tracer()
+{
+    static VaultProfilerTracer tracer;
+    return tracer;
+}
+
+VaultProfiler::Call* VaultProfiler::current()
+{
+    return currentCall.get();
+}
+
+void VaultProfiler::statement(const char* text)
+{
+    Call* call = current();
+    if (!call) return;
+
+    clock_t::time_point now = clock_t::now();
+    if (startsWith(text, "BEGIN"))
+    {
+        call->in_transaction_ = true;
+        call->transaction_callback_ = false;
+        call->transaction_start_ = now;
+        return;
+    }
+
+    if (startsWith(text, "COMMIT") || startsWith(text, "ROLLBACK"))
+    {
+        // The transaction is no longer current once it starts committing. If no callback was registered
+        // for it, the time spent committing is left out.
+        if (call->in_transaction_ && !call->transaction_callback_)
+        {
+            call->db_ns_ += nanoseconds(now - call->transaction_start_);
+            call->in_transaction_ = false;
+        }
+        return;
+    }
+
+    if (startsWith(text, "SELECT"))
+    {
+        call->statements_read_++;
+    }
+    else if (startsWith(text, "INSERT") || startsWith(text, "UPDATE") || startsWith(text, "DELETE"))
+    {
+        call->statements_written_++;
+    }
+
+    // BEGIN runs before the transaction object exists, so the end-of-transaction callback is registered
+    // on the first statement inside it.
+    if (call->in_transaction_ && !call->transaction_callback_ && odb::transaction::has_current())
+    {
+        odb::transaction::current().callback_register(&VaultProfiler::transactionEnded, call);
+        call->transaction_callback_ = true;
+    }
+}
+
+void VaultProfiler::lockWaited(clock_t::duration wait)
+{
+    Call* call = current();
+    if (call) { call->lock_wait_ns_ += nanoseconds(wait); }
+}
+
+void VaultProfiler::transactionEnded(unsigned short /*event*/, void* key, unsigned long long /*data*/)
+{
+    Call* call = static_cast<Call*>(key);
+    if (!call->in_transaction_) return;
+
+    call->db_ns_ += nanoseconds(clock_t::now() - call->transaction_start_);
+    call->in_transaction_ = false;
+    call->transaction_callback_ = false;
+}
+
+void VaultProfiler::Call::begin(const char* method)
+{
+    method_ = method;
+    parent_ = currentCall.get();
+    lock_wait_ns_ = 0;
+    db_ns_ = 0;
+    statements_read_ = 0;
+    statements_written_ = 0;
+    in_transaction_ = false;
+    transaction_callback_ = false;
+    currentCall.reset(this);
+    start_ = clock_t::now();
+}
+
+void VaultProfiler::Call::end()
+{
+    uint64_t ns = nanoseconds(clock_t::now() - start_);
+    currentCall.reset(parent_);
+
+    boost::lock_guard<boost::mutex> lock(countersMutex);
+    MethodCounters& c = counters[method_];
+    c.calls++;
+    if (std::uncaught_exception()) { c.errors++; }
+    c.total_ns += ns;
+    c.lock_wait_ns += lock_wait_ns_;
+    c.db_ns += db_ns_;
+    c.max_ns = std::max(c.max_ns, ns);
+    c.statements_read += statements_read_;
+    c.statements_written += statements_written_;
+    c.histogram[bucket(ns)]++;
+}
+
+void VaultProfiler::Lock::lockProfiled()
+{
+    clock_t::time_point start = clock_t::now();
+    mutex_.lock();
+
+    lockWaited(clock_t::now() - start);
+}
+
+std::string VaultCallStats::toJson() const
+{
+    std::stringstream ss;
+    ss << "{"
+       << "\"method\":\"" << method << "\","
+       << "\"calls\":" << calls << ","
+       << "\"errors\":" << errors << ","
+       << "\"total_ns\":" << total_ns << ","
+       << "\"lock_wait_ns\":" << lock_wait_ns << ","
+       << "\"db_ns\":" << db_ns << ","
+       << "\"compute_ns\":" << compute_ns << ","
+       << "\"max_ns\":" << max_ns << ","
+       << "\"p50_ns\":" << p50_ns << ","
+       << "\"p90_ns\":" << p90_ns << ","
+       << "\"p99_ns\":" << p99_ns << ","
+       << "\"statements_read\":" << statements_read << ","
+       << "\"statements_written\":" << statements_written
+       << "}";
+    return ss.str();
+}
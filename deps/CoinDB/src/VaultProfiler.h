@@ -0,0 +1,128 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// VaultProfiler.h
+//
+// Copyright (c) 2011-2016 Ciphrex Corp.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+//
+
+#pragma once
+
+#include <boost/thread/mutex.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace odb
+{
+    class tracer;
+}
+
+namespace CoinDB
+{
+
+struct VaultCallStats
+{
+    std::string method;
+    uint64_t calls;
+    uint64_t errors;                // calls that threw
+    uint64_t total_ns;
+    uint64_t lock_wait_ns;          // waiting for the vault mutex
+    uint64_t db_ns;                 // inside database transactions, commit included
+    uint64_t compute_ns;            // everything else
+    uint64_t max_ns;
+    uint64_t p50_ns;                // percentiles are accurate to within 19%
+    uint64_t p90_ns;
+    uint64_t p99_ns;
+    uint64_t statements_read;       // SELECT statements
+    uint64_t statements_written;    // INSERT, UPDATE and DELETE statements
+
+    std::string toJson() const;
+};
+
+typedef std::vector<VaultCallStats> vault_stats_t;
+
+// Per-method call counts and latencies for the public Vault methods. Counters are kept per process
+// and shared by all vaults, so short-lived vaults like the ones vaultd opens per request still add up.
+//
+// While disabled the only cost is one atomic load per call and per SQL statement. While enabled, time
+// is split between waiting for the vault mutex, database transactions and everything else. A method
+// called from within another one is counted on its own, and its time is also part of its caller's.
+class VaultProfiler
+{
+public:
+    typedef std::chrono::steady_clock clock_t;
+
+    static bool             enabled() { return enabled_.load(std::memory_order_relaxed); }
+    static void             enable(bool enabled = true);
+
+    // Sorted by total time, most expensive first.
+    static vault_stats_t    getStats();
+    static void             reset();
+
+    // Installed on every vault database. Attributes statements and transactions to the call in progress.
+    static odb::tracer&     tracer();
+
+    // Declared first thing in each public method. method must be a string literal.
+    class Call
+    {
+    public:
+        explicit Call(const char* method) : method_(nullptr) { if (enabled()) begin(method); }
+        ~Call() { if (method_) end(); }
+
+    private:
+        friend class VaultProfiler;
+
+        Call(const Call&) = delete;
+        Call& operator=(const Call&) = delete;
+
+        const char*         method_;
+        Call*               parent_;
+        clock_t::time_point start_;
+        uint64_t            lock_wait_ns_;
+        uint64_t            db_ns_;
+        uint64_t            statements_read_;
+        uint64_t            statements_written_;
+
+        // Open transaction
+        bool                in_transaction_;
+        bool                transaction_callback_;
+        clock_t::time_point transaction_start_;
+
+        void begin(const char* method);
+        void end();
+    };
+
+    // Takes the vault mutex, charging the wait to the call in progress.
+    class Lock
+    {
+    public:
+        explicit Lock(boost::mutex& mutex) : mutex_(mutex) { if (enabled()) lockProfiled(); else mutex_.lock(); }
+        ~Lock() { mutex_.unlock(); }
+
+    private:
+        Lock(const Lock&) = delete;
+        Lock& operator=(const Lock&) = delete;
+
+        boost::mutex& mutex_;
+
+        void lockProfiled();
+    };
+
+private:
+    friend class VaultProfilerTracer;
+
+    static std::atomic<bool> enabled_;
+
+    static Call* current();
+    static void statement(const char* text);
+    static void lockWaited(clock_t::duration wait);
+    static void transactionEnded(unsigned short event, void* key, unsigned long long data);
+};
+
+}
@@ -0,0 +1,161 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// multivaultsync_test.cpp
+//
+// Copyright (c) 2011-2016 Ciphrex Corp.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+//
+// Registers two vaults with one MultiVaultSync and checks that relayed
+// transactions only reach the vaults whose own filter elements they match,
+// and that unregistered vaults get nothing.
+//
+
+#include <MultiVaultSync.h>
+
+#include <CoinCore/random.h>
+
+#include <boost/filesystem.hpp>
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace CoinDB;
+using namespace std;
+
+namespace
+{
+
+const string DB_FILE_A = "build/multivaultsync_test_a.db";
+const string DB_FILE_B = "build/multivaultsync_test_b.db";
+const string ACCOUNT_NAME = "account";
+
+unsigned int g_failed = 0;
+unsigned int g_passed = 0;
+
+void check(bool condition, const string& name)
+{
+    if (condition)
+    {
+        g_passed++;
+        return;
+    }
+
+    g_failed++;
+    cerr << "FAILED: " << name << endl;
+}
+
+template<typename F>
+bool throws(F f)
+{
+    try
+    {
+        f();
+    }
+    catch (const exception&)
+    {
+        return true;
+    }
+    return false;
+}
+
+void newVaultAccount(Vault& vault)
+{
+    vault.newKeychain("keychain", secure_random_bytes(32));
+    vault.newAccount(ACCOUNT_NAME, 1, vector<string>(1, "keychain"));
+}
+
+// Spends an outpoint no vault knows about, so only the outputs can match.
+Coin::Transaction newTx(const vector<bytes_t>& txoutscripts)
+{
+    Coin::Transaction cointx;
+    cointx.inputs.push_back(Coin::TxIn(Coin::OutPoint(random_bytes(32), 0), bytes_t(), 0xffffffff));
+    uint64_t value = 100000;
+    for (auto& txoutscript: txoutscripts) { cointx.outputs.push_back(Coin::TxOut(value++, txoutscript)); }
+    return cointx;
+}
+
+bool hasTx(const Vault& vault, const Coin::Transaction& cointx)
+{
+    return !throws([&]() { vault.getTx(cointx.hash()); });
+}
+
+void testRouting(MultiVaultSync& sync, Vault& vaultA, Vault& vaultB)
+{
+    bytes_t scriptA = vaultA.issueSigningScript(ACCOUNT_NAME)->txoutscript();
+    bytes_t scriptB = vaultB.issueSigningScript(ACCOUNT_NAME)->txoutscript();
+
+    sync.registerVault(&vaultA);
+    sync.registerVault(&vaultB);
+    check(sync.getVaultCount() == 2, "both vaults registered");
+    check(throws([&]() { sync.registerVault(&vaultA); }), "registering a vault twice throws");
+
+    sync.updateBloomFilter();
+
+    Coin::Transaction txA = newTx(vector<bytes_t>(1, scriptA));
+    sync.insertTx(txA);
+    check(hasTx(vaultA, txA), "tx paying vault A reaches vault A");
+    check(!hasTx(vaultB, txA), "tx paying vault A does not reach vault B");
+
+    Coin::Transaction txB = newTx(vector<bytes_t>(1, scriptB));
+    sync.insertTx(txB);
+    check(hasTx(vaultB, txB), "tx paying vault B reaches vault B");
+    check(!hasTx(vaultA, txB), "tx paying vault B does not reach vault A");
+
+    vector<bytes_t> bothScripts;
+    bothScripts.push_back(scriptA);
+    bothScripts.push_back(scriptB);
+    Coin::Transaction txBoth = newTx(bothScripts);
+    sync.insertTx(txBoth);
+    check(hasTx(vaultA, txBoth) && hasTx(vaultB, txBoth), "tx paying both vaults reaches both");
+
+    Coin::Transaction txNeither = newTx(vector<bytes_t>(1, random_bytes(25)));
+    sync.insertTx(txNeither);
+    check(!hasTx(vaultA, txNeither) && !hasTx(vaultB, txNeither), "unrelated tx reaches neither vault");
+
+    // Scripts issued after the filters were built only match once they are rebuilt.
+    bytes_t newScriptA = vaultA.issueSigningScript(ACCOUNT_NAME)->txoutscript();
+    sync.updateBloomFilter();
+    Coin::Transaction txNewA = newTx(vector<bytes_t>(1, newScriptA));
+    sync.insertTx(txNewA);
+    check(hasTx(vaultA, txNewA) && !hasTx(vaultB, txNewA), "tx paying a newly issued script reaches its vault");
+
+    sync.unregisterVault(&vaultB);
+    check(sync.getVaultCount() == 1, "vault B unregistered");
+    Coin::Transaction txB2 = newTx(vector<bytes_t>(1, scriptB));
+    sync.insertTx(txB2);
+    check(!hasTx(vaultB, txB2), "unregistered vault gets nothing");
+
+    sync.unregisterVault(&vaultA);
+    check(sync.getVaultCount() == 0, "vault A unregistered");
+}
+
+}
+
+int main()
+{
+    try
+    {
+        boost::filesystem::remove(DB_FILE_A);
+        boost::filesystem::remove(DB_FILE_B);
+
+        Vault vaultA(DB_FILE_A, true);
+        Vault vaultB(DB_FILE_B, true);
+        newVaultAccount(vaultA);
+        newVaultAccount(vaultB);
+
+        MultiVaultSync sync;
+        testRouting(sync, vaultA, vaultB);
+    }
+    catch (const exception& e)
+    {
+        cerr << "Error: " << e.what() << endl;
+        return -2;
+    }
+
+    cout << g_passed << " passed, " << g_failed << " failed." << endl;
+    return g_failed ? -1 : 0;
+}
@@ -0,0 +1,184 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// scriptreserve_test.cpp
+//
+// Copyright (c) 2011-2016 Ciphrex Corp.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+//
+// Runs ScriptReserve against a new vault: reservations come out of the queue
+// unique and already issued, the queue is refilled in batches, labels are
+// written on the flush interval, once a batch of them is pending and on stop(),
+// and scripts left queued at stop() are never handed out again.
+//
+
+#include <Vault.h>
+#include <ScriptReserve.h>
+
+#include <CoinCore/random.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
+
+#include <iostream>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace CoinDB;
+using namespace std;
+
+namespace
+{
+
+const string DB_FILE = "build/scriptreserve_test.db";
+const string ACCOUNT_NAME = "account";
+const uint32_t BATCH_SIZE = 10;
+
+unsigned int g_failed = 0;
+unsigned int g_passed = 0;
+
+void check(bool condition, const string& name)
+{
+    if (condition)
+    {
+        g_passed++;
+        return;
+    }
+
+    g_failed++;
+    cerr << "FAILED: " << name << endl;
+}
+
+template<typename F>
+bool throws(F f)
+{
+    try
+    {
+        f();
+    }
+    catch (const exception&)
+    {
+        return true;
+    }
+    return false;
+}
+
+map<unsigned long, SigningScriptView> getScripts(Vault& vault)
+{
+    map<unsigned long, SigningScriptView> scripts;
+    for (auto& view: vault.getSigningScriptViews(ACCOUNT_NAME, DEFAULT_BIN_NAME)) { scripts[view.id] = view; }
+    return scripts;
+}
+
+// The worker writes on its own schedule, so wait for it a while.
+bool waitForLabels(ScriptReserve& reserve, unsigned int milliseconds)
+{
+    for (unsigned int waited = 0; reserve.pendingLabels() > 0 && waited < milliseconds; waited += 10)
+    {
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+    }
+    return reserve.pendingLabels() == 0;
+}
+
+void testReserveAndRefill(Vault& vault, set<unsigned long>& handedOut)
+{
+    check(throws([&]() { ScriptReserve(vault, ACCOUNT_NAME, DEFAULT_BIN_NAME, 0); }), "zero batch size throws");
+    check(throws([&]() { ScriptReserve(vault, "nosuchaccount").start(); }), "start throws for an unknown account");
+
+    ScriptReserve reserve(vault, ACCOUNT_NAME, DEFAULT_BIN_NAME, BATCH_SIZE);
+    check(throws([&]() { reserve.reserve(); }), "reserve before start throws");
+
+    reserve.start();
+    check(reserve.isStarted(), "started");
+    check(reserve.available() == BATCH_SIZE, "start fills the queue");
+
+    // Several batches, so the queue has to be refilled along the way.
+    const unsigned int count = 5 * BATCH_SIZE + 3;
+    vector<ScriptReserve::Reservation> reservations;
+    set<bytes_t> txoutscripts;
+    for (unsigned int i = 0; i < count; i++)
+    {
+        reservations.push_back(reserve.reserve(i % 2 ? "label" + to_string(i) : ""));
+        handedOut.insert(reservations.back().id);
+        txoutscripts.insert(reservations.back().txoutscript);
+    }
+    check(handedOut.size() == count && txoutscripts.size() == count, "reservations are unique");
+
+    // Everything handed out is already issued in the vault.
+    map<unsigned long, SigningScriptView> scripts = getScripts(vault);
+    bool bIssued = true;
+    for (auto& reservation: reservations)
+    {
+        auto it = scripts.find(reservation.id);
+        bIssued = bIssued && it != scripts.end() && it->second.status == SigningScript::ISSUED && it->second.txoutscript == reservation.txoutscript && it->second.index == reservation.index;
+    }
+    check(bIssued, "reservations are issued in the vault");
+
+    // More than a batch of labels was queued, so the worker writes them without waiting for stop().
+    check(waitForLabels(reserve, 5000), "labels written by the worker");
+    scripts = getScripts(vault);
+    bool bLabeled = true;
+    for (auto& reservation: reservations) { bLabeled = bLabeled && scripts[reservation.id].label == reservation.label; }
+    check(bLabeled, "labels match");
+
+    // A single label is written once the flush interval passes.
+    reserve.setFlushInterval(50);
+    ScriptReserve::Reservation reservation = reserve.reserve("interval");
+    handedOut.insert(reservation.id);
+    check(waitForLabels(reserve, 5000), "label written on the flush interval");
+    check(getScripts(vault)[reservation.id].label == "interval", "interval label matches");
+
+    // Labels still pending at stop() are written by it.
+    reserve.setFlushInterval(60000);
+    reservation = reserve.reserve("stop");
+    handedOut.insert(reservation.id);
+    reserve.stop();
+    check(!reserve.isStarted(), "stopped");
+    check(reserve.pendingLabels() == 0 && getScripts(vault)[reservation.id].label == "stop", "stop writes pending labels");
+    check(throws([&]() { reserve.reserve(); }), "reserve after stop throws");
+}
+
+void testRestart(Vault& vault, const set<unsigned long>& handedOut)
+{
+    // Scripts the first reserve still held were issued without a label and must not come out again.
+    set<unsigned long> issued;
+    for (auto& item: getScripts(vault)) { if (item.second.status == SigningScript::ISSUED) issued.insert(item.first); }
+    check(issued.size() > handedOut.size(), "queued scripts stay issued");
+
+    ScriptReserve reserve(vault, ACCOUNT_NAME, DEFAULT_BIN_NAME, BATCH_SIZE);
+    reserve.start();
+    bool bNew = true;
+    for (unsigned int i = 0; i < 2 * BATCH_SIZE; i++) { bNew = bNew && !issued.count(reserve.reserve().id); }
+    check(bNew, "a new reserve hands out only scripts not issued before");
+    reserve.stop();
+}
+
+}
+
+int main()
+{
+    try
+    {
+        boost::filesystem::remove(DB_FILE);
+
+        Vault vault(DB_FILE, true);
+        vault.newKeychain("keychain", secure_random_bytes(32));
+        vault.newAccount(ACCOUNT_NAME, 1, vector<string>(1, "keychain"));
+
+        set<unsigned long> handedOut;
+        testReserveAndRefill(vault, handedOut);
+        testRestart(vault, handedOut);
+    }
+    catch (const exception& e)
+    {
+        cerr << "Error: " << e.what() << endl;
+        return -2;
+    }
+
+    cout << g_passed << " passed, " << g_failed << " failed." << endl;
+    return g_failed ? -1 : 0;
+}
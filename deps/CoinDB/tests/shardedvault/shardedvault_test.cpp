@@ -0,0 +1,210 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// shardedvault_test.cpp
+//
+// Copyright (c) 2011-2016 Ciphrex Corp.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+//
+// Spreads accounts over three shards and checks that getTxViews pages through
+// the merged history in order, listing transactions stored on several shards
+// once, and that the catalog brings every account back to its shard on reopen.
+//
+
+#include <ShardedVault.h>
+
+#include <CoinCore/random.h>
+
+#include <boost/filesystem.hpp>
+
+#include <iostream>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace CoinDB;
+using namespace std;
+
+namespace
+{
+
+const string DB_NAME = "build/shardedvault_test";
+const unsigned int SHARD_COUNT = 3;
+const unsigned int TX_COUNT = 20;
+
+unsigned int g_failed = 0;
+unsigned int g_passed = 0;
+
+void check(bool condition, const string& name)
+{
+    if (condition)
+    {
+        g_passed++;
+        return;
+    }
+
+    g_failed++;
+    cerr << "FAILED: " << name << endl;
+}
+
+template<typename F>
+bool throws(F f)
+{
+    try
+    {
+        f();
+    }
+    catch (const exception&)
+    {
+        return true;
+    }
+    return false;
+}
+
+void removeDatabases()
+{
+    boost::filesystem::remove(DB_NAME + ".catalog");
+    for (unsigned int i = 0; i < SHARD_COUNT; i++) { boost::filesystem::remove(DB_NAME + "-shard" + to_string(i)); }
+}
+
+string accountName(unsigned int i)
+{
+    return "account" + to_string(i);
+}
+
+// Spends an outpoint no shard knows about, so only the outputs decide where it is stored.
+shared_ptr<Tx> newTx(const vector<bytes_t>& txoutscripts, uint32_t timestamp)
+{
+    Coin::Transaction cointx;
+    cointx.inputs.push_back(Coin::TxIn(Coin::OutPoint(random_bytes(32), 0), bytes_t(), 0xffffffff));
+    uint64_t value = 100000;
+    for (auto& txoutscript: txoutscripts) { cointx.outputs.push_back(Coin::TxOut(value++, txoutscript)); }
+
+    shared_ptr<Tx> tx(new Tx());
+    tx->set(cointx, timestamp, Tx::PROPAGATED);
+    return tx;
+}
+
+vector<bytes_t> unsignedHashes(const vector<TxView>& views)
+{
+    vector<bytes_t> hashes;
+    for (auto& view: views) { hashes.push_back(view.unsigned_hash); }
+    return hashes;
+}
+
+void testAccounts(ShardedVault& vault, map<string, unsigned int>& accountShards)
+{
+    vault.newKeychain("keychain", secure_random_bytes(32));
+    for (unsigned int i = 0; i < SHARD_COUNT; i++) { vault.newAccount(accountName(i), 1, vector<string>(1, "keychain")); }
+    check(throws([&]() { vault.newAccount(accountName(0), 1, vector<string>(1, "keychain")); }), "duplicate account name throws");
+
+    // Each new account goes to the least loaded shard, so three accounts land on three shards.
+    set<Vault*> shards;
+    for (unsigned int i = 0; i < SHARD_COUNT; i++)
+    {
+        Vault* shard = vault.getAccountShard(accountName(i));
+        shards.insert(shard);
+        for (unsigned int j = 0; j < vault.getShardCount(); j++) { if (vault.getShard(j) == shard) accountShards[accountName(i)] = j; }
+    }
+    check(shards.size() == SHARD_COUNT, "accounts are spread over every shard");
+    check(vault.getAllAccountInfo().size() == SHARD_COUNT, "all accounts are listed");
+}
+
+void testTxViewPaging(ShardedVault& vault)
+{
+    vector<bytes_t> scripts;
+    for (unsigned int i = 0; i < SHARD_COUNT; i++) { scripts.push_back(vault.getAccountShard(accountName(i))->issueSigningScript(accountName(i))->txoutscript()); }
+
+    // Newest first. Every fourth tx shares its timestamp with the one before it, on another shard,
+    // and every fifth pays two accounts so it is stored on two shards.
+    vector<bytes_t> expected;
+    uint32_t timestamp = 1500000000;
+    for (unsigned int i = 0; i < TX_COUNT; i++)
+    {
+        if (i % 4 != 3) { timestamp--; }
+
+        vector<bytes_t> txoutscripts(1, scripts[i % SHARD_COUNT]);
+        if (i % 5 == 4) { txoutscripts.push_back(scripts[(i + 1) % SHARD_COUNT]); }
+
+        shared_ptr<Tx> tx = newTx(txoutscripts, timestamp);
+        check(vault.insertTx(tx) != nullptr, "tx " + to_string(i) + " inserted");
+        expected.push_back(tx->unsigned_hash());
+    }
+
+    vector<TxView> all = vault.getTxViews();
+    check(all.size() == TX_COUNT, "cross-shard txs are listed once");
+
+    vector<bytes_t> allHashes = unsignedHashes(all);
+    set<bytes_t> listed(allHashes.begin(), allHashes.end());
+    check(listed == set<bytes_t>(expected.begin(), expected.end()), "every tx is listed");
+
+    bool bOrdered = true;
+    for (size_t i = 1; i < all.size(); i++) { bOrdered = bOrdered && all[i - 1].timestamp >= all[i].timestamp; }
+    check(bOrdered, "txs are listed newest first");
+
+    // Concatenated pages of any size give the same list as one unpaged call.
+    for (int pageSize = 1; pageSize <= 7; pageSize++)
+    {
+        vector<bytes_t> paged;
+        for (unsigned long start = 0; start < TX_COUNT + pageSize; start += pageSize)
+        {
+            vector<bytes_t> page = unsignedHashes(vault.getTxViews(Tx::ALL, start, pageSize));
+            check(page.size() <= (size_t)pageSize, "page is not longer than requested");
+            paged.insert(paged.end(), page.begin(), page.end());
+        }
+        check(paged == allHashes, "pages of " + to_string(pageSize) + " match the full list");
+    }
+
+    check(vault.getTxViews(Tx::ALL, TX_COUNT, 5).empty(), "page past the end is empty");
+}
+
+void testReopen(const map<string, unsigned int>& accountShards)
+{
+    check(throws([&]() { ShardedVault("", "", DB_NAME, true, SHARD_COUNT); }), "creating over an existing catalog throws");
+
+    // shard_count is ignored when opening, the catalog decides.
+    ShardedVault vault("", "", DB_NAME, false, 1);
+    check(vault.getShardCount() == SHARD_COUNT, "catalog keeps the shard count");
+
+    bool bSameShards = true;
+    for (auto& item: accountShards) { bSameShards = bSameShards && vault.getAccountShard(item.first) == vault.getShard(item.second); }
+    check(bSameShards, "catalog keeps every account on its shard");
+    check(vault.getTxViews().size() == TX_COUNT, "txs are still listed after reopening");
+
+    vault.renameAccount(accountName(0), "renamed");
+    check(!vault.accountExists(accountName(0)) && vault.accountExists("renamed"), "rename updates the catalog");
+    vault.close();
+
+    ShardedVault reopened("", "", DB_NAME);
+    check(reopened.accountExists("renamed") && reopened.getAccountShard("renamed") == reopened.getShard(accountShards.at(accountName(0))), "renamed account is found after reopening");
+}
+
+}
+
+int main()
+{
+    try
+    {
+        removeDatabases();
+
+        map<string, unsigned int> accountShards;
+        {
+            ShardedVault vault("", "", DB_NAME, true, SHARD_COUNT);
+            check(vault.getShardCount() == SHARD_COUNT, "shards created");
+            testAccounts(vault, accountShards);
+            testTxViewPaging(vault);
+        }
+        testReopen(accountShards);
+    }
+    catch (const exception& e)
+    {
+        cerr << "Error: " << e.what() << endl;
+        return -2;
+    }
+
+    cout << g_passed << " passed, " << g_failed << " failed." << endl;
+    return g_failed ? -1 : 0;
+}
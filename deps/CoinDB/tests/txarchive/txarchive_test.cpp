@@ -0,0 +1,166 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// txarchive_test.cpp
+//
+// Copyright (c) 2011-2016 Ciphrex Corp.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+//
+// Archives a funding transaction and the one spending it, then delivers them
+// again through the merkle block, new transaction and insertTx paths and checks
+// that none of them puts an archived transaction back in the vault.
+//
+
+#include <Vault.h>
+
+#include <CoinCore/random.h>
+
+#include <boost/filesystem.hpp>
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace CoinDB;
+using namespace std;
+
+namespace
+{
+
+const string DB_FILE = "build/txarchive_test.db";
+const string ARCHIVE_FILE = "build/txarchive_test.archive";
+const string ACCOUNT_NAME = "account";
+
+// Enough empty blocks on top for both transactions to reach MIN_ARCHIVE_CONFIRMATIONS.
+const unsigned int BLOCK_COUNT = Vault::MIN_ARCHIVE_CONFIRMATIONS + 10;
+
+unsigned int g_failed = 0;
+unsigned int g_passed = 0;
+
+void check(bool condition, const string& name)
+{
+    if (condition)
+    {
+        g_passed++;
+        return;
+    }
+
+    g_failed++;
+    cerr << "FAILED: " << name << endl;
+}
+
+template<typename F>
+bool throws(F f)
+{
+    try
+    {
+        f();
+    }
+    catch (const exception&)
+    {
+        return true;
+    }
+    return false;
+}
+
+class Chain
+{
+public:
+    Chain() : height_(0), prevhash_(32, 0) { }
+
+    int height() const { return height_; }
+
+    // Builds the next block holding txs, or a single unrelated tx when txs is empty.
+    Vault::merkle_block_txs_t nextBlock(const vector<Coin::Transaction>& txs)
+    {
+        vector<Coin::MerkleLeaf> leaves;
+        for (auto& tx: txs) { leaves.push_back(Coin::MerkleLeaf(tx.hash(), true)); }
+        if (leaves.empty()) { leaves.push_back(Coin::MerkleLeaf(random_bytes(32), false)); }
+
+        height_++;
+        Coin::MerkleBlock merkleblock(Coin::PartialMerkleTree(leaves), 1, prevhash_, 1500000000 + height_ * 600, 0x207fffff, 0);
+        prevhash_ = merkleblock.blockHeader.hash();
+        return Vault::merkle_block_txs_t(ChainMerkleBlock(merkleblock, true, height_), txs);
+    }
+
+private:
+    int height_;
+    uchar_vector prevhash_;
+};
+
+Coin::Transaction newTx(const Coin::OutPoint& outpoint, const bytes_t& txoutscript)
+{
+    Coin::Transaction cointx;
+    cointx.inputs.push_back(Coin::TxIn(outpoint, bytes_t(), 0xffffffff));
+    cointx.outputs.push_back(Coin::TxOut(100000, txoutscript));
+    return cointx;
+}
+
+size_t txCount(const Vault& vault)
+{
+    return vault.getTxViews().size();
+}
+
+}
+
+int main()
+{
+    try
+    {
+        boost::filesystem::remove(DB_FILE);
+        boost::filesystem::remove(ARCHIVE_FILE);
+
+        Vault vault(DB_FILE, true);
+        vault.newKeychain("keychain", secure_random_bytes(32));
+        vault.newAccount(ACCOUNT_NAME, 1, vector<string>(1, "keychain"));
+        vault.openTxArchive(ARCHIVE_FILE);
+
+        // fundingTx pays the account, spendingTx sends all of it elsewhere one block later.
+        bytes_t txoutscript = vault.issueSigningScript(ACCOUNT_NAME)->txoutscript();
+        Coin::Transaction fundingTx = newTx(Coin::OutPoint(random_bytes(32), 0), txoutscript);
+        Coin::Transaction spendingTx = newTx(Coin::OutPoint(fundingTx.hash(), 0), random_bytes(25));
+
+        Chain chain;
+        vector<Vault::merkle_block_txs_t> blocks;
+        blocks.push_back(chain.nextBlock(vector<Coin::Transaction>(1, fundingTx)));
+        blocks.push_back(chain.nextBlock(vector<Coin::Transaction>(1, spendingTx)));
+        while ((unsigned int)chain.height() < BLOCK_COUNT) { blocks.push_back(chain.nextBlock(vector<Coin::Transaction>())); }
+
+        check(vault.insertMerkleBlocks(blocks) == 2, "both txs inserted");
+        check(txCount(vault) == 2, "both txs listed");
+
+        check(throws([&]() { vault.archiveTxs(Vault::MIN_ARCHIVE_CONFIRMATIONS - 1); }), "too few confirmations throws");
+
+        // max_txs bounds each call, oldest first.
+        check(vault.archiveTxs(Vault::MIN_ARCHIVE_CONFIRMATIONS, 1) == 1, "max_txs limits the first call to one tx");
+        check(txCount(vault) == 1, "funding tx left the vault");
+        check(vault.archiveTxs(Vault::MIN_ARCHIVE_CONFIRMATIONS, 1) == 1, "second call archives the spending tx");
+        check(txCount(vault) == 0, "spending tx left the vault");
+        check(vault.archiveTxs(Vault::MIN_ARCHIVE_CONFIRMATIONS) == 0, "nothing left to archive");
+        check(!throws([&]() { vault.getTx(fundingTx.hash()); }), "archived tx is still found by hash");
+
+        // A rescan delivers the same transactions in a new block.
+        vector<Coin::Transaction> rescanTxs;
+        rescanTxs.push_back(fundingTx);
+        rescanTxs.push_back(spendingTx);
+        check(vault.insertMerkleBlocks(vector<Vault::merkle_block_txs_t>(1, chain.nextBlock(rescanTxs))) == 0, "merkle path does not re-add archived txs");
+        check(txCount(vault) == 0, "no txs listed after the merkle path");
+
+        check(!vault.insertNewTx(fundingTx), "insertNewTx does not re-add an archived tx");
+
+        std::shared_ptr<Tx> tx(new Tx());
+        tx->set(fundingTx, time(NULL), Tx::PROPAGATED);
+        check(!vault.insertTx(tx), "insertTx does not re-add an archived tx");
+        check(txCount(vault) == 0, "no txs listed after the other paths");
+    }
+    catch (const exception& e)
+    {
+        cerr << "Error: " << e.what() << endl;
+        return -2;
+    }
+
+    cout << g_passed << " passed, " << g_failed << " failed." << endl;
+    return g_failed ? -1 : 0;
+}
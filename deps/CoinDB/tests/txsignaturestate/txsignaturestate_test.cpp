@@ -0,0 +1,191 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// txsignaturestate_test.cpp
+//
+// Copyright (c) 2011-2016 Ciphrex Corp.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+//
+// Checks that the signature state cached on a Tx follows the tx when its
+// outputs are shuffled or edited: signing from the cached signer after a
+// shuffle has to produce signatures that are valid for the shuffled tx.
+//
+
+#include <Schema.h>
+
+#include <CoinQ/CoinQ_script.h>
+#include <CoinCore/secp256k1_openssl.h>
+#include <CoinCore/random.h>
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace CoinDB;
+using namespace CoinQ::Script;
+using namespace CoinCrypto;
+using namespace std;
+
+namespace
+{
+
+const unsigned int TXOUT_COUNT = 8;
+
+unsigned int g_failed = 0;
+unsigned int g_passed = 0;
+
+void check(bool condition, const string& name)
+{
+    if (condition)
+    {
+        g_passed++;
+        return;
+    }
+
+    g_failed++;
+    cerr << "FAILED: " << name << endl;
+}
+
+vector<bytes_t> txoutScripts(const Coin::Transaction& coin_tx)
+{
+    vector<bytes_t> scripts;
+    for (auto& output: coin_tx.outputs) { scripts.push_back(output.scriptPubKey); }
+    return scripts;
+}
+
+// A 2 of 2 pay to script hash input with placeholders for both signatures.
+shared_ptr<Tx> newUnsignedTx(const vector<secp256k1_key>& keys)
+{
+    vector<bytes_t> pubkeys;
+    for (auto& key: keys) { pubkeys.push_back(key.getPubKey()); }
+    Script script(Script::PAY_TO_MULTISIG_SCRIPT_HASH, keys.size(), pubkeys);
+
+    txins_t txins;
+    txins.push_back(shared_ptr<TxIn>(new TxIn(random_bytes(32), 0, script.txinscript(Script::EDIT), 0xffffffff)));
+
+    txouts_t txouts;
+    for (unsigned int i = 0; i < TXOUT_COUNT; i++)
+    {
+        bytes_t txoutscript = Script(Script::PAY_TO_PUBKEY_HASH, 1, vector<bytes_t>(1, pubkeys[0])).txoutscript();
+        txoutscript.push_back(i); // make every output distinct
+        txouts.push_back(shared_ptr<TxOut>(new TxOut(100000 * (i + 1), txoutscript)));
+    }
+
+    shared_ptr<Tx> tx(new Tx());
+    tx->set(1, txins, txouts, 0, time(NULL), Tx::UNSIGNED, false, true);
+    return tx;
+}
+
+// Signs the way Vault::signTx_unwrapped does: from the tx's cached signer.
+void signTx(shared_ptr<Tx> tx, const vector<secp256k1_key>& keys)
+{
+    Signer signer(tx->signer());
+    const Coin::Transaction& coin_tx = signer.getTx();
+    for (auto& txin: tx->txins())
+    {
+        SignableTxIn signableTxIn(signer.getSignableTxIns()[txin->txindex()]);
+        bytes_t signingHash = coin_tx.getSigHash(SIGHASH_ALL, txin->txindex(), signableTxIn.redeemscript(), 0);
+        for (auto& key: keys)
+        {
+            bytes_t signature = secp256k1_sign(key, signingHash);
+            signature.push_back(SIGHASH_ALL);
+            signableTxIn.addsig(key.getPubKey(), signature);
+        }
+        txin->script(signableTxIn.txinscript());
+    }
+}
+
+// Verifies every signature against the tx as it is now, not as any cached copy has it.
+bool verifyTx(shared_ptr<Tx> tx, const vector<secp256k1_key>& keys)
+{
+    Coin::Transaction coin_tx = tx->toCoinCore();
+    for (auto& txin: tx->txins())
+    {
+        SignableTxIn signableTxIn(coin_tx, txin->txindex());
+        bytes_t signingHash = coin_tx.getSigHash(SIGHASH_ALL, txin->txindex(), signableTxIn.redeemscript(), 0);
+        if (signableTxIn.sigs().size() != keys.size()) return false;
+        for (std::size_t i = 0; i < keys.size(); i++)
+        {
+            bytes_t signature = signableTxIn.sigs()[i];
+            if (signature.empty()) return false;
+            signature.pop_back(); // hash type
+            if (!secp256k1_verify(keys[i], signingHash, signature)) return false;
+        }
+    }
+    return true;
+}
+
+void testShuffleThenSign(const vector<secp256k1_key>& keys)
+{
+    shared_ptr<Tx> tx = newUnsignedTx(keys);
+    check(tx->missingSigCount() == keys.size(), "new tx is missing every signature");
+
+    vector<bytes_t> before = txoutScripts(tx->toCoinCore());
+    check(txoutScripts(tx->signer().getTx()) == before, "cached signer has the output order");
+
+    // random_shuffle can leave the order as it was, so try until it moves.
+    for (unsigned int i = 0; i < 100 && txoutScripts(tx->toCoinCore()) == before; i++) { tx->shuffle_txouts(); }
+    vector<bytes_t> after = txoutScripts(tx->toCoinCore());
+    check(after != before, "shuffle moves the outputs");
+    check(txoutScripts(tx->signer().getTx()) == after, "shuffle resets the cached signer");
+
+    signTx(tx, keys);
+    check(tx->missingSigCount() == 0, "signing after a shuffle fills every signature");
+    check(verifyTx(tx, keys), "signatures made after a shuffle are valid for the shuffled tx");
+}
+
+void testTxOutSetters(const vector<secp256k1_key>& keys)
+{
+    shared_ptr<Tx> tx = newUnsignedTx(keys);
+    tx->missingSigCount();
+
+    shared_ptr<TxOut> txout = tx->txouts()[0];
+    txout->value(txout->value() + 1);
+    check(tx->signer().getTx().outputs[0].value == txout->value(), "txout value resets the cached signer");
+
+    bytes_t script = txout->script();
+    script.push_back(0xff);
+    txout->script(script);
+    check(tx->signer().getTx().outputs[0].scriptPubKey == script, "txout script resets the cached signer");
+
+    signTx(tx, keys);
+    check(verifyTx(tx, keys), "signatures made after editing a txout are valid");
+
+    // The signatures commit to the outputs, so editing one after signing breaks them.
+    txout->value(txout->value() + 1);
+    check(!verifyTx(tx, keys), "editing a signed txout breaks its signatures");
+}
+
+void testShuffleTxIns(const vector<secp256k1_key>& keys)
+{
+    shared_ptr<Tx> tx = newUnsignedTx(keys);
+    tx->missingSigCount();
+    tx->shuffle_txins();
+    signTx(tx, keys);
+    check(tx->missingSigCount() == 0 && verifyTx(tx, keys), "signing after shuffling txins is valid");
+}
+
+}
+
+int main()
+{
+    try
+    {
+        vector<secp256k1_key> keys(2);
+        for (auto& key: keys) { key.newKey(); }
+
+        testShuffleThenSign(keys);
+        testTxOutSetters(keys);
+        testShuffleTxIns(keys);
+    }
+    catch (const exception& e)
+    {
+        cerr << "Error: " << e.what() << endl;
+        return -2;
+    }
+
+    cout << g_passed << " passed, " << g_failed << " failed." << endl;
+    return g_failed ? -1 : 0;
+}
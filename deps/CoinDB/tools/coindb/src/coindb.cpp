@@ -19,6 +19,8 @@
 #include <odb/transaction.hxx>
 
 #include <Vault.h>
+#include <VaultJson.h>
+#include <BlockFileRescan.h>
 #include <Passphrase.h>
 
 #include <CoinCore/Base58Check.h>
@@ -46,6 +48,9 @@ using namespace CoinDB;
 std::string g_dbuser;
 std::string g_dbpasswd;
 
+// Lets stats run other commands.
+cli::Shell* g_shell = nullptr;
+
 // Global operations
 cli::result_t cmd_create(const cli::params_t& params)
 {
@@ -359,13 +364,13 @@ cli::result_t cmd_exportbip32(const cli::params_t& params)
     Vault vault(g_dbuser, g_dbpasswd, params[0], false);
     if (export_privkey)
     {
-        secure_bytes_t unlock_key = sha256_2(params[2]);
+        secure_bytes_t unlock_key = to_secure_bytes(sha256_2(params[2]));
         vault.unlockKeychain(params[1], unlock_key);
     }
     secure_bytes_t extkey = vault.exportBIP32(params[1], export_privkey);
 
     stringstream ss;
-    ss << toBase58Check(extkey);
+    ss << toBase58Check(to_bytes(extkey));
     return ss.str();
 }
 
@@ -376,15 +381,15 @@ cli::result_t cmd_importbip32(const cli::params_t& params)
     bytes_t salt;
     if (import_privkey)
     {
-        lock_key = sha256_2(params[3]);
+        lock_key = to_secure_bytes(sha256_2(params[3]));
         // TODO: add salt
     }
 
-    secure_bytes_t extkey;
+    bytes_t extkey;
     if (!fromBase58Check(params[2], extkey)) throw std::runtime_error("Invalid BIP32.");
 
     Vault vault(g_dbuser, g_dbpasswd, params[0], false);
-    std::shared_ptr<Keychain> keychain = vault.importBIP32(params[1], extkey, lock_key);
+    std::shared_ptr<Keychain> keychain = vault.importBIP32(params[1], to_secure_bytes(extkey), lock_key);
 
     stringstream ss;
     ss << (keychain->isPrivate() ? "Private" : "Public") << " keychain " << keychain->name() << " imported from BIP32.";
@@ -488,6 +493,19 @@ cli::result_t cmd_listaccounts(const cli::params_t& params)
     return ss.str();
 }
 
+cli::result_t cmd_listaccountsjson(const cli::params_t& params)
+{
+    Vault vault(g_dbuser, g_dbpasswd, params[0], false);
+    vector<AccountInfo> accounts = vault.getAllAccountInfo();
+
+    stdutils::JsonWriter json(accounts.size() * 256);
+    json.beginArray();
+    for (auto& account: accounts)
+        writeJson(json, account);
+    json.endArray();
+    return json.release();
+}
+
 cli::result_t cmd_exportaccount(const cli::params_t& params)
 {
     Vault vault(g_dbuser, g_dbpasswd, params[0], false);
@@ -573,6 +591,39 @@ cli::result_t cmd_issuescript(const cli::params_t& params)
     return ss.str(); 
 }
 
+cli::result_t cmd_reservescripts(const cli::params_t& params)
+{
+    Vault vault(g_dbuser, g_dbpasswd, params[0], false);
+    CoinQ::NetworkSelector networkSelector(vault.getNetwork());
+    const CoinQ::CoinParams& coinParams = networkSelector.getCoinParams();
+
+    std::string account_name;
+    if (params[1] != "@null") account_name = params[1];
+    uint32_t count = strtoul(params[2].c_str(), NULL, 10);
+    if (count == 0) throw std::runtime_error("Count must be positive.");
+    std::string label = params.size() > 3 ? params[3] : std::string("");
+    std::string bin_name = params.size() > 4 ? params[4] : std::string(DEFAULT_BIN_NAME);
+
+    // One transaction for the scripts and one for their labels.
+    std::vector<std::shared_ptr<SigningScript>> scripts = vault.issueSigningScripts(account_name, bin_name, count);
+    if (!label.empty())
+    {
+        std::vector<std::pair<unsigned long, std::string>> labels;
+        for (auto& script: scripts) { labels.push_back(std::make_pair(script->id(), label)); }
+        vault.setSigningScriptLabels(labels);
+    }
+
+    stringstream ss;
+    bool newLine = false;
+    for (auto& script: scripts)
+    {
+        if (newLine) ss << endl;
+        newLine = true;
+        ss << script->index() << " " << uchar_vector(script->txoutscript()).getHex() << " " << CoinQ::Script::getAddressForTxOutScript(script->txoutscript(), coinParams.address_versions());
+    }
+    return ss.str();
+}
+
 cli::result_t cmd_invoicecontact(const cli::params_t& params)
 {
     Vault vault(g_dbuser, g_dbpasswd, params[0], false);
@@ -623,6 +674,30 @@ cli::result_t cmd_listscripts(const cli::params_t& params)
     return ss.str();
 }
 
+cli::result_t cmd_listscriptsjson(const cli::params_t& params)
+{
+    std::string account_name = params.size() > 1 ? params[1] : std::string("@all");
+    if (account_name == "@all") account_name = "";
+
+    std::string bin_name = params.size() > 2 ? params[2] : std::string("@all");
+    if (bin_name == "@all") bin_name = "";
+
+    int flags = params.size() > 3 ? (int)strtoul(params[3].c_str(), NULL, 0) : ((int)SigningScript::ISSUED | (int)SigningScript::USED);
+    
+    Vault vault(g_dbuser, g_dbpasswd, params[0], false);
+    CoinQ::NetworkSelector networkSelector(vault.getNetwork());
+    const CoinQ::CoinParams& coinParams = networkSelector.getCoinParams();
+
+    vector<SigningScriptView> scriptViews = vault.getSigningScriptViews(account_name, bin_name, flags);
+
+    stdutils::JsonWriter json(scriptViews.size() * 512);
+    json.beginArray();
+    for (auto& scriptView: scriptViews)
+        writeJson(json, scriptView, coinParams);
+    json.endArray();
+    return json.release();
+}
+
 cli::result_t cmd_history(const cli::params_t& params)
 {
     std::string account_name = params.size() > 1 ? params[1] : std::string("@all");
@@ -673,6 +748,31 @@ cli::result_t cmd_historycsv(const cli::params_t& params)
     return ss.str();
 }
 
+cli::result_t cmd_historyjson(const cli::params_t& params)
+{
+    std::string account_name = params.size() > 1 ? params[1] : std::string("@all");
+    if (account_name == "@all") account_name = "";
+
+    std::string bin_name = params.size() > 2 ? params[2] : std::string("@all");
+    if (bin_name == "@all") bin_name = "";
+
+    bool hide_change = params.size() > 3 ? params[3] == "true" : true;
+    
+    Vault vault(g_dbuser, g_dbpasswd, params[0], false);
+    CoinQ::NetworkSelector networkSelector(vault.getNetwork());
+    const CoinQ::CoinParams& coinParams = networkSelector.getCoinParams();
+
+    uint32_t best_height = vault.getBestHeight();
+    vector<TxOutView> txOutViews = vault.getTxOutViews(account_name, bin_name, TxOut::ROLE_BOTH, TxOut::BOTH, Tx::ALL, hide_change);
+
+    stdutils::JsonWriter json(txOutViews.size() * 512);
+    json.beginArray();
+    for (auto& txOutView: txOutViews)
+        writeJson(json, txOutView, best_height, coinParams);
+    json.endArray();
+    return json.release();
+}
+
 cli::result_t cmd_unspent(const cli::params_t& params)
 {
     std::string account_name = params[1];
@@ -692,6 +792,27 @@ cli::result_t cmd_unspent(const cli::params_t& params)
     return ss.str();
 }
 
+cli::result_t cmd_unspentjson(const cli::params_t& params)
+{
+    std::string account_name = params[1];
+
+    uint32_t min_confirmations = params.size() > 2 ? strtoul(params[2].c_str(), NULL, 0) : 0;
+
+    Vault vault(g_dbuser, g_dbpasswd, params[0], false);
+    CoinQ::NetworkSelector networkSelector(vault.getNetwork());
+    const CoinQ::CoinParams& coinParams = networkSelector.getCoinParams();
+
+    uint32_t best_height = vault.getBestHeight();
+    vector<TxOutView> txOutViews = vault.getUnspentTxOutViews(account_name, min_confirmations);
+
+    stdutils::JsonWriter json(txOutViews.size() * 512);
+    json.beginArray();
+    for (auto& txOutView: txOutViews)
+        writeJson(json, txOutView, best_height, coinParams);
+    json.endArray();
+    return json.release();
+}
+
 cli::result_t cmd_unsigned(const cli::params_t& params)
 {
     std::string account_name = params.size() > 1 ? params[1] : std::string("@all");
@@ -795,6 +916,22 @@ cli::result_t cmd_listtxs(const cli::params_t& params)
     return ss.str();
 }
 
+cli::result_t cmd_listtxsjson(const cli::params_t& params)
+{
+    int tx_status_flags = params.size() > 1 && params[1] == "unsigned" ? Tx::UNSIGNED : Tx::ALL;
+    uint32_t minheight = params.size() > 2 ? strtoul(params[2].c_str(), NULL, 0) : 0;
+    Vault vault(g_dbuser, g_dbpasswd, params[0], false);
+    uint32_t best_height = vault.getBestHeight();
+    std::vector<TxView> txViews = vault.getTxViews(tx_status_flags, 0, -1, minheight);
+
+    stdutils::JsonWriter json(txViews.size() * 384);
+    json.beginArray();
+    for (auto& txView: txViews)
+        writeJson(json, txView, best_height);
+    json.endArray();
+    return json.release();
+}
+
 cli::result_t cmd_txinfo(const cli::params_t& params)
 {
     Vault vault(g_dbuser, g_dbpasswd, params[0], false);
@@ -832,6 +969,29 @@ cli::result_t cmd_txinfo(const cli::params_t& params)
     return ss.str();
 }
 
+cli::result_t cmd_txjson(const cli::params_t& params)
+{
+    Vault vault(g_dbuser, g_dbpasswd, params[0], false);
+    CoinQ::NetworkSelector networkSelector(vault.getNetwork());
+    const CoinQ::CoinParams& coinParams = networkSelector.getCoinParams();
+
+    std::shared_ptr<Tx> tx;
+    bytes_t hash = uchar_vector(params[1]);
+    if (hash.size() == 32)
+    {
+        tx = vault.getTx(hash);
+    }
+    else
+    {
+        unsigned long tx_id = strtoul(params[1].c_str(), NULL, 0);
+        tx = vault.getTx(tx_id);
+    }
+
+    stdutils::JsonWriter json;
+    writeJson(json, tx->toCoinCore(), coinParams);
+    return json.release();
+}
+
 cli::result_t cmd_txconf(const cli::params_t& params)
 {
     Vault vault(g_dbuser, g_dbpasswd, params[0], false);
@@ -1113,6 +1273,57 @@ cli::result_t cmd_signtx(const cli::params_t& params)
     return ss.str();
 }
 
+cli::result_t cmd_exportpartialtx(const cli::params_t& params)
+{
+    Vault vault(g_dbuser, g_dbpasswd, params[0], false);
+
+    PartialTx partialtx;
+    bytes_t hash = uchar_vector(params[1]);
+    if (hash.size() == 32)
+    {
+        partialtx = vault.getPartialTx(hash, true);
+    }
+    else
+    {
+        unsigned long tx_id = strtoul(params[1].c_str(), NULL, 0);
+        partialtx = vault.getPartialTx(tx_id, true);
+    }
+
+    string filename = params.size() > 2 ? params[2] : (uchar_vector(partialtx.unsigned_hash()).getHex() + ".ptx");
+    ofstream ofs(filename, ofstream::out);
+    ofs << partialtx.toSerialized();
+    ofs.close();
+
+    stringstream ss;
+    ss << "Exported partially signed transaction to " << filename << ". " << partialtx.sigsneeded() << " signature(s) still needed.";
+    return ss.str();
+}
+
+cli::result_t cmd_importpartialtx(const cli::params_t& params)
+{
+    Vault vault(g_dbuser, g_dbpasswd, params[0], false);
+
+    ifstream ifs(params[1], ifstream::in);
+    if (!ifs.good()) throw std::runtime_error("Error opening file.");
+    stringstream partialtxstr;
+    partialtxstr << ifs.rdbuf();
+
+    std::shared_ptr<Tx> tx = vault.importPartialTxFromString(partialtxstr.str());
+
+    stringstream ss;
+    if (tx)
+    {
+        ss << "Tx updated. unsigned hash: " << uchar_vector(tx->unsigned_hash()).getHex();
+        if (tx->status() != Tx::UNSIGNED)
+            ss << " hash: " << uchar_vector(tx->hash()).getHex();
+    }
+    else
+    {
+        ss << "Tx not updated.";
+    }
+    return ss.str();
+}
+
 cli::result_t cmd_exporttxs(const cli::params_t& params)
 {
     Vault vault(g_dbuser, g_dbpasswd, params[0], false);
@@ -1137,6 +1348,35 @@ cli::result_t cmd_importtxs(const cli::params_t& params)
     return ss.str();
 }
 
+cli::result_t cmd_archivetxs(const cli::params_t& params)
+{
+    Vault vault(g_dbuser, g_dbpasswd, params[0], false);
+
+    uint32_t min_confirmations = strtoul(params[1].c_str(), NULL, 0);
+    vault.openTxArchive(params.size() > 2 ? params[2] : "");
+    unsigned int count = vault.archiveTxs(min_confirmations);
+
+    stringstream ss;
+    ss << count << " transaction(s) archived.";
+    return ss.str();
+}
+
+// Change log operations
+cli::result_t cmd_changes(const cli::params_t& params)
+{
+    Vault vault(g_dbuser, g_dbpasswd, params[0], false);
+
+    unsigned long sequence = params.size() > 1 ? strtoul(params[1].c_str(), NULL, 0) : 0;
+    unsigned int limit = params.size() > 2 ? strtoul(params[2].c_str(), NULL, 0) : 100;
+    unsigned int wait = params.size() > 3 ? strtoul(params[3].c_str(), NULL, 0) : 0;
+
+    // Long-poll: block until something past sequence is committed or the wait expires.
+    if (wait > 0) { vault.waitForChanges(sequence, wait * 1000); }
+
+    // Pass the last sequence back in to continue.
+    return changesToJson(vault.getChangesSince(sequence, limit));
+}
+
 
 // Blockchain operations
 cli::result_t cmd_bestheight(const cli::params_t& params)
@@ -1273,6 +1513,21 @@ cli::result_t cmd_importmerkleblocks(const cli::params_t& params)
     return ss.str();
 }
 
+cli::result_t cmd_rescanblockfiles(const cli::params_t& params)
+{
+    Vault vault(g_dbuser, g_dbpasswd, params[0], false);
+    CoinQ::NetworkSelector networkSelector(vault.getNetwork());
+
+    BlockFileRescan rescan(vault, networkSelector.getCoinParams());
+    if (params.size() > 2) { rescan.setThreads(strtoul(params[2].c_str(), NULL, 10)); }
+
+    unsigned int count = rescan.rescan(params[1]);
+
+    stringstream ss;
+    ss << count << " transactions found in " << params[1] << ".";
+    return ss.str();
+}
+
 cli::result_t cmd_incompleteblocks(const cli::params_t& params)
 {
     Vault vault(g_dbuser, g_dbpasswd, params[0], false);
@@ -1293,6 +1548,24 @@ cli::result_t cmd_randombytes(const cli::params_t& params)
     return bytes.getHex();
 }
 
+// Profiling
+cli::result_t cmd_stats(const cli::params_t& params)
+{
+    if (params[0] == "stats") throw std::runtime_error("Cannot profile stats.");
+
+    Vault::enableProfiling();
+    cli::result_t result = g_shell->exec(params[0], cli::params_t(params.begin() + 1, params.end()));
+
+    stringstream ss;
+    ss << result << endl << endl;
+    ss << formattedVaultCallStatsHeader();
+    for (auto& stats: Vault::getStats())
+    {
+        ss << endl << formattedVaultCallStats(stats);
+    }
+    return ss.str();
+}
+
 int main(int argc, char* argv[])
 {
     stringstream helpMessage;
@@ -1300,6 +1573,7 @@ int main(int argc, char* argv[])
 
     using namespace cli;
     Shell shell(helpMessage.str());
+    g_shell = &shell;
 
     // Global operations
     shell.add(command(
@@ -1454,6 +1728,11 @@ int main(int argc, char* argv[])
         "listaccounts",
         "display list of accounts",
         command::params(1, "db file")));
+    shell.add(command(
+        &cmd_listaccountsjson,
+        "listaccountsjson",
+        "display list of accounts in json format",
+        command::params(1, "db file")));
     shell.add(command(
         &cmd_exportaccount,
         "exportaccount",
@@ -1482,6 +1761,12 @@ int main(int argc, char* argv[])
         "issue a new signing script",
         command::params(2, "db file", "account name"),
         command::params(3, "label", (std::string("bin name = ") + DEFAULT_BIN_NAME).c_str(), "index = 0")));
+    shell.add(command(
+        &cmd_reservescripts,
+        "reservescripts",
+        "issue a batch of signing scripts in one transaction",
+        command::params(3, "db file", "account name", "count"),
+        command::params(2, "label", (std::string("bin name = ") + DEFAULT_BIN_NAME).c_str())));
     shell.add(command(
         &cmd_invoicecontact,
         "invoicecontact",
@@ -1494,6 +1779,12 @@ int main(int argc, char* argv[])
         "display list of signing scripts (flags: UNUSED=1, CHANGE=2, PENDING=4, RECEIVED=8, CANCELED=16)",
         command::params(1, "db file"),
         command::params(3, "account name = @all", "bin name = @all", "flags = PENDING | RECEIVED")));
+    shell.add(command(
+        &cmd_listscriptsjson,
+        "listscriptsjson",
+        "display list of signing scripts in json format (flags: UNUSED=1, CHANGE=2, PENDING=4, RECEIVED=8, CANCELED=16)",
+        command::params(1, "db file"),
+        command::params(3, "account name = @all", "bin name = @all", "flags = PENDING | RECEIVED")));
     shell.add(command(
         &cmd_history,
         "history",
@@ -1506,12 +1797,24 @@ int main(int argc, char* argv[])
         "display transaction history in csv format",
         command::params(1, "db file"),
         command::params(3, "account name = @all", "bin name = @all", "hide change = true")));
+    shell.add(command(
+        &cmd_historyjson,
+        "historyjson",
+        "display transaction history in json format",
+        command::params(1, "db file"),
+        command::params(3, "account name = @all", "bin name = @all", "hide change = true")));
     shell.add(command(
         &cmd_unspent,
         "unspent",
         "display unspent outputs",
         command::params(2, "db file", "account name"),
         command::params(1, "minimum confirmations = 0")));
+    shell.add(command(
+        &cmd_unspentjson,
+        "unspentjson",
+        "display unspent outputs in json format",
+        command::params(2, "db file", "account name"),
+        command::params(1, "minimum confirmations = 0")));
     shell.add(command(
         &cmd_unsigned,
         "unsigned",
@@ -1555,11 +1858,22 @@ int main(int argc, char* argv[])
         "list transactions",
         command::params(1, "db file"),
         command::params(2, "all | unsigned (default: all)", "minheight (default:0)")));
+    shell.add(command(
+        &cmd_listtxsjson,
+        "listtxsjson",
+        "list transactions in json format",
+        command::params(1, "db file"),
+        command::params(2, "all | unsigned (default: all)", "minheight (default:0)")));
     shell.add(command(
         &cmd_txinfo,
         "txinfo",
         "display transaction information",
         command::params(2, "db file", "tx hash or id")));
+    shell.add(command(
+        &cmd_txjson,
+        "txjson",
+        "display transaction inputs and outputs in json format",
+        command::params(2, "db file", "tx hash or id")));
     shell.add(command(
         &cmd_txconf,
         "txconf",
@@ -1610,6 +1924,17 @@ int main(int argc, char* argv[])
         "add signatures to transaction for specified keychain",
         command::params(3, "db file", "tx hash or id", "keychain name"),
         command::params(1, "passphrase")));
+    shell.add(command(
+        &cmd_exportpartialtx,
+        "exportpartialtx",
+        "export partially signed transaction to file",
+        command::params(2, "db file", "tx hash or id"),
+        command::params(1, "output file = *.ptx")));
+    shell.add(command(
+        &cmd_importpartialtx,
+        "importpartialtx",
+        "merge signatures from partially signed transaction file",
+        command::params(2, "db file", "partial tx file")));
     shell.add(command(
         &cmd_exporttxs,
         "exporttxs",
@@ -1621,6 +1946,20 @@ int main(int argc, char* argv[])
         "importtxs",
         "import transactions from file",
         command::params(2, "db file", "account file")));
+    shell.add(command(
+        &cmd_archivetxs,
+        "archivetxs",
+        "move old fully spent transactions to the archive file",
+        command::params(2, "db file", "min confirmations"),
+        command::params(1, "archive file = *.archive")));
+
+    // Change log operations
+    shell.add(command(
+        &cmd_changes,
+        "changes",
+        "display vault changes logged after a sequence number, optionally waiting for new ones",
+        command::params(1, "db file"),
+        command::params(3, "sequence = 0", "limit = 100", "wait seconds = 0")));
 
     // Blockchain operations
     shell.add(command(
@@ -1678,6 +2017,12 @@ int main(int argc, char* argv[])
         "importmerkleblocks",
         "import merkle blocks from file",
         command::params(2, "db file", "input file")));
+    shell.add(command(
+        &cmd_rescanblockfiles,
+        "rescanblockfiles",
+        "scan local blk*.dat files for vault transactions",
+        command::params(2, "db file", "blocks dir"),
+        command::params(1, "threads = 0")));
     shell.add(command(
         &cmd_incompleteblocks,
         "incompleteblocks",
@@ -1691,6 +2036,14 @@ int main(int argc, char* argv[])
         "output random bytes in hex",
         command::params(1, "length")));
 
+    // Profiling
+    shell.add(command(
+        &cmd_stats,
+        "stats",
+        "run a command and display time spent in each vault method",
+        command::params(1, "command"),
+        command::params(3, "param 1", "param 2", "...")));
+
     try 
     {
         CoinDBConfig config;
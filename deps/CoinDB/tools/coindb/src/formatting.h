@@ -500,3 +500,53 @@ inline std::string formattedAccountBinView(const CoinDB::AccountBinView& view)
     return ss.str();
 }
 
+
+// Vault call stats
+inline std::string formattedVaultCallStatsHeader()
+{
+    using namespace std;
+
+    stringstream ss;
+    ss << " ";
+    ss << left  << setw(28) << "method" << " | "
+       << right << setw(7)  << "calls" << " | "
+       << right << setw(6)  << "errors" << " | "
+       << right << setw(10) << "total ms" << " | "
+       << right << setw(10) << "lock ms" << " | "
+       << right << setw(10) << "db ms" << " | "
+       << right << setw(10) << "other ms" << " | "
+       << right << setw(9)  << "p50 ms" << " | "
+       << right << setw(9)  << "p99 ms" << " | "
+       << right << setw(9)  << "max ms" << " | "
+       << right << setw(8)  << "reads" << " | "
+       << right << setw(8)  << "writes";
+    ss << " ";
+
+    size_t header_length = ss.str().size();
+    ss << endl;
+    for (size_t i = 0; i < header_length; i++) { ss << "="; }
+    return ss.str();
+}
+
+inline std::string formattedVaultCallStats(const CoinDB::VaultCallStats& stats)
+{
+    using namespace std;
+
+    stringstream ss;
+    ss << fixed << setprecision(3);
+    ss << " ";
+    ss << left  << setw(28) << stats.method << " | "
+       << right << setw(7)  << stats.calls << " | "
+       << right << setw(6)  << stats.errors << " | "
+       << right << setw(10) << stats.total_ns/1e6 << " | "
+       << right << setw(10) << stats.lock_wait_ns/1e6 << " | "
+       << right << setw(10) << stats.db_ns/1e6 << " | "
+       << right << setw(10) << stats.compute_ns/1e6 << " | "
+       << right << setw(9)  << stats.p50_ns/1e6 << " | "
+       << right << setw(9)  << stats.p99_ns/1e6 << " | "
+       << right << setw(9)  << stats.max_ns/1e6 << " | "
+       << right << setw(8)  << stats.statements_read << " | "
+       << right << setw(8)  << stats.statements_written;
+    ss << " ";
+    return ss.str();
+}
@@ -14,6 +14,11 @@
 #include <CoinQ/CoinQ_script.h>
 #include <stdutils/uchar_vector.h>
 
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <exception>
+#include <fstream>
 #include <iostream>
 #include <sstream>
 #include <stdexcept>
@@ -24,10 +29,72 @@ using namespace std;
 
 const unsigned char ADDRESS_VERSIONS[] = { 0x00, 0x05 };
 
+// Indices derived between writes in range mode.
+const uint32_t RANGE_BATCH_SIZE = 10000;
+
 void showUsage(char* argv[])
 {
     cerr << "# Usage 1: " << argv[0] << " <master key> <path>" << endl;
     cerr << "# Usage 2: " << argv[0] << " <minsigs> <master key 1> <path 1> ... [master key n] [path n]" << endl;
+    cerr << "# Usage 3: " << argv[0] << " -range <first index> <count> [-threads <n>] [-out <file>] <minsigs> <master key 1> <parent path 1> ... [master key n] [parent path n]" << endl;
+    cerr << "#          Writes one line per index: index, compressed address, txout script and redeem script." << endl;
+}
+
+// Derives the compressed P2SH multisig address at each index in [first, first + count) under the given
+// parents. Each parent is derived once by the caller, so an index costs one child derivation per key.
+// Indices are spread across threads a batch at a time and written in order. Indices that BIP32 says
+// to skip for any of the keys are left out.
+void deriveRange(uint32_t minsigs, const vector<HDKeychain>& parents, uint32_t first, uint32_t count, unsigned int nThreads, ostream& out)
+{
+    vector<string> lines;
+    const uint64_t end = (uint64_t)first + count;
+    for (uint64_t batchStart = first; batchStart < end; batchStart += RANGE_BATCH_SIZE)
+    {
+        uint32_t batchSize = min<uint64_t>(RANGE_BATCH_SIZE, end - batchStart);
+        lines.assign(batchSize, string());
+
+        vector<exception_ptr> errors(nThreads);
+        auto derive = [&](unsigned int thread)
+        {
+            try
+            {
+                vector<bytes_t> pubkeys;
+                for (uint32_t i = thread; i < batchSize; i += nThreads)
+                {
+                    uint32_t index = batchStart + i;
+                    pubkeys.clear();
+                    try
+                    {
+                        for (auto& parent: parents) { pubkeys.push_back(parent.getChild(index).pubkey()); }
+                    }
+                    catch (const InvalidHDKeychainException&)
+                    {
+                        continue;
+                    }
+                    sort(pubkeys.begin(), pubkeys.end());
+
+                    Script script(Script::PAY_TO_MULTISIG_SCRIPT_HASH, minsigs, pubkeys);
+                    uchar_vector txoutscript = script.txoutscript();
+                    lines[i] = to_string(index) + " " + getAddressForTxOutScript(txoutscript, ADDRESS_VERSIONS) + " " + txoutscript.getHex() + " " + uchar_vector(script.redeemscript()).getHex() + "\n";
+                }
+            }
+            catch (...)
+            {
+                errors[thread] = current_exception();
+            }
+        };
+
+        boost::thread_group threads;
+        for (unsigned int thread = 1; thread < nThreads; thread++) { threads.create_thread(bind(derive, thread)); }
+        derive(0);
+        threads.join_all();
+
+        for (auto& error: errors) { if (error) rethrow_exception(error); }
+
+        for (auto& line: lines) { out << line; }
+        out.flush();
+        if (!out) throw runtime_error("Failed to write output.");
+    }
 }
 
 int main(int argc, char* argv[])
@@ -40,6 +107,66 @@ int main(int argc, char* argv[])
 
     try
     {
+        if (string(argv[1]) == "-range")
+        {
+            if (argc < 4)
+            {
+                showUsage(argv);
+                return -1;
+            }
+
+            uint32_t first = strtoul(argv[2], NULL, 10);
+            uint32_t count = strtoul(argv[3], NULL, 10);
+            if ((uint64_t)first + count > 0x100000000ull) throw runtime_error("Index range exceeds 2^32.");
+
+            unsigned int nThreads = boost::thread::hardware_concurrency();
+            string outfile;
+            int i = 4;
+            for (; i + 1 < argc && argv[i][0] == '-'; i += 2)
+            {
+                string option(argv[i]);
+                if (option == "-threads")   { nThreads = strtoul(argv[i+1], NULL, 10); }
+                else if (option == "-out")  { outfile = argv[i+1]; }
+                else throw runtime_error(string("Invalid option: ") + option);
+            }
+            if (nThreads == 0) { nThreads = 1; }
+
+            if (i + 3 > argc || (argc - i) % 2 == 0)
+            {
+                showUsage(argv);
+                return -1;
+            }
+
+            uint32_t minsigs = strtoul(argv[i], NULL, 10);
+            vector<HDKeychain> parents;
+            for (i++; i < argc; i += 2)
+            {
+                bytes_t extkey;
+                if (!fromBase58Check(string(argv[i]), extkey))
+                {
+                    stringstream err;
+                    err << "Invalid master key base58: " << argv[i];
+                    throw runtime_error(err.str());
+                }
+
+                HDKeychain keychain(extkey);
+                parents.push_back(keychain.getChild(string(argv[i+1])));
+            }
+            if (minsigs == 0 || minsigs > parents.size()) throw runtime_error("Invalid minsigs.");
+
+            if (outfile.empty())
+            {
+                deriveRange(minsigs, parents, first, count, nThreads, cout);
+            }
+            else
+            {
+                ofstream out(outfile, ios::out | ios::trunc);
+                if (!out) throw runtime_error(string("Failed to open output file: ") + outfile);
+                deriveRange(minsigs, parents, first, count, nThreads, out);
+            }
+            return 0;
+        }
+
         if (argc == 3)
         {
             bytes_t extkey;
@@ -50,9 +50,8 @@ int main(int argc, char* argv[])
         keychain = keychain.getChild(string(argv[2]));
         uchar_vector data(argv[3]);
 
-        secure_bytes_t privkey = keychain.privkey();
         secp256k1_key key;
-        key.setPrivKey(privkey);
+        key.setPrivKey(keychain.privkey());
         uchar_vector signature = secp256k1_sign(key, data);
 
         cout << "Signature: " << uchar_vector(signature).getHex() << endl;
@@ -28,10 +28,28 @@ public:
     uint32_t getFilterTweak() const { return m_filterTweak; }
     uint8_t getFilterFlags() const { return m_filterFlags; }
 
+    const std::string& getCaptureFile() const { return m_captureFile; }
+    const std::string& getReplayFile() const { return m_replayFile; }
+    bool getReplayRealtime() const { return m_bReplayRealtime; }
+
+    const std::string& getHeaderSnapshotFile() const { return m_headerSnapshotFile; }
+    const std::string& getWriteHeaderSnapshotFile() const { return m_writeHeaderSnapshotFile; }
+
+    unsigned short getMetricsPort() const { return m_metricsPort; }
+
 protected:
     double m_filterFalsePositiveRate;
     uint32_t m_filterTweak;
     uint8_t m_filterFlags;
+
+    std::string m_captureFile;
+    std::string m_replayFile;
+    bool m_bReplayRealtime;
+
+    std::string m_headerSnapshotFile;
+    std::string m_writeHeaderSnapshotFile;
+
+    unsigned short m_metricsPort;
 };
 
 inline SyncDBConfig::SyncDBConfig() : CoinDBConfig()
@@ -42,6 +60,12 @@ inline SyncDBConfig::SyncDBConfig() : CoinDBConfig()
         ("filterfpr", po::value<double>(&m_filterFalsePositiveRate), "filter false positive rate")
         ("filtertweak", po::value<uint32_t>(&m_filterTweak), "filter tweak")
         ("filterflags", po::value<uint8_t>(&m_filterFlags), "filter flags")
+        ("capture", po::value<std::string>(&m_captureFile), "record peer messages to file")
+        ("replay", po::value<std::string>(&m_replayFile), "replay peer messages from file instead of connecting")
+        ("realtime", po::bool_switch(&m_bReplayRealtime), "replay with the original timing")
+        ("headersnapshot", po::value<std::string>(&m_headerSnapshotFile), "start from a header snapshot if there is no headers file yet")
+        ("writeheadersnapshot", po::value<std::string>(&m_writeHeaderSnapshotFile), "write a header snapshot from the last checkpoint and exit")
+        ("metricsport", po::value<unsigned short>(&m_metricsPort), "serve metrics on this localhost port")
     ;
 }
 
@@ -52,6 +76,7 @@ inline bool SyncDBConfig::parseParams(int argc, char* argv[])
     if (!m_vm.count("filterfpr"))   { m_filterFalsePositiveRate = DEFAULT_FILTER_FALSE_POSITIVE_RATE; }
     if (!m_vm.count("filtertweak")) { m_filterTweak = DEFAULT_FILTER_TWEAK; }
     if (!m_vm.count("filterflags")) { m_filterFlags = DEFAULT_FILTER_FLAGS; }
+    if (!m_vm.count("metricsport")) { m_metricsPort = 0; }
 
     return true;
 }
@@ -14,6 +14,8 @@
 #include "SyncDBConfig.h"
 
 #include <SynchedVault.h>
+#include <MultiVaultSync.h>
+#include <VaultMetrics.h>
 
 #include <CoinQ/CoinQ_coinparams.h>
 
@@ -23,8 +25,10 @@
 #include <iostream>
 #include <signal.h>
 
+#include <atomic>
 #include <thread>
 #include <chrono>
+#include <memory>
 
 using namespace CoinDB;
 using namespace CoinQ;
@@ -131,6 +135,174 @@ void subscribeHandlers(SynchedVault& synchedVault)
     });
 }
 
+void subscribeHandlers(MultiVaultSync& multiVaultSync)
+{
+    multiVaultSync.subscribeStatusChanged([&](SynchedVault::status_t status) {
+        stringstream ss;
+        ss << "Sync status: " << SynchedVault::getStatusString(status);
+        LOGGER(info) << ss.str() << endl;
+        cout << ss.str() << endl;
+        if (status == SynchedVault::STOPPED) { g_bShutdown = true; }
+    });
+
+    multiVaultSync.subscribeVaultError([](Vault* vault, const string& error, int /*code*/)
+    {
+        stringstream ss;
+        ss << "Vault error: " << vault->getName() << endl << "  " << error;
+        LOGGER(error) << ss.str() << endl;
+        cout << ss.str() << endl;
+    });
+
+    multiVaultSync.subscribeBestHeaderChanged([](uint32_t bestheight, const bytes_t& besthash)
+    {
+        stringstream ss;
+        ss << "Best height: " << bestheight << " Best hash: " << uchar_vector(besthash).getHex();
+        LOGGER(info) << ss.str() << endl;
+        cout << ss.str() << endl;
+    });
+
+    multiVaultSync.subscribeProtocolError([](const string& error, int /*code*/)
+    {
+        stringstream ss;
+        ss << "Protocol error: " << error;
+        LOGGER(error) << ss.str() << endl;
+        cout << ss.str() << endl;
+    });
+
+    multiVaultSync.subscribeConnectionError([](const string& error, int /*code*/)
+    {
+        stringstream ss;
+        ss << "Connection error: " << error;
+        LOGGER(error) << ss.str() << endl;
+        cout << ss.str() << endl;
+    });
+
+    multiVaultSync.subscribeBlockTreeError([](const string& error, int /*code*/)
+    {
+        stringstream ss;
+        ss << "Blocktree error: " << error;
+        LOGGER(error) << ss.str() << endl;
+        cout << ss.str() << endl;
+    });
+}
+
+// Transaction and block events come from each vault, so every message names the vault it is for.
+void subscribeHandlers(Vault& vault)
+{
+    string name = vault.getName();
+
+    vault.subscribeTxInserted([name](std::shared_ptr<Tx> tx)
+    {
+        stringstream ss;
+        ss << name << ": Transaction inserted: " << uchar_vector(tx->hash()).getHex();
+        LOGGER(info) << ss.str() << endl;
+        cout << ss.str() << endl;
+    });
+
+    vault.subscribeTxUpdated([name](std::shared_ptr<Tx> tx)
+    {
+        stringstream ss;
+        ss << name << ": Transaction updated: " << uchar_vector(tx->hash()).getHex() << " Status: " << Tx::getStatusString(tx->status());
+        LOGGER(info) << ss.str() << endl;
+        cout << ss.str() << endl;
+    });
+
+    vault.subscribeMerkleBlockInserted([name](std::shared_ptr<MerkleBlock> merkleblock)
+    {
+        stringstream ss;
+        ss << name << ": Merkle block inserted: " << uchar_vector(merkleblock->blockheader()->hash()).getHex() << " Height: " << merkleblock->blockheader()->height();
+        LOGGER(info) << ss.str() << endl;
+        cout << ss.str() << endl;
+    });
+}
+
+// Several vaults share one header tree and one peer connection.
+int runMultiVaultSync(const SyncDBConfig& config, const CoinParams& coinParams, const vector<string>& dbnames, const string& host, const string& port, const string& blocktreefile)
+{
+    MultiVaultSync multiVaultSync(coinParams);
+    multiVaultSync.setFilterParams(config.getFilterFalsePositiveRate(), config.getFilterTweak(), config.getFilterFlags());
+    subscribeHandlers(multiVaultSync);
+
+    CoinQ::MetricsServer metricsServer([&]() {
+        CoinQ::MetricsWriter writer;
+        writeVaultMetrics(writer);
+        writeProcessMetrics(writer);
+        return writer.str();
+    });
+
+    vector<unique_ptr<Vault>> vaults;
+    try
+    {
+        if (config.getMetricsPort())
+        {
+            Vault::enableProfiling();
+            metricsServer.start(config.getMetricsPort());
+            cout << "Serving metrics at http://127.0.0.1:" << config.getMetricsPort() << "/metrics" << endl;
+            LOGGER(info) << "Serving metrics at http://127.0.0.1:" << config.getMetricsPort() << "/metrics" << endl;
+        }
+
+        for (auto& dbname: dbnames)
+        {
+            cout << "Opening coin database " << dbname << endl;
+            LOGGER(info) << "Opening coin database " << dbname << endl;
+            vaults.push_back(unique_ptr<Vault>(new Vault(config.getDatabaseUser(), config.getDatabasePassword(), dbname)));
+            subscribeHandlers(*vaults.back());
+            multiVaultSync.registerVault(vaults.back().get());
+        }
+
+        cout << "Loading block tree " << blocktreefile << "..." << endl;
+        LOGGER(info) << "Loading block tree " << blocktreefile << endl;
+        multiVaultSync.setHeaderSnapshotFile(config.getHeaderSnapshotFile());
+        multiVaultSync.loadHeaders(blocktreefile, false, [&](const CoinQBlockTreeMem& blockTree) {
+            cout << "  " << blockTree.getBestHash().getHex() << " height: " << blockTree.getBestHeight() << endl;
+            return !g_bShutdown;
+        });
+
+        if (g_bShutdown)
+        {
+            LOGGER(info) << "Interrupted." << endl;
+            cout << "Interrupted." << endl;
+        }
+        else
+        {
+            cout << "Done." << endl << endl;
+
+            stringstream ss;
+            ss << endl << "Network Settings" << endl
+               << "-------------------------------------------" << endl
+               << "  network:          " << coinParams.network_name() << endl
+               << "  host:             " << host << endl
+               << "  port:             " << port << endl
+               << "  vaults:           " << stdutils::delimited_list(dbnames, ", ") << endl
+               << "  magic bytes:      " << hex << coinParams.magic_bytes() << endl
+               << "  protocol version: " << dec << coinParams.protocol_version() << endl;
+
+            LOGGER(info) << ss.str() << endl;
+            cout << ss.str() << endl;
+
+            cout << "Connecting to " << host << ":" << port << endl;
+            LOGGER(info) << "Connecting to " << host << ":" << port << endl;
+            multiVaultSync.startSync(host, port);
+
+            while (!g_bShutdown) { std::this_thread::sleep_for(std::chrono::microseconds(200)); }
+        }
+    }
+    catch (const std::exception& e)
+    {
+        LOGGER(error) << "Error: " << e.what() << endl;
+        cerr << "Error: " << e.what() << endl;
+        multiVaultSync.stopSync();
+        for (auto& vault: vaults) { multiVaultSync.unregisterVault(vault.get()); }
+        return 1;
+    }
+
+    multiVaultSync.stopSync();
+
+    // Vaults must be unregistered before they are closed.
+    for (auto& vault: vaults) { multiVaultSync.unregisterVault(vault.get()); }
+    return 0;
+}
+
 int main(int argc, char* argv[])
 {
     SyncDBConfig config;
@@ -144,10 +316,12 @@ int main(int argc, char* argv[])
             return 0;
         }
 
-        if (argc < 4)
+        if (argc < (!config.getWriteHeaderSnapshotFile().empty() ? 2 : config.getReplayFile().empty() ? 4 : 3))
         {
             cerr << "SyncDB by Eric Lombrozo " << VERSION_INFO << endl
-                 << "# Usage: " << argv[0] << " <network> <dbname> <host> [port]" << endl
+                 << "# Usage: " << argv[0] << " <network> <dbname>[,<dbname>...] <host> [port]" << endl
+                 << "#        " << argv[0] << " <network> <dbname> --replay=<file> [--realtime]" << endl
+                 << "#        " << argv[0] << " <network> --writeheadersnapshot=<file>" << endl
                  << "# Supported networks: " << stdutils::delimited_list(networkSelector.getNetworkNames(), ", ") << endl
                  << "# Use " << argv[0] << " --help for more options." << endl;
             return -1;
@@ -163,9 +337,53 @@ int main(int argc, char* argv[])
 
     const CoinParams& coinParams = networkSelector.getCoinParams();
 
+    if (!config.getWriteHeaderSnapshotFile().empty())
+    {
+        string blocktreefile = config.getDataDir() + "/" + coinParams.network_name() + "_headers.dat";
+        try
+        {
+            // The snapshot starts at the highest checkpoint we have, so it can be verified on load.
+            CoinQBlockTreeMem blockTree;
+            blockTree.setCheckpoints(coinParams.checkpoints());
+            cout << "Loading block tree " << blocktreefile << "..." << endl;
+            blockTree.loadFromFile(blocktreefile, false);
+
+            int baseHeight = -1;
+            for (auto& checkpoint: coinParams.checkpoints())
+            {
+                if (checkpoint.height >= blockTree.getBaseHeight() && checkpoint.height <= blockTree.getBestHeight()) { baseHeight = checkpoint.height; }
+            }
+            if (baseHeight < 0) throw runtime_error("Block tree does not reach a checkpoint.");
+
+            blockTree.writeSnapshot(config.getWriteHeaderSnapshotFile(), baseHeight);
+            cout << "Wrote header snapshot " << config.getWriteHeaderSnapshotFile() << " from height " << baseHeight << " to " << blockTree.getBestHeight() << "." << endl;
+            return 0;
+        }
+        catch (const exception& e)
+        {
+            cerr << "Error: " << e.what() << endl;
+            return 1;
+        }
+    }
+
     string dbname = argv[2];
-    string host = argv[3];
+    string host = argc > 3 ? argv[3] : "";
     string port = argc > 4 ? argv[4] : coinParams.default_port();
+    bool replay = !config.getReplayFile().empty();
+
+    // A comma-separated list of databases syncs them all over one connection.
+    vector<string> dbnames;
+    {
+        stringstream ss(dbname);
+        string item;
+        while (getline(ss, item, ',')) { if (!item.empty()) dbnames.push_back(item); }
+    }
+
+    if (dbnames.size() > 1 && (replay || !config.getCaptureFile().empty()))
+    {
+        cerr << "Error: --capture and --replay need a single database." << endl;
+        return -1;
+    }
 
     string logfile = config.getDataDir() + "/syncdb.log";    
     INIT_LOGGER(logfile.c_str());
@@ -175,11 +393,59 @@ int main(int argc, char* argv[])
     signal(SIGINT, &finish);
     signal(SIGTERM, &finish);
 
+    if (dbnames.size() > 1) return runMultiVaultSync(config, coinParams, dbnames, host, port, blocktreefile);
+
     LOGGER(trace) << "foo" << endl;
     SynchedVault synchedVault(coinParams);
     LOGGER(trace) << "bar" << endl;
     subscribeHandlers(synchedVault);
 
+    // Throughput counters for replays
+    std::atomic<uint64_t> txsInserted(0);
+    std::atomic<uint64_t> merkleBlocksInserted(0);
+    synchedVault.subscribeTxInserted([&](std::shared_ptr<Tx> /*tx*/) { txsInserted++; });
+    synchedVault.subscribeMerkleBlockInserted([&](std::shared_ptr<MerkleBlock> /*merkleblock*/) { merkleBlocksInserted++; });
+    std::chrono::steady_clock::time_point replayStart;
+
+    // A diverging replay means the sync state machine no longer behaves as it did when the capture was taken.
+    std::atomic<bool> replayDiverged(false);
+    synchedVault.subscribeProtocolError([&](const string& error, int /*code*/) {
+        if (error.compare(0, 15, "Replay diverged") == 0) { replayDiverged = true; }
+    });
+
+    // Rendered on the metrics server thread. Only counters and heights are read, never the vault itself.
+    CoinQ::MetricsServer metricsServer([&]() {
+        CoinQ::MetricsWriter writer;
+        writeSynchedVaultMetrics(writer, synchedVault);
+        writeVaultMetrics(writer);
+        writeProcessMetrics(writer);
+        return writer.str();
+    });
+
+    if (config.getMetricsPort())
+    {
+        try
+        {
+            Vault::enableProfiling();
+            metricsServer.start(config.getMetricsPort());
+            cout << "Serving metrics at http://127.0.0.1:" << config.getMetricsPort() << "/metrics" << endl;
+            LOGGER(info) << "Serving metrics at http://127.0.0.1:" << config.getMetricsPort() << "/metrics" << endl;
+        }
+        catch (const std::exception& e)
+        {
+            LOGGER(error) << "Error: " << e.what() << endl;
+            cerr << "Error: " << e.what() << endl;
+            return 1;
+        }
+    }
+
+    if (!config.getCaptureFile().empty())
+    {
+        cout << "Recording peer messages to " << config.getCaptureFile() << endl;
+        LOGGER(info) << "Recording peer messages to " << config.getCaptureFile() << endl;
+        synchedVault.setCaptureFile(config.getCaptureFile());
+    }
+
     try
     {
         cout << "Opening coin database " << dbname << endl;
@@ -188,6 +454,7 @@ int main(int argc, char* argv[])
 
         cout << "Loading block tree " << blocktreefile << "..." << endl;
         LOGGER(info) << "Loading block tree " << blocktreefile << endl;
+        synchedVault.setHeaderSnapshotFile(config.getHeaderSnapshotFile());
         synchedVault.loadHeaders(blocktreefile, false, [&](const CoinQBlockTreeMem& blockTree) {
             cout << "  " << blockTree.getBestHash().getHex() << " height: " << blockTree.getBestHeight() << endl;
             return !g_bShutdown;
@@ -202,6 +469,30 @@ int main(int argc, char* argv[])
 
         cout << "Done." << endl << endl;
 
+        if (replay)
+        {
+            cout << "Replaying " << config.getReplayFile() << (config.getReplayRealtime() ? " in real time" : "") << endl;
+            LOGGER(info) << "Replaying " << config.getReplayFile() << (config.getReplayRealtime() ? " in real time" : "") << endl;
+            replayStart = std::chrono::steady_clock::now();
+            synchedVault.startReplay(config.getReplayFile(), config.getReplayRealtime());
+            while (!g_bShutdown) { std::this_thread::sleep_for(std::chrono::microseconds(200)); }
+            synchedVault.stopSync();
+
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - replayStart).count();
+            stringstream ss;
+            ss << endl << "Replay Results" << endl
+               << "-------------------------------------------" << endl
+               << "  elapsed:          " << seconds << " s" << endl
+               << "  best height:      " << synchedVault.getBestHeight() << endl
+               << "  sync height:      " << synchedVault.getSyncHeight() << endl
+               << "  merkle blocks:    " << merkleBlocksInserted << " (" << (seconds > 0 ? merkleBlocksInserted / seconds : 0) << "/s)" << endl
+               << "  transactions:     " << txsInserted << " (" << (seconds > 0 ? txsInserted / seconds : 0) << "/s)" << endl;
+
+            LOGGER(info) << ss.str() << endl;
+            cout << ss.str() << endl;
+            return replayDiverged ? 3 : 0;
+        }
+
         stringstream ss;
         ss << endl << "Network Settings" << endl
            << "-------------------------------------------" << endl
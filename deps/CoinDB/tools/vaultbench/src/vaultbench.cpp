@@ -0,0 +1,559 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// vaultbench.cpp
+//
+// Copyright (c) 2011-2016 Ciphrex Corp.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+//
+// Generates large synthetic vaults and times common vault operations on them,
+// so vault performance can be measured offline.
+//
+
+#include <CoinDBConfig.h>
+
+#include <Vault.h>
+
+#include <CoinCore/hash.h>
+#include <CoinCore/MerkleTree.h>
+
+#include <logger/logger.h>
+
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+
+#include <cli.hpp> // Needs <iomanip>.
+
+const std::string VAULTBENCH_VERSION = "v0.1.0";
+const std::string DEFAULT_NETWORK = "bitcoin";
+
+const uint32_t BLOCK_VERSION = 4;
+const uint32_t BLOCK_BITS = 0x207fffff;
+const uint32_t BLOCK_INTERVAL = 600;
+
+const uint64_t MIN_TXOUT_VALUE = 100000;
+const uint64_t MAX_TXOUT_VALUE = 100000000;
+const uint64_t TX_FEE = 10000;
+
+using namespace std;
+using namespace CoinDB;
+
+std::string g_dbuser;
+std::string g_dbpasswd;
+
+typedef std::mt19937 rng_t;
+
+// Uniform on [min, max].
+uint64_t randomRange(rng_t& rng, uint64_t min, uint64_t max)
+{
+    return std::uniform_int_distribution<uint64_t>(min, max)(rng);
+}
+
+bytes_t randomBytes(rng_t& rng, size_t size)
+{
+    bytes_t bytes(size);
+    for (auto& byte: bytes) { byte = randomRange(rng, 0, 255); }
+    return bytes;
+}
+
+////////////////////
+// SYNTHETIC DATA //
+////////////////////
+
+// Keeps what is needed to build the same merkle block again after a reorg has deleted it.
+struct SyntheticBlock
+{
+    Coin::MerkleBlock merkleblock;
+    uint32_t height;
+};
+
+// Every transaction in the block is matched, as if the filter matched nothing else.
+SyntheticBlock newSyntheticBlock(const bytes_t& prevhash, uint32_t prevheight, uint32_t timestamp, const std::vector<bytes_t>& txhashes, rng_t& rng)
+{
+    std::vector<Coin::MerkleLeaf> leaves;
+    for (auto& txhash: txhashes) { leaves.push_back(Coin::MerkleLeaf(uchar_vector(txhash).getReverse(), true)); }
+    if (leaves.empty()) { leaves.push_back(Coin::MerkleLeaf(randomBytes(rng, 32), false)); } // Coinbase
+
+    Coin::PartialMerkleTree tree;
+    tree.setUncompressed(leaves);
+
+    SyntheticBlock block;
+    block.merkleblock = Coin::MerkleBlock(tree, BLOCK_VERSION, prevhash, timestamp, BLOCK_BITS, randomRange(rng, 0, 0xffffffff));
+    block.height = prevheight + 1;
+    return block;
+}
+
+std::shared_ptr<MerkleBlock> toMerkleBlock(const SyntheticBlock& block)
+{
+    std::shared_ptr<MerkleBlock> merkleblock(new MerkleBlock());
+    merkleblock->fromCoinCore(block.merkleblock, block.height);
+    return merkleblock;
+}
+
+struct Utxo
+{
+    unsigned long id;
+    uint64_t value;
+};
+
+typedef std::map<std::string, std::vector<Utxo>> utxo_pool_t;
+
+void addUtxos(utxo_pool_t& pool, std::shared_ptr<Tx> tx)
+{
+    if (!tx) return;
+    for (auto& txout: tx->txouts())
+    {
+        if (txout->receiving_account()) { pool[txout->receiving_account()->name()].push_back(Utxo{txout->id(), txout->value()}); }
+    }
+}
+
+// Receives coins from outside the vault. Inputs spend made-up outpoints.
+std::shared_ptr<Tx> insertFundingTx(Vault& vault, const std::vector<std::string>& account_names, unsigned int fanin, unsigned int fanout, rng_t& rng)
+{
+    Coin::Transaction cointx;
+    for (unsigned int i = 0; i < fanin; i++)
+    {
+        uchar_vector scriptsig;
+        scriptsig.push_back(72); scriptsig += randomBytes(rng, 72);
+        scriptsig.push_back(33); scriptsig += randomBytes(rng, 33);
+        cointx.addInput(Coin::TxIn(Coin::OutPoint(randomBytes(rng, 32), randomRange(rng, 0, 3)), scriptsig, 0xffffffff));
+    }
+    for (unsigned int i = 0; i < fanout; i++)
+    {
+        const std::string& account_name = account_names[randomRange(rng, 0, account_names.size() - 1)];
+        bytes_t txoutscript = vault.issueSigningScript(account_name)->txoutscript();
+        cointx.addOutput(Coin::TxOut(randomRange(rng, MIN_TXOUT_VALUE, MAX_TXOUT_VALUE), txoutscript));
+    }
+
+    return vault.insertNewTx(cointx);
+}
+
+// Spends fanin coins of one account to fanout outputs, about half of them to other accounts in the vault.
+// Change goes back to the account. If the coins don't cover the fee and a minimum output, more coins are
+// merged in. Returns nullptr if the account does not have enough coins or the vault fails to create or sign
+// the transaction. Failures are counted and their coins go back to the pool.
+std::shared_ptr<Tx> insertSpendingTx(Vault& vault, const std::string& account_name, std::vector<std::string>& keychain_names, const std::vector<std::string>& account_names, utxo_pool_t& pool, unsigned int fanin, unsigned int fanout, rng_t& rng, unsigned long& failures)
+{
+    auto& utxos = pool[account_name];
+    if (utxos.size() < fanin) return nullptr;
+
+    std::vector<Utxo> coins;
+    uint64_t input_total = 0;
+    while (coins.size() < fanin || input_total <= TX_FEE + MIN_TXOUT_VALUE)
+    {
+        if (utxos.empty())
+        {
+            utxos.insert(utxos.end(), coins.begin(), coins.end());
+            return nullptr;
+        }
+
+        std::size_t j = randomRange(rng, 0, utxos.size() - 1);
+        coins.push_back(utxos[j]);
+        input_total += utxos[j].value;
+        utxos[j] = utxos.back();
+        utxos.pop_back();
+    }
+
+    ids_t coin_ids;
+    for (auto& coin: coins) { coin_ids.push_back(coin.id); }
+
+    uint64_t value = (input_total - TX_FEE) / (fanout + 1);
+    if (value < MIN_TXOUT_VALUE / 10) { value = input_total - TX_FEE; fanout = 1; }
+
+    txouts_t txouts;
+    for (unsigned int i = 0; i < fanout; i++)
+    {
+        bytes_t txoutscript;
+        if (randomRange(rng, 0, 1))
+        {
+            const std::string& payee = account_names[randomRange(rng, 0, account_names.size() - 1)];
+            txoutscript = vault.issueSigningScript(payee)->txoutscript();
+        }
+        else
+        {
+            txoutscript = uchar_vector("76a914") + randomBytes(rng, 20) + uchar_vector("88ac");
+        }
+        txouts.push_back(std::shared_ptr<TxOut>(new TxOut(value, txoutscript)));
+    }
+
+    std::shared_ptr<Tx> tx;
+    try
+    {
+        tx = vault.createTx(account_name, 1, 0, coin_ids, txouts, TX_FEE, 0, true);
+        return vault.signTx(tx->unsigned_hash(), keychain_names, true);
+    }
+    catch (const std::exception& e)
+    {
+        LOGGER(error) << "insertSpendingTx - " << e.what() << std::endl;
+        if (tx)
+        {
+            try { vault.deleteTx(tx->unsigned_hash()); }
+            catch (const std::exception& e) { LOGGER(error) << "insertSpendingTx - " << e.what() << std::endl; }
+        }
+        utxos.insert(utxos.end(), coins.begin(), coins.end());
+        failures++;
+        return nullptr;
+    }
+}
+
+// m-of-n
+bool parseMofN(const std::string& s, unsigned int& m, unsigned int& n)
+{
+    std::size_t pos = s.find("-of-");
+    if (pos == std::string::npos) return false;
+    m = strtoul(s.substr(0, pos).c_str(), NULL, 0);
+    n = strtoul(s.substr(pos + 4).c_str(), NULL, 0);
+    return m > 0 && m <= n;
+}
+
+std::vector<std::string> getAccountNames(Vault& vault)
+{
+    std::vector<std::string> account_names;
+    for (auto& info: vault.getAllAccountInfo()) { account_names.push_back(info.name()); }
+    if (account_names.empty()) throw std::runtime_error("Vault has no accounts.");
+    return account_names;
+}
+
+void unlockAllKeychains(Vault& vault, std::map<std::string, std::vector<std::string>>& account_keychains)
+{
+    for (auto& info: vault.getAllAccountInfo())
+    {
+        account_keychains[info.name()] = info.keychain_names();
+        for (auto& keychain_name: info.keychain_names()) { vault.unlockKeychain(keychain_name); }
+    }
+}
+
+//////////////////
+// MEASUREMENTS //
+//////////////////
+
+class Timings
+{
+public:
+    template<typename Fn>
+    void time(const std::string& operation, Fn fn)
+    {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        add(operation, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    void add(const std::string& operation, double ms)
+    {
+        if (!samples_.count(operation)) { operations_.push_back(operation); }
+        samples_[operation].push_back(ms);
+    }
+
+    std::string report() const
+    {
+        std::stringstream ss;
+        ss << std::left << std::setw(24) << "operation" << std::right
+           << std::setw(8) << "count" << std::setw(12) << "mean ms" << std::setw(12) << "p50 ms"
+           << std::setw(12) << "p90 ms" << std::setw(12) << "p99 ms" << std::setw(12) << "max ms";
+
+        for (auto& operation: operations_)
+        {
+            std::vector<double> samples = samples_.at(operation);
+            std::sort(samples.begin(), samples.end());
+            double total = 0;
+            for (auto sample: samples) { total += sample; }
+
+            ss << std::endl << std::left << std::setw(24) << operation << std::right
+               << std::setw(8) << samples.size() << std::fixed << std::setprecision(3)
+               << std::setw(12) << total / samples.size()
+               << std::setw(12) << percentile(samples, 50)
+               << std::setw(12) << percentile(samples, 90)
+               << std::setw(12) << percentile(samples, 99)
+               << std::setw(12) << samples.back();
+        }
+        return ss.str();
+    }
+
+private:
+    std::vector<std::string> operations_;
+    std::map<std::string, std::vector<double>> samples_;
+
+    // Nearest rank on sorted samples.
+    static double percentile(const std::vector<double>& samples, unsigned int p)
+    {
+        std::size_t rank = (samples.size() * p + 99) / 100;
+        return samples[rank ? rank - 1 : 0];
+    }
+};
+
+//////////////
+// COMMANDS //
+//////////////
+
+cli::result_t cmd_generate(const cli::params_t& params)
+{
+    unsigned int keychain_count = params.size() > 1 ? strtoul(params[1].c_str(), NULL, 0) : 3;
+    unsigned int account_count  = params.size() > 2 ? strtoul(params[2].c_str(), NULL, 0) : 10;
+    unsigned int minsigs = 2, keychains_per_account = 3;
+    if (params.size() > 3 && !parseMofN(params[3], minsigs, keychains_per_account)) throw std::runtime_error("Invalid m-of-n.");
+    unsigned int block_count    = params.size() > 4 ? strtoul(params[4].c_str(), NULL, 0) : 1000;
+    unsigned int txs_per_block  = params.size() > 5 ? strtoul(params[5].c_str(), NULL, 0) : 10;
+    double spend_ratio          = params.size() > 6 ? strtod(params[6].c_str(), NULL) : 0.3;
+    unsigned int max_fanin      = params.size() > 7 ? strtoul(params[7].c_str(), NULL, 0) : 4;
+    unsigned int max_fanout     = params.size() > 8 ? strtoul(params[8].c_str(), NULL, 0) : 4;
+    unsigned int seed           = params.size() > 9 ? strtoul(params[9].c_str(), NULL, 0) : 1;
+
+    if (keychains_per_account > keychain_count) throw std::runtime_error("Accounts cannot use more keychains than the vault has.");
+    if (account_count == 0 || max_fanin == 0 || max_fanout == 0) throw std::runtime_error("Account count and fan-in/out must be positive.");
+
+    rng_t rng(seed);
+    Vault vault(g_dbuser, g_dbpasswd, params[0], true, SCHEMA_VERSION, DEFAULT_NETWORK);
+
+    // Keychains
+    std::vector<std::string> keychain_names;
+    for (unsigned int i = 0; i < keychain_count; i++)
+    {
+        std::stringstream name;
+        name << "keychain" << i;
+        bytes_t entropy = sha256(uchar_vector(randomBytes(rng, 32)));
+        vault.newKeychain(name.str(), secure_bytes_t(entropy.begin(), entropy.end()));
+        vault.unlockKeychain(name.str());
+        keychain_names.push_back(name.str());
+    }
+
+    // Accounts use consecutive keychains, wrapping around.
+    uint32_t now = time(NULL);
+    std::vector<std::string> account_names;
+    std::map<std::string, std::vector<std::string>> account_keychains;
+    for (unsigned int i = 0; i < account_count; i++)
+    {
+        std::stringstream name;
+        name << "account" << i;
+        std::vector<std::string> names;
+        for (unsigned int j = 0; j < keychains_per_account; j++) { names.push_back(keychain_names[(i + j) % keychain_count]); }
+        vault.newAccount(name.str(), minsigs, names, DEFAULT_UNUSED_POOL_SIZE, now);
+        account_names.push_back(name.str());
+        account_keychains[name.str()] = names;
+    }
+
+    // The horizon block has to be old enough for the accounts.
+    uint32_t timestamp = now - Vault::MAX_HORIZON_TIMESTAMP_OFFSET - (block_count + 1) * BLOCK_INTERVAL;
+    SyntheticBlock block = newSyntheticBlock(randomBytes(rng, 32), 0, timestamp, std::vector<bytes_t>(), rng);
+    if (!vault.insertMerkleBlock(toMerkleBlock(block))) throw std::runtime_error("Horizon block was not inserted.");
+
+    utxo_pool_t pool;
+    unsigned long txcount = 0;
+    unsigned long failures = 0;
+    for (unsigned int b = 0; b < block_count; b++)
+    {
+        std::vector<bytes_t> txhashes;
+        for (unsigned int t = 0; t < txs_per_block; t++)
+        {
+            unsigned int fanin = randomRange(rng, 1, max_fanin);
+            unsigned int fanout = randomRange(rng, 1, max_fanout);
+
+            std::shared_ptr<Tx> tx;
+            if (std::uniform_real_distribution<double>(0, 1)(rng) < spend_ratio)
+            {
+                const std::string& account_name = account_names[randomRange(rng, 0, account_names.size() - 1)];
+                tx = insertSpendingTx(vault, account_name, account_keychains[account_name], account_names, pool, fanin, fanout, rng, failures);
+            }
+            if (!tx) { tx = insertFundingTx(vault, account_names, fanin, fanout, rng); }
+            if (!tx) continue;
+
+            addUtxos(pool, tx);
+            txhashes.push_back(tx->hash());
+            txcount++;
+        }
+
+        timestamp += BLOCK_INTERVAL;
+        block = newSyntheticBlock(block.merkleblock.blockHeader.hash(), block.height, timestamp, txhashes, rng);
+        if (!vault.insertMerkleBlock(toMerkleBlock(block))) throw std::runtime_error("Block was not inserted.");
+
+        if ((b + 1) % 100 == 0) { cout << "Inserted " << (b + 1) << " blocks, " << txcount << " transactions." << endl; }
+    }
+
+    std::size_t utxocount = 0;
+    for (auto& utxos: pool) { utxocount += utxos.second.size(); }
+
+    stringstream ss;
+    ss << "Generated vault " << params[0] << " with " << keychain_count << " keychains, " << account_count << " " << minsigs << "-of-" << keychains_per_account << " accounts, "
+       << (block_count + 1) << " blocks, " << txcount << " transactions and " << utxocount << " unspent outputs.";
+    if (failures) { ss << " " << failures << " spends failed and were replaced by funding transactions."; }
+    return ss.str();
+}
+
+cli::result_t cmd_run(const cli::params_t& params)
+{
+    unsigned int samples     = params.size() > 1 ? strtoul(params[1].c_str(), NULL, 0) : 100;
+    unsigned int reorg_depth = params.size() > 2 ? strtoul(params[2].c_str(), NULL, 0) : 3;
+    unsigned int seed        = params.size() > 3 ? strtoul(params[3].c_str(), NULL, 0) : 1;
+    if (samples == 0) throw std::runtime_error("Sample count must be positive.");
+    if (reorg_depth == 0 || reorg_depth >= samples) throw std::runtime_error("Reorg depth must be at least 1 and less than the sample count.");
+
+    rng_t rng(seed);
+    Timings timings;
+
+    Vault vault(g_dbuser, g_dbpasswd, params[0], false);
+    std::vector<std::string> account_names = getAccountNames(vault);
+    std::map<std::string, std::vector<std::string>> account_keychains;
+    unlockAllKeychains(vault, account_keychains);
+
+    auto randomAccount = [&]() -> const std::string& { return account_names[randomRange(rng, 0, account_names.size() - 1)]; };
+
+    // New transactions, each confirmed in its own block.
+    std::shared_ptr<BlockHeader> best = vault.getBestBlockHeader();
+    if (!best) throw std::runtime_error("Vault has no blocks.");
+    bytes_t prevhash = best->hash();
+    uint32_t prevheight = best->height();
+    uint32_t timestamp = best->timestamp();
+
+    std::vector<SyntheticBlock> blocks;
+    for (unsigned int i = 0; i < samples; i++)
+    {
+        std::shared_ptr<Tx> tx;
+        timings.time("insertTx", [&]() { tx = insertFundingTx(vault, account_names, randomRange(rng, 1, 2), randomRange(rng, 1, 2), rng); });
+        if (!tx) throw std::runtime_error("Transaction was not inserted.");
+
+        timestamp += BLOCK_INTERVAL;
+        SyntheticBlock block = newSyntheticBlock(prevhash, prevheight, timestamp, std::vector<bytes_t>(1, tx->hash()), rng);
+        timings.time("insertMerkleBlock", [&]() { if (!vault.insertMerkleBlock(toMerkleBlock(block))) throw std::runtime_error("Block was not inserted."); });
+
+        prevhash = block.merkleblock.blockHeader.hash();
+        prevheight = block.height;
+        blocks.push_back(block);
+    }
+
+    // Replace the last reorg_depth blocks with a longer empty branch, then switch back.
+    const SyntheticBlock& fork = blocks[blocks.size() - reorg_depth - 1];
+    for (unsigned int i = 0; i < std::max(1u, samples / 10); i++)
+    {
+        SyntheticBlock alt = newSyntheticBlock(fork.merkleblock.blockHeader.hash(), fork.height, fork.merkleblock.blockHeader.timestamp() + 1, std::vector<bytes_t>(), rng);
+        timings.time("reorg", [&]() { vault.insertMerkleBlock(toMerkleBlock(alt)); });
+        for (unsigned int j = 0; j < reorg_depth; j++)
+        {
+            alt = newSyntheticBlock(alt.merkleblock.blockHeader.hash(), alt.height, alt.merkleblock.blockHeader.timestamp() + BLOCK_INTERVAL, std::vector<bytes_t>(), rng);
+            vault.insertMerkleBlock(toMerkleBlock(alt));
+        }
+
+        auto it = blocks.end() - reorg_depth;
+        timings.time("reorg", [&]() { vault.insertMerkleBlock(toMerkleBlock(*it)); });
+        for (++it; it != blocks.end(); ++it) { vault.insertMerkleBlock(toMerkleBlock(*it)); }
+    }
+
+    // Reads
+    for (unsigned int i = 0; i < samples; i++)
+    {
+        const std::string& account_name = randomAccount();
+        timings.time("getAccountBalance", [&]() { vault.getAccountBalance(account_name, 0); });
+    }
+
+    unsigned long txcount = vault.getTxViews(Tx::ALL, 0, -1).size();
+    for (unsigned int i = 0; i < samples; i++)
+    {
+        unsigned long start = txcount > 100 ? randomRange(rng, 0, txcount - 100) : 0;
+        timings.time("getTxViews(100)", [&]() { vault.getTxViews(Tx::ALL, start, 100); });
+    }
+
+    for (unsigned int i = 0; i < samples; i++)
+    {
+        timings.time("getBloomFilter", [&]() { vault.getBloomFilter(0.001, 0, 0); });
+    }
+
+    // Transaction creation and signing. Nothing is left behind.
+    for (unsigned int i = 0; i < samples; i++)
+    {
+        const std::string& account_name = randomAccount();
+        txouts_t txouts;
+        txouts.push_back(std::shared_ptr<TxOut>(new TxOut(MIN_TXOUT_VALUE, uchar_vector("76a914") + randomBytes(rng, 20) + uchar_vector("88ac"))));
+
+        std::shared_ptr<Tx> tx;
+        try
+        {
+            timings.time("createTx", [&]() { tx = vault.createTx(account_name, 1, 0, txouts, TX_FEE, 1, true); });
+        }
+        catch (const AccountInsufficientFundsException&)
+        {
+            continue;
+        }
+
+        timings.time("signTx", [&]() { vault.signTx(tx->unsigned_hash(), account_keychains[account_name], false); });
+        vault.deleteTx(tx->unsigned_hash());
+    }
+
+    // Export and import. Each account can only be imported once, so imports go to a new scratch vault.
+    std::string filepath = params[0] + ".bench.acct";
+    for (unsigned int i = 0; i < samples; i++)
+    {
+        const std::string& account_name = account_names[i % account_names.size()];
+        timings.time("exportAccount", [&]() { vault.exportAccount(account_name, filepath, false); });
+    }
+
+    std::string scratch_dbname = params[0] + "-import";
+    {
+        Vault scratch(g_dbuser, g_dbpasswd, scratch_dbname, true, SCHEMA_VERSION, DEFAULT_NETWORK);
+        for (unsigned int i = 0; i < std::min<std::size_t>(samples, account_names.size()); i++)
+        {
+            vault.exportAccount(account_names[i], filepath, false);
+            unsigned int privkeysimported = 0;
+            timings.time("importAccount", [&]() { scratch.importAccount(filepath, privkeysimported); });
+        }
+    }
+    boost::filesystem::remove(filepath);
+
+    stringstream ss;
+    ss << timings.report() << endl << endl
+       << "Added " << samples << " transactions and blocks to " << params[0] << ". Imported accounts are in " << scratch_dbname << ".";
+    return ss.str();
+}
+
+int main(int argc, char* argv[])
+{
+    stringstream helpMessage;
+    helpMessage << "Vault benchmark " << VAULTBENCH_VERSION << " - Schema " << SCHEMA_VERSION << " - " << DBMS;
+
+    using namespace cli;
+    Shell shell(helpMessage.str());
+
+    shell.add(command(
+        &cmd_generate,
+        "generate",
+        "create a synthetic vault. fan-in and fan-out are uniform between 1 and the maximum",
+        command::params(1, "db file"),
+        command::params(9, "keychains = 3", "accounts = 10", "m-of-n = 2-of-3", "blocks = 1000", "txs per block = 10", "spend ratio = 0.3", "max fan-in = 4", "max fan-out = 4", "seed = 1")));
+    shell.add(command(
+        &cmd_run,
+        "run",
+        "time vault operations and report latency percentiles. adds transactions and blocks, so run it on a copy",
+        command::params(1, "db file"),
+        command::params(3, "samples = 100", "reorg depth = 3", "seed = 1")));
+
+    try
+    {
+        CoinDBConfig config;
+        if (!config.parseParams(argc, argv))
+        {
+            cout << config.getHelpOptions();
+            return 0;
+        }
+
+        g_dbuser = config.getDatabaseUser();
+        g_dbpasswd = config.getDatabasePassword();
+        string logfile = config.getDataDir() + "/vaultbench.log";
+
+        INIT_LOGGER(logfile.c_str());
+
+        return shell.exec(argc, argv);
+    }
+    catch (const std::exception& e)
+    {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -19,6 +19,8 @@
 
 #include <signal.h>
 
+#include <sstream>
+
 bool g_bShutdown = false;
 
 void finish(int sig)
@@ -38,26 +40,43 @@ int main(int argc, char* argv[])
 
         if (argc < 3)
         {
-            cerr << "# Usage: " << argv[0] << " <network> <host> [start hash] [start height] [port]" << endl
+            cerr << "# Usage: " << argv[0] << " <network> <host[,host...]> [start hash] [start height] [port] [block store dir]" << endl
+                 << "# Pass an empty start hash to start from the genesis block or resume from the block store." << endl
+                 << "# A block store cannot be used with a start hash." << endl
                  << "# Supported networks: " << stdutils::delimited_list(networkSelector.getNetworkNames(), ", ") << endl;
             return -1;
         }
 
         CoinParams coinParams = networkSelector.getCoinParams(argv[1]);
-        string host = argv[2];
+
+        vector<string> hosts;
+        {
+            stringstream ss(argv[2]);
+            string host;
+            while (getline(ss, host, ',')) { if (!host.empty()) hosts.push_back(host); }
+        }
 
         vector<uchar_vector> locatorHashes;
-        if (argc > 3) { locatorHashes.push_back(uchar_vector(argv[3])); }
+        if (argc > 3 && argv[3][0] != '\0') { locatorHashes.push_back(uchar_vector(argv[3])); }
 
+        // Without a start hash heights are already counted from the genesis block.
         int startHeight = (argc > 4) ? strtoll(argv[4], NULL, 0) : 0;
+        int heightBase = locatorHashes.empty() ? 0 : startHeight + 1;
 
         string port = (argc > 5) ? argv[5] : coinParams.default_port();
 
+        BlockStore blockStore;
         Network::BlockchainDownload download(coinParams);
+        if (argc > 6)
+        {
+            if (!locatorHashes.empty()) throw runtime_error("A block store cannot be used with a start hash.");
+            blockStore.open(argv[6], coinParams.magic_bytes());
+            download.setBlockStore(&blockStore);
+        }
 
         cout << endl << "Connecting to " << coinParams.network_name() << " peer" << endl
              << "-------------------------------------------" << endl
-             << "  host:             " << host << endl
+             << "  hosts:            " << stdutils::delimited_list(hosts, ", ") << endl
              << "  port:             " << port << endl
              << "  magic bytes:      " << hex << coinParams.magic_bytes() << endl
              << "  protocol version: " << dec << coinParams.protocol_version() << endl
@@ -65,20 +84,22 @@ int main(int argc, char* argv[])
 
         download.subscribeStarted([&]()         { cout << "Blockchain download started." << endl; });
         download.subscribeStopped([&]()         { cout << "Blockchain download stopped." << endl; });
-        download.subscribeOpen([&]()            { cout << "Peer connection opened." << endl; });
-        download.subscribeClose([&]()           { cout << "Peer connection closed." << endl; });
+        download.subscribeOpen([&]()            { cout << "Peer connection opened. Connected peers: " << download.connectedPeers() << endl; });
+        download.subscribeClose([&]()           { cout << "Peer connection closed. Connected peers: " << download.connectedPeers() << endl; });
         download.subscribeTimeout([&]()         { cout << "Peer timed out." << endl; });
         download.subscribeConnectionError([&](const string& error, int /*code*/) { cout << "Connection error: " << error << endl; });
 
-        download.subscribeBlock([&](const Coin::CoinBlock& block)    { cout << "Block - hash: " << block.hash().getHex() << " height: " << download.getBestHeight() + startHeight + 1 << endl; });
+        download.subscribeBlock([&](const Coin::CoinBlock& block)    { cout << "Block - hash: " << block.hash().getHex() << " height: " << download.getBestHeight() + heightBase << endl; });
+        download.subscribeBlocksSynched([&]()   { cout << "Blocks synched. Header height: " << download.getHeaderHeight() + heightBase << endl; });
         download.subscribeProtocolError([&](const string& error, int /*code*/)   { cout << "Protocol error:" << error << endl; });
+        download.subscribeBlockTreeError([&](const string& error, int /*code*/)  { cout << "Block tree error: " << error << endl; });
 
         INIT_LOGGER("blockchain.log");
     
         signal(SIGINT, &finish);
         signal(SIGTERM, &finish);
 
-        download.start(host, port, locatorHashes);
+        download.start(hosts, port, locatorHashes);
 
         while (!g_bShutdown) { usleep(200); }
         download.stop();
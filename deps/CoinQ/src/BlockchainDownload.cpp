@@ -13,200 +13,699 @@
 
 #include <logger/logger.h>
 
-#include <thread>
-#include <chrono>
+#include <algorithm>
+#include <sstream>
 
 using namespace CoinQ::Network;
 using namespace std;
 
+namespace
+{
+    // How often in-flight requests are checked for stalls.
+    const long STALL_CHECK_INTERVAL = 5; // seconds
+}
+
 BlockchainDownload::BlockchainDownload(const CoinQ::CoinParams& coinParams, bool bCheckProofOfWork) :
     m_coinParams(coinParams),
     m_bCheckProofOfWork(bCheckProofOfWork),
+    m_blockStore(nullptr),
+    m_windowSize(DEFAULT_WINDOW_SIZE),
+    m_maxBlocksInFlight(DEFAULT_MAX_BLOCKS_IN_FLIGHT),
+    m_stallTimeout(DEFAULT_STALL_TIMEOUT),
+    m_heightOffset(0),
+    m_headerPeer(nullptr),
+    m_bHeadersSynched(false),
+    m_bBlocksSynched(false),
+    m_bHalted(false),
+    m_nextHeight(0),
+    m_lastQueuedHeight(-1),
+    m_bestHeight(-1),
     m_bStarted(false),
     m_bIOServiceStarted(false),
     m_work(m_ioService),
-    m_bConnected(false),
-    m_peer(m_ioService)
+    m_stallTimer(m_ioService),
+    m_connectedPeers(0)
 {
     // Select hash functions
     Coin::CoinBlockHeader::setHashFunc(m_coinParams.block_header_hash_function());
-    Coin::CoinBlockHeader::setPOWHashFunc(m_coinParams.block_header_pow_hash_function());
+    Coin::CoinBlockHeader::setPOWHashFunc(m_coinParams.block_header_pow_hash_function(), m_coinParams.block_header_pow_batch_hash_function());
+}
+
+BlockchainDownload::~BlockchainDownload()
+{
+    stop();
+}
+
+void BlockchainDownload::setCoinParams(const CoinQ::CoinParams& coinParams)
+{
+    if (m_bStarted) throw runtime_error("BlockchainDownload::setCoinParams() - must be stopped to set coin parameters.");
+
+    m_coinParams = coinParams;
+    Coin::CoinBlockHeader::setHashFunc(m_coinParams.block_header_hash_function());
+    Coin::CoinBlockHeader::setPOWHashFunc(m_coinParams.block_header_pow_hash_function(), m_coinParams.block_header_pow_batch_hash_function());
+}
+
+void BlockchainDownload::setBlockStore(CoinQ::BlockStore* blockStore)
+{
+    if (m_bStarted) throw runtime_error("BlockchainDownload::setBlockStore() - must be stopped to set block store.");
+    m_blockStore = blockStore;
+}
+
+void BlockchainDownload::setWindowSize(unsigned int windowSize)
+{
+    if (windowSize == 0) throw runtime_error("BlockchainDownload::setWindowSize() - window size must be positive.");
+    boost::lock_guard<boost::mutex> lock(m_stateMutex);
+    m_windowSize = windowSize;
+}
+
+void BlockchainDownload::setMaxBlocksInFlight(unsigned int maxBlocksInFlight)
+{
+    if (maxBlocksInFlight == 0) throw runtime_error("BlockchainDownload::setMaxBlocksInFlight() - limit must be positive.");
+    boost::lock_guard<boost::mutex> lock(m_stateMutex);
+    m_maxBlocksInFlight = maxBlocksInFlight;
+}
+
+void BlockchainDownload::setStallTimeout(unsigned int seconds)
+{
+    boost::lock_guard<boost::mutex> lock(m_stateMutex);
+    m_stallTimeout = seconds;
+}
+
+int BlockchainDownload::getBestHeight() const
+{
+    boost::lock_guard<boost::mutex> lock(m_stateMutex);
+    return m_bestHeight;
+}
+
+bytes_t BlockchainDownload::getBestHash() const
+{
+    boost::lock_guard<boost::mutex> lock(m_stateMutex);
+    return m_bestHash;
+}
+
+int BlockchainDownload::getHeaderHeight() const
+{
+    boost::lock_guard<boost::mutex> lock(m_stateMutex);
+    return m_blockTree.isEmpty() ? -1 : m_blockTree.getBestHeight() + m_heightOffset;
+}
+
+void BlockchainDownload::start(const string& host, const string& port, const vector<uchar_vector>& locatorHashes, const uchar_vector& hashStop)
+{
+    start(vector<string>(1, host), port, locatorHashes, hashStop);
+}
+
+void BlockchainDownload::start(const string& host, int port, const vector<uchar_vector>& locatorHashes, const uchar_vector& hashStop)
+{
+    std::stringstream ssport;
+    ssport << port;
+    start(host, ssport.str(), locatorHashes, hashStop);
+}
+
+void BlockchainDownload::start(const vector<string>& hosts, const string& port, const vector<uchar_vector>& locatorHashes, const uchar_vector& hashStop)
+{
+    if (hosts.empty()) throw runtime_error("BlockchainDownload - no hosts given.");
+
+    // Heights from locator hashes count from the first block downloaded, which the store can't take.
+    if (m_blockStore && !locatorHashes.empty()) throw runtime_error("BlockchainDownload - locator hashes cannot be used with a block store.");
 
-    // Subscribe peer handlers
-    m_peer.subscribeOpen([&](CoinQ::Peer& /*peer*/)
     {
-        LOGGER(trace) << "BlockchainDownload - Peer connection opened." << endl;
-        m_bConnected = true;
-        notifyOpen();
-        try
+        if (m_bStarted) throw runtime_error("BlockchainDownload - already started.");
+        boost::lock_guard<boost::mutex> lock(m_startMutex);
+        if (m_bStarted) throw runtime_error("BlockchainDownload - already started.");
+
         {
-            if (m_blockTree.isEmpty())
-            {
-  //              m_blockTree.setGenesisBlock(m_coinParams.genesis_block());
-                m_peer.getBlocks(m_locatorHashes, m_hashStop);
-            }
-            else
+            boost::lock_guard<boost::mutex> stateLock(m_stateMutex);
+
+            m_locatorHashes = locatorHashes;
+            m_hashStop = hashStop;
+
+            m_peerStates.clear();
+            m_headerPeer = nullptr;
+            m_bHeadersSynched = false;
+            m_bBlocksSynched = false;
+            m_bHalted = false;
+            m_queue.clear();
+            m_inFlight.clear();
+            m_received.clear();
+            m_bestHeight = -1;
+            m_bestHash.clear();
+
+            m_blockTree.clear();
+            m_heightOffset = 0;
+            m_nextHeight = 0;
+            m_lastQueuedHeight = -1;
+            m_lastQueuedHash.clear();
+
+            // With locator hashes the tree is rooted at the first header received. Otherwise it is
+            // rooted at the best block in the store, or at the genesis block, which is then queued
+            // like any other.
+            if (m_locatorHashes.empty())
             {
-                m_peer.getBlocks(m_blockTree.getLocatorHashes(-1));
+                int storeHeight = m_blockStore ? m_blockStore->getBestHeight() : -1;
+                if (storeHeight >= 0)
+                {
+                    Coin::CoinBlock last = m_blockStore->getBlock((uint32_t)storeHeight);
+                    m_blockTree.setGenesisBlock(last.blockHeader);
+                    m_heightOffset = storeHeight;
+                    m_nextHeight = storeHeight + 1;
+                    m_lastQueuedHeight = 0;
+                    m_lastQueuedHash = last.hash();
+                    m_bestHeight = storeHeight;
+                    m_bestHash = last.hash();
+                }
+                else
+                {
+                    m_blockTree.setGenesisBlock(m_coinParams.genesis_block());
+                }
             }
         }
-        catch (const std::exception& e)
+
+        LOGGER(trace) << "BlockchainDownload::start() - " << hosts.size() << " host(s), resuming at height " << m_nextHeight << std::endl;
+
+        startIOServiceThread();
+        m_bStarted = true;
+
+        string port_ = port.empty() ? m_coinParams.default_port() : port;
+        for (auto& host: hosts)
+        {
+            std::shared_ptr<CoinQ::Peer> peer(new CoinQ::Peer(m_ioService));
+            peer->set(host, port_, m_coinParams.magic_bytes(), m_coinParams.protocol_version(), "Wallet v0.1", 0, false);
+            subscribePeer(*peer);
+            m_peers.push_back(peer);
+        }
+
+        {
+            boost::lock_guard<boost::mutex> stateLock(m_stateMutex);
+            for (auto& peer: m_peers) { m_peerStates[peer.get()]; }
+        }
+
+        for (auto& peer: m_peers)
+        {
+            LOGGER(trace) << "Starting peer " << peer->name() << "..." << endl;
+            peer->start();
+        }
+
+        startStallTimer();
+    }
+
+    notifyStarted();
+}
+
+void BlockchainDownload::stop()
+{
+    {
+        if (!m_bStarted) return;
+        boost::lock_guard<boost::mutex> lock(m_startMutex);
+        if (!m_bStarted) return;
+
+        boost::system::error_code ec;
+        m_stallTimer.cancel(ec);
+
+        for (auto& peer: m_peers) { peer->stop(); }
+        stopIOServiceThread();
+        m_peers.clear();
+
         {
-            LOGGER(error) << "BlockchainDownload - Peer::getBlocks error - " << e.what();
-            // TODO: propagate code
-            notifyBlockTreeError(e.what(), -1);
+            boost::lock_guard<boost::mutex> stateLock(m_stateMutex);
+            m_peerStates.clear();
+            m_headerPeer = nullptr;
+            m_queue.clear();
+            m_inFlight.clear();
+            m_received.clear();
         }
+        m_connectedPeers = 0;
+
+        m_bStarted = false;
+    }
+
+    notifyStopped();
+}
+
+void BlockchainDownload::subscribePeer(CoinQ::Peer& peer)
+{
+    peer.subscribeOpen([this](CoinQ::Peer& peer)
+    {
+        LOGGER(trace) << "BlockchainDownload - Peer connection opened: " << peer.name() << endl;
+        {
+            boost::lock_guard<boost::mutex> lock(m_stateMutex);
+            PeerState& state = m_peerStates[&peer];
+            if (!state.bOpen)
+            {
+                state.bOpen = true;
+                m_connectedPeers++;
+            }
+
+            if (!m_headerPeer)
+            {
+                m_headerPeer = &peer;
+                requestHeaders(peer);
+            }
+            requestBlocks();
+        }
+        notifyOpen();
     });
 
-    m_peer.subscribeClose([this](CoinQ::Peer& /*peer*/)
+    peer.subscribeClose([this](CoinQ::Peer& peer)
     {
-        if (m_bConnected) { stop(); }
+        LOGGER(trace) << "BlockchainDownload - Peer connection closed: " << peer.name() << endl;
+        {
+            boost::lock_guard<boost::mutex> lock(m_stateMutex);
+            PeerState& state = m_peerStates[&peer];
+            if (state.bOpen)
+            {
+                state.bOpen = false;
+                m_connectedPeers--;
+            }
+
+            // Hand this peer's blocks to the others.
+            std::vector<Wanted> wanted;
+            for (auto it = m_inFlight.begin(); it != m_inFlight.end();)
+            {
+                if (it->second.peer == &peer)
+                {
+                    wanted.push_back(Wanted{it->first, it->second.height, nullptr});
+                    it = m_inFlight.erase(it);
+                }
+                else
+                {
+                    ++it;
+                }
+            }
+            state.inFlight = 0;
+            requeue(wanted);
+
+            if (m_headerPeer == &peer)
+            {
+                m_headerPeer = nullptr;
+                for (auto& item: m_peerStates)
+                {
+                    if (!item.second.bOpen) continue;
+                    m_headerPeer = item.first;
+                    if (!m_bHeadersSynched) { requestHeaders(*m_headerPeer); }
+                    break;
+                }
+            }
+            requestBlocks();
+        }
         notifyClose();
     });
 
-    m_peer.subscribeTimeout([&](CoinQ::Peer& /*peer*/)
+    peer.subscribeTimeout([this](CoinQ::Peer& /*peer*/)
     {
         notifyTimeout();
     });
 
-    m_peer.subscribeConnectionError([&](CoinQ::Peer& /*peer*/, const std::string& error, int code)
+    peer.subscribeConnectionError([this](CoinQ::Peer& /*peer*/, const std::string& error, int code)
     {
         notifyConnectionError(error, code);
     });
 
-    m_peer.subscribeProtocolError([&](CoinQ::Peer& /*peer*/, const std::string& error, int code)
+    peer.subscribeProtocolError([this](CoinQ::Peer& /*peer*/, const std::string& error, int code)
     {
         notifyProtocolError(error, code);
     });
 
-    m_peer.subscribeInv([&](CoinQ::Peer& peer, const Coin::Inventory& inv)
+    peer.subscribeHeaders([this](CoinQ::Peer& peer, const Coin::HeadersMessage& headersMessage)
+    {
+        LOGGER(trace) << "BlockchainDownload - Received " << headersMessage.headers.size() << " headers from " << peer.name() << endl;
+
+        std::string error;
+        bool bSynched = false;
+        {
+            boost::lock_guard<boost::mutex> lock(m_stateMutex);
+            if (m_bHalted) return;
+
+            if (headersMessage.headers.empty())
+            {
+                if (&peer == m_headerPeer) { m_bHeadersSynched = true; }
+            }
+            else
+            {
+                try
+                {
+                    std::size_t begin = 0;
+                    if (m_blockTree.isEmpty())
+                    {
+                        m_blockTree.setGenesisBlock(headersMessage.headers[0]);
+                        begin = 1;
+                    }
+
+                    std::size_t firstInvalid = m_bCheckProofOfWork ? CoinQBlockTreeMem::getFirstInvalidProofOfWork(headersMessage.headers, begin) : headersMessage.headers.size();
+                    for (std::size_t i = begin; i < headersMessage.headers.size(); i++)
+                    {
+                        m_blockTree.insertHeader(headersMessage.headers[i], i >= firstInvalid);
+                    }
+                }
+                catch (const exception& e)
+                {
+                    error = e.what();
+                }
+
+                queueNewHeaders();
+
+                // Keep asking the same peer until it has nothing more or the stop hash is reached.
+                if (error.empty())
+                {
+                    if (m_lastQueuedHash == m_hashStop)
+                    {
+                        m_bHeadersSynched = true;
+                    }
+                    else
+                    {
+                        m_bHeadersSynched = false;
+                        requestHeaders(peer);
+                    }
+                }
+                requestBlocks();
+            }
+
+            if (m_bHeadersSynched && !m_bBlocksSynched && m_queue.empty() && m_inFlight.empty() && m_received.empty())
+            {
+                m_bBlocksSynched = true;
+                bSynched = true;
+            }
+        }
+
+        if (!error.empty())
+        {
+            LOGGER(error) << "BlockchainDownload - Block tree insertion error: " << error << endl;
+            notifyBlockTreeError(error, -1);
+        }
+        if (bSynched) { notifyBlocksSynched(); }
+    });
+
+    peer.subscribeInv([this](CoinQ::Peer& peer, const Coin::Inventory& inv)
     {
-        if (!m_bConnected) return;
         LOGGER(trace) << "Received inventory message:" << std::endl << inv.toIndentedString(2) << std::endl;
 
-        using namespace Coin;
-        GetDataMessage getData;
+        boost::lock_guard<boost::mutex> lock(m_stateMutex);
+        if (m_blockTree.isEmpty()) return;
+
+        // New blocks are fetched by header first so they go through the same queue.
         for (auto& item: inv.items)
         {
-            switch (item.itemType)
-            {
-            case MSG_BLOCK:
-                getData.items.push_back(InventoryItem(MSG_BLOCK, item.hash));
-                break;
-            default:
-                break;
-            } 
+            if (item.itemType != MSG_BLOCK) continue;
+            if (m_blockTree.hasHeader(uchar_vector(item.hash, item.hash + 32))) continue;
+
+            requestHeaders(peer);
+            break;
         }
+    });
 
-        if (!getData.items.empty())
+    peer.subscribeBlock([this](CoinQ::Peer& peer, const Coin::CoinBlock& block)
+    {
+        const uchar_vector& hash = block.hash();
+        LOGGER(trace) << "BlockchainDownload - Received block " << hash.getHex() << " from " << peer.name() << endl;
+
+        // The header hash only vouches for the transactions through the merkle root.
+        bool bValid = block.isValidMerkleRoot();
+        if (!bValid) { LOGGER(error) << "BlockchainDownload - Block " << hash.getHex() << " from " << peer.name() << " does not match its merkle root." << endl; }
+
+        std::vector<std::pair<Coin::CoinBlock, int>> ready;
+        bool bSynched = false;
         {
-            try
+            boost::lock_guard<boost::mutex> lock(m_stateMutex);
+            if (m_bHalted) return;
+
+            int height = -1;
+            auto it = m_inFlight.find(hash);
+            if (it != m_inFlight.end())
             {
-                const unsigned char* hash = getData.items[getData.items.size() - 1].hash;
-                m_lastRequestedBlockHash = bytes_t(hash, hash + 32);
-                m_peer.send(getData);
+                PeerState& state = m_peerStates[it->second.peer];
+                if (state.inFlight > 0) { state.inFlight--; }
+
+                if (bValid)
+                {
+                    height = it->second.height;
+                    m_inFlight.erase(it);
+                }
+                else
+                {
+                    // Ask another peer for it.
+                    std::vector<Wanted> wanted(1, Wanted{hash, it->second.height, &peer});
+                    m_inFlight.erase(it);
+                    requeue(wanted);
+                }
             }
-            catch (const exception& e)
+            else if (bValid && m_blockTree.hasHeader(hash))
+            {
+                // A late delivery from a peer we gave up on is still good if nobody else has sent it.
+                const ChainHeader& header = m_blockTree.getHeader(hash);
+                if (header.inBestChain)
+                {
+                    height = header.height + m_heightOffset;
+                    auto queued = std::find_if(m_queue.begin(), m_queue.end(), [&](const Wanted& wanted) { return wanted.hash == hash; });
+                    if (queued != m_queue.end()) { m_queue.erase(queued); }
+                }
+            }
+
+            if (height >= m_nextHeight && !m_received.count(height))
+            {
+                m_received.insert(std::make_pair(height, block));
+            }
+
+            ready = takeReadyBlocks();
+            requestBlocks();
+
+            if (m_bHeadersSynched && !m_bBlocksSynched && m_queue.empty() && m_inFlight.empty() && m_received.empty())
             {
-                LOGGER(error) << "BlockchainDownload - Peer::send() failed: " << e.what() << endl;
-                m_lastRequestedBlockHash.clear();
-                notifyConnectionError(e.what(), -1);
+                m_bBlocksSynched = true;
+                bSynched = true;
             }
         }
+
+        if (!bValid) { notifyProtocolError("Block does not match its merkle root.", -1); }
+        deliver(ready);
+        if (bSynched) { notifyBlocksSynched(); }
     });
+}
 
-    m_peer.subscribeBlock([&](CoinQ::Peer& /*peer*/, const Coin::CoinBlock& block)
-    {
-        m_lastReceivedBlockHash = block.hash();
-        LOGGER(trace) << "BlockchainDownload - Received block: " << m_lastReceivedBlockHash.getHex() << endl;
+void BlockchainDownload::requestHeaders(CoinQ::Peer& peer)
+{
+    if (m_bHalted) return;
 
-        try
+    try
+    {
+        if (m_blockTree.isEmpty())
         {
-            if (m_blockTree.isEmpty()) { m_blockTree.setGenesisBlock(block.blockHeader); }
-            m_blockTree.insertHeader(block.blockHeader);
+            peer.getHeaders(m_locatorHashes, m_hashStop);
         }
-        catch (const exception& e)
+        else
         {
-            LOGGER(error) << "BlockchainDownload - Failed to insert header: " << e.what() << endl;
-            notifyBlockTreeError(e.what(), -1);
+            peer.getHeaders(m_blockTree.getLocatorHashes(-1), m_hashStop);
         }
+    }
+    catch (const exception& e)
+    {
+        LOGGER(error) << "BlockchainDownload - Failed to request headers from " << peer.name() << ": " << e.what() << endl;
+    }
+}
 
-        notifyBlock(block);
+void BlockchainDownload::queueNewHeaders()
+{
+    if (m_blockTree.isEmpty()) return;
 
-        try
+    // If the best chain no longer runs through the last header queued, back up to where it forks.
+    if (m_lastQueuedHeight >= 0 && !m_blockTree.getHeader(m_lastQueuedHash).inBestChain)
+    {
+        const ChainHeader* fork = &m_blockTree.getHeader(m_lastQueuedHash);
+        while (!fork->inBestChain) { fork = &m_blockTree.getHeader(fork->prevBlockHash()); }
+
+        int forkHeight = fork->height + m_heightOffset;
+        LOGGER(debug) << "BlockchainDownload - Reorg at height " << forkHeight << "." << endl;
+
+        m_queue.erase(std::remove_if(m_queue.begin(), m_queue.end(), [&](const Wanted& wanted) { return wanted.height > forkHeight; }), m_queue.end());
+
+        for (auto it = m_inFlight.begin(); it != m_inFlight.end();)
         {
-            m_peer.getBlocks(m_blockTree.getLocatorHashes(-1));
+            if (it->second.height > forkHeight)
+            {
+                PeerState& state = m_peerStates[it->second.peer];
+                if (state.inFlight > 0) { state.inFlight--; }
+                it = m_inFlight.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
         }
-        catch (const exception& e)
+
+        m_received.erase(m_received.upper_bound(forkHeight), m_received.end());
+
+        // Blocks already delivered past the fork are delivered again from the new branch.
+        if (m_nextHeight > forkHeight + 1)
         {
-            LOGGER(error) << "BlockchainDownload - Failed to request blocks: " << e.what() << endl;
-            notifyConnectionError(e.what(), -1);
+            m_nextHeight = forkHeight + 1;
+            m_bestHeight = forkHeight;
+            m_bestHash = fork->hash();
         }
-    });
+
+        m_lastQueuedHeight = fork->height;
+        m_lastQueuedHash = fork->hash();
+    }
+
+    if (m_lastQueuedHash == m_hashStop) return;
+
+    int bestHeight = m_blockTree.getBestHeight();
+    for (int h = m_lastQueuedHeight + 1; h <= bestHeight; h++)
+    {
+        const ChainHeader& header = m_blockTree.getHeader(h);
+        m_queue.push_back(Wanted{header.hash(), h + m_heightOffset, nullptr});
+        m_lastQueuedHeight = h;
+        m_lastQueuedHash = header.hash();
+        m_bBlocksSynched = false;
+        if (m_lastQueuedHash == m_hashStop) break;
+    }
 }
 
-BlockchainDownload::~BlockchainDownload()
+void BlockchainDownload::requeue(std::vector<Wanted>& wanted)
 {
-    stop();
+    // In-flight blocks are all below the queue, so they go back at the front in height order.
+    std::sort(wanted.begin(), wanted.end(), [](const Wanted& a, const Wanted& b) { return a.height > b.height; });
+    for (auto& item: wanted) { m_queue.push_front(item); }
 }
 
-void BlockchainDownload::start(const string& host, const string& port, const vector<uchar_vector>& locatorHashes, const uchar_vector& hashStop)
+void BlockchainDownload::requestBlocks()
 {
+    if (m_bHalted) return;
+
+    std::map<CoinQ::Peer*, Coin::GetDataMessage> requests;
+    clock_t::time_point now = clock_t::now();
+
+    while (!m_queue.empty() && m_queue.front().height < m_nextHeight + (int)m_windowSize)
     {
-        if (m_bStarted) throw runtime_error("BlockchainDownload - already started.");
-        boost::lock_guard<boost::mutex> lock(m_startMutex);
-        if (m_bStarted) throw runtime_error("BlockchainDownload - already started.");
-    
-        LOGGER(trace) << "BlockchainDownload::start(" << host << ", " << port << ")" << std::endl;
+        const Wanted& wanted = m_queue.front();
 
-        startIOServiceThread();
-        m_bStarted = true;
+        // Pick the least busy peer, passing over one that already stalled on this block if possible.
+        CoinQ::Peer* best = nullptr;
+        unsigned int bestInFlight = 0;
+        for (auto& item: m_peerStates)
+        {
+            const PeerState& state = item.second;
+            if (!state.bOpen || state.inFlight >= m_maxBlocksInFlight) continue;
 
-        string port_ = port.empty() ? m_coinParams.default_port() : port;
-        m_peer.set(host, port_, m_coinParams.magic_bytes(), m_coinParams.protocol_version(), "Wallet v0.1", 0, false);
+            bool bBetter = !best ||
+                (best == wanted.stalledPeer && item.first != wanted.stalledPeer) ||
+                ((item.first == wanted.stalledPeer) == (best == wanted.stalledPeer) && state.inFlight < bestInFlight);
+            if (bBetter)
+            {
+                best = item.first;
+                bestInFlight = state.inFlight;
+            }
+        }
+        if (!best) break;
+
+        requests[best].items.push_back(Coin::InventoryItem(MSG_BLOCK | best->inv_flags(), wanted.hash));
+        m_inFlight[wanted.hash] = InFlight{best, wanted.height, now};
+        m_peerStates[best].inFlight++;
+        m_queue.pop_front();
+    }
 
-        if (locatorHashes.empty())
+    for (auto& request: requests)
+    {
+        try
         {
-            m_locatorHashes.clear();
-            m_locatorHashes.push_back(uchar_vector(32, 0));
+            request.first->send(request.second);
         }
-        else
+        catch (const exception& e)
         {
-            m_locatorHashes = locatorHashes;
+            // The close handler hands the blocks to other peers.
+            LOGGER(error) << "BlockchainDownload - Failed to request blocks from " << request.first->name() << ": " << e.what() << endl;
         }
+    }
+}
 
-        m_hashStop = hashStop;
+void BlockchainDownload::checkStalls()
+{
+    if (m_stallTimeout == 0) return;
 
-        LOGGER(trace) << "Starting peer " << host << ":" << port_ << "..." << endl;
-        m_peer.start();
-        LOGGER(trace) << "Peer started." << endl;
+    clock_t::time_point cutoff = clock_t::now() - std::chrono::seconds(m_stallTimeout);
+    std::vector<Wanted> wanted;
+    for (auto it = m_inFlight.begin(); it != m_inFlight.end();)
+    {
+        if (it->second.requested < cutoff)
+        {
+            LOGGER(debug) << "BlockchainDownload - Block at height " << it->second.height << " stalled on " << it->second.peer->name() << "." << endl;
+            PeerState& state = m_peerStates[it->second.peer];
+            if (state.inFlight > 0) { state.inFlight--; }
+            wanted.push_back(Wanted{it->first, it->second.height, it->second.peer});
+            it = m_inFlight.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
     }
-
-    notifyStarted();
+    requeue(wanted);
 }
 
-void BlockchainDownload::start(const string& host, int port, const vector<uchar_vector>& locatorHashes, const uchar_vector& hashStop)
+std::vector<std::pair<Coin::CoinBlock, int>> BlockchainDownload::takeReadyBlocks()
 {
-    std::stringstream ssport;
-    ssport << port;
-    start(host, ssport.str(), locatorHashes, hashStop);
+    std::vector<std::pair<Coin::CoinBlock, int>> ready;
+    for (auto it = m_received.begin(); it != m_received.end() && it->first == m_nextHeight; it = m_received.erase(it))
+    {
+        ready.push_back(std::make_pair(it->second, it->first));
+        m_nextHeight++;
+    }
+    return ready;
 }
 
-void BlockchainDownload::stop()
+void BlockchainDownload::deliver(std::vector<std::pair<Coin::CoinBlock, int>>& blocks)
 {
+    for (auto& item: blocks)
     {
-        if (!m_bStarted) return;
-        boost::lock_guard<boost::mutex> lock(m_startMutex);
-        if (!m_bStarted) return;
+        if (m_blockStore)
+        {
+            try
+            {
+                m_blockStore->append(item.first, item.second);
+            }
+            catch (const exception& e)
+            {
+                LOGGER(error) << "BlockchainDownload - Failed to store block at height " << item.second << ": " << e.what() << endl;
+                halt();
+                notifyBlockTreeError(e.what(), -1);
+                return;
+            }
+        }
 
-        m_bConnected = false;
-        m_peer.stop();
-        stopIOServiceThread();
+        {
+            boost::lock_guard<boost::mutex> lock(m_stateMutex);
+            m_bestHeight = item.second;
+            m_bestHash = item.first.hash();
+        }
+        notifyBlock(item.first);
+    }
+}
 
-        m_bStarted = false;
+void BlockchainDownload::halt()
+{
+    {
+        boost::lock_guard<boost::mutex> lock(m_stateMutex);
+        m_bHalted = true;
+        m_queue.clear();
+        m_inFlight.clear();
+        m_received.clear();
+        for (auto& item: m_peerStates) { item.second.inFlight = 0; }
     }
 
-    notifyStopped();
+    // Runs on the io service thread, so the peers are closed here and the thread is left to stop().
+    for (auto& peer: m_peers) { peer->stop(); }
+}
+
+void BlockchainDownload::startStallTimer()
+{
+    m_stallTimer.expires_from_now(boost::posix_time::seconds(STALL_CHECK_INTERVAL));
+    m_stallTimer.async_wait([this](const boost::system::error_code& ec)
+    {
+        if (ec) return;
+        {
+            boost::lock_guard<boost::mutex> lock(m_stateMutex);
+            checkStalls();
+            requestBlocks();
+        }
+        startStallTimer();
+    });
 }
 
 void BlockchainDownload::startIOServiceThread()
@@ -232,6 +731,5 @@ void BlockchainDownload::stopIOServiceThread()
     m_ioServiceThread.join();
     m_ioService.reset();
     m_bIOServiceStarted = false;
-    LOGGER(trace) << "IO service thread stopped." << endl; 
+    LOGGER(trace) << "IO service thread stopped." << endl;
 }
-
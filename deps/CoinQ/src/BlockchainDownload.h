@@ -21,12 +21,18 @@
 
 #include "CoinQ_coinparams.h"
 #include "CoinQ_blocks.h"
+#include "CoinQ_blockstore.h"
 
 #include <CoinCore/typedefs.h>
 #include <CoinCore/CoinNodeData.h>
 
 #include <Signals/Signals.h>
 
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <memory>
 #include <queue>
 
 
@@ -35,9 +41,22 @@ namespace CoinQ
     namespace Network
     {
 
+// Downloads full blocks from one or more peers. Headers are fetched first from one peer, then blocks
+// are requested from every open peer at once, a few at a time each, within a sliding window ahead of
+// the next block due. Blocks are delivered through subscribeBlock strictly in height order.
+//
+// If a reorg replaces blocks that were already delivered, delivery starts again at the first block
+// of the new branch.
+//
+// A block whose transactions don't hash to its header's merkle root is dropped and requested again
+// from another peer.
 class BlockchainDownload
 {
 public:
+    static const unsigned int DEFAULT_WINDOW_SIZE = 1024;       // blocks past the next one due
+    static const unsigned int DEFAULT_MAX_BLOCKS_IN_FLIGHT = 16; // per peer
+    static const unsigned int DEFAULT_STALL_TIMEOUT = 30;       // seconds
+
     BlockchainDownload(const CoinQ::CoinParams& coinParams = CoinQ::getBitcoinParams(), bool bCheckProofOfWork = false);
     ~BlockchainDownload();
 
@@ -46,13 +65,35 @@ public:
 
     void enableCheckProofOfWork(bool bCheckProofOfWork = true) { m_bCheckProofOfWork = bCheckProofOfWork; }
 
-    int getBestHeight() const { return m_blockTree.getBestHeight(); }
-    const bytes_t& getBestHash() const { return m_blockTree.getBestHash(); }
+    // Blocks are appended to the store before they are delivered. A download resumes from the best block
+    // in the store, so it cannot be started with locator hashes. The store must stay open while started.
+    // If an append fails the download halts: the block is not delivered, nothing more is requested, the
+    // peers are closed and the error is signalled through subscribeBlockTreeError. Call stop() before
+    // starting again.
+    void setBlockStore(CoinQ::BlockStore* blockStore);
+
+    void setWindowSize(unsigned int windowSize);
+    void setMaxBlocksInFlight(unsigned int maxBlocksInFlight);
+
+    // A block holding up delivery for this long is requested again from another peer.
+    void setStallTimeout(unsigned int seconds);
+
+    // Last block delivered. Heights count from the genesis block unless locator hashes were given,
+    // in which case they count from the first block downloaded.
+    int getBestHeight() const;
+    bytes_t getBestHash() const;
+
+    // Best header, which may be well ahead of the blocks delivered.
+    int getHeaderHeight() const;
 
     void start(const std::string& host, const std::string& port = std::string(), const std::vector<uchar_vector>& locatorHashes = std::vector<uchar_vector>(), const uchar_vector& hashStop = uchar_vector(32, 0));
     void start(const std::string& host, int port, const std::vector<uchar_vector>& locatorHashes = std::vector<uchar_vector>(), const uchar_vector& hashStop = uchar_vector(32, 0));
+    void start(const std::vector<std::string>& hosts, const std::string& port = std::string(), const std::vector<uchar_vector>& locatorHashes = std::vector<uchar_vector>(), const uchar_vector& hashStop = uchar_vector(32, 0));
     void stop();
-    bool connected() const { return m_bConnected; }
+
+    // True while at least one peer connection is open.
+    bool connected() const { return m_connectedPeers > 0; }
+    unsigned int connectedPeers() const { return m_connectedPeers; }
 
     typedef Signals::Signal<>                           VoidSignal;
     typedef Signals::Signal<const Coin::CoinBlock&>     BlockSignal;
@@ -61,6 +102,8 @@ public:
     // SYNC EVENT SUBSCRIPTIONS
     Signals::Connection subscribeStarted(VoidSignal::Slot slot)             { return notifyStarted.connect(slot); }
     Signals::Connection subscribeStopped(VoidSignal::Slot slot)             { return notifyStopped.connect(slot); }
+
+    // Open, close and timeout are signalled for each peer.
     Signals::Connection subscribeOpen(VoidSignal::Slot slot)                { return notifyOpen.connect(slot); }
     Signals::Connection subscribeClose(VoidSignal::Slot slot)               { return notifyClose.connect(slot); }
     Signals::Connection subscribeTimeout(VoidSignal::Slot slot)             { return notifyTimeout.connect(slot); }
@@ -75,16 +118,71 @@ public:
     Signals::Connection subscribeBlock(BlockSignal::Slot slot)              { return notifyBlock.connect(slot); }
 
 private:
+    typedef std::chrono::steady_clock clock_t;
+
     CoinQ::CoinParams m_coinParams;
     bool m_bCheckProofOfWork;
 
+    CoinQ::BlockStore* m_blockStore;
+    unsigned int m_windowSize;
+    unsigned int m_maxBlocksInFlight;
+    unsigned int m_stallTimeout;
+
     std::vector<uchar_vector> m_locatorHashes;
     uchar_vector m_hashStop;
 
-    uchar_vector m_lastRequestedBlockHash;
-    uchar_vector m_lastReceivedBlockHash;
     CoinQBlockTreeMem m_blockTree;
- 
+    int m_heightOffset;             // height of the block tree root
+
+    // Download state, guarded by m_stateMutex
+    struct Wanted
+    {
+        uchar_vector hash;
+        int height;
+        CoinQ::Peer* stalledPeer;   // peer that failed to deliver it, if any
+    };
+
+    struct InFlight
+    {
+        CoinQ::Peer* peer;
+        int height;
+        clock_t::time_point requested;
+    };
+
+    struct PeerState
+    {
+        PeerState() : bOpen(false), inFlight(0) { }
+        bool bOpen;
+        unsigned int inFlight;
+    };
+
+    mutable boost::mutex m_stateMutex;
+    std::map<CoinQ::Peer*, PeerState> m_peerStates;
+    CoinQ::Peer* m_headerPeer;
+    bool m_bHeadersSynched;
+    bool m_bBlocksSynched;
+    bool m_bHalted;                                     // after a block store failure
+    std::deque<Wanted> m_queue;                         // in height order, all above m_inFlight
+    std::map<uchar_vector, InFlight> m_inFlight;
+    std::map<int, Coin::CoinBlock> m_received;          // waiting for earlier blocks
+    int m_nextHeight;                                   // next block to deliver
+    int m_lastQueuedHeight;                             // tree height
+    uchar_vector m_lastQueuedHash;
+    int m_bestHeight;                                   // last block delivered
+    bytes_t m_bestHash;
+
+    // Called with m_stateMutex held
+    void requestHeaders(CoinQ::Peer& peer);
+    void queueNewHeaders();
+    void requeue(std::vector<Wanted>& wanted);
+    void requestBlocks();
+    void checkStalls();
+    std::vector<std::pair<Coin::CoinBlock, int>> takeReadyBlocks();
+
+    void deliver(std::vector<std::pair<Coin::CoinBlock, int>>& blocks);
+    void halt();
+    void subscribePeer(CoinQ::Peer& peer);
+
     bool m_bStarted;
     boost::mutex m_startMutex;
 
@@ -96,8 +194,11 @@ private:
     boost::thread m_ioServiceThread;
     CoinQ::io_service_t::work m_work;
 
-    bool m_bConnected;
-    CoinQ::Peer m_peer;
+    boost::asio::deadline_timer m_stallTimer;
+    void startStallTimer();
+
+    std::atomic<unsigned int> m_connectedPeers;
+    std::vector<std::shared_ptr<CoinQ::Peer>> m_peers;
 
     // Sync signals
     VoidSignal          notifyStarted;
@@ -118,4 +219,3 @@ private:
 
     }
 }
-
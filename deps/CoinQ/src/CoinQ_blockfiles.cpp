@@ -0,0 +1,347 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// CoinQ_blockfiles.cpp
+//
+// Copyright (c) 2011-2016 Ciphrex Corp.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+//
+
+#include "CoinQ_blockfiles.h"
+
+#include <logger/logger.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/regex.hpp>
+#include <boost/thread.hpp>
+
+#include <openssl/sha.h>
+
+#include <algorithm>
+#include <deque>
+#include <fstream>
+#include <stdexcept>
+
+using namespace CoinQ;
+
+namespace
+{
+    const std::size_t HEADER_SIZE = 80;
+
+    // magic, size
+    const std::size_t FRAME_SIZE = 4 + 4;
+
+    uint64_t getUint(const unsigned char* p, std::size_t size)
+    {
+        uint64_t value = 0;
+        for (std::size_t i = 0; i < size; i++) { value |= (uint64_t)p[i] << (8 * i); }
+        return value;
+    }
+
+    // Bounds-checked reads for RawBlock::parse().
+    class Cursor
+    {
+    public:
+        Cursor(const unsigned char* begin, const unsigned char* end) : p_(begin), end_(end) { }
+
+        const unsigned char* pos() const { return p_; }
+
+        const unsigned char* skip(uint64_t size)
+        {
+            if (size > (uint64_t)(end_ - p_)) throw std::runtime_error("RawBlock - block is truncated.");
+            const unsigned char* begin = p_;
+            p_ += size;
+            return begin;
+        }
+
+        uint64_t varInt()
+        {
+            unsigned char prefix = *skip(1);
+            switch (prefix)
+            {
+            case 0xfd:  return getUint(skip(2), 2);
+            case 0xfe:  return getUint(skip(4), 4);
+            case 0xff:  return getUint(skip(8), 8);
+            default:    return prefix;
+            }
+        }
+
+        bool peek(unsigned char a, unsigned char b) const { return end_ - p_ >= 2 && p_[0] == a && p_[1] == b; }
+
+    private:
+        const unsigned char* p_;
+        const unsigned char* end_;
+    };
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// RawBlock
+//
+uchar_vector RawBlock::Tx::hash() const
+{
+    // The txid covers everything but the segwit marker, flag and witnesses.
+    unsigned char hash[SHA256_DIGEST_LENGTH];
+    SHA256_CTX sha256;
+    SHA256_Init(&sha256);
+    SHA256_Update(&sha256, begin, 4);
+    SHA256_Update(&sha256, body, bodyEnd - body);
+    SHA256_Update(&sha256, end - 4, 4);
+    SHA256_Final(hash, &sha256);
+    SHA256_Init(&sha256);
+    SHA256_Update(&sha256, hash, SHA256_DIGEST_LENGTH);
+    SHA256_Final(hash, &sha256);
+
+    uchar_vector rval(hash, SHA256_DIGEST_LENGTH);
+    return rval.getReverse();
+}
+
+Coin::Transaction RawBlock::Tx::toTransaction() const
+{
+    return Coin::Transaction(uchar_vector(begin, end));
+}
+
+void RawBlock::parse(const unsigned char* data, std::size_t size)
+{
+    txs_.clear();
+    outpoints_.clear();
+    scripts_.clear();
+
+    Cursor cursor(data, data + size);
+    header_ = cursor.skip(HEADER_SIZE);
+
+    uint64_t txCount = cursor.varInt();
+    if (txCount > size) throw std::runtime_error("RawBlock - invalid transaction count.");
+    txs_.reserve(txCount);
+
+    for (uint64_t i = 0; i < txCount; i++)
+    {
+        Tx tx;
+        tx.begin = cursor.skip(4); // version
+
+        bool bWitness = cursor.peek(0, 1);
+        if (bWitness) { cursor.skip(2); }
+
+        tx.body = cursor.pos();
+        tx.firstInput = outpoints_.size();
+        tx.inputCount = cursor.varInt();
+        for (uint32_t j = 0; j < tx.inputCount; j++)
+        {
+            outpoints_.push_back(cursor.skip(36));
+            cursor.skip(cursor.varInt()); // script
+            cursor.skip(4); // sequence
+        }
+
+        tx.firstOutput = scripts_.size();
+        tx.outputCount = cursor.varInt();
+        for (uint32_t j = 0; j < tx.outputCount; j++)
+        {
+            cursor.skip(8); // value
+            Script script;
+            script.size = cursor.varInt();
+            script.begin = cursor.skip(script.size);
+            scripts_.push_back(script);
+        }
+        tx.bodyEnd = cursor.pos();
+
+        if (bWitness)
+        {
+            for (uint32_t j = 0; j < tx.inputCount; j++)
+            {
+                uint64_t itemCount = cursor.varInt();
+                for (uint64_t k = 0; k < itemCount; k++) { cursor.skip(cursor.varInt()); }
+            }
+        }
+
+        cursor.skip(4); // locktime
+        tx.end = cursor.pos();
+        txs_.push_back(tx);
+    }
+}
+
+Coin::CoinBlockHeader RawBlock::getHeader() const
+{
+    return Coin::CoinBlockHeader(uchar_vector(header_, header_ + HEADER_SIZE));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// BlockFiles
+//
+class BlockFiles::MappedFile
+{
+public:
+    MappedFile(const std::string& filepath) :
+        mapping_(filepath.c_str(), boost::interprocess::read_only),
+        region_(mapping_, boost::interprocess::read_only) { }
+
+    const unsigned char* data() const { return (const unsigned char*)region_.get_address(); }
+    std::size_t size() const { return region_.get_size(); }
+
+private:
+    boost::interprocess::file_mapping mapping_;
+    boost::interprocess::mapped_region region_;
+};
+
+BlockFiles::BlockFiles() :
+    blockCount_(0),
+    tree_(false, false)
+{
+}
+
+BlockFiles::~BlockFiles()
+{
+    close();
+}
+
+void BlockFiles::open(const std::string& dirpath, const CoinParams& coinParams, unsigned int nThreads)
+{
+    namespace fs = boost::filesystem;
+
+    close();
+
+    // Core 28 and later obfuscate block files unless started with -blocksxor=0.
+    {
+        std::ifstream xorfile((fs::path(dirpath) / "xor.dat").string(), std::ios::in | std::ios::binary);
+        char key[8];
+        if (xorfile && xorfile.read(key, sizeof(key)) && std::any_of(key, key + sizeof(key), [](char c) { return c != 0; }))
+            throw std::runtime_error("BlockFiles - obfuscated block files are not supported.");
+    }
+
+    std::vector<std::string> filepaths;
+    {
+        const boost::regex pattern("blk[0-9]+\\.dat");
+        boost::system::error_code ec;
+        for (fs::directory_iterator it(dirpath, ec), end; !ec && it != end; it.increment(ec))
+        {
+            if (!fs::is_regular_file(it->status())) continue;
+            std::string filename = it->path().filename().string();
+            if (boost::regex_match(filename, pattern) && fs::file_size(it->path()) > 0) { filepaths.push_back(it->path().string()); }
+        }
+        if (ec) throw std::runtime_error(std::string("BlockFiles - cannot read directory: ") + ec.message());
+    }
+    if (filepaths.empty()) throw std::runtime_error("BlockFiles - no block files found.");
+    std::sort(filepaths.begin(), filepaths.end());
+
+    for (auto& filepath: filepaths) { files_.emplace_back(new MappedFile(filepath)); }
+
+    // Walk the framing of each file. Core preallocates its files, so a zero magic marks the end.
+    struct Entry
+    {
+        Location location;
+        uchar_vector hash;
+        uchar_vector prevhash;
+    };
+
+    if (nThreads == 0) { nThreads = boost::thread::hardware_concurrency(); }
+    nThreads = std::max<unsigned int>(1, std::min<std::size_t>(nThreads, files_.size()));
+
+    const uint32_t magic = coinParams.magic_bytes();
+    std::vector<std::vector<Entry>> entries(files_.size());
+    std::vector<std::exception_ptr> errors(nThreads);
+    auto scanFiles = [&](unsigned int thread)
+    {
+        try
+        {
+            for (std::size_t i = thread; i < files_.size(); i += nThreads)
+            {
+                const unsigned char* p = files_[i]->data();
+                const unsigned char* end = p + files_[i]->size();
+                while ((std::size_t)(end - p) >= FRAME_SIZE + HEADER_SIZE && getUint(p, 4) == magic)
+                {
+                    uint32_t size = getUint(p + 4, 4);
+                    if (size < HEADER_SIZE || size > (std::size_t)(end - p) - FRAME_SIZE) break; // still being written
+
+                    Coin::CoinBlockHeader header(uchar_vector(p + FRAME_SIZE, p + FRAME_SIZE + HEADER_SIZE));
+                    entries[i].push_back(Entry{Location{(uint32_t)i, size, p + FRAME_SIZE}, header.hash(), header.prevBlockHash()});
+                    p += FRAME_SIZE + size;
+                }
+            }
+        }
+        catch (...)
+        {
+            errors[thread] = std::current_exception();
+        }
+    };
+
+    boost::thread_group threads;
+    for (unsigned int thread = 1; thread < nThreads; thread++) { threads.create_thread(std::bind(scanFiles, thread)); }
+    scanFiles(0);
+    threads.join_all();
+
+    for (auto& error: errors) { if (error) std::rethrow_exception(error); }
+
+    // Link the headers up from the genesis block, parents before children.
+    std::map<uchar_vector, Location> locations;
+    std::multimap<uchar_vector, const Entry*> children;
+    for (auto& fileEntries: entries)
+    {
+        for (auto& entry: fileEntries)
+        {
+            if (!locations.insert(std::make_pair(entry.hash, entry.location)).second) continue;
+            children.insert(std::make_pair(entry.prevhash, &entry));
+        }
+    }
+    blockCount_ = locations.size();
+
+    Coin::CoinBlockHeader genesis = coinParams.genesis_block();
+    if (!locations.count(genesis.hash())) throw std::runtime_error("BlockFiles - genesis block not found.");
+
+    tree_.clear();
+    tree_.setGenesisBlock(genesis);
+
+    std::deque<uchar_vector> pending(1, genesis.hash());
+    while (!pending.empty())
+    {
+        auto range = children.equal_range(pending.front());
+        pending.pop_front();
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            const Location& location = it->second->location;
+            tree_.insertHeader(Coin::CoinBlockHeader(uchar_vector(location.data, location.data + HEADER_SIZE)), false);
+            pending.push_back(it->second->hash);
+        }
+    }
+
+    int bestHeight = tree_.getBestHeight();
+    chain_.resize(bestHeight + 1);
+    for (int height = 0; height <= bestHeight; height++) { chain_[height] = locations.at(tree_.getHeader(height).hash()); }
+
+    LOGGER(debug) << "BlockFiles - opened " << files_.size() << " files in " << dirpath << " with " << blockCount_ << " blocks. Best height: " << bestHeight << std::endl;
+}
+
+void BlockFiles::close()
+{
+    chain_.clear();
+    tree_.clear();
+    files_.clear();
+    blockCount_ = 0;
+}
+
+int BlockFiles::getHeight(const bytes_t& hash) const
+{
+    if (!tree_.hasHeader(hash)) return -1;
+    const ChainHeader& header = tree_.getHeader(hash);
+    return header.inBestChain ? header.height : -1;
+}
+
+int BlockFiles::getHeightBefore(uint32_t timestamp) const
+{
+    return tree_.getHeaderBefore(timestamp).height;
+}
+
+const ChainHeader& BlockFiles::getHeader(int height) const
+{
+    if (height < 0 || height >= (int)chain_.size()) throw std::runtime_error("BlockFiles - height out of range.");
+    return tree_.getHeader(height);
+}
+
+const unsigned char* BlockFiles::getBlock(int height, std::size_t& size) const
+{
+    if (height < 0 || height >= (int)chain_.size()) throw std::runtime_error("BlockFiles - height out of range.");
+    size = chain_[height].size;
+    return chain_[height].data;
+}
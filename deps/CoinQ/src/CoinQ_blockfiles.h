@@ -0,0 +1,125 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// CoinQ_blockfiles.h
+//
+// Copyright (c) 2011-2016 Ciphrex Corp.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+//
+
+#pragma once
+
+#include "CoinQ_coinparams.h"
+#include "CoinQ_blocks.h"
+
+#include <CoinCore/typedefs.h>
+#include <CoinCore/CoinNodeData.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace CoinQ
+{
+
+// Zero-copy view of a serialized block. Everything points into the buffer passed to parse(), which
+// must outlive the view. Nothing is hashed or copied until asked for.
+class RawBlock
+{
+public:
+    struct Script
+    {
+        const unsigned char* begin;
+        std::size_t size;
+    };
+
+    struct Tx
+    {
+        const unsigned char* begin;     // full serialization, witnesses included
+        const unsigned char* end;
+        const unsigned char* body;      // inputs and outputs only
+        const unsigned char* bodyEnd;
+        uint32_t firstInput;            // index into outpoints()
+        uint32_t inputCount;
+        uint32_t firstOutput;           // index into scripts()
+        uint32_t outputCount;
+
+        // Same byte order as Coin::Transaction::hash(). Reverse it for merkle trees and outpoints.
+        uchar_vector hash() const;
+        Coin::Transaction toTransaction() const;
+    };
+
+    // Throws std::runtime_error if the block is malformed or runs past size.
+    void parse(const unsigned char* data, std::size_t size);
+
+    const unsigned char* header() const { return header_; } // 80 bytes
+    Coin::CoinBlockHeader getHeader() const;
+
+    const std::vector<Tx>& txs() const { return txs_; }
+
+    // 36 bytes each, serialized as in the block: previous tx hash then output index.
+    const std::vector<const unsigned char*>& outpoints() const { return outpoints_; }
+
+    const std::vector<Script>& scripts() const { return scripts_; }
+
+private:
+    const unsigned char* header_;
+    std::vector<Tx> txs_;
+    std::vector<const unsigned char*> outpoints_;
+    std::vector<Script> scripts_;
+};
+
+// Read-only access to a directory of blk*.dat files, such as Bitcoin Core's blocks directory or a
+// BlockStore. Every file is memory-mapped.
+//
+// Core writes blocks in the order they arrive rather than by height, so open() walks the framing of
+// every file in parallel, then links the headers up from the genesis block to find the best chain.
+// Core's file obfuscation (a non-zero key in xor.dat) is not supported.
+class BlockFiles
+{
+public:
+    BlockFiles();
+    ~BlockFiles();
+
+    // Pass 0 threads to use one per core.
+    void open(const std::string& dirpath, const CoinParams& coinParams, unsigned int nThreads = 0);
+    void close();
+    bool isOpen() const { return !files_.empty(); }
+
+    // Number of blocks found in the files, including those off the best chain.
+    std::size_t getBlockCount() const { return blockCount_; }
+
+    // -1 when no blocks were found.
+    int getBestHeight() const { return (int)chain_.size() - 1; }
+
+    // -1 if the block is not in the best chain.
+    int getHeight(const bytes_t& hash) const;
+
+    // Highest block with a timestamp no later than the one given, or the genesis block.
+    int getHeightBefore(uint32_t timestamp) const;
+
+    const ChainHeader& getHeader(int height) const;
+
+    // Points into the mapped file. Throws std::runtime_error if the height is out of range.
+    const unsigned char* getBlock(int height, std::size_t& size) const;
+
+private:
+    class MappedFile;
+    std::vector<std::unique_ptr<MappedFile>> files_;
+
+    struct Location
+    {
+        uint32_t file;
+        uint32_t size;
+        const unsigned char* data;
+    };
+
+    std::size_t blockCount_;
+    CoinQBlockTreeMem tree_;
+    std::vector<Location> chain_;   // by height
+};
+
+}
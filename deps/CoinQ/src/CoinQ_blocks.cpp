@@ -10,11 +10,74 @@
 //
 
 #include "CoinQ_blocks.h"
+#include "CoinQ_workerpool.h"
 
 #include <logger/logger.h>
 
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <limits>
+
 using namespace CoinQ;
 
+namespace
+{
+    // Headers are read from file in batches so their proof of work can be checked in parallel. They
+    // are still linked one at a time, in file order.
+    const std::size_t HEADER_BATCH_SIZE = 2000;
+
+    // Snapshot layout: magic, version, base height, base chain work (big endian), header count, the
+    // headers from the base up, then a double SHA-256 of everything before it. Integers are little endian.
+    const unsigned char SNAPSHOT_MAGIC[4] = { 'C', 'Q', 'H', 'S' };
+    const uint32_t SNAPSHOT_VERSION = 1;
+    const std::size_t SNAPSHOT_CHAINWORK_SIZE = 32;
+    const std::size_t SNAPSHOT_PREFIX_SIZE = 4 + 4 + 4 + SNAPSHOT_CHAINWORK_SIZE + 4;
+    const std::size_t SNAPSHOT_CHECKSUM_SIZE = 32;
+
+    uint32_t getUint32(const unsigned char* p)
+    {
+        return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+    }
+
+    void putUint32(uchar_vector& data, uint32_t value)
+    {
+        for (int i = 0; i < 4; i++) { data.push_back((value >> (8 * i)) & 0xff); }
+    }
+
+    uchar_vector readFile(const std::string& filename)
+    {
+        boost::filesystem::path p(filename);
+        if (!boost::filesystem::exists(p)) throw BlockTreeFileNotFoundException();
+
+        if (!boost::filesystem::is_regular_file(p)) throw BlockTreeInvalidFileTypeException();
+
+#ifndef _WIN32
+        std::ifstream fs(p.native(), std::ios::binary);
+#else
+        std::ifstream fs(filename, std::ios::binary);
+#endif
+        if (!fs.good()) throw BlockTreeFailedToOpenFileForReadException();
+
+        uchar_vector data(boost::filesystem::file_size(p));
+        if (!data.empty()) { fs.read((char*)&data[0], data.size()); }
+        if (fs.bad() || (std::size_t)fs.gcount() != data.size()) throw BlockTreeFileReadFailureException();
+        return data;
+    }
+
+    // Threads for header proof of work checks. They are started on first use and live until exit, so
+    // checking one headers message doesn't cost a thread start per chunk.
+    WorkerPool& getProofOfWorkPool()
+    {
+        // The calling thread does one share of the work, so one thread fewer than the core count.
+        static WorkerPool pool(std::max(boost::thread::hardware_concurrency(), 1u) - 1);
+        return pool;
+    }
+}
+
 bool CoinQBlockTreeMem::setBestChain(ChainHeader& header)
 {
     if (header.inBestChain) return false;
@@ -64,7 +127,7 @@ bool CoinQBlockTreeMem::unsetBestChain(ChainHeader& header)
 {
     if (!header.inBestChain) return false;
 
-    if (header.height == 0) throw std::runtime_error("Cannot remove genesis block from best chain.");
+    if (header.height == mBaseHeight) throw std::runtime_error("Cannot remove base block from best chain.");
 
     ChainHeader* pParent = &mHeaderHashMap.at(header.prevBlockHash());
     if (pParent->inBestChain)
@@ -97,20 +160,36 @@ bool CoinQBlockTreeMem::unsetBestChain(ChainHeader& header)
 void CoinQBlockTreeMem::setGenesisBlock(const Coin::CoinBlockHeader& header)
 {
     LOGGER(trace) << "setGenesisBlock - hash: " << header.getPOWHashLittleEndian().getHex() << std::endl;
+    setBaseBlock(header, 0, header.getWork());
+}
+
+void CoinQBlockTreeMem::setBaseBlock(const Coin::CoinBlockHeader& header, int height, const BigInt& chainWork)
+{
     if (mHeaderHashMap.size() != 0) throw std::runtime_error("Tree is not empty.");
+    if (height < 0) throw std::runtime_error("Invalid base height.");
 
-    bFlushed = false;
     uchar_vector hash = header.hash();
-    ChainHeader& genesisHeader = mHeaderHashMap[hash] = header;
-    mHeaderHeightMap[0] = &genesisHeader;
-    genesisHeader.height = 0;
-    genesisHeader.inBestChain = true;
-    genesisHeader.chainWork = genesisHeader.getWork();
-    mBestHeight = 0;
-    mTotalWork = genesisHeader.chainWork;
-    pHead = &genesisHeader;
-    notifyInsert(header);
-    notifyAddBestChain(header);
+    auto itCheckpoint = mCheckpoints.find(height);
+    if (itCheckpoint != mCheckpoints.end() && itCheckpoint->second != hash) throw std::runtime_error("Header does not match checkpoint.");
+
+    bFlushed = false;
+    ChainHeader& baseHeader = mHeaderHashMap[hash] = header;
+    mHeaderHeightMap[height] = &baseHeader;
+    baseHeader.height = height;
+    baseHeader.inBestChain = true;
+    baseHeader.chainWork = chainWork;
+    mBaseHeight = height;
+    mBestHeight = height;
+    mTotalWork = chainWork;
+    pHead = &baseHeader;
+    notifyInsert(baseHeader);
+    notifyAddBestChain(baseHeader);
+}
+
+void CoinQBlockTreeMem::setCheckpoints(const CoinQ::checkpoints_t& checkpoints)
+{
+    mCheckpoints.clear();
+    for (auto& checkpoint: checkpoints) { mCheckpoints[checkpoint.height] = checkpoint.hash; }
 }
 
 bool CoinQBlockTreeMem::insertHeader(const Coin::CoinBlockHeader& header, bool bCheckProofOfWork, bool bReplaceTip)
@@ -132,11 +211,16 @@ bool CoinQBlockTreeMem::insertHeader(const Coin::CoinBlockHeader& header, bool b
         throw std::runtime_error("Timestamp too far in the future.");
     }*/
 
+    // Check checkpoint
+    int height = parent.height + 1;
+    auto itCheckpoint = mCheckpoints.find(height);
+    if (itCheckpoint != mCheckpoints.end() && itCheckpoint->second != headerHash) throw std::runtime_error("Header does not match checkpoint.");
+
     // Check proof of work
-    if (bCheckProofOfWork && BigInt(header.getPOWHashLittleEndian()) > header.getTarget()) throw std::runtime_error("Header hash is too big.");
+    if (bCheckProofOfWork && !header.checkProofOfWork()) throw std::runtime_error("Header hash is too big.");
 
     ChainHeader& chainHeader = mHeaderHashMap[headerHash] = header;
-    chainHeader.height = parent.height + 1;
+    chainHeader.height = height;
     chainHeader.chainWork = parent.chainWork + chainHeader.getWork();
     parent.childHashes.insert(headerHash);
     notifyInsert(chainHeader);
@@ -150,6 +234,55 @@ bool CoinQBlockTreeMem::insertHeader(const Coin::CoinBlockHeader& header, bool b
     return true;
 }
 
+// static
+std::size_t CoinQBlockTreeMem::getFirstInvalidProofOfWork(const std::vector<Coin::CoinBlockHeader>& headers, std::size_t begin, unsigned int nThreads)
+{
+    if (begin >= headers.size()) return headers.size();
+
+    // Keep chunks big enough to fill the multi-lane hash kernels.
+    const std::size_t MIN_CHUNK_SIZE = 16;
+
+    WorkerPool& pool = getProofOfWorkPool();
+    if (nThreads == 0) { nThreads = pool.size() + 1; }
+    std::size_t count = headers.size() - begin;
+    std::size_t nChunks = std::max<std::size_t>(1, std::min<std::size_t>(nThreads, (count + MIN_CHUNK_SIZE - 1) / MIN_CHUNK_SIZE));
+    std::size_t chunkSize = (count + nChunks - 1) / nChunks;
+
+    std::vector<std::size_t> firstInvalid(nChunks, headers.size());
+    std::vector<std::exception_ptr> errors(nChunks);
+    auto checkChunk = [&](std::size_t chunk)
+    {
+        try
+        {
+            std::size_t chunkBegin = begin + chunk * chunkSize;
+            std::size_t chunkEnd = std::min(chunkBegin + chunkSize, headers.size());
+            Coin::CoinBlockHeader::computePOWHashes(headers.begin() + chunkBegin, headers.begin() + chunkEnd);
+            for (std::size_t i = chunkBegin; i < chunkEnd; i++)
+            {
+                if (!headers[i].checkProofOfWork())
+                {
+                    firstInvalid[chunk] = i;
+                    break;
+                }
+            }
+        }
+        catch (...)
+        {
+            errors[chunk] = std::current_exception();
+        }
+    };
+
+    pool.run(nChunks, checkChunk);
+
+    for (std::size_t chunk = 0; chunk < nChunks; chunk++)
+    {
+        if (errors[chunk]) std::rethrow_exception(errors[chunk]);
+        if (firstInvalid[chunk] < headers.size()) return firstInvalid[chunk];
+    }
+
+    return headers.size();
+}
+
 bool CoinQBlockTreeMem::deleteHeader(const uchar_vector& hash)
 {
     header_hash_map_t::iterator it = mHeaderHashMap.find(hash);
@@ -222,7 +355,7 @@ const ChainHeader& CoinQBlockTreeMem::getHeaderBefore(uint32_t timestamp) const
     if (mBestHeight == -1) throw std::runtime_error("Tree is empty.");
 
     int i;
-    for (i = 1; i <= mBestHeight; i++)
+    for (i = mBaseHeight + 1; i <= mBestHeight; i++)
     {
         ChainHeader* header = mHeaderHeightMap.at(i);
         if (header->timestamp() > timestamp) break; 
@@ -241,12 +374,12 @@ std::vector<uchar_vector> CoinQBlockTreeMem::getLocatorHashes(int maxSize = -1)
         return locatorHashes;
     }
 
-    if (maxSize < 0) maxSize = mBestHeight + 1;
+    if (maxSize < 0) maxSize = mBestHeight - mBaseHeight + 1;
 
     int i = mBestHeight;
     int n = 0;
     int step = 1;
-    while ((i >= 0) && (n < maxSize))
+    while ((i >= mBaseHeight) && (n < maxSize))
     {
         locatorHashes.push_back(mHeaderHeightMap.at(i)->hash());
         i -= step;
@@ -264,6 +397,69 @@ int CoinQBlockTreeMem::getConfirmations(const uchar_vector& hash) const
     return mBestHeight - it->second.height + 1;
 }
 
+void CoinQBlockTreeMem::insertLoadedHeaders(const std::vector<Coin::CoinBlockHeader>& headers, bool bCheckProofOfWork, unsigned int& count, CoinQBlockTreeMem::callback_t callback)
+{
+    // The first header of a file roots the tree and is not checked. Nor are headers at or below the
+    // highest checkpoint, which vouches for them once the chain reaches it. checkUnanchoredProofOfWork()
+    // covers files that stop short of it.
+    std::size_t begin = mBestHeight >= 0 ? 0 : 1;
+    int topCheckpointHeight = getTopCheckpointHeight();
+    if (topCheckpointHeight > mBestHeight) { begin = std::max<std::size_t>(begin, std::min<std::size_t>(topCheckpointHeight - mBestHeight, headers.size())); }
+
+    std::size_t firstInvalid = bCheckProofOfWork ? getFirstInvalidProofOfWork(headers, begin) : headers.size();
+    for (std::size_t i = 0; i < headers.size(); i++)
+    {
+        try
+        {
+            if (mBestHeight >= 0)
+            {
+                // Only the first invalid header needs checking again, to throw the right error.
+                insertHeader(headers[i], i >= firstInvalid);
+                if (count % 10000 == 0)
+                {
+                    if (callback && !callback(*this)) throw BlockTreeLoadInterruptedException();
+                    LOGGER(debug) << "CoinQBlockTreeMem::loadFromFile() - header hash: " << headers[i].hash().getHex() << " height: " << mBestHeight << std::endl;
+                }
+                count++;
+            }
+            else
+            { 
+                setGenesisBlock(headers[i]);
+                if (callback && !callback(*this)) throw BlockTreeLoadInterruptedException();
+                LOGGER(debug) << "CoinQBlockTreeMem::loadFromFile() - genesis hash: " << headers[i].hash().getHex() << std::endl;
+                count++;
+            }
+        }
+        catch (const BlockTreeException& e)
+        {
+            throw e;
+        }
+        catch (const std::exception& e)
+        {
+            throw std::runtime_error(std::string("Block ") + headers[i].hash().getHex() + ": " + e.what());
+        }
+    }
+}
+
+void CoinQBlockTreeMem::checkUnanchoredProofOfWork() const
+{
+    // Headers that were not checked on the way in but are above the last checkpoint reached.
+    int topCheckpointHeight = getTopCheckpointHeight();
+    if (mBestHeight < 0 || mBestHeight >= topCheckpointHeight) return;
+
+    int anchorHeight = mBaseHeight;
+    for (auto& checkpoint: mCheckpoints)
+    {
+        if (checkpoint.first <= mBestHeight) { anchorHeight = std::max(anchorHeight, checkpoint.first); }
+    }
+
+    std::vector<Coin::CoinBlockHeader> headers;
+    for (int height = anchorHeight + 1; height <= mBestHeight; height++) { headers.push_back(*mHeaderHeightMap.at(height)); }
+
+    std::size_t firstInvalid = getFirstInvalidProofOfWork(headers);
+    if (firstInvalid < headers.size()) throw std::runtime_error(std::string("Block ") + headers[firstInvalid].hash().getHex() + ": Header hash is too big.");
+}
+
 void CoinQBlockTreeMem::loadFromFile(const std::string& filename, bool bCheckProofOfWork, CoinQBlockTreeMem::callback_t callback)
 {
     boost::filesystem::path p(filename);
@@ -271,9 +467,6 @@ void CoinQBlockTreeMem::loadFromFile(const std::string& filename, bool bCheckPro
 
     if (!boost::filesystem::is_regular_file(p)) throw BlockTreeInvalidFileTypeException();
 
-    const unsigned int RECORD_SIZE = MIN_COIN_BLOCK_HEADER_SIZE + 4;
-    if (boost::filesystem::file_size(p) % RECORD_SIZE != 0) throw BlockTreeInvalidFileLengthException();
-
 #ifndef _WIN32
     std::ifstream fs(p.native(), std::ios::binary);
 #else
@@ -281,6 +474,23 @@ void CoinQBlockTreeMem::loadFromFile(const std::string& filename, bool bCheckPro
 #endif
     if (!fs.good()) throw BlockTreeFailedToOpenFileForReadException();
 
+    // Trees rooted above the genesis block are saved as snapshots.
+    {
+        char magic[sizeof(SNAPSHOT_MAGIC)];
+        if (fs.read(magic, sizeof(magic)) && std::equal(SNAPSHOT_MAGIC, SNAPSHOT_MAGIC + sizeof(SNAPSHOT_MAGIC), (const unsigned char*)magic))
+        {
+            fs.close();
+            readSnapshot(readFile(filename), false, bCheckProofOfWork, callback);
+            if (callback) callback(*this); // No need to interrupt since we're done.
+            return;
+        }
+        fs.clear();
+        fs.seekg(0);
+    }
+
+    const unsigned int RECORD_SIZE = MIN_COIN_BLOCK_HEADER_SIZE + 4;
+    if (boost::filesystem::file_size(p) % RECORD_SIZE != 0) throw BlockTreeInvalidFileLengthException();
+
     clear();
     uchar_vector headerBytes;
     uchar_vector hash;
@@ -288,6 +498,9 @@ void CoinQBlockTreeMem::loadFromFile(const std::string& filename, bool bCheckPro
 
     unsigned int count = 0;
 
+    std::vector<Coin::CoinBlockHeader> headers;
+    headers.reserve(HEADER_BATCH_SIZE);
+
     char buf[RECORD_SIZE * 64];
     while (fs)
     {
@@ -303,42 +516,122 @@ void CoinQBlockTreeMem::loadFromFile(const std::string& filename, bool bCheckPro
             hash = header.hash();
             if (memcmp(&buf[pos + MIN_COIN_BLOCK_HEADER_SIZE], &hash[0], 4)) throw BlockTreeChecksumErrorException();
 
-            try
+            headers.push_back(header);
+            if (headers.size() >= HEADER_BATCH_SIZE)
             {
-                if (mBestHeight >= 0)
-                {
-                    insertHeader(header, bCheckProofOfWork);
-                    if (count % 10000 == 0)
-                    {
-                        if (callback && !callback(*this)) throw BlockTreeLoadInterruptedException();
-                        LOGGER(debug) << "CoinQBlockTreeMem::loadFromFile() - header hash: " << header.hash().getHex() << " height: " << count << std::endl;
-                    }
-                    count++;
-                }
-                else
-                { 
-                    setGenesisBlock(header);
-                    if (callback && !callback(*this)) throw BlockTreeLoadInterruptedException();
-                    LOGGER(debug) << "CoinQBlockTreeMem::loadFromFile() - genesis hash: " << header.hash().getHex() << std::endl;
-                    count++;
-                }
-            }
-            catch (const BlockTreeException& e)
-            {
-                throw e;
-            }
-            catch (const std::exception& e)
-            {
-                throw std::runtime_error(std::string("Block ") + hash.getHex() + ": " + e.what());
+                insertLoadedHeaders(headers, bCheckProofOfWork, count, callback);
+                headers.clear();
             }
         }
 
         if (pos != nbytesread) throw BlockTreeUnexpectedEndOfFileException();
     }
 
+    insertLoadedHeaders(headers, bCheckProofOfWork, count, callback);
+    if (bCheckProofOfWork) { checkUnanchoredProofOfWork(); }
+
     if (callback) callback(*this); // No need to interrupt since we're done.
 }
 
+void CoinQBlockTreeMem::loadSnapshot(const std::string& filename, CoinQBlockTreeMem::callback_t callback)
+{
+    readSnapshot(readFile(filename), true, true, callback);
+    if (callback) callback(*this); // No need to interrupt since we're done.
+}
+
+void CoinQBlockTreeMem::readSnapshot(const uchar_vector& data, bool bRequireCheckpoint, bool bCheckProofOfWork, CoinQBlockTreeMem::callback_t callback)
+{
+    if (data.size() < SNAPSHOT_PREFIX_SIZE + MIN_COIN_BLOCK_HEADER_SIZE + SNAPSHOT_CHECKSUM_SIZE) throw BlockTreeUnexpectedEndOfFileException();
+    if (!std::equal(SNAPSHOT_MAGIC, SNAPSHOT_MAGIC + sizeof(SNAPSHOT_MAGIC), data.begin())) throw BlockTreeInvalidFileTypeException();
+    if (getUint32(&data[4]) != SNAPSHOT_VERSION) throw BlockTreeUnsupportedSnapshotVersionException();
+
+    uchar_vector checksum = sha256_2(uchar_vector(data.begin(), data.end() - SNAPSHOT_CHECKSUM_SIZE));
+    if (!std::equal(checksum.begin(), checksum.end(), data.end() - SNAPSHOT_CHECKSUM_SIZE)) throw BlockTreeChecksumErrorException();
+
+    uint32_t baseHeight = getUint32(&data[8]);
+    BigInt chainWork(std::vector<unsigned char>(data.begin() + 12, data.begin() + 12 + SNAPSHOT_CHAINWORK_SIZE));
+    uint32_t nHeaders = getUint32(&data[12 + SNAPSHOT_CHAINWORK_SIZE]);
+    if (nHeaders == 0 || (uint64_t)baseHeight + nHeaders > (uint64_t)std::numeric_limits<int>::max() ||
+        data.size() != SNAPSHOT_PREFIX_SIZE + (uint64_t)nHeaders * MIN_COIN_BLOCK_HEADER_SIZE + SNAPSHOT_CHECKSUM_SIZE) throw BlockTreeInvalidFileLengthException();
+
+    // The hashes link every header to the one above it, so a checkpoint anywhere in the file vouches
+    // for the base.
+    if (bRequireCheckpoint)
+    {
+        auto itCheckpoint = mCheckpoints.lower_bound(baseHeight);
+        if (itCheckpoint == mCheckpoints.end() || itCheckpoint->first >= (int)(baseHeight + nHeaders)) throw BlockTreeSnapshotNotCheckpointedException();
+    }
+
+    clear();
+
+    const unsigned char* p = &data[SNAPSHOT_PREFIX_SIZE];
+    Coin::CoinBlockHeader baseHeader(uchar_vector(p, p + MIN_COIN_BLOCK_HEADER_SIZE));
+    try
+    {
+        setBaseBlock(baseHeader, baseHeight, chainWork);
+    }
+    catch (const std::exception& e)
+    {
+        throw std::runtime_error(std::string("Block ") + baseHeader.hash().getHex() + ": " + e.what());
+    }
+    if (callback && !callback(*this)) throw BlockTreeLoadInterruptedException();
+    LOGGER(debug) << "CoinQBlockTreeMem::loadFromFile() - base hash: " << baseHeader.hash().getHex() << " height: " << baseHeight << std::endl;
+
+    unsigned int count = 1;
+    std::vector<Coin::CoinBlockHeader> headers;
+    headers.reserve(HEADER_BATCH_SIZE);
+    for (uint32_t i = 1; i < nHeaders; i++)
+    {
+        p += MIN_COIN_BLOCK_HEADER_SIZE;
+        headers.push_back(Coin::CoinBlockHeader(uchar_vector(p, p + MIN_COIN_BLOCK_HEADER_SIZE)));
+        if (headers.size() >= HEADER_BATCH_SIZE)
+        {
+            insertLoadedHeaders(headers, bCheckProofOfWork, count, callback);
+            headers.clear();
+        }
+    }
+
+    insertLoadedHeaders(headers, bCheckProofOfWork, count, callback);
+    if (bCheckProofOfWork) { checkUnanchoredProofOfWork(); }
+}
+
+void CoinQBlockTreeMem::writeSnapshotStream(std::ostream& os, int baseHeight) const
+{
+    if (mBestHeight == -1) throw std::runtime_error("Tree is empty.");
+    if (baseHeight < mBaseHeight || baseHeight > mBestHeight) throw std::runtime_error("Invalid base height.");
+
+    uchar_vector data;
+    data.reserve(SNAPSHOT_PREFIX_SIZE + (mBestHeight - baseHeight + 1) * MIN_COIN_BLOCK_HEADER_SIZE + SNAPSHOT_CHECKSUM_SIZE);
+    data.insert(data.end(), SNAPSHOT_MAGIC, SNAPSHOT_MAGIC + sizeof(SNAPSHOT_MAGIC));
+    putUint32(data, SNAPSHOT_VERSION);
+    putUint32(data, baseHeight);
+
+    std::vector<unsigned char> chainWork = mHeaderHeightMap.at(baseHeight)->chainWork.getBytes();
+    if (chainWork.size() > SNAPSHOT_CHAINWORK_SIZE) throw std::runtime_error("Chain work is too big.");
+    data.insert(data.end(), SNAPSHOT_CHAINWORK_SIZE - chainWork.size(), 0);
+    data.insert(data.end(), chainWork.begin(), chainWork.end());
+
+    putUint32(data, mBestHeight - baseHeight + 1);
+    for (int i = baseHeight; i <= mBestHeight; i++)
+    {
+        uchar_vector headerBytes = mHeaderHeightMap.at(i)->getSerialized();
+        data.insert(data.end(), headerBytes.begin(), headerBytes.begin() + MIN_COIN_BLOCK_HEADER_SIZE);
+    }
+
+    uchar_vector checksum = sha256_2(data);
+    data.insert(data.end(), checksum.begin(), checksum.end());
+
+    os.write((const char*)&data[0], data.size());
+    if (os.bad()) throw BlockTreeFileWriteFailureException();
+}
+
+void CoinQBlockTreeMem::writeSnapshot(const std::string& filename, int baseHeight) const
+{
+    std::ofstream fs(filename, std::ios::binary | std::ios::trunc);
+    if (!fs.good()) throw BlockTreeFileWriteFailureException();
+    writeSnapshotStream(fs, baseHeight);
+}
+
 void CoinQBlockTreeMem::flushToFile(const std::string& filename)
 {
     if (mBestHeight == -1) throw std::runtime_error("Tree is empty.");
@@ -353,20 +646,27 @@ void CoinQBlockTreeMem::flushToFile(const std::string& filename)
         std::ofstream fs(filename + ".swp", std::ios::binary | std::ios::trunc);
 #endif
 
-        uchar_vector headerBytes, hash;
-
-        for (int i = 0; i <= mBestHeight; i++)
+        if (mBaseHeight > 0)
+        {
+            writeSnapshotStream(fs, mBaseHeight);
+        }
+        else
         {
-            ChainHeader* pHeader = mHeaderHeightMap.at(i);
+            uchar_vector headerBytes, hash;
 
-            headerBytes = pHeader->getSerialized();
-            hash = pHeader->hash();
+            for (int i = 0; i <= mBestHeight; i++)
+            {
+                ChainHeader* pHeader = mHeaderHeightMap.at(i);
+
+                headerBytes = pHeader->getSerialized();
+                hash = pHeader->hash();
 
-            fs.write((const char*)&headerBytes[0], MIN_COIN_BLOCK_HEADER_SIZE);
-            if (fs.bad()) throw BlockTreeFileWriteFailureException();
+                fs.write((const char*)&headerBytes[0], MIN_COIN_BLOCK_HEADER_SIZE);
+                if (fs.bad()) throw BlockTreeFileWriteFailureException();
 
-            fs.write((const char*)&hash[0], 4);
-            if (fs.bad()) throw BlockTreeFileWriteFailureException();
+                fs.write((const char*)&hash[0], 4);
+                if (fs.bad()) throw BlockTreeFileWriteFailureException();
+            }
         }
     }
 
@@ -377,4 +677,3 @@ void CoinQBlockTreeMem::flushToFile(const std::string& filename)
 
     bFlushed = true;
 }
-
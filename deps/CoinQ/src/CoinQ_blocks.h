@@ -11,6 +11,7 @@
 
 #pragma once
 
+#include "CoinQ_coinparams.h"
 #include "CoinQ_exceptions.h"
 #include "CoinQ_signals.h"
 #include "CoinQ_slots.h"
@@ -136,9 +137,13 @@ private:
     typedef std::map<unsigned int, ChainHeader*> header_height_map_t;
     header_height_map_t mHeaderHeightMap;
 
+    int mBaseHeight;
     int mBestHeight;
     BigInt mTotalWork;
 
+    typedef std::map<int, uchar_vector> checkpoint_map_t;
+    checkpoint_map_t mCheckpoints;
+
     ChainHeader* pHead;    
 
     bool bCheckTimestamp;
@@ -156,9 +161,9 @@ protected:
 
 public:
     CoinQBlockTreeMem(bool _bCheckTimestamp = true, bool _bCheckProofOfWork = true)
-        : bFlushed(true), mBestHeight(-1), mTotalWork(0), pHead(NULL), bCheckTimestamp(_bCheckTimestamp), bCheckProofOfWork(_bCheckProofOfWork) { }
+        : bFlushed(true), mBaseHeight(0), mBestHeight(-1), mTotalWork(0), pHead(NULL), bCheckTimestamp(_bCheckTimestamp), bCheckProofOfWork(_bCheckProofOfWork) { }
     CoinQBlockTreeMem(const Coin::CoinBlockHeader& header, bool _bCheckTimestamp = true, bool _bCheckProofOfWork = true)
-        : bFlushed(true), mBestHeight(-1), mTotalWork(0), pHead(NULL), bCheckTimestamp(_bCheckTimestamp), bCheckProofOfWork(_bCheckProofOfWork) { setGenesisBlock(header); }
+        : bFlushed(true), mBaseHeight(0), mBestHeight(-1), mTotalWork(0), pHead(NULL), bCheckTimestamp(_bCheckTimestamp), bCheckProofOfWork(_bCheckProofOfWork) { setGenesisBlock(header); }
 
     void subscribeAddBestChain(chain_header_slot_t slot) { notifyAddBestChain.connect(slot); }
     void subscribeRemoveBestChain(chain_header_slot_t slot) { notifyRemoveBestChain.connect(slot); }
@@ -173,10 +178,27 @@ public:
     void clearReorg() { notifyReorg.clear();; }
 
     void setGenesisBlock(const Coin::CoinBlockHeader& header);
+
+    // Roots the tree at a block other than the genesis block. Nothing below it can be added, and the
+    // chain work of later headers is counted from the one given.
+    void setBaseBlock(const Coin::CoinBlockHeader& header, int height, const BigInt& chainWork);
+    int getBaseHeight() const { return mBaseHeight; }
+
+    // Headers at checkpoint heights must match. Headers loaded from file at or below the highest
+    // checkpoint are not checked for proof of work. Kept by clear().
+    void setCheckpoints(const CoinQ::checkpoints_t& checkpoints);
+    int getTopCheckpointHeight() const { return mCheckpoints.empty() ? -1 : mCheckpoints.rbegin()->first; }
+
     bool isEmpty() const { return pHead == nullptr; }
     bool insertHeader(const Coin::CoinBlockHeader& header, bool bCheckProofOfWork = true, bool bReplaceTip = false);
     bool deleteHeader(const uchar_vector& hash);
 
+    // Checks the proof of work of headers from begin onward in up to nThreads chunks (0 for one per core), run
+    // on a shared pool of worker threads.
+    // Returns the index of the first invalid header, or headers.size() if all are valid. Headers before
+    // that index can then be inserted in order with bCheckProofOfWork = false.
+    static std::size_t getFirstInvalidProofOfWork(const std::vector<Coin::CoinBlockHeader>& headers, std::size_t begin = 0, unsigned int nThreads = 0);
+
     bool hasHeader(const uchar_vector& hash) const;
     const ChainHeader& getHeader(const uchar_vector& hash) const;
     const ChainHeader& getHeader(int height) const;
@@ -191,13 +213,33 @@ public:
     std::vector<uchar_vector> getLocatorHashes(int maxSize) const;
 
     int getConfirmations(const uchar_vector& hash) const;
-    void clear() { mHeaderHashMap.clear(); mHeaderHeightMap.clear(); mBestHeight = -1; mTotalWork = 0; pHead = NULL; }
+    void clear() { mHeaderHashMap.clear(); mHeaderHeightMap.clear(); mBaseHeight = 0; mBestHeight = -1; mTotalWork = 0; pHead = NULL; }
 
     typedef std::function<bool(const CoinQBlockTreeMem&)> callback_t;
+
+    // Reads either a file written by flushToFile() or a header snapshot.
     void loadFromFile(const std::string& filename, bool bCheckProofOfWork = true, callback_t callback = nullptr); 
 
+    // Starts the tree from a header snapshot instead of the genesis block. The snapshot must reach one of
+    // the checkpoints, which vouches for everything below it. Headers above the highest checkpoint are
+    // checked for proof of work.
+    void loadSnapshot(const std::string& filename, callback_t callback = nullptr);
+
+    // Trees rooted above the genesis block are written as snapshots.
     void flushToFile(const std::string& filename);
 
+    // Writes the best chain from baseHeight up. The file holds the chain work at the base and ends with
+    // a double SHA-256 of its contents.
+    void writeSnapshot(const std::string& filename, int baseHeight) const;
+
     bool flushed() const { return bFlushed; }
+
+private:
+    // Headers read from file extend the best chain in order.
+    void insertLoadedHeaders(const std::vector<Coin::CoinBlockHeader>& headers, bool bCheckProofOfWork, unsigned int& count, callback_t callback);
+    void checkUnanchoredProofOfWork() const;
+
+    void readSnapshot(const uchar_vector& data, bool bRequireCheckpoint, bool bCheckProofOfWork, callback_t callback);
+    void writeSnapshotStream(std::ostream& os, int baseHeight) const;
 };
 
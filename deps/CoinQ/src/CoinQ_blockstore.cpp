@@ -0,0 +1,322 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// CoinQ_blockstore.cpp
+//
+// Copyright (c) 2011-2016 Ciphrex Corp.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+//
+
+#include "CoinQ_blockstore.h"
+
+#include <logger/logger.h>
+
+#include <boost/filesystem.hpp>
+
+#include <cstdio>
+#include <stdexcept>
+#include <vector>
+
+using namespace CoinQ;
+
+namespace
+{
+    const char INDEX_FILE[] = "index.dat";
+
+    // hash, height, file, offset, size
+    const std::size_t INDEX_RECORD_SIZE = 32 + 4 + 4 + 4 + 4;
+
+    // magic, size
+    const std::size_t FRAME_SIZE = 4 + 4;
+
+    void putUint(unsigned char* p, uint64_t value, std::size_t size)
+    {
+        for (std::size_t i = 0; i < size; i++) { p[i] = (value >> (8 * i)) & 0xff; }
+    }
+
+    uint64_t getUint(const unsigned char* p, std::size_t size)
+    {
+        uint64_t value = 0;
+        for (std::size_t i = 0; i < size; i++) { value |= (uint64_t)p[i] << (8 * i); }
+        return value;
+    }
+}
+
+BlockStore::BlockStore() :
+    magic_bytes_(0),
+    max_file_size_(DEFAULT_MAX_FILE_SIZE),
+    bOpen(false),
+    fileNumber_(0),
+    fileSize_(0)
+{
+}
+
+BlockStore::~BlockStore()
+{
+    close();
+}
+
+void BlockStore::open(const std::string& dirpath, uint32_t magic_bytes, uint32_t max_file_size)
+{
+    namespace fs = boost::filesystem;
+
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    if (bOpen) throw std::runtime_error("BlockStore - already open.");
+
+    dirpath_ = dirpath;
+    magic_bytes_ = magic_bytes;
+    max_file_size_ = max_file_size;
+    hashes_.clear();
+    heights_.clear();
+    fileNumber_ = 0;
+
+    boost::system::error_code ec;
+    fs::create_directories(dirpath_, ec);
+    if (ec) throw std::runtime_error(std::string("BlockStore - cannot create directory: ") + ec.message());
+
+    // Replay the index. A record cut short by a crash is dropped.
+    fs::path indexPath = fs::path(dirpath_) / INDEX_FILE;
+    if (fs::exists(indexPath))
+    {
+        uintmax_t indexSize = fs::file_size(indexPath);
+        uintmax_t validSize = indexSize - indexSize % INDEX_RECORD_SIZE;
+
+        std::ifstream index(indexPath.string(), std::ios::in | std::ios::binary);
+        if (!index) throw std::runtime_error("BlockStore - cannot read index.");
+
+        unsigned char record[INDEX_RECORD_SIZE];
+        for (uintmax_t pos = 0; pos < validSize; pos += INDEX_RECORD_SIZE)
+        {
+            if (!index.read((char*)record, INDEX_RECORD_SIZE)) throw std::runtime_error("BlockStore - cannot read index.");
+
+            bytes_t hash(record, record + 32);
+            Location location;
+            location.height = getUint(record + 32, 4);
+            location.file = getUint(record + 36, 4);
+            location.offset = getUint(record + 40, 4);
+            location.size = getUint(record + 44, 4);
+
+            hashes_[hash] = location;
+            setHeight(hash, location.height);
+            if (location.file > fileNumber_) { fileNumber_ = location.file; }
+        }
+        index.close();
+
+        if (validSize != indexSize)
+        {
+            LOGGER(warning) << "BlockStore - dropping " << (indexSize - validSize) << " bytes at the end of the index." << std::endl;
+            fs::resize_file(indexPath, validSize);
+        }
+    }
+
+    // Make sure existing block files belong to this network.
+    std::ifstream first(blockFilePath(0), std::ios::in | std::ios::binary);
+    if (first)
+    {
+        unsigned char magic[4];
+        if (first.read((char*)magic, sizeof(magic)) && getUint(magic, 4) != magic_bytes_)
+            throw std::runtime_error("BlockStore - block files were written for a different network.");
+    }
+
+    index_.open(indexPath.string(), std::ios::out | std::ios::app | std::ios::binary);
+    if (!index_) throw std::runtime_error("BlockStore - cannot open index for writing.");
+
+    openBlockFile(fileNumber_);
+    bOpen = true;
+
+    LOGGER(debug) << "BlockStore - opened " << dirpath_ << " with " << heights_.size() << " blocks." << std::endl;
+}
+
+void BlockStore::close()
+{
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    if (!bOpen) return;
+
+    index_.close();
+    file_.close();
+    hashes_.clear();
+    heights_.clear();
+    bOpen = false;
+}
+
+bool BlockStore::isOpen() const
+{
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    return bOpen;
+}
+
+void BlockStore::append(const Coin::CoinBlock& block, uint32_t height)
+{
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    if (!bOpen) throw std::runtime_error("BlockStore - not open.");
+
+    const bytes_t& hash = block.hash();
+
+    Location location;
+    auto it = hashes_.find(hash);
+    if (it != hashes_.end())
+    {
+        // Already on disk - only the height needs recording.
+        location = it->second;
+        location.height = height;
+    }
+    else
+    {
+        uchar_vector raw = block.getSerialized();
+        if (fileSize_ > 0 && fileSize_ + FRAME_SIZE + raw.size() > max_file_size_) { openBlockFile(fileNumber_ + 1); }
+
+        unsigned char frame[FRAME_SIZE];
+        putUint(frame, magic_bytes_, 4);
+        putUint(frame + 4, raw.size(), 4);
+        file_.write((const char*)frame, FRAME_SIZE);
+        file_.write((const char*)raw.data(), raw.size());
+        file_.flush();
+        if (!file_) throw std::runtime_error("BlockStore - failed to write block file.");
+
+        location.height = height;
+        location.file = fileNumber_;
+        location.offset = fileSize_ + FRAME_SIZE;
+        location.size = raw.size();
+        fileSize_ += FRAME_SIZE + raw.size();
+    }
+
+    unsigned char record[INDEX_RECORD_SIZE];
+    std::copy(hash.begin(), hash.end(), record);
+    putUint(record + 32, location.height, 4);
+    putUint(record + 36, location.file, 4);
+    putUint(record + 40, location.offset, 4);
+    putUint(record + 44, location.size, 4);
+    index_.write((const char*)record, INDEX_RECORD_SIZE);
+    index_.flush();
+    if (!index_) throw std::runtime_error("BlockStore - failed to write index.");
+
+    hashes_[hash] = location;
+    setHeight(hash, height);
+}
+
+std::size_t BlockStore::size() const
+{
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    return heights_.size();
+}
+
+bool BlockStore::hasBlock(const bytes_t& hash) const
+{
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    return hashes_.count(hash) > 0;
+}
+
+int BlockStore::getBestHeight() const
+{
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    return heights_.empty() ? -1 : (int)heights_.rbegin()->first;
+}
+
+int BlockStore::getFirstHeight() const
+{
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    return heights_.empty() ? -1 : (int)heights_.begin()->first;
+}
+
+bytes_t BlockStore::getHash(uint32_t height) const
+{
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    auto it = heights_.find(height);
+    if (it == heights_.end()) throw std::runtime_error("BlockStore - no block at that height.");
+    return it->second;
+}
+
+BlockStore::Location BlockStore::getLocation(const bytes_t& hash) const
+{
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    auto it = hashes_.find(hash);
+    if (it == hashes_.end()) throw std::runtime_error("BlockStore - block not found.");
+    return it->second;
+}
+
+bytes_t BlockStore::getRawBlock(const bytes_t& hash) const
+{
+    Location location = getLocation(hash);
+    std::ifstream file;
+    uint32_t openFile = (uint32_t)-1;
+    return readRawBlock(file, openFile, location);
+}
+
+Coin::CoinBlock BlockStore::getBlock(const bytes_t& hash) const
+{
+    return Coin::CoinBlock(getRawBlock(hash));
+}
+
+Coin::CoinBlock BlockStore::getBlock(uint32_t height) const
+{
+    return getBlock(getHash(height));
+}
+
+void BlockStore::readBlocks(uint32_t startHeight, block_callback_t callback) const
+{
+    std::vector<Location> locations;
+    {
+        boost::lock_guard<boost::mutex> lock(mutex_);
+        for (auto it = heights_.lower_bound(startHeight); it != heights_.end(); ++it)
+        {
+            locations.push_back(hashes_.at(it->second));
+        }
+    }
+
+    std::ifstream file;
+    uint32_t openFile = (uint32_t)-1;
+    for (auto& location: locations)
+    {
+        Coin::CoinBlock block(readRawBlock(file, openFile, location));
+        if (!callback(block, location.height)) break;
+    }
+}
+
+std::string BlockStore::blockFilePath(uint32_t fileNumber) const
+{
+    char filename[16];
+    std::snprintf(filename, sizeof(filename), "blk%05u.dat", fileNumber);
+    return (boost::filesystem::path(dirpath_) / filename).string();
+}
+
+void BlockStore::openBlockFile(uint32_t fileNumber)
+{
+    namespace fs = boost::filesystem;
+
+    if (file_.is_open()) { file_.close(); }
+
+    std::string filepath = blockFilePath(fileNumber);
+    fileSize_ = fs::exists(filepath) ? fs::file_size(filepath) : 0;
+    file_.open(filepath, std::ios::out | std::ios::app | std::ios::binary);
+    if (!file_) throw std::runtime_error("BlockStore - cannot open block file for writing.");
+    fileNumber_ = fileNumber;
+}
+
+void BlockStore::setHeight(const bytes_t& hash, uint32_t height)
+{
+    heights_.erase(heights_.lower_bound(height), heights_.end());
+    heights_[height] = hash;
+    hashes_[hash].height = height;
+}
+
+bytes_t BlockStore::readRawBlock(std::ifstream& file, uint32_t& openFile, const Location& location) const
+{
+    if (openFile != location.file)
+    {
+        if (file.is_open()) { file.close(); }
+        file.clear();
+        file.open(blockFilePath(location.file), std::ios::in | std::ios::binary);
+        if (!file) throw std::runtime_error("BlockStore - cannot open block file.");
+        openFile = location.file;
+    }
+
+    unsigned char frame[FRAME_SIZE];
+    file.seekg(location.offset - FRAME_SIZE);
+    if (!file.read((char*)frame, FRAME_SIZE) || getUint(frame, 4) != magic_bytes_ || getUint(frame + 4, 4) != location.size)
+        throw std::runtime_error("BlockStore - block file is corrupt.");
+
+    bytes_t raw(location.size);
+    if (!file.read((char*)raw.data(), raw.size())) throw std::runtime_error("BlockStore - block file is truncated.");
+    return raw;
+}
@@ -0,0 +1,114 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// CoinQ_blockstore.h
+//
+// Copyright (c) 2011-2016 Ciphrex Corp.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+//
+
+#pragma once
+
+#include <CoinCore/typedefs.h>
+#include <CoinCore/CoinNodeData.h>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/lock_guard.hpp>
+
+#include <fstream>
+#include <functional>
+#include <map>
+#include <string>
+#include <stdint.h>
+
+namespace CoinQ
+{
+
+// Append-only archive of full blocks, indexed by hash and by height.
+//
+// Blocks go into blk00000.dat, blk00001.dat, ... framed as in Bitcoin Core's block files: the 4-byte
+// network magic, the 4-byte block size and the serialized block. Once a block is written, a 48-byte
+// record is appended to index.dat: block hash, height, file number, offset and size, little endian.
+// Opening the store replays the index. A block whose index record was never written is ignored and
+// its space in the block file is not reused.
+//
+// The height index holds the best chain. Appending a block at some height drops whatever the index
+// had at that height and above, which is how a reorg is recorded. Dropped blocks stay on disk and
+// can still be read by hash.
+//
+// All methods are thread-safe.
+class BlockStore
+{
+public:
+    static const uint32_t DEFAULT_MAX_FILE_SIZE = 0x8000000; // 128 MiB
+
+    struct Location
+    {
+        uint32_t height;
+        uint32_t file;
+        uint32_t offset;    // of the serialized block, past the framing
+        uint32_t size;
+    };
+
+    BlockStore();
+    ~BlockStore();
+
+    // Creates the directory if needed. Throws std::runtime_error if the store cannot be read or its
+    // files were written for another network.
+    void open(const std::string& dirpath, uint32_t magic_bytes, uint32_t max_file_size = DEFAULT_MAX_FILE_SIZE);
+    void close();
+    bool isOpen() const;
+
+    const std::string& dirpath() const { return dirpath_; }
+
+    void append(const Coin::CoinBlock& block, uint32_t height);
+
+    // Number of blocks in the height index.
+    std::size_t size() const;
+
+    bool hasBlock(const bytes_t& hash) const;
+
+    // -1 when the store is empty.
+    int getBestHeight() const;
+    int getFirstHeight() const;
+
+    // Throw std::runtime_error if there is no such block.
+    bytes_t getHash(uint32_t height) const;
+    Location getLocation(const bytes_t& hash) const;
+    Coin::CoinBlock getBlock(const bytes_t& hash) const;
+    Coin::CoinBlock getBlock(uint32_t height) const;
+    bytes_t getRawBlock(const bytes_t& hash) const;
+
+    // Calls back with each best chain block from startHeight up, in height order, reading each block
+    // file front to back. Return false from the callback to stop early. The index is only locked while
+    // the list of blocks is taken, so appends may continue meanwhile.
+    typedef std::function<bool(const Coin::CoinBlock& /*block*/, uint32_t /*height*/)> block_callback_t;
+    void readBlocks(uint32_t startHeight, block_callback_t callback) const;
+
+private:
+    mutable boost::mutex mutex_;
+
+    std::string dirpath_;
+    uint32_t magic_bytes_;
+    uint32_t max_file_size_;
+    bool bOpen;
+
+    typedef std::map<bytes_t, Location> hash_map_t;
+    hash_map_t hashes_;
+
+    typedef std::map<uint32_t, bytes_t> height_map_t;
+    height_map_t heights_;
+
+    std::ofstream index_;
+    std::ofstream file_;
+    uint32_t fileNumber_;
+    uint32_t fileSize_;
+
+    std::string blockFilePath(uint32_t fileNumber) const;
+    void openBlockFile(uint32_t fileNumber);
+    void setHeight(const bytes_t& hash, uint32_t height);
+    bytes_t readRawBlock(std::ifstream& file, uint32_t& openFile, const Location& location) const;
+};
+
+}
@@ -66,6 +66,25 @@ void NetworkSelector::select(const std::string& network_name)
 
 
 // Coins can be added here
+
+// Checkpoints must be in the best chain of every node. Only add blocks buried deep enough that they
+// can never be reorganized away.
+const checkpoints_t bitcoinCheckpoints = {
+    {  11111, uchar_vector("0000000069e244f73d78e8fd29ba2fd2ed618bd6fa2ee92559f542fdb26e7c1d") },
+    {  33333, uchar_vector("000000002dd5588a74784eaa7ab0507a18ad16a236e7b1ce69f00d7ddfb5d0a6") },
+    {  74000, uchar_vector("0000000000573993a3c9e41ce34471c079dcf5f52a0e824a81e7f953b8661a20") },
+    { 105000, uchar_vector("00000000000291ce28027faea320c8d2b054b2e0fe44a773f3eefb151d6bdc97") },
+    { 134444, uchar_vector("00000000000005b12ffd4cd315cd34ffd4a594f430ac814c91184a0d42d2b0fe") },
+    { 168000, uchar_vector("000000000000099e61ea72015e79632f216fe6cb33d7899acb35b75c8303b763") },
+    { 193000, uchar_vector("000000000000059f452a5f7340de6682a977387c17010ff6e6c3bd83ca8b1317") },
+    { 210000, uchar_vector("000000000000048b95347e83192f69cf0366076336c639f9b7228e9ba171342e") },
+    { 216116, uchar_vector("00000000000001b4f4b433e81ee46494af945cf96014816a4e2370f11b23df4e") },
+    { 225430, uchar_vector("00000000000001c108384350f74090433e7fcf79a606b8e797f065b130575932") },
+    { 250000, uchar_vector("000000000000003887df1f29024b06fc2200b55f8af8f35453d7be294df2d214") },
+    { 279000, uchar_vector("0000000000000001ae8c72a0b0c301f67e3afca10e819efa9041e458e9bd7e40") },
+    { 295000, uchar_vector("00000000000000004d9b4ef50f0f9d686fd69db2e03af35a100370c64632a983") }
+};
+
 const CoinParams bitcoinParams(
     0xd9b4bef9ul,
     70001,
@@ -90,10 +109,17 @@ const CoinParams bitcoinParams(
         2083236893,
         uchar_vector(32, 0),
         uchar_vector("4a5e1e4baab89f3a32518a88c31bc87f618f76673e2cc77ab2127b7afdeda33b")
-    )
+    ),
+    false,
+    nullptr,
+    bitcoinCheckpoints
 );
 const CoinParams& getBitcoinParams() { return bitcoinParams; }
 
+const checkpoints_t testnet3Checkpoints = {
+    {    546, uchar_vector("000000002a936ca763904c3c35fce2f3556c559c0214345d31b1bcebf76acb70") }
+};
+
 const CoinParams testnet3Params(
     0x0709110bul,
     70001,
@@ -119,7 +145,9 @@ const CoinParams testnet3Params(
         uchar_vector(32, 0),
         uchar_vector("4a5e1e4baab89f3a32518a88c31bc87f618f76673e2cc77ab2127b7afdeda33b")
     ),
-    true
+    true,
+    nullptr,
+    testnet3Checkpoints
 );
 const CoinParams& getTestnet3Params() { return testnet3Params; }
 
@@ -148,7 +176,8 @@ const CoinParams litecoinParams(
         uchar_vector(32, 0),
         uchar_vector("97ddfbbae6be97fd6cdf3e7ca13232a3afff2353e29badfab7f73011edd4ced9")
     ),
-    true
+    true,
+    &scrypt_1024_1_1_256_batch
 );
 const CoinParams& getLitecoinParams() { return litecoinParams; }
 
@@ -176,7 +205,9 @@ const CoinParams ltcTestnet4Params(
         293345,
         uchar_vector(32, 0),
         uchar_vector("97ddfbbae6be97fd6cdf3e7ca13232a3afff2353e29badfab7f73011edd4ced9")
-    )
+    ),
+    false,
+    &scrypt_1024_1_1_256_batch
 );
 const CoinParams& getLtcTestnet4Params() { return ltcTestnet4Params; }
 
@@ -204,7 +235,9 @@ const CoinParams quarkcoinParams(
         12058113,
         uchar_vector(32, 0),
         uchar_vector("868b2fb28cb1a0b881480cc85eb207e29e6ae75cdd6d26688ed34c2d2d23c776")
-    )
+    ),
+    false,
+    &hash9_batch
 );
 const CoinParams& getQuarkcoinParams() { return quarkcoinParams; }
 
@@ -20,6 +20,16 @@
 
 namespace CoinQ {
 
+// A block known to be in the best chain. Headers at or below the highest checkpoint are linked to it
+// by their hashes, so their proof of work need not be checked.
+struct Checkpoint
+{
+    int height;
+    uchar_vector hash;  // same byte order as Coin::CoinBlockHeader::hash()
+};
+
+typedef std::vector<Checkpoint> checkpoints_t;
+
 class CoinParams
 {
 public:
@@ -43,7 +53,9 @@ public:
         Coin::hashfunc_t block_header_hash_function,
         Coin::hashfunc_t block_header_pow_hash_function,
         const Coin::CoinBlockHeader& genesis_block,
-        bool segwit_enabled = false) :
+        bool segwit_enabled = false,
+        Coin::batchhashfunc_t block_header_pow_batch_hash_function = nullptr,
+        const checkpoints_t& checkpoints = checkpoints_t()) :
     magic_bytes_(magic_bytes),
     protocol_version_(protocol_version),
     default_port_(default_port),
@@ -61,7 +73,9 @@ public:
     block_header_hash_function_(block_header_hash_function),
     block_header_pow_hash_function_(block_header_pow_hash_function),
     genesis_block_(genesis_block),
-    segwit_enabled_(segwit_enabled)
+    segwit_enabled_(segwit_enabled),
+    block_header_pow_batch_hash_function_(block_header_pow_batch_hash_function),
+    checkpoints_(checkpoints)
     {
         address_versions_[0] = pay_to_pubkey_hash_version_;
         address_versions_[1] = pay_to_script_hash_version_;
@@ -95,6 +109,8 @@ public:
     Coin::hashfunc_t                block_header_pow_hash_function() const { return block_header_pow_hash_function_; }
     const Coin::CoinBlockHeader&    genesis_block() const { return genesis_block_; }
     bool                            segwit_enabled() const { return segwit_enabled_; }
+    Coin::batchhashfunc_t           block_header_pow_batch_hash_function() const { return block_header_pow_batch_hash_function_; } // Null if headers are hashed one at a time.
+    const checkpoints_t&            checkpoints() const { return checkpoints_; } // By increasing height.
 
 private:
     uint32_t                magic_bytes_;
@@ -117,6 +133,8 @@ private:
     Coin::hashfunc_t        block_header_pow_hash_function_;
     Coin::CoinBlockHeader   genesis_block_;
     bool                    segwit_enabled_;
+    Coin::batchhashfunc_t   block_header_pow_batch_hash_function_;
+    checkpoints_t           checkpoints_;
 };
 
 typedef std::pair<std::string, const CoinParams&> NetworkPair;
@@ -33,7 +33,9 @@ enum ErrorCodes
     BLOCKTREE_CHECKSUM_ERROR,
     BLOCKTREE_LOAD_INTERRUPTED,
     BLOCKTREE_UNEXPECTED_END_OF_FILE,
-    BLOCKTREE_SWAPFILE_ALREADY_EXISTS
+    BLOCKTREE_SWAPFILE_ALREADY_EXISTS,
+    BLOCKTREE_UNSUPPORTED_SNAPSHOT_VERSION,
+    BLOCKTREE_SNAPSHOT_NOT_CHECKPOINTED
 };
 
 // NETWORK SELECTOR EXCEPTIONS
@@ -133,5 +135,17 @@ public:
     explicit BlockTreeSwapfileAlreadyExistsException() : BlockTreeException("Blocktree swapfile already exists.", BLOCKTREE_SWAPFILE_ALREADY_EXISTS) { }
 };
 
+class BlockTreeUnsupportedSnapshotVersionException : public BlockTreeException
+{
+public:
+    explicit BlockTreeUnsupportedSnapshotVersionException() : BlockTreeException("Blocktree unsupported snapshot version.", BLOCKTREE_UNSUPPORTED_SNAPSHOT_VERSION) { }
+};
+
+class BlockTreeSnapshotNotCheckpointedException : public BlockTreeException
+{
+public:
+    explicit BlockTreeSnapshotNotCheckpointedException() : BlockTreeException("Blocktree snapshot does not reach a checkpoint.", BLOCKTREE_SNAPSHOT_NOT_CHECKPOINTED) { }
+};
+
 }
 
@@ -0,0 +1,297 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// CoinQ_mempool.cpp
+//
+// Copyright (c) 2011-2016 Ciphrex Corp.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+//
+
+#include "CoinQ_mempool.h"
+
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+
+using namespace CoinQ::Network;
+
+// Slots are value-initialized so new tables start out EMPTY.
+static const std::size_t MIN_CAPACITY = 64;
+
+static uint32_t now()
+{
+    return (uint32_t)std::time(nullptr);
+}
+
+MempoolTracker::MempoolTracker(std::size_t maxSize, uint32_t maxAge) :
+    m_slots(MIN_CAPACITY),
+    m_size(0),
+    m_deleted(0),
+    m_nextSeq(0),
+    m_maxSize(maxSize),
+    m_maxAge(maxAge),
+    m_inserted(0),
+    m_confirmed(0),
+    m_erased(0),
+    m_expired(0),
+    m_evicted(0)
+{
+}
+
+void MempoolTracker::setLimits(std::size_t maxSize, uint32_t maxAge)
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    m_maxSize = maxSize;
+    m_maxAge = maxAge;
+    expire_unwrapped(now());
+    if (m_maxSize && m_size > m_maxSize) { evict_unwrapped(m_maxSize); }
+}
+
+bool MempoolTracker::insert(const bytes_t& txHash)
+{
+    hash_t hash;
+    if (!toHash(txHash, hash)) return false;
+
+    uint32_t timestamp = now();
+
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    expire_unwrapped(timestamp);
+    if (find(hash) != m_slots.size()) return false;
+
+    if (m_maxSize && m_size >= m_maxSize) { evict_unwrapped(m_maxSize - 1); }
+    return insert_unwrapped(hash, timestamp);
+}
+
+bool MempoolTracker::contains(const bytes_t& txHash) const
+{
+    hash_t hash;
+    if (!toHash(txHash, hash)) return false;
+
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    return find(hash) != m_slots.size();
+}
+
+bool MempoolTracker::erase(const bytes_t& txHash)
+{
+    hash_t hash;
+    if (!toHash(txHash, hash)) return false;
+
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    std::size_t slot = find(hash);
+    if (slot == m_slots.size()) return false;
+
+    erase_unwrapped(slot);
+    m_erased++;
+    return true;
+}
+
+void MempoolTracker::clear()
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    m_slots.assign(MIN_CAPACITY, Slot());
+    m_order.clear();
+    m_size = 0;
+    m_deleted = 0;
+}
+
+std::size_t MempoolTracker::confirm(const std::deque<bytes_t>& txHashes, std::vector<bytes_t>& confirmed)
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    std::size_t count = 0;
+    for (auto& txHash: txHashes)
+    {
+        hash_t hash;
+        if (!toHash(txHash, hash)) break;
+
+        std::size_t slot = find(hash);
+        if (slot == m_slots.size()) break;
+
+        erase_unwrapped(slot);
+        confirmed.push_back(txHash);
+        count++;
+    }
+
+    m_confirmed += count;
+    return count;
+}
+
+std::size_t MempoolTracker::expire()
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    return expire_unwrapped(now());
+}
+
+std::size_t MempoolTracker::size() const
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    return m_size;
+}
+
+MempoolTracker::Stats MempoolTracker::getStats() const
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    Stats stats;
+    stats.size = m_size;
+    stats.capacity = m_slots.size();
+    stats.maxSize = m_maxSize;
+    stats.maxAge = m_maxAge;
+    stats.oldestTimestamp = 0;
+    for (auto& record: m_order)
+    {
+        if (!isLive(record)) continue;
+        stats.oldestTimestamp = m_slots[record.slot].timestamp;
+        break;
+    }
+    stats.inserted = m_inserted;
+    stats.confirmed = m_confirmed;
+    stats.erased = m_erased;
+    stats.expired = m_expired;
+    stats.evicted = m_evicted;
+    return stats;
+}
+
+bool MempoolTracker::toHash(const bytes_t& bytes, hash_t& hash)
+{
+    if (bytes.size() != HASH_SIZE) return false;
+    std::memcpy(hash.data(), bytes.data(), HASH_SIZE);
+    return true;
+}
+
+std::size_t MempoolTracker::hashIndex(const hash_t& hash, std::size_t mask)
+{
+    // Transaction hashes are already uniformly distributed so any eight bytes will do.
+    uint64_t h;
+    std::memcpy(&h, hash.data(), sizeof(h));
+    return (std::size_t)h & mask;
+}
+
+std::size_t MempoolTracker::find(const hash_t& hash) const
+{
+    std::size_t capacity = m_slots.size();
+    std::size_t mask = capacity - 1;
+    std::size_t i = hashIndex(hash, mask);
+    for (std::size_t probes = 0; probes < capacity; probes++)
+    {
+        const Slot& slot = m_slots[i];
+        if (slot.state == EMPTY) break;
+        if (slot.state == OCCUPIED && slot.hash == hash) return i;
+        i = (i + 1) & mask;
+    }
+    return capacity;
+}
+
+bool MempoolTracker::insert_unwrapped(const hash_t& hash, uint32_t timestamp)
+{
+    // Keep the load factor including tombstones under 3/4.
+    if ((m_size + m_deleted + 1) * 4 > m_slots.size() * 3) { rehash((m_size + 1) * 2); }
+
+    std::size_t mask = m_slots.size() - 1;
+    std::size_t i = hashIndex(hash, mask);
+    while (m_slots[i].state == OCCUPIED) { i = (i + 1) & mask; }
+
+    Slot& slot = m_slots[i];
+    if (slot.state == DELETED) { m_deleted--; }
+    slot.hash = hash;
+    slot.timestamp = timestamp;
+    slot.seq = m_nextSeq++;
+    slot.state = OCCUPIED;
+    m_size++;
+    m_inserted++;
+
+    OrderRecord record;
+    record.slot = i;
+    record.seq = slot.seq;
+    m_order.push_back(record);
+    return true;
+}
+
+void MempoolTracker::erase_unwrapped(std::size_t slot)
+{
+    m_slots[slot].state = DELETED;
+    m_size--;
+    m_deleted++;
+
+    // Drop stale order records once they dominate the queue.
+    if (m_order.size() > 2 * m_size + MIN_CAPACITY)
+    {
+        std::deque<OrderRecord> order;
+        for (auto& record: m_order) { if (isLive(record)) order.push_back(record); }
+        m_order.swap(order);
+    }
+}
+
+bool MempoolTracker::isLive(const OrderRecord& record) const
+{
+    const Slot& slot = m_slots[record.slot];
+    return slot.state == OCCUPIED && slot.seq == record.seq;
+}
+
+void MempoolTracker::popStaleOrder()
+{
+    while (!m_order.empty() && !isLive(m_order.front())) { m_order.pop_front(); }
+}
+
+std::size_t MempoolTracker::expire_unwrapped(uint32_t now)
+{
+    if (!m_maxAge || now < m_maxAge) return 0;
+
+    uint32_t cutoff = now - m_maxAge;
+    std::size_t count = 0;
+    popStaleOrder();
+    while (!m_order.empty() && m_slots[m_order.front().slot].timestamp < cutoff)
+    {
+        std::size_t slot = m_order.front().slot;
+        m_order.pop_front();
+        erase_unwrapped(slot);
+        count++;
+        popStaleOrder();
+    }
+
+    m_expired += count;
+    return count;
+}
+
+void MempoolTracker::evict_unwrapped(std::size_t targetSize)
+{
+    popStaleOrder();
+    while (m_size > targetSize && !m_order.empty())
+    {
+        std::size_t slot = m_order.front().slot;
+        m_order.pop_front();
+        erase_unwrapped(slot);
+        m_evicted++;
+        popStaleOrder();
+    }
+}
+
+void MempoolTracker::rehash(std::size_t capacity)
+{
+    std::size_t newCapacity = MIN_CAPACITY;
+    while (newCapacity < capacity) { newCapacity <<= 1; }
+
+    std::vector<Slot> slots(newCapacity);
+
+    // Reinsert in insertion order so the order queue stays sorted.
+    std::deque<OrderRecord> order;
+    std::size_t mask = newCapacity - 1;
+    for (auto& record: m_order)
+    {
+        if (!isLive(record)) continue;
+
+        const Slot& oldSlot = m_slots[record.slot];
+        std::size_t i = hashIndex(oldSlot.hash, mask);
+        while (slots[i].state == OCCUPIED) { i = (i + 1) & mask; }
+        slots[i] = oldSlot;
+
+        OrderRecord newRecord;
+        newRecord.slot = i;
+        newRecord.seq = record.seq;
+        order.push_back(newRecord);
+    }
+
+    m_slots.swap(slots);
+    m_order.swap(order);
+    m_deleted = 0;
+}
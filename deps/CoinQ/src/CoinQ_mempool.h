@@ -0,0 +1,129 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// CoinQ_mempool.h
+//
+// Copyright (c) 2011-2016 Ciphrex Corp.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+//
+
+#pragma once
+
+#include "CoinQ_typedefs.h"
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+
+#include <array>
+#include <deque>
+#include <vector>
+#include <stdint.h>
+
+namespace CoinQ
+{
+    namespace Network
+    {
+
+// Tracks the hashes of relevant unconfirmed transactions we've seen so that merkle block
+// confirmations can be matched without re-requesting transactions.
+//
+// Hashes are stored in an open-addressing table keyed on the fixed-size hash. Entries are
+// expired once they are older than maxAge seconds and the oldest entries are evicted when
+// maxSize is reached so that long-running instances do not grow without bound.
+class MempoolTracker
+{
+public:
+    enum { HASH_SIZE = 32 };
+    enum { DEFAULT_MAX_SIZE = 100000 };
+    enum { DEFAULT_MAX_AGE = 14 * 24 * 60 * 60 }; // two weeks, same as bitcoind's default mempool expiry
+
+    struct Stats
+    {
+        std::size_t size;
+        std::size_t capacity;
+        std::size_t maxSize;
+        uint32_t maxAge;
+        uint32_t oldestTimestamp;   // 0 if empty
+        uint64_t inserted;
+        uint64_t confirmed;
+        uint64_t erased;
+        uint64_t expired;
+        uint64_t evicted;
+    };
+
+    explicit MempoolTracker(std::size_t maxSize = DEFAULT_MAX_SIZE, uint32_t maxAge = DEFAULT_MAX_AGE);
+
+    // A maxSize or maxAge of zero disables the corresponding limit.
+    void setLimits(std::size_t maxSize, uint32_t maxAge);
+
+    // Returns false if the hash was already present or is not a valid hash.
+    bool insert(const bytes_t& txHash);
+    bool contains(const bytes_t& txHash) const;
+    bool erase(const bytes_t& txHash);
+    void clear();
+
+    // Erases the longest prefix of txHashes that is present in the mempool under a single lock.
+    // The erased hashes are appended to confirmed in order. Returns the number of hashes erased.
+    std::size_t confirm(const std::deque<bytes_t>& txHashes, std::vector<bytes_t>& confirmed);
+
+    // Removes all entries older than maxAge. Returns the number of entries removed.
+    std::size_t expire();
+
+    std::size_t size() const;
+    Stats getStats() const;
+
+private:
+    typedef std::array<unsigned char, HASH_SIZE> hash_t;
+
+    enum SlotState { EMPTY = 0, OCCUPIED, DELETED };
+
+    struct Slot
+    {
+        hash_t hash;
+        uint32_t timestamp;
+        uint64_t seq;
+        unsigned char state;
+    };
+
+    // Insertion order used for age expiry and size eviction. Erased slots leave stale
+    // records behind which are detected by comparing sequence numbers.
+    struct OrderRecord
+    {
+        std::size_t slot;
+        uint64_t seq;
+    };
+
+    mutable boost::mutex m_mutex;
+
+    std::vector<Slot> m_slots;
+    std::deque<OrderRecord> m_order;
+    std::size_t m_size;
+    std::size_t m_deleted;
+    uint64_t m_nextSeq;
+
+    std::size_t m_maxSize;
+    uint32_t m_maxAge;
+
+    uint64_t m_inserted;
+    uint64_t m_confirmed;
+    uint64_t m_erased;
+    uint64_t m_expired;
+    uint64_t m_evicted;
+
+    static bool toHash(const bytes_t& bytes, hash_t& hash);
+    static std::size_t hashIndex(const hash_t& hash, std::size_t mask);
+
+    // Returns the slot holding hash, or m_slots.size() if not found.
+    std::size_t find(const hash_t& hash) const;
+    bool insert_unwrapped(const hash_t& hash, uint32_t timestamp);
+    void erase_unwrapped(std::size_t slot);
+    bool isLive(const OrderRecord& record) const;
+    void popStaleOrder();
+    std::size_t expire_unwrapped(uint32_t now);
+    void evict_unwrapped(std::size_t targetSize);
+    void rehash(std::size_t capacity);
+};
+
+    }
+}
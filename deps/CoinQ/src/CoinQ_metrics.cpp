@@ -0,0 +1,266 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// CoinQ_metrics.cpp
+//
+// Copyright (c) 2011-2016 Ciphrex Corp.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+//
+
+#include "CoinQ_metrics.h"
+
+#include <logger/logger.h>
+
+#include <boost/bind.hpp>
+
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+
+#if defined(__linux__)
+#include <unistd.h>
+#elif defined(__APPLE__)
+#include <mach/mach.h>
+#endif
+
+using namespace CoinQ;
+
+namespace
+{
+    const std::size_t MAX_REQUEST_SIZE = 8192;
+    const unsigned int REQUEST_TIMEOUT = 10; // seconds
+
+    std::string escapeLabelValue(const std::string& value)
+    {
+        std::string escaped;
+        for (char c: value)
+        {
+            switch (c)
+            {
+            case '\\':  escaped += "\\\\"; break;
+            case '"':   escaped += "\\\""; break;
+            case '\n':  escaped += "\\n"; break;
+            default:    escaped += c;
+            }
+        }
+        return escaped;
+    }
+
+    std::string escapeHelp(const std::string& help)
+    {
+        std::string escaped;
+        for (char c: help)
+        {
+            switch (c)
+            {
+            case '\\':  escaped += "\\\\"; break;
+            case '\n':  escaped += "\\n"; break;
+            default:    escaped += c;
+            }
+        }
+        return escaped;
+    }
+
+    std::string httpResponse(const std::string& status, const std::string& body)
+    {
+        std::stringstream ss;
+        ss << "HTTP/1.0 " << status << "\r\n"
+           << "Content-Type: text/plain; version=0.0.4\r\n"
+           << "Content-Length: " << body.size() << "\r\n"
+           << "Connection: close\r\n"
+           << "\r\n"
+           << body;
+        return ss.str();
+    }
+
+    class MetricsConnection : public std::enable_shared_from_this<MetricsConnection>
+    {
+    public:
+        MetricsConnection(boost::asio::io_service& io_service, const MetricsServer::render_t& render) :
+            socket_(io_service), timer_(io_service), request_(MAX_REQUEST_SIZE), render_(render) { }
+
+        boost::asio::ip::tcp::socket& socket() { return socket_; }
+
+        void start()
+        {
+            auto self(shared_from_this());
+            timer_.expires_from_now(boost::posix_time::seconds(REQUEST_TIMEOUT));
+            timer_.async_wait([this, self](const boost::system::error_code& ec) {
+                if (ec) return;
+                boost::system::error_code ignored;
+                socket_.close(ignored);
+            });
+
+            boost::asio::async_read_until(socket_, request_, "\r\n\r\n", [this, self](const boost::system::error_code& ec, std::size_t /*bytes*/) {
+                if (ec)
+                {
+                    timer_.cancel();
+                    return;
+                }
+
+                std::istream is(&request_);
+                std::string method, target;
+                is >> method >> target;
+                target = target.substr(0, target.find('?'));
+
+                if (method != "GET")
+                {
+                    response_ = httpResponse("405 Method Not Allowed", "Only GET is supported.\n");
+                }
+                else if (target != "/metrics")
+                {
+                    response_ = httpResponse("404 Not Found", "Metrics are served at /metrics.\n");
+                }
+                else
+                {
+                    try
+                    {
+                        response_ = httpResponse("200 OK", render_());
+                    }
+                    catch (const std::exception& e)
+                    {
+                        LOGGER(error) << "MetricsServer - " << e.what() << std::endl;
+                        response_ = httpResponse("500 Internal Server Error", std::string(e.what()) + "\n");
+                    }
+                }
+
+                boost::asio::async_write(socket_, boost::asio::buffer(response_), [this, self](const boost::system::error_code& /*ec*/, std::size_t /*bytes*/) {
+                    timer_.cancel();
+                    boost::system::error_code ignored;
+                    socket_.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignored);
+                    socket_.close(ignored);
+                });
+            });
+        }
+
+    private:
+        boost::asio::ip::tcp::socket socket_;
+        boost::asio::deadline_timer timer_;
+        boost::asio::streambuf request_;
+        std::string response_;
+        const MetricsServer::render_t& render_;
+    };
+}
+
+void MetricsWriter::family(const std::string& name, type_t type, const std::string& help)
+{
+    ss_ << "# HELP " << name << " " << escapeHelp(help) << "\n"
+        << "# TYPE " << name << " " << (type == COUNTER ? "counter" : type == GAUGE ? "gauge" : "histogram") << "\n";
+}
+
+void MetricsWriter::sample(const std::string& name, double value, const labels_t& labels)
+{
+    ss_ << name;
+    if (!labels.empty())
+    {
+        ss_ << "{";
+        bool bComma = false;
+        for (auto& label: labels)
+        {
+            if (bComma) { ss_ << ","; }
+            else        { bComma = true; }
+            ss_ << label.first << "=\"" << escapeLabelValue(label.second) << "\"";
+        }
+        ss_ << "}";
+    }
+
+    ss_ << " ";
+    if (std::isnan(value))      { ss_ << "NaN"; }
+    else if (std::isinf(value)) { ss_ << (value > 0 ? "+Inf" : "-Inf"); }
+    else                        { ss_ << std::setprecision(15) << value; }
+    ss_ << "\n";
+}
+
+void CoinQ::writeProcessMetrics(MetricsWriter& writer)
+{
+#if defined(__linux__)
+    std::ifstream statm("/proc/self/statm");
+    unsigned long long pages = 0, residentPages = 0;
+    if (!(statm >> pages >> residentPages)) return;
+
+    long pageSize = sysconf(_SC_PAGESIZE);
+    writer.gauge("process_resident_memory_bytes", "Resident memory size in bytes.", (double)residentPages * pageSize);
+    writer.gauge("process_virtual_memory_bytes", "Virtual memory size in bytes.", (double)pages * pageSize);
+#elif defined(__APPLE__)
+    task_basic_info_data_t info;
+    mach_msg_type_number_t count = TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS) return;
+
+    writer.gauge("process_resident_memory_bytes", "Resident memory size in bytes.", (double)info.resident_size);
+    writer.gauge("process_virtual_memory_bytes", "Virtual memory size in bytes.", (double)info.virtual_size);
+#else
+    (void)writer;
+#endif
+}
+
+MetricsServer::MetricsServer(render_t render) :
+    render_(render),
+    acceptor_(io_service_),
+    bRunning(false)
+{
+}
+
+MetricsServer::~MetricsServer()
+{
+    stop();
+}
+
+void MetricsServer::start(unsigned short port, const std::string& address)
+{
+    if (bRunning) throw std::runtime_error("MetricsServer - already started.");
+
+    try
+    {
+        boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::address::from_string(address), port);
+        acceptor_.open(endpoint.protocol());
+        acceptor_.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+        acceptor_.bind(endpoint);
+        acceptor_.listen();
+    }
+    catch (const boost::system::system_error& e)
+    {
+        boost::system::error_code ignored;
+        acceptor_.close(ignored);
+
+        std::stringstream err;
+        err << "MetricsServer - cannot listen on " << address << ":" << port << ": " << e.what();
+        throw std::runtime_error(err.str());
+    }
+
+    bRunning = true;
+    io_service_.reset();
+    do_accept();
+    thread_ = boost::thread(boost::bind(&boost::asio::io_service::run, &io_service_));
+    LOGGER(debug) << "MetricsServer - listening on " << address << ":" << this->port() << std::endl;
+}
+
+void MetricsServer::stop()
+{
+    if (!bRunning) return;
+    bRunning = false;
+
+    io_service_.stop();
+    thread_.join();
+
+    boost::system::error_code ignored;
+    acceptor_.close(ignored);
+}
+
+unsigned short MetricsServer::port() const
+{
+    boost::system::error_code ec;
+    boost::asio::ip::tcp::endpoint endpoint = acceptor_.local_endpoint(ec);
+    return ec ? 0 : endpoint.port();
+}
+
+void MetricsServer::do_accept()
+{
+    auto connection = std::make_shared<MetricsConnection>(io_service_, render_);
+    acceptor_.async_accept(connection->socket(), [this, connection](const boost::system::error_code& ec) {
+        if (ec == boost::asio::error::operation_aborted || !acceptor_.is_open()) return;
+        if (!ec) { connection->start(); }
+        do_accept();
+    });
+}
@@ -0,0 +1,80 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// CoinQ_metrics.h
+//
+// Copyright (c) 2011-2016 Ciphrex Corp.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+//
+
+#pragma once
+
+#include <boost/asio.hpp>
+#include <boost/thread.hpp>
+
+#include <functional>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <stdint.h>
+
+namespace CoinQ
+{
+
+// Builds a page in the Prometheus text exposition format. Each metric family is declared once with
+// family(), followed by its samples. Histogram samples are written by the caller under the
+// _bucket, _sum and _count suffixes.
+class MetricsWriter
+{
+public:
+    enum type_t { COUNTER, GAUGE, HISTOGRAM };
+
+    typedef std::vector<std::pair<std::string, std::string>> labels_t;
+
+    void family(const std::string& name, type_t type, const std::string& help);
+    void sample(const std::string& name, double value, const labels_t& labels = labels_t());
+
+    // Family with a single unlabeled sample
+    void counter(const std::string& name, const std::string& help, double value) { family(name, COUNTER, help); sample(name, value); }
+    void gauge(const std::string& name, const std::string& help, double value) { family(name, GAUGE, help); sample(name, value); }
+
+    std::string str() const { return ss_.str(); }
+
+private:
+    std::stringstream ss_;
+};
+
+// Adds resident and virtual memory of the current process. Nothing is added where they cannot be read.
+void writeProcessMetrics(MetricsWriter& writer);
+
+// Serves GET /metrics over plain HTTP from its own thread. The page is rendered on every request, so
+// render must be thread-safe. Binds to the loopback interface unless told otherwise; the page is not
+// authenticated.
+class MetricsServer
+{
+public:
+    typedef std::function<std::string()> render_t;
+
+    explicit MetricsServer(render_t render);
+    ~MetricsServer();
+
+    void start(unsigned short port, const std::string& address = "127.0.0.1");
+    void stop();
+    bool isRunning() const { return bRunning; }
+
+    unsigned short port() const;
+
+private:
+    render_t render_;
+
+    boost::asio::io_service io_service_;
+    boost::asio::ip::tcp::acceptor acceptor_;
+    boost::thread thread_;
+    bool bRunning;
+
+    void do_accept();
+};
+
+}
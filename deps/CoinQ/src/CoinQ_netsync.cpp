@@ -39,7 +39,7 @@ NetworkSync::NetworkSync(const CoinQ::CoinParams& coinParams, bool bCheckProofOf
 {
     // Select hash functions
     Coin::CoinBlockHeader::setHashFunc(m_coinParams.block_header_hash_function());
-    Coin::CoinBlockHeader::setPOWHashFunc(m_coinParams.block_header_pow_hash_function());
+    Coin::CoinBlockHeader::setPOWHashFunc(m_coinParams.block_header_pow_hash_function(), m_coinParams.block_header_pow_batch_hash_function());
 
 /*
     // Subscribe block tree handlers 
@@ -138,10 +138,7 @@ NetworkSync::NetworkSync(const CoinQ::CoinParams& coinParams, bool bCheckProofOf
         boost::unique_lock<boost::mutex> syncLock(m_syncMutex);
         if (m_currentMerkleTxHashes.empty())
         {
-            {
-                boost::lock_guard<boost::mutex> mempoolLock(m_mempoolMutex);
-                m_mempoolTxs.insert(tx.hash());
-            }
+            m_mempool.insert(tx.hash());
 
             syncLock.unlock();
             notifyNewTx(tx);
@@ -164,11 +161,16 @@ NetworkSync::NetworkSync(const CoinQ::CoinParams& coinParams, bool bCheckProofOf
             {
                 notifySynchingHeaders();
                 boost::unique_lock<boost::mutex> fileFlushLock(m_fileFlushMutex);
-                for (auto& item: headersMessage.headers)
+
+                // Proof of work is checked for the whole message in parallel. Only the first invalid
+                // header, if any, is checked again on insertion so it fails with the right error.
+                std::size_t firstInvalid = CoinQBlockTreeMem::getFirstInvalidProofOfWork(headersMessage.headers);
+                for (std::size_t i = 0; i < headersMessage.headers.size(); i++)
                 {
+                    auto& item = headersMessage.headers[i];
                     try
                     {
-                        if (m_blockTree.insertHeader(item)) { m_bHeadersSynched = false; }
+                        if (m_blockTree.insertHeader(item, i >= firstInvalid)) { m_bHeadersSynched = false; }
                     }
                     catch (const std::exception& e)
                     {
@@ -246,12 +248,8 @@ NetworkSync::NetworkSync(const CoinQ::CoinParams& coinParams, bool bCheckProofOf
                     LOGGER(trace) << "New merkle transaction (" << (m_currentMerkleTxIndex + 1) << " of " << m_currentMerkleTxCount << "): " << tx.hash().getHex() << endl;
 
                     notifyMerkleTx(m_currentMerkleBlock, tx, m_currentMerkleTxIndex++, m_currentMerkleTxCount);
-                    m_currentMerkleTxHashes.pop();
-
-                    {
-                        boost::lock_guard<boost::mutex> mempoolLock(m_mempoolMutex);
-                        m_mempoolTxs.erase(tx.hash());
-                    }
+                    m_currentMerkleTxHashes.pop_front();
+                    m_mempool.erase(tx.hash());
                 }
             }
 
@@ -432,6 +430,9 @@ NetworkSync::NetworkSync(const CoinQ::CoinParams& coinParams, bool bCheckProofOf
 NetworkSync::~NetworkSync()
 {
     stop();
+
+    // Still finishing the close handler if the peer closed on its own, as at the end of a replay.
+    if (m_ioServiceThread.joinable()) { m_ioServiceThread.join(); }
 }
 
 void NetworkSync::setCoinParams(const CoinQ::CoinParams& coinParams)
@@ -447,6 +448,7 @@ void NetworkSync::loadHeaders(const std::string& blockTreeFile, bool bCheckProof
 {
     stopFileFlushThread();
     m_blockTreeFile = blockTreeFile;
+    m_blockTree.setCheckpoints(m_coinParams.checkpoints());
 
     try
     {
@@ -465,6 +467,26 @@ void NetworkSync::loadHeaders(const std::string& blockTreeFile, bool bCheckProof
         notifyBlockTreeError(e.what(), -1);
     }
 
+    if (!m_headerSnapshotFile.empty())
+    {
+        try
+        {
+            m_blockTree.loadSnapshot(m_headerSnapshotFile, callback);
+
+            std::stringstream status;
+            status << "Loaded header snapshot. Base Height: " << m_blockTree.getBaseHeight() << " / " << "Best Height: " << m_blockTree.getBestHeight();
+            notifyStatus(status.str());
+            notifyAddBestChain(m_blockTree.getHeader(-1));
+            return;
+        }
+        catch (const std::exception& e)
+        {
+            LOGGER(error) << "NetworkSync::loadHeaders() - header snapshot: " << e.what() << std::endl;
+            // TODO: propagate code
+            notifyBlockTreeError(e.what(), -1);
+        }
+    }
+
     m_blockTree.clear();
     m_blockTree.setGenesisBlock(m_coinParams.genesis_block());
     notifyStatus("Block tree file not found. A new one will be created.");
@@ -558,17 +580,12 @@ void NetworkSync::stopSynchingBlocks(bool bClearFilter)
 
 void NetworkSync::addToMempool(const uchar_vector& txHash)
 {
-    boost::lock_guard<boost::mutex> mempoolLock(m_mempoolMutex);
-    m_mempoolTxs.insert(txHash);
+    m_mempool.insert(txHash);
 }
 
 void NetworkSync::insertTx(const Coin::Transaction& tx)
 {
-    {
-        boost::lock_guard<boost::mutex> mempoolLock(m_mempoolMutex);
-        m_mempoolTxs.insert(tx.hash());
-    }
-
+    m_mempool.insert(tx.hash());
     notifyNewTx(tx);
 }
 
@@ -599,11 +616,7 @@ void NetworkSync::insertMerkleBlock(const Coin::MerkleBlock& merkleBlock, const
         {
             LOGGER(trace) << "New merkle transaction (" << (m_currentMerkleTxIndex + 1) << " of " << m_currentMerkleTxCount << "): " << tx.hash().getHex() << endl;
             notifyMerkleTx(chainMerkleBlock, tx, i++, n);
-
-            {
-                boost::lock_guard<boost::mutex> mempoolLock(m_mempoolMutex);
-                m_mempoolTxs.erase(tx.hash());
-            }
+            m_mempool.erase(tx.hash());
         }
     }
 }
@@ -623,6 +636,7 @@ void NetworkSync::start(const std::string& host, const std::string& port)
 
         std::string port_ = port.empty() ? m_coinParams.default_port() : port;
         m_peer.set(host, port_, m_coinParams.magic_bytes(), m_coinParams.protocol_version(), "Wallet v0.1", 0, false);
+        m_peer.setReplayFile(std::string());
 
         LOGGER(trace) << "Starting peer " << host << ":" << port_ << "..." << endl;
         m_peer.start();
@@ -639,6 +653,41 @@ void NetworkSync::start(const std::string& host, int port)
     start(host, ssport.str());
 }
 
+void NetworkSync::startReplay(const std::string& filepath, bool bRealtime)
+{
+    {
+        if (m_bStarted) throw runtime_error("NetworkSync - already started.");
+        boost::lock_guard<boost::mutex> lock(m_startMutex);
+        if (m_bStarted) throw runtime_error("NetworkSync - already started.");
+
+        LOGGER(trace) << "NetworkSync::startReplay(" << filepath << ", " << (bRealtime ? "true" : "false") << ")" << std::endl;
+        m_peer.set("", "", m_coinParams.magic_bytes(), m_coinParams.protocol_version(), "Wallet v0.1", 0, false);
+        m_peer.setReplayFile(filepath, bRealtime);
+
+        startFileFlushThread();
+        startIOServiceThread();
+
+        m_bStarted = true;
+
+        try
+        {
+            m_peer.start();
+        }
+        catch (...)
+        {
+            // Bad capture file
+            stopIOServiceThread();
+            stopFileFlushThread();
+            m_bStarted = false;
+            throw;
+        }
+
+        LOGGER(trace) << "Peer replay started." << endl;
+    }
+
+    notifyStarted();
+}
+
 void NetworkSync::stop()
 {
     {
@@ -654,7 +703,7 @@ void NetworkSync::stop()
         m_bStarted = false;
         m_bHeadersSynched = false;
         m_lastRequestedMerkleBlockHash.clear();
-        while (!m_currentMerkleTxHashes.empty()) { m_currentMerkleTxHashes.pop(); }
+        m_currentMerkleTxHashes.clear();
     }
 
     notifyStopped();
@@ -688,7 +737,10 @@ void NetworkSync::getFilteredBlock(const bytes_t& hash)
 
 void NetworkSync::setBloomFilter(const Coin::BloomFilter& bloomFilter)
 {
-    m_bloomFilter = bloomFilter;
+    {
+        boost::lock_guard<boost::mutex> lock(m_bloomFilterMutex);
+        m_bloomFilter = bloomFilter;
+    }
     if (!m_bloomFilter.isSet()) return;
 
     LOGGER(trace) << "Sending new bloom filter to peer." << endl;
@@ -696,6 +748,18 @@ void NetworkSync::setBloomFilter(const Coin::BloomFilter& bloomFilter)
     m_peer.send(filterLoad);
 }
 
+NetworkSync::BloomFilterStats NetworkSync::getBloomFilterStats() const
+{
+    boost::lock_guard<boost::mutex> lock(m_bloomFilterMutex);
+
+    BloomFilterStats stats;
+    stats.loaded = m_bloomFilter.isSet();
+    stats.size = stats.loaded ? m_bloomFilter.getFilter().size() : 0;
+    stats.hashFuncs = stats.loaded ? m_bloomFilter.getNHashFuncs() : 0;
+    stats.falsePositiveRate = m_bloomFilter.estimatedFalsePositiveRate();
+    return stats;
+}
+
 void NetworkSync::clearBloomFilter()
 {
     LOGGER(trace) << "Clearing bloom filter." << endl;
@@ -710,6 +774,12 @@ void NetworkSync::startIOServiceThread()
     if (m_bIOServiceStarted) throw std::runtime_error("NetworkSync - io service already started.");
 
     LOGGER(trace) << "Starting IO service thread..." << endl;
+    if (m_ioServiceThread.joinable())
+    {
+        // Left running by a stop from one of its own handlers.
+        m_ioServiceThread.join();
+        m_ioService.reset();
+    }
     m_bIOServiceStarted = true;
     m_ioServiceThread = boost::thread(boost::bind(&CoinQ::io_service_t::run, &m_ioService));
     LOGGER(trace) << "IO service thread started." << endl;
@@ -723,6 +793,14 @@ void NetworkSync::stopIOServiceThread()
 
     LOGGER(trace) << "Stopping IO service thread..." << endl;
     m_ioService.stop();
+    if (boost::this_thread::get_id() == m_ioServiceThread.get_id())
+    {
+        // Called from a handler, as when the peer closes on its own. run() returns once the handler
+        // does, as long as the service is not reset first, so the next start or the destructor joins it.
+        m_bIOServiceStarted = false;
+        LOGGER(trace) << "IO service thread stopping." << endl;
+        return;
+    }
     LOGGER(trace) << "Waiting for io_service::run() to exit..." << endl;
     while (!m_ioService.stopped()) { std::this_thread::sleep_for(std::chrono::microseconds(200)); }
     //LOGGER(trace) << "Joining IO service thread..." << endl;
@@ -797,7 +875,7 @@ void NetworkSync::syncMerkleBlock(const ChainMerkleBlock& merkleBlock, const Coi
 {
     LOGGER(trace) << "Synchronizing merkle block: " << merkleBlock.hash().getHex() << " height: " << merkleBlock.height << endl;
 
-    while (!m_currentMerkleTxHashes.empty()) { m_currentMerkleTxHashes.pop(); }
+    m_currentMerkleTxHashes.clear();
 
     // The byte order of the tx hashes must be reversed when moving between merkle trees and the block chain
     const std::list<uchar_vector>& reversedTxHashes = merkleTree.getTxHashes();
@@ -813,7 +891,7 @@ void NetworkSync::syncMerkleBlock(const ChainMerkleBlock& merkleBlock, const Coi
     for (auto& reversedTxHash: merkleTree.getTxHashes())
     {
         uchar_vector txHash = reversedTxHash.getReverse();
-        m_currentMerkleTxHashes.push(txHash);
+        m_currentMerkleTxHashes.push_back(txHash);
         LOGGER(trace) << "  Added tx to queue (" << ++i << " of " << m_currentMerkleTxCount << "): " << txHash.getHex() << endl;
     }
     
@@ -841,7 +919,7 @@ void NetworkSync::processBlockTx(const Coin::Transaction& tx)
             {
                 LOGGER(trace) << "NetworkSync::processBlockTx - New merkle transaction (" << (m_currentMerkleTxIndex + 1) << " of " << m_currentMerkleTxCount << "): " << txHashHex << endl;
                 notifyMerkleTx(m_currentMerkleBlock, tx, m_currentMerkleTxIndex++, m_currentMerkleTxCount);
-                m_currentMerkleTxHashes.pop();
+                m_currentMerkleTxHashes.pop_front();
             }
             else if ((!m_lastRequestedMerkleBlockHash.empty()) && (m_lastRequestedBlockHash != m_lastRequestedMerkleBlockHash))
             {
@@ -908,18 +986,17 @@ void NetworkSync::processBlockTx(const Coin::Transaction& tx)
 
 void NetworkSync::processMempoolConfirmations()
 {
-    boost::unique_lock<boost::mutex> mempoolLock(m_mempoolMutex);
-    LOGGER(trace) << "Confirming " << m_currentMerkleTxHashes.size() << " merkle block transactions from " << m_mempoolTxs.size() << " mempool transactions..." << endl;
-    while (!m_currentMerkleTxHashes.empty() && m_mempoolTxs.count(m_currentMerkleTxHashes.front()))
+    LOGGER(trace) << "Confirming " << m_currentMerkleTxHashes.size() << " merkle block transactions from " << m_mempool.size() << " mempool transactions..." << endl;
+
+    // Match and erase the whole run of already seen transactions in one pass, then notify without holding the mempool lock.
+    std::vector<bytes_t> confirmedTxHashes;
+    std::size_t count = m_mempool.confirm(m_currentMerkleTxHashes, confirmedTxHashes);
+    m_currentMerkleTxHashes.erase(m_currentMerkleTxHashes.begin(), m_currentMerkleTxHashes.begin() + count);
+
+    for (auto& txHash: confirmedTxHashes)
     {
-        const uchar_vector& txHash = m_currentMerkleTxHashes.front();
-        LOGGER(trace) << "  Confirming tx (" << (m_currentMerkleTxIndex + 1) << " of " << m_currentMerkleTxCount << "): " << txHash.getHex() << endl;
-        mempoolLock.unlock();
+        LOGGER(trace) << "  Confirming tx (" << (m_currentMerkleTxIndex + 1) << " of " << m_currentMerkleTxCount << "): " << uchar_vector(txHash).getHex() << endl;
         notifyTxConfirmed(m_currentMerkleBlock, txHash, m_currentMerkleTxIndex++, m_currentMerkleTxCount);
-
-        mempoolLock.lock();
-        m_mempoolTxs.erase(txHash);
-        m_currentMerkleTxHashes.pop();
     }
     LOGGER(trace) << "Done processing mempool confirmations." << endl;
 }
@@ -18,6 +18,7 @@
 #include "CoinQ_peer_io.h"
 #include "CoinQ_blocks.h"
 #include "CoinQ_filter.h"
+#include "CoinQ_mempool.h"
 
 #include "CoinQ_signals.h"
 #include "CoinQ_slots.h"
@@ -30,7 +31,7 @@
 #include <CoinCore/typedefs.h>
 #include <CoinCore/BloomFilter.h>
 
-#include <queue>
+#include <deque>
 
 typedef Coin::Transaction coin_tx_t;
 typedef ChainHeader chain_header_t;
@@ -61,6 +62,11 @@ public:
 
     void enableCheckProofOfWork(bool bCheckProofOfWork = true) { m_bCheckProofOfWork = bCheckProofOfWork; }
 
+    // Used by loadHeaders() when the block tree file cannot be loaded. Headers then start at the
+    // snapshot instead of the genesis block, so vaults must not need blocks from before it.
+    void setHeaderSnapshotFile(const std::string& snapshotFile) { m_headerSnapshotFile = snapshotFile; }
+    const std::string& getHeaderSnapshotFile() const { return m_headerSnapshotFile; }
+
     void loadHeaders(const std::string& blockTreeFile, bool bCheckProofOfWork = true, CoinQBlockTreeMem::callback_t callback = nullptr);
     bool headersSynched() const { return m_bHeadersSynched; }
     int getBestHeight() const;
@@ -80,9 +86,30 @@ public:
     void stop();
     bool connected() const { return m_bConnected; }
 
+    // Records the peer's messages to a capture file on every subsequent start. An empty path turns capture off.
+    void setCaptureFile(const std::string& filepath) { m_peer.setCaptureFile(filepath); }
+
+    // Starts without a network connection, feeding the peer's messages from a capture file instead.
+    // The blocktree and bloom filter must be in the same state as when the capture was taken for the
+    // replay to match. Stops at the end of the capture.
+    void startReplay(const std::string& filepath, bool bRealtime = false);
+    bool replaying() const { return m_peer.isReplaying(); }
+
     void setBloomFilter(const Coin::BloomFilter& bloomFilter);
     void clearBloomFilter();
 
+    struct BloomFilterStats
+    {
+        bool loaded;
+        std::size_t size;               // bytes
+        uint32_t hashFuncs;
+        double falsePositiveRate;       // estimated from the bits set
+    };
+
+    BloomFilterStats getBloomFilterStats() const;
+
+    PeerStats getPeerStats() const { return m_peer.getStats(); }
+
     void syncBlocks(const std::vector<bytes_t>& locatorHashes, uint32_t startTime);
     void syncBlocks(int startHeight);
     void stopSynchingBlocks(bool bClearFilter = true);
@@ -90,6 +117,10 @@ public:
     // TRANSACTIONS PUSHED OFF CHAIN MUST BE ADDED BACK TO MEMPOOL
     void addToMempool(const uchar_vector& txHash);
 
+    // A maxSize or maxAge of zero disables the corresponding limit.
+    void setMempoolLimits(std::size_t maxSize, uint32_t maxAge) { m_mempool.setLimits(maxSize, maxAge); }
+    MempoolTracker::Stats getMempoolStats() const { return m_mempool.getStats(); }
+
     // FOR TESTING
     void insertTx(const Coin::Transaction& tx);
     void insertMerkleBlock(const Coin::MerkleBlock& merkleBlock, const std::vector<Coin::Transaction>& txs);
@@ -159,6 +190,7 @@ private:
 
     mutable boost::mutex m_syncMutex;
     std::string m_blockTreeFile;
+    std::string m_headerSnapshotFile;
     CoinQBlockTreeMem m_blockTree;
     bool m_blockTreeLoaded;
     bool m_bHeadersSynched;
@@ -169,15 +201,15 @@ private:
 
     void do_syncBlocks(int startHeight);
 
+    mutable boost::mutex m_bloomFilterMutex;
     Coin::BloomFilter m_bloomFilter;
 
     void initBlockFilter();
 
     // Merkle block state
-    mutable boost::mutex m_mempoolMutex;
-    std::set<bytes_t> m_mempoolTxs;
+    MempoolTracker m_mempool;
     ChainMerkleBlock m_currentMerkleBlock;
-    std::queue<bytes_t> m_currentMerkleTxHashes;
+    std::deque<bytes_t> m_currentMerkleTxHashes;
     unsigned int m_currentMerkleTxIndex;
     unsigned int m_currentMerkleTxCount;
     bool m_bMissingTxs;
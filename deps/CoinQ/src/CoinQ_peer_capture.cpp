@@ -0,0 +1,120 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// CoinQ_peer_capture.cpp
+//
+// Copyright (c) 2011-2016 Ciphrex Corp.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+//
+
+#include "CoinQ_peer_capture.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace CoinQ;
+
+namespace
+{
+    const char TAG[] = { 'C', 'Q', 'P', 'C', 'A', 'P', '0', '1' };
+    const std::size_t TAG_SIZE = sizeof(TAG);
+
+    // direction, microseconds, length
+    const std::size_t RECORD_HEADER_SIZE = 1 + 8 + 4;
+
+    // Message header is magic, 12-byte command, payload size and checksum.
+    const std::size_t COMMAND_OFFSET = 4;
+    const std::size_t COMMAND_SIZE = 12;
+
+    // Larger than any message a peer will send.
+    const uint32_t MAX_MESSAGE_SIZE = 0x02000000;
+
+    void putUint(unsigned char* p, uint64_t value, std::size_t size)
+    {
+        for (std::size_t i = 0; i < size; i++) { p[i] = (value >> (8 * i)) & 0xff; }
+    }
+
+    uint64_t getUint(const unsigned char* p, std::size_t size)
+    {
+        uint64_t value = 0;
+        for (std::size_t i = 0; i < size; i++) { value |= (uint64_t)p[i] << (8 * i); }
+        return value;
+    }
+}
+
+std::string PeerCaptureRecord::command() const
+{
+    if (message.size() < COMMAND_OFFSET + COMMAND_SIZE) return std::string();
+
+    auto begin = message.begin() + COMMAND_OFFSET;
+    auto end = std::find(begin, begin + COMMAND_SIZE, 0);
+    return std::string(begin, end);
+}
+
+PeerCaptureWriter::PeerCaptureWriter(const std::string& filepath, uint32_t magic_bytes) :
+    filepath_(filepath),
+    file_(filepath, std::ios::out | std::ios::trunc | std::ios::binary),
+    start_(std::chrono::steady_clock::now())
+{
+    if (!file_) throw std::runtime_error("PeerCaptureWriter - failed to create file.");
+
+    unsigned char magic[4];
+    putUint(magic, magic_bytes, 4);
+    file_.write(TAG, TAG_SIZE);
+    file_.write((const char*)magic, sizeof(magic));
+    file_.flush();
+    if (!file_) throw std::runtime_error("PeerCaptureWriter - failed to write file.");
+}
+
+void PeerCaptureWriter::write(PeerCaptureRecord::direction_t direction, const bytes_t& message)
+{
+    uint64_t microseconds = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_).count();
+
+    unsigned char header[RECORD_HEADER_SIZE];
+    header[0] = (unsigned char)direction;
+    putUint(header + 1, microseconds, 8);
+    putUint(header + 9, message.size(), 4);
+
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    file_.write((const char*)header, sizeof(header));
+    file_.write((const char*)message.data(), message.size());
+    file_.flush();
+    if (!file_) throw std::runtime_error("PeerCaptureWriter - failed to write file.");
+}
+
+PeerCaptureReader::PeerCaptureReader(const std::string& filepath) :
+    filepath_(filepath),
+    file_(filepath, std::ios::in | std::ios::binary)
+{
+    if (!file_) throw std::runtime_error("PeerCaptureReader - failed to open file.");
+
+    char tag[TAG_SIZE];
+    unsigned char magic[4];
+    if (!file_.read(tag, TAG_SIZE) || !std::equal(tag, tag + TAG_SIZE, TAG) || !file_.read((char*)magic, sizeof(magic)))
+        throw std::runtime_error("PeerCaptureReader - not a capture file.");
+
+    magic_bytes_ = getUint(magic, 4);
+}
+
+bool PeerCaptureReader::read(PeerCaptureRecord& record)
+{
+    unsigned char header[RECORD_HEADER_SIZE];
+    file_.read((char*)header, sizeof(header));
+    if (file_.gcount() == 0) return false;
+    if (!file_) throw std::runtime_error("PeerCaptureReader - truncated record.");
+
+    if (header[0] != PeerCaptureRecord::RECEIVED && header[0] != PeerCaptureRecord::SENT)
+        throw std::runtime_error("PeerCaptureReader - corrupt record.");
+
+    uint32_t length = getUint(header + 9, 4);
+    if (length > MAX_MESSAGE_SIZE) throw std::runtime_error("PeerCaptureReader - corrupt record.");
+
+    record.direction = (PeerCaptureRecord::direction_t)header[0];
+    record.microseconds = getUint(header + 1, 8);
+    record.message.resize(length);
+    if (length > 0 && !file_.read((char*)record.message.data(), length))
+        throw std::runtime_error("PeerCaptureReader - truncated record.");
+
+    return true;
+}
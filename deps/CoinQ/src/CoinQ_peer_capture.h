@@ -0,0 +1,84 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// CoinQ_peer_capture.h
+//
+// Copyright (c) 2011-2016 Ciphrex Corp.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+//
+
+#pragma once
+
+#include <CoinCore/typedefs.h>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/lock_guard.hpp>
+
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <stdint.h>
+
+namespace CoinQ
+{
+
+// A capture file holds every message a peer received and sent, in the order they happened, with the
+// time since the capture started. Messages are stored exactly as they went over the wire, header and
+// checksum included, so a replay goes through the same decoding as a live connection.
+//
+// Layout: an 8-byte file tag and the 4-byte network magic, then one record per message: a direction
+// byte, an 8-byte timestamp in microseconds and a 4-byte length followed by the message bytes. All
+// integers are little endian.
+struct PeerCaptureRecord
+{
+    enum direction_t { RECEIVED = 0, SENT = 1 };
+
+    PeerCaptureRecord() : direction(RECEIVED), microseconds(0) { }
+    PeerCaptureRecord(direction_t direction_, uint64_t microseconds_, const bytes_t& message_) : direction(direction_), microseconds(microseconds_), message(message_) { }
+
+    // Returns the command from the message header.
+    std::string command() const;
+
+    direction_t direction;
+    uint64_t microseconds;
+    bytes_t message;
+};
+
+class PeerCaptureWriter
+{
+public:
+    // Truncates the file if it exists.
+    PeerCaptureWriter(const std::string& filepath, uint32_t magic_bytes);
+
+    const std::string& filepath() const { return filepath_; }
+
+    // Thread-safe. Records are flushed so a capture survives the process being killed.
+    void write(PeerCaptureRecord::direction_t direction, const bytes_t& message);
+
+private:
+    std::string filepath_;
+    std::ofstream file_;
+    boost::mutex mutex_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+class PeerCaptureReader
+{
+public:
+    // Throws std::runtime_error if the file is not a capture file.
+    explicit PeerCaptureReader(const std::string& filepath);
+
+    const std::string& filepath() const { return filepath_; }
+    uint32_t magic_bytes() const { return magic_bytes_; }
+
+    // Returns false at the end of the file. Throws std::runtime_error if a record is cut short.
+    bool read(PeerCaptureRecord& record);
+
+private:
+    std::string filepath_;
+    std::ifstream file_;
+    uint32_t magic_bytes_;
+};
+
+}
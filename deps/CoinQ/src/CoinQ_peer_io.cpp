@@ -116,112 +116,122 @@ void Peer::do_read()
                 break;
             }
 
-            try
-            {
-                Coin::CoinNodeMessage peerMessage(read_message);
-
-                if (!peerMessage.isChecksumValid()) throw std::runtime_error("Invalid checksum.");
-
-                std::string command = peerMessage.getCommand();
-                if (command == "verack") {
-                    LOGGER(trace) << "Peer read handler - VERACK" << std::endl;
-
-                    // Signal completion of handshake
-                    if (bHandshakeComplete) throw std::runtime_error("Second verack received.");
-                    boost::unique_lock<boost::mutex> lock(handshakeMutex);
-                    if (bHandshakeComplete) throw std::runtime_error("Second verack received.");
-                    timer_.cancel();
-                    bHandshakeComplete = true;
-                    lock.unlock();
-                    bWriteReady = true;
-                    notifyOpen(*this);
-                }
-                else if (command == "version")
-                {
-                    LOGGER(trace) << "Peer read handler - VERSION" << std::endl;
+            do_process(uchar_vector(read_message.begin(), read_message.begin() + MIN_MESSAGE_HEADER_SIZE + payloadSize));
 
-                    // TODO: Check version information
-                    Coin::VerackMessage verackMessage;
-                    Coin::CoinNodeMessage msg(magic_bytes_, &verackMessage);
-                    do_send(msg);
-                }
-                else if (command == "inv")
-                {
-                    LOGGER(trace) << "Peer read handler - INV" << std::endl;
+            read_message.assign(read_message.begin() + MIN_MESSAGE_HEADER_SIZE + payloadSize, read_message.end());
+            LOGGER(debug) << "Peer read handler - remaining message bytes: " << read_message.size() << endl;
+        }
 
-                    Coin::Inventory* pInventory = static_cast<Coin::Inventory*>(peerMessage.getPayload());
-                    notifyInv(*this, *pInventory);
-                }
-                else if (command == "tx")
-                {
-                    LOGGER(trace) << "Peer read handler - TX" << std::endl;
+        do_read();
+    }));
+}
 
-                    Coin::Transaction* pTx = static_cast<Coin::Transaction*>(peerMessage.getPayload());
-                    notifyTx(*this, *pTx);
-                }
-                else if (command == "block")
-                {
-                    LOGGER(trace) << "Peer read handler - BLOCK" << std::endl;
+void Peer::do_process(const uchar_vector& message)
+{
+    messagesReceived++;
+    bytesReceived += message.size();
+    lastReceived = std::time(NULL);
+    do_capture(PeerCaptureRecord::RECEIVED, message);
 
-                    Coin::CoinBlock* pBlock = static_cast<Coin::CoinBlock*>(peerMessage.getPayload());
-                    notifyBlock(*this, *pBlock);
-                }
-                else if (command == "merkleblock")
-                {
-                    LOGGER(trace) << "Peer read handler - MERKLEBLOCK" << std::endl;
+    try
+    {
+        Coin::CoinNodeMessage peerMessage(message);
+
+        if (!peerMessage.isChecksumValid()) throw std::runtime_error("Invalid checksum.");
+
+        std::string command = peerMessage.getCommand();
+        if (command == "verack") {
+            LOGGER(trace) << "Peer read handler - VERACK" << std::endl;
+
+            // Signal completion of handshake
+            if (bHandshakeComplete) throw std::runtime_error("Second verack received.");
+            boost::unique_lock<boost::mutex> lock(handshakeMutex);
+            if (bHandshakeComplete) throw std::runtime_error("Second verack received.");
+            timer_.cancel();
+            bHandshakeComplete = true;
+            lock.unlock();
+            bWriteReady = true;
+            notifyOpen(*this);
+        }
+        else if (command == "version")
+        {
+            LOGGER(trace) << "Peer read handler - VERSION" << std::endl;
 
-                    Coin::MerkleBlock* pMerkleBlock = static_cast<Coin::MerkleBlock*>(peerMessage.getPayload());
-                    notifyMerkleBlock(*this, *pMerkleBlock);
-                }
-                else if (command == "addr")
-                {
-                    LOGGER(trace) << "Peer read handler - ADDR" << std::endl;
+            // TODO: Check version information
+            Coin::VerackMessage verackMessage;
+            Coin::CoinNodeMessage msg(magic_bytes_, &verackMessage);
+            do_send(msg);
+        }
+        else if (command == "inv")
+        {
+            LOGGER(trace) << "Peer read handler - INV" << std::endl;
 
-                    Coin::AddrMessage* pAddr = static_cast<Coin::AddrMessage*>(peerMessage.getPayload());
-                    notifyAddr(*this, *pAddr);
-                }
-                else if (command == "headers")
-                {
-                    LOGGER(trace) << "Peer read handler - HEADERS" << std::endl;
+            Coin::Inventory* pInventory = static_cast<Coin::Inventory*>(peerMessage.getPayload());
+            notifyInv(*this, *pInventory);
+        }
+        else if (command == "tx")
+        {
+            LOGGER(trace) << "Peer read handler - TX" << std::endl;
 
-                    Coin::HeadersMessage* pHeaders = static_cast<Coin::HeadersMessage*>(peerMessage.getPayload());
-                    notifyHeaders(*this, *pHeaders);
-                }
-                else if (command == "ping")
-                {
-                    LOGGER(trace) << "Peer read handler - PING" << std::endl;
+            Coin::Transaction* pTx = static_cast<Coin::Transaction*>(peerMessage.getPayload());
+            notifyTx(*this, *pTx);
+        }
+        else if (command == "block")
+        {
+            LOGGER(trace) << "Peer read handler - BLOCK" << std::endl;
 
-                    Coin::PingMessage* pPing = static_cast<Coin::PingMessage*>(peerMessage.getPayload());
-                    Coin::PongMessage pongMessage(pPing->nonce);
-                    Coin::CoinNodeMessage msg(magic_bytes_, &pongMessage);
-                    do_send(msg);
-                }
-                else
-                {
-                    LOGGER(error) << "Peer read handler - command not implemented: " << command << std::endl;
+            Coin::CoinBlock* pBlock = static_cast<Coin::CoinBlock*>(peerMessage.getPayload());
+            notifyBlock(*this, *pBlock);
+        }
+        else if (command == "merkleblock")
+        {
+            LOGGER(trace) << "Peer read handler - MERKLEBLOCK" << std::endl;
 
-                    std::stringstream err;
-                    err << "Command type not implemented: " << command;
-                    notifyProtocolError(*this, err.str(), -1);
-                }
+            Coin::MerkleBlock* pMerkleBlock = static_cast<Coin::MerkleBlock*>(peerMessage.getPayload());
+            notifyMerkleBlock(*this, *pMerkleBlock);
+        }
+        else if (command == "addr")
+        {
+            LOGGER(trace) << "Peer read handler - ADDR" << std::endl;
 
-                notifyMessage(*this, peerMessage);
-            }
-            catch (const std::exception& e)
-            {
-                std::stringstream err;
-                err << "Message decode error: " << e.what();
-                LOGGER(error) << "Peer read handler error: " << err.str() << std::endl;
-                notifyProtocolError(*this, err.str(), -1);
-                min_read_bytes = MIN_MESSAGE_HEADER_SIZE;
-            }
+            Coin::AddrMessage* pAddr = static_cast<Coin::AddrMessage*>(peerMessage.getPayload());
+            notifyAddr(*this, *pAddr);
+        }
+        else if (command == "headers")
+        {
+            LOGGER(trace) << "Peer read handler - HEADERS" << std::endl;
 
-            read_message.assign(read_message.begin() + MIN_MESSAGE_HEADER_SIZE + payloadSize, read_message.end());
-            LOGGER(debug) << "Peer read handler - remaining message bytes: " << read_message.size() << endl;
+            Coin::HeadersMessage* pHeaders = static_cast<Coin::HeadersMessage*>(peerMessage.getPayload());
+            notifyHeaders(*this, *pHeaders);
+        }
+        else if (command == "ping")
+        {
+            LOGGER(trace) << "Peer read handler - PING" << std::endl;
+
+            Coin::PingMessage* pPing = static_cast<Coin::PingMessage*>(peerMessage.getPayload());
+            Coin::PongMessage pongMessage(pPing->nonce);
+            Coin::CoinNodeMessage msg(magic_bytes_, &pongMessage);
+            do_send(msg);
         }
+        else
+        {
+            LOGGER(error) << "Peer read handler - command not implemented: " << command << std::endl;
 
-        do_read();
-    }));
+            std::stringstream err;
+            err << "Command type not implemented: " << command;
+            notifyProtocolError(*this, err.str(), -1);
+        }
+
+        notifyMessage(*this, peerMessage);
+    }
+    catch (const std::exception& e)
+    {
+        std::stringstream err;
+        err << "Message decode error: " << e.what();
+        LOGGER(error) << "Peer read handler error: " << err.str() << std::endl;
+        notifyProtocolError(*this, err.str(), -1);
+        min_read_bytes = MIN_MESSAGE_HEADER_SIZE;
+    }
 }
 
 void Peer::do_write(boost::shared_ptr<uchar_vector> data)
@@ -252,12 +262,114 @@ void Peer::do_write(boost::shared_ptr<uchar_vector> data)
 void Peer::do_send(const Coin::CoinNodeMessage& message)
 {
     boost::shared_ptr<uchar_vector> data(new uchar_vector(message.getSerialized()));
+    messagesSent++;
+    bytesSent += data->size();
+    do_capture(PeerCaptureRecord::SENT, *data);
+
+    if (bReplaying)
+    {
+        {
+            boost::lock_guard<boost::mutex> replayLock(replayMutex);
+            replaySent.push_back(*data);
+        }
+        replayCond.notify_all();
+        return;
+    }
+
     // LOGGER(trace) << "do_send() - data: " << data->getHex() << std::endl;
     boost::lock_guard<boost::mutex> sendLock(sendMutex);
     sendQueue.push(data);
     if (sendQueue.size() == 1) { strand_.post(boost::bind(&Peer::do_write, this, data)); }
 }
 
+void Peer::do_capture(PeerCaptureRecord::direction_t direction, const bytes_t& message)
+{
+    if (!captureWriter_) return;
+
+    try
+    {
+        captureWriter_->write(direction, message);
+    }
+    catch (const std::exception& e)
+    {
+        LOGGER(error) << "Peer::do_capture() - " << e.what() << std::endl;
+    }
+}
+
+void Peer::do_replay(std::shared_ptr<PeerCaptureReader> reader)
+{
+    LOGGER(trace) << "Peer replay thread started." << std::endl;
+
+    boost::system_time start = boost::get_system_time();
+    std::string error;
+    try
+    {
+        PeerCaptureRecord record;
+        while (bRunning && reader->read(record))
+        {
+            boost::unique_lock<boost::mutex> lock(replayMutex);
+            if (record.direction == PeerCaptureRecord::SENT)
+            {
+                if (!replayCond.timed_wait(lock, boost::posix_time::seconds(REPLAY_TIMEOUT), [this]() { return !bRunning || !replaySent.empty(); }))
+                    throw std::runtime_error("timed out waiting for " + record.command() + ".");
+                if (!bRunning) break;
+
+                PeerCaptureRecord sent(PeerCaptureRecord::SENT, 0, replaySent.front());
+                replaySent.pop_front();
+
+                // Version messages carry the time and a random nonce, so only the command can match.
+                if (sent.message != record.message && !(sent.command() == "version" && record.command() == "version"))
+                    throw std::runtime_error("sent " + sent.command() + ", captured " + record.command() + ".");
+            }
+            else
+            {
+                if (bReplayRealtime)
+                {
+                    boost::system_time deadline = start + boost::posix_time::microseconds(record.microseconds);
+                    replayCond.timed_wait(lock, deadline, [this]() { return !bRunning; });
+                }
+                replayCond.wait(lock, [this]() { return !bRunning || replayPending < REPLAY_WINDOW; });
+                if (!bRunning) break;
+
+                replayPending++;
+                lock.unlock();
+
+                uchar_vector message(record.message);
+                strand_.post([this, message]() {
+                    if (bRunning) { do_process(message); }
+                    {
+                        boost::lock_guard<boost::mutex> replayLock(replayMutex);
+                        replayPending--;
+                    }
+                    replayCond.notify_all();
+                });
+            }
+        }
+    }
+    catch (const std::exception& e)
+    {
+        error = e.what();
+    }
+
+    // Runs after every message posted above has been handled.
+    strand_.post([this, error]() {
+        if (!bRunning) return;
+        do_stop();
+
+        if (error.empty())
+        {
+            LOGGER(trace) << "Peer replay finished." << std::endl;
+            return;
+        }
+
+        std::string err = "Replay diverged: " + error;
+        LOGGER(error) << "Peer replay - " << err << std::endl;
+        notifyProtocolError(*this, err, -1);
+    });
+
+    LOGGER(trace) << "Peer replay thread stopped." << std::endl;
+}
+
 void Peer::do_connect(tcp::resolver::iterator iter)
 {
     boost::asio::async_connect(socket_, iter, strand_.wrap([this](const boost::system::error_code& ec, tcp::resolver::iterator) {
@@ -299,6 +411,13 @@ void Peer::do_stop()
     bRunning = false;
     bHandshakeComplete = false;
     bWriteReady = false;
+    if (bReplaying)
+    {
+        {
+            boost::lock_guard<boost::mutex> replayLock(replayMutex);
+        }
+        replayCond.notify_all();
+    }
     notifyClose(*this);
     notifyStop(*this);
 }
@@ -312,12 +431,38 @@ void Peer::start()
     boost::unique_lock<boost::shared_mutex> lock(mutex);
     if (bRunning) throw std::runtime_error("Peer already started.");
 
+    // Left over from a replay that ended on its own.
+    if (replayThread.joinable()) { replayThread.join(); }
+
+    std::shared_ptr<PeerCaptureReader> reader;
+    if (!replayFile_.empty())
+    {
+        reader = std::make_shared<PeerCaptureReader>(replayFile_);
+        if (reader->magic_bytes() != magic_bytes_) throw std::runtime_error("Capture file is for a different network.");
+    }
+
+    captureWriter_.reset();
+    if (!captureFile_.empty()) { captureWriter_.reset(new PeerCaptureWriter(captureFile_, magic_bytes_)); }
+
     bRunning = true;
     bHandshakeComplete = false;
     bWriteReady = false;
     read_message.clear();
     min_read_bytes = MIN_MESSAGE_HEADER_SIZE;
 
+    if (reader)
+    {
+        LOGGER(trace) << "Peer replaying " << replayFile_ << (bReplayRealtime ? " in real time." : ".") << std::endl;
+        bReplaying = true;
+        replaySent.clear();
+        replayPending = 0;
+        replayThread = boost::thread(&Peer::do_replay, this, reader);
+        strand_.post(boost::bind(&Peer::do_handshake, this));
+        return;
+    }
+
+    bReplaying = false;
+
     tcp::resolver::query query(host_, port_);
 
     resolver_.async_resolve(query, [this](const boost::system::error_code& ec, tcp::resolver::iterator iterator) {
@@ -350,16 +495,28 @@ void Peer::stop()
 
         bRunning = false;
 
-        boost::system::error_code ec;
-        socket_.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
-        if (ec)
+        if (bReplaying)
         {
-            stringstream err;
-            err << "Peer shutdown error: " << ec.message();
-            notifyConnectionError(*this, err.str(), ec.value());
+            {
+                boost::lock_guard<boost::mutex> replayLock(replayMutex);
+            }
+            replayCond.notify_all();
+            if (replayThread.get_id() != boost::this_thread::get_id()) { replayThread.join(); }
+        }
+        else
+        {
+            boost::system::error_code ec;
+            socket_.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
+            if (ec)
+            {
+                stringstream err;
+                err << "Peer shutdown error: " << ec.message();
+                notifyConnectionError(*this, err.str(), ec.value());
+            }
+
+            socket_.close();
         }
 
-        socket_.close();
         do_clearSendQueue();
         bHandshakeComplete = false;
         bWriteReady = false;
@@ -369,6 +526,20 @@ void Peer::stop()
     notifyStop(*this);
 }
 
+PeerStats Peer::getStats() const
+{
+    PeerStats stats;
+    stats.messagesReceived = messagesReceived;
+    stats.bytesReceived = bytesReceived;
+    stats.messagesSent = messagesSent;
+    stats.bytesSent = bytesSent;
+    stats.lastReceived = lastReceived;
+
+    boost::lock_guard<boost::mutex> sendLock(sendMutex);
+    stats.sendQueue = sendQueue.size();
+    return stats;
+}
+
 bool Peer::send(Coin::CoinNodeStructure& message)
 {
     boost::shared_lock<boost::shared_mutex> runLock(mutex);
@@ -13,12 +13,17 @@
 
 #include "CoinQ_signals.h"
 #include "CoinQ_slots.h"
+#include "CoinQ_peer_capture.h"
 
 #include <CoinCore/typedefs.h>
 #include <CoinCore/numericdata.h>
 
 #include <logger/logger.h>
 
+#include <atomic>
+#include <ctime>
+#include <deque>
+#include <memory>
 #include <queue>
 
 #include <boost/shared_ptr.hpp>
@@ -61,6 +66,16 @@ typedef std::function<void(Peer&, const Coin::Transaction&)>        peer_tx_slot
 typedef std::function<void(Peer&, const Coin::AddrMessage&)>        peer_addr_slot_t;
 typedef std::function<void(Peer&, const Coin::Inventory&)>          peer_inv_slot_t; 
 
+// Traffic since the peer was constructed, replays included. Messages are counted whole, header included.
+struct PeerStats
+{
+    uint64_t messagesReceived;
+    uint64_t bytesReceived;
+    uint64_t messagesSent;
+    uint64_t bytesSent;
+    std::size_t sendQueue;      // messages waiting to be written
+    std::time_t lastReceived;   // 0 if nothing was received yet
+};
 
 class Peer
 {
@@ -79,12 +94,20 @@ public:
         start_height_(start_height),
         relay_(relay),
         invFlags_(invFlags),
+        bReplayRealtime(false),
+        bReplaying(false),
+        replayPending(0),
+        messagesReceived(0),
+        bytesReceived(0),
+        messagesSent(0),
+        bytesSent(0),
+        lastReceived(0),
         bRunning(false)
     {
         magic_bytes_vector_ = uint_to_vch(magic_bytes_, LITTLE_ENDIAN_);
     }
 
-    ~Peer() { stop(); }
+    ~Peer() { stop(); if (replayThread.joinable()) replayThread.join(); }
 
     void set(const std::string& host, const std::string& port, uint32_t magic_bytes, uint32_t protocol_version, const std::string& user_agent = std::string(), uint32_t start_height = 0, bool relay = true)
     {
@@ -102,6 +125,17 @@ public:
 
     void setInvFlags(uint32_t invFlags) { invFlags_ = invFlags; }
 
+    // Records every message received and sent from the next start() on. An empty path turns capture off.
+    void setCaptureFile(const std::string& filepath) { captureFile_ = filepath; }
+
+    // Makes the next start() read messages from a capture file instead of connecting. Received messages
+    // go through the same handlers as on a live connection, and each sent message must match the next
+    // one captured. A received message is only delivered once everything captured before it has been
+    // sent, so handlers see the same sequence whatever the thread timing. With realtime set the original
+    // spacing is kept, otherwise messages are delivered as fast as they are handled. The peer closes at
+    // the end of the capture, or with a protocol error if the replay diverges. An empty path turns replay off.
+    void setReplayFile(const std::string& filepath, bool realtime = false) { replayFile_ = filepath; bReplayRealtime = realtime; }
+
     void subscribeMessage(peer_message_slot_t slot) { notifyMessage.connect(slot); }
     void subscribeHeaders(peer_headers_slot_t slot) { notifyHeaders.connect(slot); }
     void subscribeBlock(peer_block_slot_t slot) { notifyBlock.connect(slot); }
@@ -125,6 +159,9 @@ public:
     bool send(Coin::CoinNodeStructure& message);
 
     bool isRunning() const { return bRunning; }
+    bool isReplaying() const { return bReplaying; }
+
+    PeerStats getStats() const;
 
     uint32_t magic_bytes() const { return magic_bytes_; }
     const endpoint_t& endpoint() const { return endpoint_; }
@@ -314,6 +351,29 @@ private:
     // Protocol flags
     uint32_t invFlags_;
 
+    // Capture and replay
+    std::string captureFile_;
+    std::unique_ptr<PeerCaptureWriter> captureWriter_;
+
+    std::string replayFile_;
+    bool bReplayRealtime;
+    bool bReplaying;
+    boost::thread replayThread;
+    boost::mutex replayMutex;
+    boost::condition_variable replayCond;
+    std::deque<uchar_vector> replaySent;
+    std::size_t replayPending;
+
+    static const unsigned int REPLAY_TIMEOUT = 30; // seconds to wait for a captured message to be sent
+    static const std::size_t REPLAY_WINDOW = 64; // received messages queued ahead of the handlers
+
+    // Traffic counters
+    std::atomic<uint64_t> messagesReceived;
+    std::atomic<uint64_t> bytesReceived;
+    std::atomic<uint64_t> messagesSent;
+    std::atomic<uint64_t> bytesSent;
+    std::atomic<std::time_t> lastReceived;
+
     // State members
     boost::shared_mutex mutex;
     bool bRunning;
@@ -348,10 +408,13 @@ private:
     uchar_vector read_message;
     uchar_vector write_message;
     std::queue<boost::shared_ptr<uchar_vector>> sendQueue;
-    boost::mutex sendMutex;
+    mutable boost::mutex sendMutex;
 
     void do_connect(tcp::resolver::iterator iter);
     void do_read();
+    void do_process(const uchar_vector& message);
+    void do_capture(PeerCaptureRecord::direction_t direction, const bytes_t& message);
+    void do_replay(std::shared_ptr<PeerCaptureReader> reader);
     void do_write(boost::shared_ptr<uchar_vector> data);
     void do_send(const Coin::CoinNodeMessage& message); // calls do_write from the strand thread 
     void do_handshake();
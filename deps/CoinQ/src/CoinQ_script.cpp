@@ -103,112 +103,223 @@ uchar_vector getNextOp(const bytes_t& script, uint& pos, bool pushdataonly)
     if (script.size() == pos)
         return uchar_vector();
 
-    uint start = pos;
-    unsigned char op = script[pos++];
-    if (op >= OP_1 && op <= OP_16)
+    const unsigned char* start = script.data() + pos;
+    const unsigned char* next = start;
+    ScriptOp op;
+    decodeOp(next, script.data() + script.size(), op);
+    pos = next - script.data();
+
+    if (op.opcode >= OP_1 && op.opcode <= OP_16)
     {
         uchar_vector rval;
-        if (pushdataonly)   { rval.push_back(op - OP_1_OFFSET); }
-        else                { rval.push_back(op); }
+        if (pushdataonly)   { rval.push_back(op.opcode - OP_1_OFFSET); }
+        else                { rval.push_back(op.opcode); }
         return rval;
     }
-    else if (op <= 0x4b)
+
+    if (!pushdataonly)  return uchar_vector(start, next);
+    if (op.isPush())    return uchar_vector(op.data.begin(), op.data.end());
+    return uchar_vector();
+}
+
+void decodeOp(const unsigned char*& pos, const unsigned char* end, ScriptOp& op)
+{
+    op.opcode = *pos++;
+    std::size_t len;
+    if (op.opcode <= 0x4b)
     {
-        pos += op;
-        if (pushdataonly) { start += 1; }
+        len = op.opcode;
     }
-    else if (op == 0x4c)
+    else if (op.opcode == OP_PUSHDATA1)
     {
-        if (script.size() < pos + 1)
+        if (end - pos < 1)
             throw std::runtime_error("Unexpected end of script.");
 
-        uint32_t len = script[pos++];
-        pos += len;
-        if (pushdataonly) { start += 2; }
+        len = pos[0];
+        pos += 1;
     }
-    else if (op == 0x4d)
+    else if (op.opcode == OP_PUSHDATA2)
     {
-        if (script.size() < pos + 2)
+        if (end - pos < 2)
             throw std::runtime_error("Unexpected end of script.");
 
-        uint32_t len =  (uint32_t)script[pos++] |
-                        (uint32_t)script[pos++] << 8;
-
-        pos += len;
-        if (pushdataonly) { start += 3; }
+        len = (std::size_t)pos[0] | (std::size_t)pos[1] << 8;
+        pos += 2;
     }
-    else if (op == 0x4e)
+    else if (op.opcode == OP_PUSHDATA4)
     {
-        if (script.size() < pos + 4)
+        if (end - pos < 4)
             throw std::runtime_error("Unexpected end of script.");
 
-        uint32_t len =  (uint32_t)script[pos++]         |
-                        (uint32_t)script[pos++] << 8    |
-                        (uint32_t)script[pos++] << 16   |
-                        (uint32_t)script[pos++] << 24;
-
-        pos += len;
-        if (pushdataonly) { start += 5; }
+        len = (std::size_t)pos[0] | (std::size_t)pos[1] << 8 | (std::size_t)pos[2] << 16 | (std::size_t)pos[3] << 24;
+        pos += 4;
     }
-    else if (pushdataonly)
+    else
     {
-        return uchar_vector();
+        op.data = ScriptSpan(pos, 0);
+        return;
     }
 
-    if (script.size() < pos)
+    if ((std::size_t)(end - pos) < len)
         throw std::runtime_error("Script pos past end.");
 
-    return uchar_vector(script.begin() + start, script.begin() + pos);
+    op.data = ScriptSpan(pos, len);
+    pos += len;
 }
 
-payee_t getScriptPubKeyPayee(const uchar_vector& scriptPubKey)
+/*
+ * Template matchers
+*/
+bool matchPayToPubKeyHash(const ScriptSpan& txoutscript, ScriptSpan& pubkeyhash)
 {
-    if (scriptPubKey.size()   == 25 &&
-        scriptPubKey[0]       == 0x76 &&
-        scriptPubKey[1]       == 0xa9 &&
-        scriptPubKey[2]       == 0x14 &&
-        scriptPubKey[23]      == 0x88 &&
-        scriptPubKey[24]      == 0xac)
-    {
-        return std::make_pair(SCRIPT_PUBKEY_PAY_TO_PUBKEY_HASH, uchar_vector(scriptPubKey.begin() + 3, scriptPubKey.begin() + 23));
-    }
+    const unsigned char* s = txoutscript.data;
+    if (txoutscript.size != 25 ||
+        s[0]  != OP_DUP ||
+        s[1]  != OP_HASH160 ||
+        s[2]  != 20 ||
+        s[23] != OP_EQUALVERIFY ||
+        s[24] != OP_CHECKSIG) return false;
+
+    pubkeyhash = ScriptSpan(s + 3, 20);
+    return true;
+}
+
+bool matchPayToScriptHash(const ScriptSpan& txoutscript, ScriptSpan& scripthash)
+{
+    const unsigned char* s = txoutscript.data;
+    if (txoutscript.size != 23 ||
+        s[0]  != OP_HASH160 ||
+        s[1]  != 20 ||
+        s[22] != OP_EQUAL) return false;
+
+    scripthash = ScriptSpan(s + 2, 20);
+    return true;
+}
+
+bool matchPayToPubKey(const ScriptSpan& txoutscript, ScriptSpan& pubkey)
+{
+    if (txoutscript.size < 2 || txoutscript.data[txoutscript.size - 1] != OP_CHECKSIG) return false;
 
-    if (scriptPubKey.size()   == 23 &&
-        scriptPubKey[0]       == 0xa9 &&
-        scriptPubKey[1]       == 0x14 &&
-        scriptPubKey[22]      == 0x87)
+    const unsigned char* pos = txoutscript.begin();
+    const unsigned char* end = txoutscript.end() - 1;
+    ScriptOp op;
+    try
     {
-        return std::make_pair(SCRIPT_PUBKEY_PAY_TO_SCRIPT_HASH, uchar_vector(scriptPubKey.begin() + 2, scriptPubKey.begin() + 22));
+        decodeOp(pos, end, op);
     }
-
-    uint pos = 0;
-    uint32_t dataLength = getDataLength(scriptPubKey, pos);
-    if (pos + dataLength + 1== scriptPubKey.size() &&
-        scriptPubKey[pos + dataLength + 1] == 0xac)
+    catch (const std::exception&)
     {
-        return std::make_pair(SCRIPT_PUBKEY_PAY_TO_PUBKEY, uchar_vector(scriptPubKey.begin() + pos, scriptPubKey.begin() + pos + dataLength));
+        return false;
     }
 
-    if (scriptPubKey.size()   == 22 &&
-        scriptPubKey[0]       == OP_0 &&
-        scriptPubKey[1]       == 20)
+    if (pos != end || op.opcode > OP_PUSHDATA4 || op.data.empty()) return false;
+
+    pubkey = op.data;
+    return true;
+}
+
+bool matchPayToWitnessPubKeyHash(const ScriptSpan& txoutscript, ScriptSpan& pubkeyhash)
+{
+    const unsigned char* s = txoutscript.data;
+    if (txoutscript.size != 22 ||
+        s[0] != OP_0 ||
+        s[1] != 20) return false;
+
+    pubkeyhash = ScriptSpan(s + 2, 20);
+    return true;
+}
+
+bool matchPayToWitnessScriptHash(const ScriptSpan& txoutscript, ScriptSpan& scripthash)
+{
+    const unsigned char* s = txoutscript.data;
+    if (txoutscript.size != 34 ||
+        s[0] != OP_0 ||
+        s[1] != 32) return false;
+
+    scripthash = ScriptSpan(s + 2, 32);
+    return true;
+}
+
+bool matchMultiSig(const ScriptSpan& redeemscript, unsigned int& minsigs, std::vector<ScriptSpan>& pubkeys)
+{
+    // Smallest possible script is OP_1 <1 byte> OP_1 OP_CHECKMULTISIG
+    if (redeemscript.size < 5) return false;
+
+    const unsigned char* pos = redeemscript.begin();
+    const unsigned char* end = redeemscript.end();
+    if (*pos < OP_1 || *pos > OP_16 || *(end - 1) != OP_CHECKMULTISIG) return false;
+
+    unsigned int m = *pos++ - OP_1_OFFSET;
+    end--;
+
+    std::vector<ScriptSpan> keys;
+    while (pos < end && *pos <= 0x4b)
     {
-        return std::make_pair(SCRIPT_PUBKEY_PAY_TO_WITNESS_PUBKEY_HASH, uchar_vector(scriptPubKey.begin() + 2, scriptPubKey.begin() + 22));
+        std::size_t len = *pos++;
+        if (len == 0 || (std::size_t)(end - pos) < len || keys.size() >= 16) return false;
+        keys.push_back(ScriptSpan(pos, len));
+        pos += len;
     }
 
-    if (scriptPubKey.size()   == 34 &&
-        scriptPubKey[0]       == OP_0 &&
-        scriptPubKey[1]       == 32)
+    // The last op before OP_CHECKMULTISIG must be the pubkey count.
+    if (end - pos != 1 || *pos < OP_1 || *pos > OP_16) return false;
+
+    unsigned int n = *pos - OP_1_OFFSET;
+    if (n != keys.size() || n < m) return false;
+
+    minsigs = m;
+    pubkeys.swap(keys);
+    return true;
+}
+
+bool matchPayToScriptHashMultiSig(const ScriptSpan& txinscript, std::vector<ScriptSpan>& sigs, ScriptSpan& redeemscript, unsigned int& minsigs, std::vector<ScriptSpan>& pubkeys)
+{
+    if (txinscript.empty() || txinscript.data[0] != OP_0) return false;
+
+    std::vector<ScriptSpan> items;
+    try
     {
-        return std::make_pair(SCRIPT_PUBKEY_PAY_TO_WITNESS_SCRIPT_HASH, uchar_vector(scriptPubKey.begin() + 2, scriptPubKey.begin() + 34));
+        ScriptTokenizer tokenizer(txinscript);
+        ScriptTokenizer::const_iterator it = tokenizer.begin();
+        for (++it; it != tokenizer.end(); ++it)
+        {
+            if (it->opcode > OP_PUSHDATA4) return false;
+            items.push_back(it->data);
+        }
     }
-
-    if (scriptPubKey.size() == 0)
+    catch (const std::exception&)
     {
-        return std::make_pair(SCRIPT_PUBKEY_EMPTY_SCRIPT, uchar_vector());
+        return false;
     }
- 
-    return std::make_pair(SCRIPT_PUBKEY_UNKNOWN_TYPE, uchar_vector());
+
+    if (items.empty() || !matchMultiSig(items.back(), minsigs, pubkeys)) return false;
+    if (items.size() - 1 > pubkeys.size()) return false;
+
+    redeemscript = items.back();
+    items.pop_back();
+    sigs.swap(items);
+    return true;
+}
+
+payee_t getScriptPubKeyPayee(const uchar_vector& scriptPubKey)
+{
+    ScriptSpan payload;
+    ScriptType type = classifyScriptPubKey(scriptPubKey, payload);
+    return std::make_pair(type, uchar_vector(payload.begin(), payload.end()));
+}
+
+ScriptType classifyScriptPubKey(const ScriptSpan& scriptPubKey, ScriptSpan& payload)
+{
+    payload = ScriptSpan();
+    if (matchPayToPubKeyHash(scriptPubKey, payload))        return SCRIPT_PUBKEY_PAY_TO_PUBKEY_HASH;
+    if (matchPayToScriptHash(scriptPubKey, payload))        return SCRIPT_PUBKEY_PAY_TO_SCRIPT_HASH;
+    if (matchPayToWitnessPubKeyHash(scriptPubKey, payload)) return SCRIPT_PUBKEY_PAY_TO_WITNESS_PUBKEY_HASH;
+    if (matchPayToWitnessScriptHash(scriptPubKey, payload)) return SCRIPT_PUBKEY_PAY_TO_WITNESS_SCRIPT_HASH;
+    if (matchPayToPubKey(scriptPubKey, payload))            return SCRIPT_PUBKEY_PAY_TO_PUBKEY;
+    if (scriptPubKey.empty())                               return SCRIPT_PUBKEY_EMPTY_SCRIPT;
+
+    payload = ScriptSpan();
+    return SCRIPT_PUBKEY_UNKNOWN_TYPE;
 }
 
 bool isValidAddress(const std::string& address, const unsigned char addressVersions[])
@@ -312,16 +423,26 @@ void SymmetricHDKeyGroup::update()
 scriptstack_t scriptToStack(const uchar_vector& script)
 {
     scriptstack_t stack;
-    uint pos = 0;
-    while (pos < script.size())
+    const unsigned char* pos = script.data();
+    const unsigned char* end = script.data() + script.size();
+    while (pos < end)
     {
-        if (script[pos] == OP_TOKEN || script[pos] == OP_TOKENHASH)
+        if (*pos == OP_TOKEN || *pos == OP_TOKENHASH)
         {
-            pos += 2;
+            pos += std::min<std::ptrdiff_t>(2, end - pos);
             continue;
         }
 
-        stack.push_back(getNextOp(script, pos, true));
+        ScriptOp op;
+        decodeOp(pos, end, op);
+        if (op.opcode >= OP_1 && op.opcode <= OP_16)
+        {
+            stack.push_back(bytes_t(1, (unsigned char)(op.opcode - OP_1_OFFSET)));
+        }
+        else
+        {
+            stack.push_back(op.isPush() ? op.data.bytes() : bytes_t());
+        }
     }
     return stack;
 }
@@ -842,42 +963,37 @@ void SignableTxIn::setTxIn(const Coin::Transaction& tx, std::size_t nIn, uint64_
     if (nIn >= tx.inputs.size())
         throw std::runtime_error("SignableTxIn::setTxIn() - nIn out of range.");
 
-    // TODO: Clean the script stuff up.
-    const bytes_t& txinscript = tx.inputs[nIn].scriptSig.empty()
-        ? pushStackItem(txoutscript)
-        : tx.inputs[nIn].scriptSig;
+    // Tokenize the scripts in place and only copy out the items we keep.
+    bytes_t wrappedtxoutscript;
+    if (tx.inputs[nIn].scriptSig.empty()) { wrappedtxoutscript = pushStackItem(txoutscript); }
+    ScriptSpan txinscript = tx.inputs[nIn].scriptSig.empty()
+        ? ScriptSpan(wrappedtxoutscript)
+        : ScriptSpan(tx.inputs[nIn].scriptSig);
 
     const std::vector<uchar_vector>& stack = tx.inputs[nIn].scriptWitness.stack;
-    std::vector<bytes_t> objects;
-    unsigned int pos = 0;
-    while (pos < txinscript.size())
+    std::vector<ScriptSpan> objects;
+    for (auto& op: ScriptTokenizer(txinscript))
     {
-        std::size_t size = getDataLength(txinscript, pos);
-        if (pos + size > txinscript.size())
-            throw std::runtime_error("SignableTxIn::setTxIn() - Push operation exceeds data size.");
+        if (!op.isPush())
+            throw std::runtime_error("Operation is not push data.");
 
-        objects.push_back(bytes_t(txinscript.begin() + pos, txinscript.begin() + pos + size));
-        pos += size;
+        objects.push_back(op.data);
     }
 
     WitnessProgramType wpType = WITNESS_NONE;
-    std::vector<bytes_t> sigs;
+    ScriptSpan redeemscript;
+    std::vector<ScriptSpan> sigs;
     type_ = UNKNOWN;
     if (objects.size() == 1)
     {
-        uint pos = 0;
-        uchar_vector wp = getNextOp(txinscript, pos, true);
-        if (pos != txinscript.size()) return;
-
-        wpType = getWitnessProgramType(wp);
+        wpType = getWitnessProgramType(uchar_vector(objects[0].begin(), objects[0].end()));
         switch (wpType)
         {
         case WITNESS_P2WSH:
             if (stack.empty())
                 throw std::runtime_error("P2WSH transaction missing witness.");
 
-            redeemscript_ = stack.back();
-//LOGGER(trace) << "redeemscript: " << uchar_vector(redeemscript_).getHex() << std::endl;
+            redeemscript = stack.back();
             for (std::size_t i = 1; i < stack.size() - 1; i++) { sigs.push_back(stack[i]); }
             break;
 
@@ -888,9 +1004,9 @@ void SignableTxIn::setTxIn(const Coin::Transaction& tx, std::size_t nIn, uint64_
     else if (objects.size() == 2)
     {
         type_ = PAY_TO_PUBKEY_HASH;
-        pubkeys_.push_back(objects[1]);
+        pubkeys_.push_back(objects[1].bytes());
         minsigs_ = 1;
-        const bytes_t& sig = objects[0];
+        bytes_t sig = objects[0].bytes();
 
         // TODO: add support for other hash types.
         if (sig.back() != SIGHASH_ALL) throw std::runtime_error("Unsupported hash type.");
@@ -917,52 +1033,26 @@ void SignableTxIn::setTxIn(const Coin::Transaction& tx, std::size_t nIn, uint64_
     }
     else if (objects.size() >= 3)
     {
-        redeemscript_ = objects.back();
+        redeemscript = objects.back();
         for (std::size_t i = 1; i < objects.size() - 1; i++) { sigs.push_back(objects[i]); }
     }
 
-    if (redeemscript_.size() >= 3)
+    if (redeemscript.size >= 3)
     {
-        // Parse redeemscript
-        // Get minsigs. Size opcode is offset by 0x50.
-        unsigned char byte = redeemscript_[0];
-        if (byte < OP_1 || byte > OP_16) return;
-        minsigs_ = byte - OP_1_OFFSET;
-//LOGGER(trace) << "minsigs: " << minsigs_ << std::endl;
+        redeemscript_ = redeemscript.bytes();
 
-        unsigned int pos = 1;
-        while (true)
-        {
-            byte = redeemscript_[pos++];
-            if (pos >= redeemscript_.size()) return;
-
-            if (byte >= OP_1 && byte <= OP_16)
-            {
-                // Interpret byte as signature counter.
-                if (pubkeys_.size() < minsigs_ || (byte - OP_1_OFFSET) != pubkeys_.size()) return;
-
-                // Redeemscript must terminate with OP_CHECKMULTISIG
-                if (redeemscript_[pos++] != 0xae || pos != redeemscript_.size()) return;
-
-                break;
-            }
-            // Interpret byte as pubkey size
-            if (byte > 0x4b || pos + byte > redeemscript_.size()) return;
-
-            if (pubkeys_.size() >= 16) throw std::runtime_error("Public key maximum of 16 exceeded.");
-
-            pubkeys_.push_back(bytes_t(redeemscript_.begin() + pos, redeemscript_.begin() + pos + byte));
-//LOGGER(trace) << "pubkey: " << uchar_vector(pubkeys_.back()). getHex() << std::endl;
-            pos += byte;
-        }
+        std::vector<ScriptSpan> pubkeys;
+        if (!matchMultiSig(redeemscript, minsigs_, pubkeys)) return;
 
+        for (auto& pubkey: pubkeys) { pubkeys_.push_back(pubkey.bytes()); }
         type_ = (wpType == WITNESS_P2WSH ? PAY_TO_M_OF_N_WITNESS_V0 : PAY_TO_M_OF_N_SCRIPT_HASH);
     }
 
     if (sigs.size() > pubkeys_.size())
         throw std::runtime_error("Too many signatures.");
 
-    // Validate signatures.
+    // Validate signatures. The sighash is the same for every signature so compute it once.
+    bytes_t sighash;
     unsigned int iSig = 0;
     unsigned int nValidSigs = 0;
     for (auto& pubkey: pubkeys_)
@@ -977,20 +1067,22 @@ void SignableTxIn::setTxIn(const Coin::Transaction& tx, std::size_t nIn, uint64_
         }
         else
         {
+            const ScriptSpan& sig = sigs[iSig];
+
             // TODO: add support for other hash types.
-            if (sigs[iSig].back() != SIGHASH_ALL) throw std::runtime_error("Unsupported hash type.");
+            if (sig.data[sig.size - 1] != SIGHASH_ALL) throw std::runtime_error("Unsupported hash type.");
 
             // Remove hash type byte.
-            bytes_t signature(sigs[iSig].begin(), sigs[iSig].end() - 1);
+            bytes_t signature(sig.begin(), sig.end() - 1);
 
             // Verify signature.
-            bytes_t sighash = tx.getSigHash(SIGHASH_ALL, nIn, redeemscript_, outpointamount);
+            if (sighash.empty()) { sighash = tx.getSigHash(SIGHASH_ALL, nIn, redeemscript_, outpointamount); }
             secp256k1_key key;
             key.setPubKey(pubkey);
             if (secp256k1_verify(key, sighash, signature))
             {
                 // Signature is valid. Keep it.
-                sigs_.push_back(sigs[iSig]);
+                sigs_.push_back(sig.bytes());
 //LOGGER(trace) << "valid:       " << uchar_vector(sigs_.back()).getHex() << std::endl;
                 iSig++;
                 nValidSigs++;
@@ -999,7 +1091,7 @@ void SignableTxIn::setTxIn(const Coin::Transaction& tx, std::size_t nIn, uint64_
             {
                 // Signature is invalid. Add placeholder for this pubkey and test it for next pubkey
                 sigs_.push_back(bytes_t());
-//LOGGER(trace) << "invalid:     " << uchar_vector(sigs[iSig]).getHex() << std::endl;
+//LOGGER(trace) << "invalid:     " << uchar_vector(sig.bytes()).getHex() << std::endl;
             }
         }
     }
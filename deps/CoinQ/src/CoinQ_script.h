@@ -189,6 +189,125 @@ uint32_t getDataLength(const uchar_vector& script, uint& pos);
 */
 uchar_vector getNextOp(const bytes_t& script, uint& pos, bool pushdataonly = false);
 
+/*
+ * ScriptSpan - a view of bytes inside a script buffer. Nothing is copied so the buffer must outlive the span.
+*/
+struct ScriptSpan
+{
+    const unsigned char* data;
+    std::size_t size;
+
+    ScriptSpan() : data(nullptr), size(0) { }
+    ScriptSpan(const unsigned char* data_, std::size_t size_) : data(data_), size(size_) { }
+    ScriptSpan(const bytes_t& bytes) : data(bytes.data()), size(bytes.size()) { }
+
+    bool empty() const { return size == 0; }
+    const unsigned char* begin() const { return data; }
+    const unsigned char* end() const { return data + size; }
+    bytes_t bytes() const { return bytes_t(begin(), end()); }
+};
+
+/*
+ * ScriptOp - a single decoded operation. For push operations data is a view of the pushed bytes.
+*/
+struct ScriptOp
+{
+    unsigned char opcode;
+    ScriptSpan data;
+
+    // OP_0, OP_PUSHDATAn, OP_1NEGATE and OP_1 through OP_16 push to the stack.
+    bool isPush() const { return opcode <= OP_PUSHDATA4 || opcode == OP_1NEGATE || (opcode >= OP_1 && opcode <= OP_16); }
+};
+
+/*
+ * decodeOp
+ *      precondition: pos < end
+ *      postcondition: pos is advanced to the start of the next operation
+ *      throws: if a push operation runs past end
+*/
+void decodeOp(const unsigned char*& pos, const unsigned char* end, ScriptOp& op);
+
+/*
+ * ScriptTokenizer - iterates the operations of a script without copying any data.
+ *
+ *      for (auto& op: ScriptTokenizer(script)) { ... }
+ *
+ *      Incrementing an iterator throws if a push operation runs past the end of the script.
+*/
+class ScriptTokenizer
+{
+public:
+    class const_iterator
+    {
+    public:
+        typedef std::forward_iterator_tag   iterator_category;
+        typedef ScriptOp                    value_type;
+        typedef std::ptrdiff_t              difference_type;
+        typedef const ScriptOp*             pointer;
+        typedef const ScriptOp&             reference;
+
+        const_iterator() : pos_(nullptr), next_(nullptr), end_(nullptr) { }
+        const_iterator(const unsigned char* pos, const unsigned char* end) : pos_(pos), next_(pos), end_(end) { decode(); }
+
+        reference operator*() const { return op_; }
+        pointer operator->() const { return &op_; }
+
+        const_iterator& operator++() { pos_ = next_; decode(); return *this; }
+        const_iterator operator++(int) { const_iterator rval(*this); ++(*this); return rval; }
+
+        bool operator==(const const_iterator& rhs) const { return pos_ == rhs.pos_; }
+        bool operator!=(const const_iterator& rhs) const { return pos_ != rhs.pos_; }
+
+        // Start of the current operation in the script buffer.
+        const unsigned char* position() const { return pos_; }
+
+    private:
+        const unsigned char* pos_;
+        const unsigned char* next_;
+        const unsigned char* end_;
+        ScriptOp op_;
+
+        void decode() { if (next_ < end_) decodeOp(next_, end_, op_); }
+    };
+
+    ScriptTokenizer(const unsigned char* begin, const unsigned char* end) : begin_(begin), end_(end) { }
+    explicit ScriptTokenizer(const bytes_t& script) : begin_(script.data()), end_(script.data() + script.size()) { }
+    explicit ScriptTokenizer(const ScriptSpan& script) : begin_(script.begin()), end_(script.end()) { }
+
+    const_iterator begin() const { return const_iterator(begin_, end_); }
+    const_iterator end() const { return const_iterator(end_, end_); }
+
+private:
+    const unsigned char* begin_;
+    const unsigned char* end_;
+};
+
+/*
+ * Template matchers - return true iff the script has the given form. Output spans point into the script.
+ *      None of them throw on malformed scripts.
+*/
+
+// OP_DUP OP_HASH160 <20 bytes> OP_EQUALVERIFY OP_CHECKSIG
+bool matchPayToPubKeyHash(const ScriptSpan& txoutscript, ScriptSpan& pubkeyhash);
+
+// OP_HASH160 <20 bytes> OP_EQUAL
+bool matchPayToScriptHash(const ScriptSpan& txoutscript, ScriptSpan& scripthash);
+
+// <pubkey> OP_CHECKSIG
+bool matchPayToPubKey(const ScriptSpan& txoutscript, ScriptSpan& pubkey);
+
+// OP_0 <20 bytes>
+bool matchPayToWitnessPubKeyHash(const ScriptSpan& txoutscript, ScriptSpan& pubkeyhash);
+
+// OP_0 <32 bytes>
+bool matchPayToWitnessScriptHash(const ScriptSpan& txoutscript, ScriptSpan& scripthash);
+
+// OP_m <pubkey 1> ... <pubkey n> OP_n OP_CHECKMULTISIG with 1 <= m <= n <= 16
+bool matchMultiSig(const ScriptSpan& redeemscript, unsigned int& minsigs, std::vector<ScriptSpan>& pubkeys);
+
+// OP_0 <sig or placeholder>... <m-of-n redeemscript>
+bool matchPayToScriptHashMultiSig(const ScriptSpan& txinscript, std::vector<ScriptSpan>& sigs, ScriptSpan& redeemscript, unsigned int& minsigs, std::vector<ScriptSpan>& pubkeys);
+
 // TODO: Get rid of PUBKEY in names below
 enum ScriptType {
     SCRIPT_PUBKEY_UNKNOWN_TYPE,
@@ -216,6 +335,11 @@ typedef std::pair<ScriptType, uchar_vector> payee_t;
 */
 payee_t getScriptPubKeyPayee(const uchar_vector& scriptPubKey);
 
+/*
+ * classifyScriptPubKey - same as getScriptPubKeyPayee but payload is a view into scriptPubKey so nothing is allocated.
+*/
+ScriptType classifyScriptPubKey(const ScriptSpan& scriptPubKey, ScriptSpan& payload);
+
 /*
  * isValidAddress - check whether address is valid
 */
@@ -15,8 +15,13 @@
 #include <vector>
 
 typedef std::vector<unsigned char> bytes_t;
-typedef std::vector<unsigned char> secure_bytes_t;
 
-// TODO: use custom allocator for secure_bytes_t;
+// Must match CoinCore/typedefs.h.
+#ifdef USE_SECURE_ALLOCATOR
+#include <stdutils/secure_allocator.h>
+typedef stdutils::secure_vector secure_bytes_t;
+#else
+typedef std::vector<unsigned char> secure_bytes_t;
+#endif
 
 #endif // COINQ_TYPEDEFS_H
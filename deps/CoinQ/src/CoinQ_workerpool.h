@@ -0,0 +1,110 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// CoinQ_workerpool.h
+//
+// Copyright (c) 2011-2016 Ciphrex Corp.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+//
+
+#pragma once
+
+#include <boost/thread.hpp>
+
+#include <deque>
+#include <functional>
+
+namespace CoinQ
+{
+
+// A fixed set of threads that lives as long as the pool, for work that is split into a few tasks
+// often enough that starting threads for each batch would show.
+class WorkerPool
+{
+public:
+    explicit WorkerPool(unsigned int nThreads)
+        : bStopping_(false)
+    {
+        for (unsigned int i = 0; i < nThreads; i++) { threads_.create_thread(std::bind(&WorkerPool::work, this)); }
+    }
+
+    ~WorkerPool()
+    {
+        {
+            boost::lock_guard<boost::mutex> lock(mutex_);
+            bStopping_ = true;
+        }
+        workCond_.notify_all();
+        threads_.join_all();
+    }
+
+    // Runs task(0) to task(nTasks - 1) and returns when all are done. The calling thread runs task(0)
+    // and then takes queued tasks itself rather than just waiting, so it also works with no threads.
+    // task must not throw.
+    void run(std::size_t nTasks, const std::function<void(std::size_t)>& task)
+    {
+        if (nTasks == 0) return;
+
+        std::size_t nPending = nTasks - 1;
+        boost::condition_variable doneCond;
+        {
+            boost::lock_guard<boost::mutex> lock(mutex_);
+            for (std::size_t i = 1; i < nTasks; i++)
+            {
+                queue_.push_back([&, i]()
+                {
+                    task(i);
+                    boost::lock_guard<boost::mutex> lock(mutex_);
+                    if (--nPending == 0) { doneCond.notify_all(); }
+                });
+            }
+        }
+        workCond_.notify_all();
+
+        task(0);
+
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        while (nPending > 0)
+        {
+            if (queue_.empty())
+            {
+                doneCond.wait(lock);
+                continue;
+            }
+
+            std::function<void()> next = std::move(queue_.front());
+            queue_.pop_front();
+            lock.unlock();
+            next();
+            lock.lock();
+        }
+    }
+
+    std::size_t size() const { return threads_.size(); }
+
+private:
+    void work()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        while (true)
+        {
+            while (queue_.empty() && !bStopping_) { workCond_.wait(lock); }
+            if (queue_.empty()) return;
+
+            std::function<void()> next = std::move(queue_.front());
+            queue_.pop_front();
+            lock.unlock();
+            next();
+            lock.lock();
+        }
+    }
+
+    boost::mutex mutex_;
+    boost::condition_variable workCond_;
+    std::deque<std::function<void()>> queue_;
+    bool bStopping_;
+    boost::thread_group threads_;
+};
+
+}
@@ -0,0 +1,214 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// header snapshot and checkpoint tests
+//
+// headersnapshot_test.cpp
+//
+// Copyright (c) 2011-2016 Ciphrex Corp.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+//
+// Builds a chain with the easiest target, so headers are mined in a few
+// tries, and checks how CoinQBlockTreeMem writes and reloads snapshots and
+// how checkpoints vouch for the headers below them.
+//
+
+#include <CoinQ/CoinQ_blocks.h>
+
+#include <boost/filesystem.hpp>
+
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+
+const uint32_t BITS = 0x207fffff;
+const int CHAIN_HEIGHT = 3000;
+
+const string SNAPSHOT_FILE = "build/headersnapshot_test.snapshot";
+const string BLOCKTREE_FILE = "build/headersnapshot_test.dat";
+
+unsigned int g_failed = 0;
+unsigned int g_passed = 0;
+
+void check(bool condition, const string& name)
+{
+    if (condition)
+    {
+        g_passed++;
+        return;
+    }
+
+    g_failed++;
+    cerr << "FAILED: " << name << endl;
+}
+
+template<typename F>
+bool throws(F f)
+{
+    try
+    {
+        f();
+    }
+    catch (const exception&)
+    {
+        return true;
+    }
+    return false;
+}
+
+// Tries nonces until the header's proof of work is as valid as asked for.
+Coin::CoinBlockHeader mine(const uchar_vector& prevBlockHash, uint32_t timestamp, bool bValid = true)
+{
+    Coin::CoinBlockHeader header(1, timestamp, BITS, 0, prevBlockHash, uchar_vector(32, 7));
+    while (header.checkProofOfWork() != bValid) { header.incrementNonce(); }
+    return header;
+}
+
+vector<Coin::CoinBlockHeader> mineChain(int height)
+{
+    vector<Coin::CoinBlockHeader> chain;
+    chain.push_back(mine(uchar_vector(32, 0), 1000));
+    for (int i = 1; i <= height; i++) { chain.push_back(mine(chain.back().hash(), 1000 + i * 600)); }
+    return chain;
+}
+
+void buildTree(CoinQBlockTreeMem& tree, const vector<Coin::CoinBlockHeader>& chain, bool bCheckProofOfWork = true)
+{
+    tree.setGenesisBlock(chain[0]);
+    for (size_t i = 1; i < chain.size(); i++) { tree.insertHeader(chain[i], bCheckProofOfWork); }
+}
+
+CoinQ::checkpoints_t getCheckpoints(const vector<Coin::CoinBlockHeader>& chain)
+{
+    return { { 1000, chain[1000].hash() }, { 2000, chain[2000].hash() } };
+}
+
+void testSnapshot(const CoinQBlockTreeMem& full, const vector<Coin::CoinBlockHeader>& chain)
+{
+    full.writeSnapshot(SNAPSHOT_FILE, 1000);
+
+    CoinQBlockTreeMem tree;
+    tree.setCheckpoints(getCheckpoints(chain));
+    tree.loadSnapshot(SNAPSHOT_FILE);
+    check(tree.getBaseHeight() == 1000, "snapshot starts at its base");
+    check(tree.getBestHeight() == CHAIN_HEIGHT && tree.getBestHash() == chain.back().hash(), "snapshot reaches the tip");
+    check(tree.getTotalWork() == full.getTotalWork(), "snapshot keeps the total work");
+    check(tree.getHeader(1000).chainWork == full.getHeader(1000).chainWork, "snapshot keeps the chain work at its base");
+    check(tree.getLocatorHashes(-1).front() == chain.back().hash(), "locator starts at the tip");
+    check(throws([&]() { tree.deleteHeader(chain[1000].hash()); }), "base cannot be deleted");
+
+    // A tree rooted at a snapshot is flushed as one and reloads from the same file as a full tree.
+    Coin::CoinBlockHeader next = mine(chain.back().hash(), 1000 + (CHAIN_HEIGHT + 1) * 600);
+    check(tree.insertHeader(next), "snapshot tree extends");
+    tree.flushToFile(BLOCKTREE_FILE);
+
+    CoinQBlockTreeMem reloaded;
+    reloaded.setCheckpoints(getCheckpoints(chain));
+    reloaded.loadFromFile(BLOCKTREE_FILE, true);
+    check(reloaded.getBaseHeight() == 1000 && reloaded.getBestHeight() == CHAIN_HEIGHT + 1 && reloaded.getBestHash() == next.hash(), "flushed snapshot tree reloads");
+
+    // The base need not be a checkpoint as long as a later header is.
+    full.writeSnapshot(SNAPSHOT_FILE, 900);
+    CoinQBlockTreeMem below;
+    below.setCheckpoints(getCheckpoints(chain));
+    below.loadSnapshot(SNAPSHOT_FILE);
+    check(below.getBaseHeight() == 900 && below.getBestHeight() == CHAIN_HEIGHT, "snapshot based below a checkpoint loads");
+}
+
+void testCorruptSnapshot(const CoinQBlockTreeMem& full, const vector<Coin::CoinBlockHeader>& chain)
+{
+    full.writeSnapshot(SNAPSHOT_FILE, 1000);
+    {
+        fstream file(SNAPSHOT_FILE, ios::in | ios::out | ios::binary);
+        file.seekp(100);
+        file.put('x');
+    }
+
+    CoinQBlockTreeMem tree;
+    tree.setCheckpoints(getCheckpoints(chain));
+    check(throws([&]() { tree.loadSnapshot(SNAPSHOT_FILE); }), "corrupted snapshot fails its checksum");
+}
+
+void testCheckpoints(const CoinQBlockTreeMem& full, const vector<Coin::CoinBlockHeader>& chain)
+{
+    full.writeSnapshot(SNAPSHOT_FILE, 1000);
+
+    CoinQBlockTreeMem unchecked;
+    check(throws([&]() { unchecked.loadSnapshot(SNAPSHOT_FILE); }), "snapshot without checkpoints is refused");
+
+    CoinQBlockTreeMem outOfRange;
+    outOfRange.setCheckpoints({ { CHAIN_HEIGHT + 1000, uchar_vector(32, 1) } });
+    check(throws([&]() { outOfRange.loadSnapshot(SNAPSHOT_FILE); }), "snapshot reaching no checkpoint is refused");
+
+    CoinQBlockTreeMem mismatched;
+    mismatched.setCheckpoints({ { 1500, uchar_vector(32, 1) } });
+    check(throws([&]() { mismatched.loadSnapshot(SNAPSHOT_FILE); }), "snapshot with a mismatched checkpoint hash is refused");
+
+    CoinQBlockTreeMem inserted;
+    inserted.setCheckpoints({ { 3, uchar_vector(32, 1) } });
+    inserted.setGenesisBlock(chain[0]);
+    inserted.insertHeader(chain[1]);
+    inserted.insertHeader(chain[2]);
+    check(throws([&]() { inserted.insertHeader(chain[3]); }), "header with a mismatched checkpoint hash is refused");
+}
+
+void testUnanchoredProofOfWork(const vector<Coin::CoinBlockHeader>& chain)
+{
+    // The last header fails its proof of work, which only checkpoints at or above it can vouch for.
+    vector<Coin::CoinBlockHeader> badChain(chain.begin(), chain.begin() + 1500);
+    badChain.back() = mine(badChain[1498].hash(), 99, false);
+
+    CoinQBlockTreeMem bad;
+    buildTree(bad, badChain, false);
+    bad.flushToFile(BLOCKTREE_FILE);
+
+    CoinQBlockTreeMem aboveTopCheckpoint;
+    aboveTopCheckpoint.setCheckpoints({ { 1000, chain[1000].hash() } });
+    check(throws([&]() { aboveTopCheckpoint.loadFromFile(BLOCKTREE_FILE, true); }), "bad proof of work above the top checkpoint is refused");
+
+    bad.writeSnapshot(SNAPSHOT_FILE, 1000);
+    CoinQBlockTreeMem snapshot;
+    snapshot.setCheckpoints({ { 1000, chain[1000].hash() } });
+    check(throws([&]() { snapshot.loadSnapshot(SNAPSHOT_FILE); }), "snapshot with bad proof of work above the top checkpoint is refused");
+
+    CoinQBlockTreeMem noCheckpoints;
+    check(throws([&]() { noCheckpoints.loadFromFile(BLOCKTREE_FILE, true); }), "bad proof of work without checkpoints is refused");
+
+    CoinQBlockTreeMem vouched;
+    vouched.setCheckpoints({ { 1000, chain[1000].hash() }, { 1499, badChain.back().hash() } });
+    vouched.loadFromFile(BLOCKTREE_FILE, true);
+    check(vouched.getBestHeight() == 1499, "checkpoint vouches for the headers below it");
+}
+
+}
+
+int main()
+{
+    try
+    {
+        vector<Coin::CoinBlockHeader> chain = mineChain(CHAIN_HEIGHT);
+        CoinQBlockTreeMem full;
+        buildTree(full, chain);
+
+        testSnapshot(full, chain);
+        testCorruptSnapshot(full, chain);
+        testCheckpoints(full, chain);
+        testUnanchoredProofOfWork(chain);
+    }
+    catch (const exception& e)
+    {
+        cerr << "Error: " << e.what() << endl;
+        return -2;
+    }
+
+    cout << g_passed << " passed, " << g_failed << " failed." << endl;
+    return g_failed ? -1 : 0;
+}
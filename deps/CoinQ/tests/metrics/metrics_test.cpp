@@ -0,0 +1,162 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// metrics page tests
+//
+// metrics_test.cpp
+//
+// Copyright (c) 2011-2016 Ciphrex Corp.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+//
+// Renders metric families with MetricsWriter and compares them with the
+// text exposition format, then fetches a page from a MetricsServer on the
+// loopback interface.
+//
+
+#include <CoinQ/CoinQ_metrics.h>
+
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+using namespace CoinQ;
+using namespace std;
+
+namespace
+{
+
+unsigned int g_failed = 0;
+unsigned int g_passed = 0;
+
+void check(bool condition, const string& name)
+{
+    if (condition)
+    {
+        g_passed++;
+        return;
+    }
+
+    g_failed++;
+    cerr << "FAILED: " << name << endl;
+}
+
+template<typename F>
+bool throws(F f)
+{
+    try
+    {
+        f();
+    }
+    catch (const exception&)
+    {
+        return true;
+    }
+    return false;
+}
+
+void testFamilies()
+{
+    MetricsWriter writer;
+    writer.counter("vault_txs_total", "Transactions inserted.", 42);
+    writer.family("peer_latency_seconds", MetricsWriter::HISTOGRAM, "Peer round trip.");
+    writer.sample("peer_latency_seconds_bucket", 3, { { "le", "0.5" } });
+    writer.sample("peer_latency_seconds_sum", 1.25);
+    check(writer.str() ==
+        "# HELP vault_txs_total Transactions inserted.\n"
+        "# TYPE vault_txs_total counter\n"
+        "vault_txs_total 42\n"
+        "# HELP peer_latency_seconds Peer round trip.\n"
+        "# TYPE peer_latency_seconds histogram\n"
+        "peer_latency_seconds_bucket{le=\"0.5\"} 3\n"
+        "peer_latency_seconds_sum 1.25\n", "families and samples rendered in order");
+
+    MetricsWriter gauge;
+    gauge.gauge("vault_best_height", "Best header height.", 431250);
+    check(gauge.str().find("# TYPE vault_best_height gauge\n") != string::npos, "gauge type line");
+    check(gauge.str().find("vault_best_height 431250\n") != string::npos, "large integer not in exponent form");
+}
+
+void testLabels()
+{
+    MetricsWriter writer;
+    writer.sample("requests", 1, { { "command", "a\"b" }, { "path", "c:\\d" }, { "note", "e\nf" } });
+    check(writer.str() == "requests{command=\"a\\\"b\",path=\"c:\\\\d\",note=\"e\\nf\"} 1\n", "label values escaped");
+
+    MetricsWriter help;
+    help.family("x", MetricsWriter::GAUGE, "quote \" backslash \\ newline \n end");
+    check(help.str() == "# HELP x quote \" backslash \\\\ newline \\n end\n# TYPE x gauge\n", "help escapes backslash and newline only");
+}
+
+void testSpecialValues()
+{
+    MetricsWriter writer;
+    writer.sample("a", numeric_limits<double>::infinity(), { { "le", "+Inf" } });
+    writer.sample("b", -numeric_limits<double>::infinity());
+    writer.sample("c", numeric_limits<double>::quiet_NaN());
+    writer.sample("d", 0.1);
+    check(writer.str() == "a{le=\"+Inf\"} +Inf\nb -Inf\nc NaN\nd 0.1\n", "infinities, NaN and fractions formatted");
+}
+
+string fetch(unsigned short port, const string& request)
+{
+    boost::asio::io_service io_service;
+    boost::asio::ip::tcp::socket socket(io_service);
+    socket.connect(boost::asio::ip::tcp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"), port));
+    boost::asio::write(socket, boost::asio::buffer(request));
+
+    string response;
+    char buf[1024];
+    boost::system::error_code ec;
+    size_t n;
+    while ((n = socket.read_some(boost::asio::buffer(buf), ec)) > 0) { response.append(buf, n); }
+    return response;
+}
+
+void testServer()
+{
+    MetricsServer server([]()
+    {
+        MetricsWriter writer;
+        writer.gauge("up", "Server is up.", 1);
+        return writer.str();
+    });
+
+    // Port 0 lets the system pick a free one.
+    server.start(0);
+    check(server.isRunning() && server.port() != 0, "server listens on a picked port");
+    check(throws([&]() { server.start(0); }), "second start throws");
+
+    string response = fetch(server.port(), "GET /metrics HTTP/1.0\r\n\r\n");
+    check(response.find("HTTP/1.0 200 OK\r\n") == 0, "GET /metrics answers 200");
+    check(response.find("Content-Type: text/plain; version=0.0.4\r\n") != string::npos, "exposition content type");
+    check(response.find("\r\n\r\n# HELP up Server is up.\n# TYPE up gauge\nup 1\n") != string::npos, "page is the rendered metrics");
+
+    check(fetch(server.port(), "GET /other HTTP/1.0\r\n\r\n").find("HTTP/1.0 404") == 0, "other paths answer 404");
+    check(fetch(server.port(), "POST /metrics HTTP/1.0\r\n\r\n").find("HTTP/1.0 405") == 0, "other methods answer 405");
+
+    server.stop();
+    check(!server.isRunning(), "server stopped");
+}
+
+}
+
+int main()
+{
+    try
+    {
+        testFamilies();
+        testLabels();
+        testSpecialValues();
+        testServer();
+    }
+    catch (const exception& e)
+    {
+        cerr << "Error: " << e.what() << endl;
+        return -2;
+    }
+
+    cout << g_passed << " passed, " << g_failed << " failed." << endl;
+    return g_failed ? -1 : 0;
+}
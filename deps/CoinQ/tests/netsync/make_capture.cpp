@@ -0,0 +1,107 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// make_capture.cpp
+//
+// Copyright (c) 2011-2016 Ciphrex Corp.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+//
+// Writes netsync_test.capture: a peer session over the test chain as
+// NetworkSync sees it when it starts from the genesis block without a filter
+// and syncs blocks from height 1 once headers are synched. Sent messages are
+// written exactly as NetworkSync builds them, since a replay compares them.
+//
+
+#include "testchain.h"
+
+#include <CoinQ/CoinQ_peer_capture.h>
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+using namespace CoinQ;
+using namespace std;
+
+namespace
+{
+
+const unsigned char LOCALHOST[] = {0,0,0,0,0,0,0,0,0,0,255,255,127,0,0,1};
+
+class CaptureBuilder
+{
+public:
+    CaptureBuilder(const string& filepath, const CoinParams& coinParams) : writer_(filepath, coinParams.magic_bytes()), coinParams_(coinParams) { }
+
+    template<typename Message> void received(Message message) { write(PeerCaptureRecord::RECEIVED, message); }
+    template<typename Message> void sent(Message message) { write(PeerCaptureRecord::SENT, message); }
+
+    void sentGetFilteredBlock(const uchar_vector& hash)
+    {
+        Coin::Inventory inv;
+        inv.addItem(Coin::InventoryItem(MSG_FILTERED_BLOCK, hash));
+        sent(Coin::GetDataMessage(inv));
+    }
+
+private:
+    void write(PeerCaptureRecord::direction_t direction, Coin::CoinNodeStructure& message)
+    {
+        writer_.write(direction, Coin::CoinNodeMessage(coinParams_.magic_bytes(), &message).getSerialized());
+    }
+
+    PeerCaptureWriter writer_;
+    const CoinParams& coinParams_;
+};
+
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc != 2)
+    {
+        cerr << "# Usage: " << argv[0] << " <capture file>" << endl;
+        return -1;
+    }
+
+    try
+    {
+        const CoinParams& coinParams = TestChain::getCoinParams();
+        vector<Coin::MerkleBlock> merkleBlocks = TestChain::getMerkleBlocks();
+
+        vector<Coin::CoinBlockHeader> headers;
+        for (auto& merkleBlock: merkleBlocks) { headers.push_back(merkleBlock.blockHeader); }
+
+        CaptureBuilder capture(argv[1], coinParams);
+
+        // Handshake. Version messages are only compared by command.
+        Coin::NetworkAddress address;
+        address.set(NODE_NETWORK, LOCALHOST, 0);
+        Coin::VersionMessage version(coinParams.protocol_version(), NODE_NETWORK, TestChain::GENESIS_TIME, address, address, 0, "/testpeer:0.1/", TestChain::BLOCK_COUNT, true);
+        capture.sent(version);
+        capture.received(version);
+        capture.sent(Coin::VerackMessage());
+        capture.received(Coin::VerackMessage());
+
+        // Headers, located from the genesis block and then from the new tip.
+        capture.sent(Coin::GetHeadersMessage(coinParams.protocol_version(), vector<uchar_vector>(1, coinParams.genesis_block().hash())));
+        capture.received(Coin::HeadersMessage(headers));
+        capture.sent(Coin::GetHeadersMessage(coinParams.protocol_version(), vector<uchar_vector>(1, headers.back().hash())));
+        capture.received(Coin::HeadersMessage());
+
+        // Filtered blocks, each asked for once the one before it is done. Block 1 is followed by its matched tx.
+        for (auto& merkleBlock: merkleBlocks)
+        {
+            capture.sentGetFilteredBlock(merkleBlock.hash());
+            capture.received(merkleBlock);
+            if (&merkleBlock == &merkleBlocks.front()) { capture.received(TestChain::getMatchedTx()); }
+        }
+    }
+    catch (const exception& e)
+    {
+        cerr << "Error: " << e.what() << endl;
+        return -2;
+    }
+
+    return 0;
+}
@@ -0,0 +1,200 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// network sync replay tests
+//
+// netsync_test.cpp
+//
+// Copyright (c) 2011-2016 Ciphrex Corp.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+//
+// Replays netsync_test.capture, a session over the chain in testchain.h, into
+// a NetworkSync starting from the genesis block and checks the headers it
+// ends up with and the notifications it sends on the way. Then replays it
+// with a bloom filter loaded, which changes what NetworkSync sends, and checks
+// that the replay reports the divergence.
+//
+
+#include "testchain.h"
+
+#include <CoinQ/CoinQ_netsync.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace CoinQ::Network;
+using namespace std;
+
+namespace
+{
+
+const string CAPTURE_FILE = "netsync_test.capture";
+const string BLOCKTREE_FILE = "build/netsync_test_blocktree.dat";
+
+// Replays run as fast as the handlers allow, so this only guards against a hang.
+const unsigned int REPLAY_TIMEOUT = 30;
+
+unsigned int g_failed = 0;
+unsigned int g_passed = 0;
+
+void check(bool condition, const string& name)
+{
+    if (condition)
+    {
+        g_passed++;
+        return;
+    }
+
+    g_failed++;
+    cerr << "FAILED: " << name << endl;
+}
+
+// Everything NetworkSync reports during a replay. Handlers run on its IO thread.
+struct SyncEvents
+{
+    SyncEvents() : headersSynched(0), blocksSynched(0), bStopped(false) { }
+
+    struct MerkleTx
+    {
+        int height;
+        bytes_t hash;
+        unsigned int txindex;
+        unsigned int txcount;
+    };
+
+    unsigned int headersSynched;
+    unsigned int blocksSynched;
+    vector<MerkleTx> merkleTxs;
+    vector<int> merkleBlockHeights;
+    vector<string> protocolErrors;
+    bool bStopped;
+
+    boost::mutex mutex;
+    boost::condition_variable cond;
+
+    template<typename F>
+    void update(F f)
+    {
+        boost::lock_guard<boost::mutex> lock(mutex);
+        f();
+        cond.notify_all();
+    }
+
+    template<typename P>
+    bool waitFor(P predicate)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        return cond.timed_wait(lock, boost::posix_time::seconds(REPLAY_TIMEOUT), predicate);
+    }
+};
+
+void subscribe(NetworkSync& networkSync, SyncEvents& events)
+{
+    // Blocks are synched from the first one as soon as headers are, as the capture expects.
+    networkSync.subscribeHeadersSynched([&]()
+    {
+        events.update([&]() { events.headersSynched++; });
+        networkSync.syncBlocks(1);
+    });
+
+    networkSync.subscribeMerkleTx([&](const ChainMerkleBlock& merkleBlock, const Coin::Transaction& tx, unsigned int txindex, unsigned int txcount)
+    {
+        SyncEvents::MerkleTx merkleTx = { merkleBlock.height, tx.hash(), txindex, txcount };
+        events.update([&]() { events.merkleTxs.push_back(merkleTx); });
+    });
+
+    networkSync.subscribeMerkleBlock([&](const ChainMerkleBlock& merkleBlock)
+    {
+        events.update([&]() { events.merkleBlockHeights.push_back(merkleBlock.height); });
+    });
+
+    networkSync.subscribeBlocksSynched([&]() { events.update([&]() { events.blocksSynched++; }); });
+    networkSync.subscribeProtocolError([&](const string& error, int /*code*/) { events.update([&]() { events.protocolErrors.push_back(error); }); });
+    networkSync.subscribeStopped([&]() { events.update([&]() { events.bStopped = true; }); });
+}
+
+void testReplay()
+{
+    boost::filesystem::remove(BLOCKTREE_FILE);
+
+    // Declared first so it outlives the IO thread, which NetworkSync joins on destruction.
+    SyncEvents events;
+    NetworkSync networkSync(TestChain::getCoinParams());
+    networkSync.loadHeaders(BLOCKTREE_FILE, false);
+    check(networkSync.getBestHeight() == 0, "starts from the genesis block");
+
+    subscribe(networkSync, events);
+    networkSync.startReplay(CAPTURE_FILE);
+    check(events.waitFor([&]() { return events.bStopped; }), "replay stops at the end of the capture");
+
+    vector<Coin::MerkleBlock> merkleBlocks = TestChain::getMerkleBlocks();
+    check(networkSync.getBestHeight() == TestChain::BLOCK_COUNT, "best height is the captured tip");
+    check(networkSync.getBestHash() == merkleBlocks.back().hash(), "best hash is the captured tip");
+
+    boost::lock_guard<boost::mutex> lock(events.mutex);
+    check(events.protocolErrors.empty(), "replay matches the capture");
+    for (auto& error: events.protocolErrors) { cerr << "  " << error << endl; }
+    check(events.headersSynched == 1, "headers synched notified once");
+    check(events.blocksSynched == 1, "blocks synched notified once");
+
+    check(events.merkleTxs.size() == 1, "one merkle tx notified");
+    if (events.merkleTxs.size() == 1)
+    {
+        const SyncEvents::MerkleTx& merkleTx = events.merkleTxs.front();
+        check(merkleTx.hash == TestChain::getMatchedTx().hash(), "merkle tx is the matched tx");
+        check(merkleTx.height == 1, "merkle tx is in block 1");
+        check(merkleTx.txindex == 0 && merkleTx.txcount == 1, "merkle tx is the only match in its block");
+    }
+
+    // Blocks without matches are notified on their own.
+    check(events.merkleBlockHeights == vector<int>({ 2, 3 }), "blocks 2 and 3 notified as merkle blocks");
+}
+
+void testDivergence()
+{
+    boost::filesystem::remove(BLOCKTREE_FILE);
+
+    SyncEvents events;
+    NetworkSync networkSync(TestChain::getCoinParams());
+    networkSync.loadHeaders(BLOCKTREE_FILE, false);
+
+    // A filter is sent before getheaders, which the capture does not have.
+    Coin::BloomFilter bloomFilter(10, 0.001, 0, 0);
+    bloomFilter.insert(TestChain::getMatchedTx().hash());
+    networkSync.setBloomFilter(bloomFilter);
+
+    subscribe(networkSync, events);
+    networkSync.startReplay(CAPTURE_FILE);
+    check(events.waitFor([&]() { return events.bStopped && !events.protocolErrors.empty(); }), "diverging replay stops with a protocol error");
+
+    boost::lock_guard<boost::mutex> lock(events.mutex);
+    check(!events.protocolErrors.empty() && events.protocolErrors.back().find("diverged") != string::npos, "protocol error reports the divergence");
+    check(events.headersSynched == 0, "no headers synched after diverging");
+    check(networkSync.getBestHeight() == 0, "no headers inserted after diverging");
+}
+
+}
+
+int main()
+{
+    try
+    {
+        testReplay();
+        testDivergence();
+    }
+    catch (const exception& e)
+    {
+        cerr << "Error: " << e.what() << endl;
+        return -2;
+    }
+
+    cout << g_passed << " passed, " << g_failed << " failed." << endl;
+    return g_failed ? -1 : 0;
+}
@@ -0,0 +1,91 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// testchain.h
+//
+// Copyright (c) 2011-2016 Ciphrex Corp.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+//
+// The chain behind netsync_test.capture, shared by the test and by
+// make_capture, which wrote the capture: a genesis block and three blocks on
+// top with the easiest target, so headers are mined in a few tries. Block 1
+// holds the one transaction the peer's filter matched.
+//
+
+#pragma once
+
+#include <CoinQ/CoinQ_coinparams.h>
+
+#include <CoinCore/CoinNodeData.h>
+#include <CoinCore/MerkleTree.h>
+#include <CoinCore/hash.h>
+
+#include <vector>
+
+namespace TestChain
+{
+
+const uint32_t BITS = 0x207fffff;
+const uint32_t GENESIS_TIME = 1500000000;
+const int BLOCK_COUNT = 3;
+
+inline const CoinQ::CoinParams& getCoinParams()
+{
+    static const CoinQ::CoinParams coinParams(
+        0xdab5bffaul,
+        70001,
+        "18444",
+        0x6f,
+        0xc4,
+        0xc4,
+        6,
+        40,
+        "TestChain",
+        "testchain",
+        100000000,
+        "tTST",
+        21000000,
+        0,
+        &sha256_2,
+        &sha256_2,
+        Coin::CoinBlockHeader(1, GENESIS_TIME, BITS, 0, uchar_vector(32, 0), uchar_vector(32, 0))
+    );
+    return coinParams;
+}
+
+inline Coin::Transaction getMatchedTx()
+{
+    Coin::Transaction tx;
+    tx.inputs.push_back(Coin::TxIn(Coin::OutPoint(uchar_vector(32, 0x11), 0), uchar_vector(), 0xffffffff));
+    tx.outputs.push_back(Coin::TxOut(100000, uchar_vector("76a914751e76e8199196d454941c45d1b3a323f1433bd688ac")));
+    return tx;
+}
+
+// Raises the nonce until the header meets its own target.
+inline void mine(Coin::CoinBlockHeader& header)
+{
+    while (!header.checkProofOfWork()) { header.incrementNonce(); }
+}
+
+// Blocks 1 to BLOCK_COUNT as the peer sends them. Only the matched tx is flagged, and merkle trees
+// hold tx hashes in reverse byte order.
+inline std::vector<Coin::MerkleBlock> getMerkleBlocks()
+{
+    std::vector<Coin::MerkleBlock> merkleBlocks;
+    uchar_vector prevBlockHash = getCoinParams().genesis_block().hash();
+    for (int height = 1; height <= BLOCK_COUNT; height++)
+    {
+        std::vector<Coin::MerkleLeaf> leaves;
+        leaves.push_back(Coin::MerkleLeaf(uchar_vector(32, height), false));
+        if (height == 1) { leaves.push_back(Coin::MerkleLeaf(getMatchedTx().hash().getReverse(), true)); }
+
+        Coin::MerkleBlock merkleBlock(Coin::PartialMerkleTree(leaves), 1, prevBlockHash, GENESIS_TIME + height * 600, BITS, 0);
+        mine(merkleBlock.blockHeader);
+        merkleBlocks.push_back(merkleBlock);
+        prevBlockHash = merkleBlock.hash();
+    }
+    return merkleBlocks;
+}
+
+}
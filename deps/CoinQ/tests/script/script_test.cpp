@@ -0,0 +1,224 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// script tokenizer and template matcher tests
+//
+// script_test.cpp
+//
+// Copyright (c) 2011-2016 Ciphrex Corp.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+//
+
+#include <CoinQ/CoinQ_script.h>
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace CoinQ::Script;
+using namespace std;
+
+// G, 2G and 3G, compressed.
+const string PUBKEY1 = "0279be667ef9dcbbac55a06295ce870b07029bfcdb2dce28d959f2815b16f81798";
+const string PUBKEY2 = "02c6047f9441ed7d6d3045406e95c07cd85c778e4b8cef3ca7abac09b95c709ee5";
+const string PUBKEY3 = "02f9308a019258c31049344f85f89d5229b531c845836f99b08601f113bce036f9";
+
+// hash160 of PUBKEY1
+const string PUBKEYHASH = "751e76e8199196d454941c45d1b3a323f1433bd6";
+
+// A DER signature with SIGHASH_ALL appended. Only its framing matters here.
+const string SIG =
+    "3044"
+    "0220" "6a2eb16b3f5e9b1e4f0f9c0ad3a7b1c8e2d4f60718293a4b5c6d7e8f90a1b2c3"
+    "0220" "1b2c3d4e5f60718293a4b5c6d7e8f90a1b2c3d4e5f60718293a4b5c6d7e8f901"
+    "01";
+
+unsigned int g_failed = 0;
+unsigned int g_passed = 0;
+
+void check(bool condition, const string& name)
+{
+    if (condition)
+    {
+        g_passed++;
+        return;
+    }
+
+    g_failed++;
+    cerr << "FAILED: " << name << endl;
+}
+
+template<typename F>
+bool throws(F f)
+{
+    try
+    {
+        f();
+    }
+    catch (const exception&)
+    {
+        return true;
+    }
+    return false;
+}
+
+bool equals(const ScriptSpan& span, const uchar_vector& bytes)
+{
+    return span.size == bytes.size() && equal(span.begin(), span.end(), bytes.begin());
+}
+
+void testPayToPubKeyHash()
+{
+    uchar_vector script("76a914" + PUBKEYHASH + "88ac");
+
+    vector<ScriptOp> ops;
+    for (auto& op: ScriptTokenizer(script)) { ops.push_back(op); }
+    check(ops.size() == 5, "p2pkh: op count");
+    check(ops.size() == 5 && ops[0].opcode == OP_DUP && ops[1].opcode == OP_HASH160, "p2pkh: leading opcodes");
+    check(ops.size() == 5 && ops[2].opcode == 20 && equals(ops[2].data, uchar_vector(PUBKEYHASH)), "p2pkh: pushed hash");
+    check(ops.size() == 5 && ops[2].data.begin() == script.data() + 3, "p2pkh: push is a view into the script");
+    check(ops.size() == 5 && ops[3].opcode == OP_EQUALVERIFY && ops[4].opcode == OP_CHECKSIG, "p2pkh: trailing opcodes");
+
+    ScriptSpan payload;
+    check(matchPayToPubKeyHash(script, payload) && equals(payload, uchar_vector(PUBKEYHASH)), "p2pkh: matchPayToPubKeyHash");
+    check(!matchPayToScriptHash(script, payload), "p2pkh: not p2sh");
+    check(!matchPayToPubKey(script, payload), "p2pkh: not p2pk");
+    check(classifyScriptPubKey(script, payload) == SCRIPT_PUBKEY_PAY_TO_PUBKEY_HASH, "p2pkh: classifyScriptPubKey");
+
+    payee_t payee = getScriptPubKeyPayee(script);
+    check(payee.first == SCRIPT_PUBKEY_PAY_TO_PUBKEY_HASH && payee.second == uchar_vector(PUBKEYHASH), "p2pkh: getScriptPubKeyPayee");
+
+    uint pos = 0;
+    uchar_vector op;
+    for (int i = 0; i < 3; i++) { op = getNextOp(script, pos); }
+    check(op == uchar_vector("14" + PUBKEYHASH) && pos == 23, "p2pkh: getNextOp");
+
+    // One byte short of the template.
+    uchar_vector shortscript(script.begin(), script.end() - 1);
+    check(!matchPayToPubKeyHash(shortscript, payload), "p2pkh: short script does not match");
+    check(classifyScriptPubKey(shortscript, payload) == SCRIPT_PUBKEY_UNKNOWN_TYPE && payload.empty(), "p2pkh: short script is unknown");
+}
+
+void testPayToScriptHashMultiSig()
+{
+    // 2 of 3
+    uchar_vector redeemscript("52");
+    for (auto& pubkey: { PUBKEY1, PUBKEY2, PUBKEY3 }) { redeemscript += uchar_vector("21" + pubkey); }
+    redeemscript += uchar_vector("53ae");
+
+    unsigned int minsigs = 0;
+    vector<ScriptSpan> pubkeys;
+    check(matchMultiSig(redeemscript, minsigs, pubkeys), "multisig: matchMultiSig");
+    check(minsigs == 2 && pubkeys.size() == 3, "multisig: m and n");
+    check(pubkeys.size() == 3 && equals(pubkeys[0], uchar_vector(PUBKEY1)) && equals(pubkeys[2], uchar_vector(PUBKEY3)), "multisig: pubkeys");
+
+    uchar_vector badcount(redeemscript);
+    badcount[badcount.size() - 2] = OP_2;
+    check(!matchMultiSig(badcount, minsigs, pubkeys), "multisig: n does not match pubkey count");
+
+    uchar_vector cutkey(redeemscript.begin(), redeemscript.begin() + 30);
+    cutkey += uchar_vector("53ae");
+    check(!matchMultiSig(cutkey, minsigs, pubkeys), "multisig: truncated pubkey");
+
+    // The scriptPubKey is the hash of the redeemscript.
+    uchar_vector txoutscript("a914" + hash160(redeemscript).getHex() + "87");
+    ScriptSpan payload;
+    check(matchPayToScriptHash(txoutscript, payload) && equals(payload, hash160(redeemscript)), "multisig: matchPayToScriptHash");
+    check(classifyScriptPubKey(txoutscript, payload) == SCRIPT_PUBKEY_PAY_TO_SCRIPT_HASH, "multisig: classifyScriptPubKey");
+
+    // OP_0 <sig> <placeholder> <redeemscript>. The redeemscript is longer than 75 bytes so it is pushed with OP_PUSHDATA1.
+    check(redeemscript.size() == 105, "multisig: redeemscript size");
+    uchar_vector txinscript("00");
+    txinscript += uchar_vector("47" + SIG);
+    txinscript += uchar_vector("00");
+    txinscript += uchar_vector("4c69");
+    txinscript += redeemscript;
+
+    vector<ScriptSpan> sigs;
+    ScriptSpan matchedredeemscript;
+    minsigs = 0;
+    pubkeys.clear();
+    check(matchPayToScriptHashMultiSig(txinscript, sigs, matchedredeemscript, minsigs, pubkeys), "multisig: matchPayToScriptHashMultiSig");
+    check(sigs.size() == 2 && equals(sigs[0], uchar_vector(SIG)) && sigs[1].empty(), "multisig: signature and placeholder");
+    check(equals(matchedredeemscript, redeemscript) && minsigs == 2 && pubkeys.size() == 3, "multisig: redeemscript");
+
+    scriptstack_t stack = scriptToStack(txinscript);
+    check(stack.size() == 4 && stack.back() == redeemscript, "multisig: scriptToStack");
+
+    // More signatures than pubkeys.
+    uchar_vector toomany("00");
+    for (int i = 0; i < 4; i++) { toomany += uchar_vector("47" + SIG); }
+    toomany += uchar_vector("4c69");
+    toomany += redeemscript;
+    check(!matchPayToScriptHashMultiSig(toomany, sigs, matchedredeemscript, minsigs, pubkeys), "multisig: too many signatures");
+
+    // Missing the leading OP_0.
+    uchar_vector nodummy(txinscript.begin() + 1, txinscript.end());
+    check(!matchPayToScriptHashMultiSig(nodummy, sigs, matchedredeemscript, minsigs, pubkeys), "multisig: no leading OP_0");
+
+    // Redeemscript cut short inside its push.
+    uchar_vector cutpush(txinscript.begin(), txinscript.end() - 1);
+    check(!matchPayToScriptHashMultiSig(cutpush, sigs, matchedredeemscript, minsigs, pubkeys), "multisig: truncated redeemscript push");
+}
+
+void testTruncatedPushData()
+{
+    const vector<string> scripts = {
+        "05010203",         // direct push of 5 with 3 bytes
+        "4b",               // direct push of 75 with nothing
+        "4c",               // OP_PUSHDATA1 without length
+        "4c05010203",       // OP_PUSHDATA1 of 5 with 3 bytes
+        "4d01",             // OP_PUSHDATA2 with half a length
+        "4d0001",           // OP_PUSHDATA2 of 256 with nothing
+        "4e010000",         // OP_PUSHDATA4 with three length bytes
+        "4effffffff00",     // OP_PUSHDATA4 of 2^32 - 1 with one byte
+        "76a90488ac"        // p2pkh prefix with a push that swallows the rest
+    };
+
+    for (auto& hex: scripts)
+    {
+        uchar_vector script(hex);
+        string name = "truncated " + hex + ": ";
+
+        check(throws([&]() { for (auto& op: ScriptTokenizer(script)) { (void)op; } }), name + "ScriptTokenizer throws");
+        check(throws([&]() { uint pos = 0; while (pos < script.size()) { getNextOp(script, pos); } }), name + "getNextOp throws");
+        check(throws([&]() { scriptToStack(script); }), name + "scriptToStack throws");
+
+        ScriptSpan payload;
+        check(classifyScriptPubKey(script, payload) == SCRIPT_PUBKEY_UNKNOWN_TYPE && payload.empty(), name + "classifyScriptPubKey is unknown");
+
+        uchar_vector p2pk(script);
+        p2pk.push_back(OP_CHECKSIG);
+        check(!matchPayToPubKey(p2pk, payload), name + "not p2pk");
+
+        unsigned int minsigs;
+        vector<ScriptSpan> pubkeys;
+        uchar_vector multisig("52" + hex + "52ae");
+        check(!matchMultiSig(multisig, minsigs, pubkeys), name + "not multisig");
+
+        vector<ScriptSpan> sigs;
+        ScriptSpan redeemscript;
+        uchar_vector txinscript("00" + hex);
+        check(!matchPayToScriptHashMultiSig(txinscript, sigs, redeemscript, minsigs, pubkeys), name + "not p2sh multisig");
+    }
+}
+
+int main()
+{
+    try
+    {
+        testPayToPubKeyHash();
+        testPayToScriptHashMultiSig();
+        testTruncatedPushData();
+    }
+    catch (const exception& e)
+    {
+        cerr << "Error: " << e.what() << endl;
+        return -2;
+    }
+
+    cout << g_passed << " passed, " << g_failed << " failed." << endl;
+    return g_failed ? -1 : 0;
+}
@@ -106,6 +106,7 @@ public:
         command_map_.insert(std::pair<std::string, command>(cmd.getName(), cmd));
         tab = cmd.getMinHelpTab(tab);
     }
+    bool has(const std::string& cmdname) const { return command_map_.count(cmdname) > 0; }
     result_t exec(const std::string& cmdname, const params_t& params);
     int exec(int argc, char** argv);
 
@@ -6,5 +6,9 @@ else
     INITIAL_CXX_FLAGS += -O3
 endif
 
+ifdef SECURE_ALLOCATOR
+    INITIAL_CXX_FLAGS += -DUSE_SECURE_ALLOCATOR
+endif
+
 CXX_FLAGS := $(INITIAL_CXX_FLAGS) $(CXX_FLAGS)
 
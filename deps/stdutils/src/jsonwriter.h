@@ -0,0 +1,159 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// jsonwriter.h
+//
+// Copyright (c) 2011-2016 Ciphrex Corp.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstring>
+
+namespace stdutils
+{
+
+// Appends JSON straight to a string buffer, with no intermediate document. Commas are inserted
+// automatically: call key() before each value inside an object and just the value inside an array.
+// The writer does not check that objects and arrays are balanced.
+//
+//  JsonWriter json;
+//  json.beginObject().field("id", 5).hexField("hash", hash).endObject();
+//  send(json.str());
+//
+class JsonWriter
+{
+public:
+    explicit JsonWriter(std::size_t reserve = 4096) : bComma(false) { buf_.reserve(reserve); }
+
+    JsonWriter& beginObject()               { separate(); buf_ += '{'; bComma = false; return *this; }
+    JsonWriter& endObject()                 { buf_ += '}'; bComma = true; return *this; }
+    JsonWriter& beginArray()                { separate(); buf_ += '['; bComma = false; return *this; }
+    JsonWriter& endArray()                  { buf_ += ']'; bComma = true; return *this; }
+
+    JsonWriter& key(const char* name)       { separate(); appendString(name, std::strlen(name)); buf_ += ':'; bComma = false; return *this; }
+    JsonWriter& key(const std::string& name){ separate(); appendString(name.data(), name.size()); buf_ += ':'; bComma = false; return *this; }
+
+    JsonWriter& value(const char* s)        { separate(); appendString(s, std::strlen(s)); bComma = true; return *this; }
+    JsonWriter& value(const std::string& s) { separate(); appendString(s.data(), s.size()); bComma = true; return *this; }
+    JsonWriter& value(bool b)               { separate(); buf_ += b ? "true" : "false"; bComma = true; return *this; }
+
+    JsonWriter& value(int n)                { return appendSigned(n); }
+    JsonWriter& value(long n)               { return appendSigned(n); }
+    JsonWriter& value(long long n)          { return appendSigned(n); }
+    JsonWriter& value(unsigned int n)       { return appendUnsigned(n); }
+    JsonWriter& value(unsigned long n)      { return appendUnsigned(n); }
+    JsonWriter& value(unsigned long long n) { return appendUnsigned(n); }
+
+    JsonWriter& null()                      { separate(); buf_ += "null"; bComma = true; return *this; }
+
+    // Lowercase hex string
+    JsonWriter& hex(const unsigned char* data, std::size_t size)
+    {
+        static const char digits[] = "0123456789abcdef";
+
+        separate();
+        buf_ += '"';
+        std::size_t pos = buf_.size();
+        buf_.resize(pos + 2 * size);
+        for (std::size_t i = 0; i < size; i++)
+        {
+            buf_[pos++] = digits[data[i] >> 4];
+            buf_[pos++] = digits[data[i] & 0x0f];
+        }
+        buf_ += '"';
+        bComma = true;
+        return *this;
+    }
+
+    JsonWriter& hex(const std::vector<unsigned char>& data) { return hex(data.data(), data.size()); }
+
+    // Value that is already valid JSON
+    JsonWriter& raw(const std::string& json){ separate(); buf_ += json; bComma = true; return *this; }
+
+    template<class T>
+    JsonWriter& field(const char* name, const T& v) { key(name); return value(v); }
+
+    JsonWriter& hexField(const char* name, const std::vector<unsigned char>& data) { key(name); return hex(data); }
+    JsonWriter& nullField(const char* name) { key(name); return null(); }
+
+    const std::string& str() const { return buf_; }
+
+    // Hands over the buffer, leaving the writer empty.
+    std::string release() { std::string rval; rval.swap(buf_); bComma = false; return rval; }
+
+    void clear() { buf_.clear(); bComma = false; }
+
+private:
+    std::string buf_;
+    bool bComma;    // a value was just completed, so the next one needs a separator
+
+    void separate() { if (bComma) buf_ += ','; }
+
+    template<class T>
+    JsonWriter& appendUnsigned(T n)
+    {
+        separate();
+        char digits[24];
+        char* p = digits + sizeof(digits);
+        do
+        {
+            *--p = '0' + (char)(n % 10);
+            n /= 10;
+        } while (n);
+        buf_.append(p, digits + sizeof(digits) - p);
+        bComma = true;
+        return *this;
+    }
+
+    template<class T>
+    JsonWriter& appendSigned(T n)
+    {
+        if (n >= 0) return appendUnsigned((unsigned long long)n);
+
+        separate();
+        buf_ += '-';
+        bComma = false;
+        return appendUnsigned(0ull - (unsigned long long)n);
+    }
+
+    // Copies runs of plain characters in one go and escapes the rest.
+    void appendString(const char* s, std::size_t size)
+    {
+        static const char digits[] = "0123456789abcdef";
+
+        buf_ += '"';
+        std::size_t start = 0;
+        for (std::size_t i = 0; i < size; i++)
+        {
+            unsigned char c = (unsigned char)s[i];
+            if (c >= 0x20 && c != '"' && c != '\\') continue;
+
+            buf_.append(s + start, i - start);
+            start = i + 1;
+            switch (c)
+            {
+            case '"':   buf_ += "\\\""; break;
+            case '\\':  buf_ += "\\\\"; break;
+            case '\b':  buf_ += "\\b"; break;
+            case '\f':  buf_ += "\\f"; break;
+            case '\n':  buf_ += "\\n"; break;
+            case '\r':  buf_ += "\\r"; break;
+            case '\t':  buf_ += "\\t"; break;
+            default:
+                buf_ += "\\u00";
+                buf_ += digits[c >> 4];
+                buf_ += digits[c & 0x0f];
+            }
+        }
+        buf_.append(s + start, size - start);
+        buf_ += '"';
+    }
+};
+
+}
@@ -0,0 +1,265 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// secure_allocator.h
+//
+// Copyright (c) 2011-2016 Ciphrex Corp.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace stdutils
+{
+
+// Overwrites memory in a way the compiler cannot drop as a dead store.
+inline void secure_cleanse(void* p, std::size_t n)
+{
+    volatile unsigned char* v = static_cast<volatile unsigned char*>(p);
+    while (n--) { *v++ = 0; }
+}
+
+// Process-wide pool of memory that is locked against paging. Locking is done once per arena rather
+// than once per allocation, which is what made the old per-allocation mlock() too slow for keys.
+//
+// Small blocks come from power-of-two size classes. Each class keeps a free list, so allocation and
+// deallocation are a pop or a push, plus a bump of the current arena when a list is empty. Arenas are
+// never returned to the system. Blocks larger than the biggest class are mapped and locked one at a
+// time. Everything is zeroed when freed.
+//
+// If the lock limit (RLIMIT_MEMLOCK) is reached, memory is still handed out but unlocked, and
+// getStats() reports it.
+class LockedPool
+{
+public:
+    static const std::size_t MIN_BLOCK_SIZE = 16;
+    static const std::size_t MAX_BLOCK_SIZE = 4096;
+    static const std::size_t ARENA_SIZE = 256 * 1024;
+
+    struct Stats
+    {
+        std::size_t arenas;
+        std::size_t used;           // bytes in blocks handed out, rounded up to their size class
+        std::size_t locked;         // bytes that were successfully locked
+        std::size_t unlocked;       // bytes that could not be locked
+    };
+
+    // Never destroyed, so static containers can free into it during exit.
+    static LockedPool& instance()
+    {
+        static LockedPool* pool = new LockedPool();
+        return *pool;
+    }
+
+    void* allocate(std::size_t size)
+    {
+        if (size == 0) { size = 1; }
+        if (size > MAX_BLOCK_SIZE) return allocateLarge(size);
+
+        unsigned int sizeClass = getSizeClass(size);
+        std::size_t blockSize = MIN_BLOCK_SIZE << sizeClass;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        void* p = freeLists_[sizeClass];
+        if (p)
+        {
+            freeLists_[sizeClass] = *static_cast<void**>(p);
+        }
+        else
+        {
+            if (arenaEnd_ - arenaPos_ < (std::ptrdiff_t)blockSize) { newArena(); }
+            p = arenaPos_;
+            arenaPos_ += blockSize;
+        }
+        stats_.used += blockSize;
+        return p;
+    }
+
+    void deallocate(void* p, std::size_t size)
+    {
+        if (!p) return;
+        if (size == 0) { size = 1; }
+        if (size > MAX_BLOCK_SIZE)
+        {
+            deallocateLarge(p, size);
+            return;
+        }
+
+        unsigned int sizeClass = getSizeClass(size);
+        std::size_t blockSize = MIN_BLOCK_SIZE << sizeClass;
+        secure_cleanse(p, blockSize);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        *static_cast<void**>(p) = freeLists_[sizeClass];
+        freeLists_[sizeClass] = p;
+        stats_.used -= blockSize;
+    }
+
+    Stats getStats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stats_;
+    }
+
+private:
+    static const unsigned int SIZE_CLASSES = 9; // 16 to 4096 bytes
+
+    LockedPool() : arenaPos_(nullptr), arenaEnd_(nullptr)
+    {
+        for (unsigned int i = 0; i < SIZE_CLASSES; i++) { freeLists_[i] = nullptr; }
+        stats_.arenas = stats_.used = stats_.locked = stats_.unlocked = 0;
+    }
+
+    LockedPool(const LockedPool&) = delete;
+    LockedPool& operator=(const LockedPool&) = delete;
+
+    static unsigned int getSizeClass(std::size_t size)
+    {
+        unsigned int sizeClass = 0;
+        while ((MIN_BLOCK_SIZE << sizeClass) < size) { sizeClass++; }
+        return sizeClass;
+    }
+
+    static std::size_t roundToPages(std::size_t size)
+    {
+        const std::size_t PAGE_SIZE_ROUNDING = 4096;
+        return (size + PAGE_SIZE_ROUNDING - 1) & ~(PAGE_SIZE_ROUNDING - 1);
+    }
+
+    // Sets bLocked if the pages could be locked.
+    static void* mapPages(std::size_t size, bool& bLocked)
+    {
+#ifdef _WIN32
+        void* p = VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+        if (!p) throw std::bad_alloc();
+        bLocked = VirtualLock(p, size) != 0;
+#else
+        void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) throw std::bad_alloc();
+        bLocked = mlock(p, size) == 0;
+#ifdef MADV_DONTDUMP
+        madvise(p, size, MADV_DONTDUMP);
+#endif
+#endif
+        return p;
+    }
+
+    static void unmapPages(void* p, std::size_t size, bool bLocked)
+    {
+#ifdef _WIN32
+        if (bLocked) { VirtualUnlock(p, size); }
+        VirtualFree(p, 0, MEM_RELEASE);
+#else
+        if (bLocked) { munlock(p, size); }
+        munmap(p, size);
+#endif
+    }
+
+    // Called with mutex_ held. Whatever is left of the current arena is too small for the request
+    // and is abandoned.
+    void newArena()
+    {
+        bool bLocked;
+        char* arena = static_cast<char*>(mapPages(ARENA_SIZE, bLocked));
+        arenaPos_ = arena;
+        arenaEnd_ = arena + ARENA_SIZE;
+        stats_.arenas++;
+        (bLocked ? stats_.locked : stats_.unlocked) += ARENA_SIZE;
+    }
+
+    // Large blocks carry their lock state in a header so they can be released correctly.
+    struct LargeHeader
+    {
+        std::size_t size;
+        bool bLocked;
+    };
+    static const std::size_t LARGE_HEADER_SIZE = 16;
+
+    void* allocateLarge(std::size_t size)
+    {
+        std::size_t mappedSize = roundToPages(size + LARGE_HEADER_SIZE);
+        bool bLocked;
+        char* p = static_cast<char*>(mapPages(mappedSize, bLocked));
+        LargeHeader* header = reinterpret_cast<LargeHeader*>(p);
+        header->size = mappedSize;
+        header->bLocked = bLocked;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.used += mappedSize;
+        (bLocked ? stats_.locked : stats_.unlocked) += mappedSize;
+        return p + LARGE_HEADER_SIZE;
+    }
+
+    void deallocateLarge(void* p, std::size_t /*size*/)
+    {
+        char* base = static_cast<char*>(p) - LARGE_HEADER_SIZE;
+        LargeHeader header = *reinterpret_cast<LargeHeader*>(base);
+        secure_cleanse(base, header.size);
+        unmapPages(base, header.size, header.bLocked);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.used -= header.size;
+        (header.bLocked ? stats_.locked : stats_.unlocked) -= header.size;
+    }
+
+    mutable std::mutex mutex_;
+    void* freeLists_[SIZE_CLASSES];
+    char* arenaPos_;
+    char* arenaEnd_;
+    Stats stats_;
+};
+
+// Allocator for key material. Memory comes from LockedPool, so it stays out of swap and is zeroed
+// before it is reused.
+template<typename T>
+class secure_allocator
+{
+public:
+    typedef T value_type;
+    typedef T* pointer;
+    typedef const T* const_pointer;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef std::size_t size_type;
+    typedef std::ptrdiff_t difference_type;
+
+    template<typename U> struct rebind { typedef secure_allocator<U> other; };
+
+    secure_allocator() noexcept { }
+    template<typename U> secure_allocator(const secure_allocator<U>&) noexcept { }
+
+    T* allocate(std::size_t n, const void* /*hint*/ = nullptr)
+    {
+        return static_cast<T*>(LockedPool::instance().allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, std::size_t n) noexcept
+    {
+        LockedPool::instance().deallocate(p, n * sizeof(T));
+    }
+};
+
+template<typename T, typename U>
+inline bool operator==(const secure_allocator<T>&, const secure_allocator<U>&) { return true; }
+
+template<typename T, typename U>
+inline bool operator!=(const secure_allocator<T>&, const secure_allocator<U>&) { return false; }
+
+typedef std::vector<unsigned char, secure_allocator<unsigned char>> secure_vector;
+
+}
@@ -0,0 +1,132 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// json writer tests
+//
+// jsonwriter_test.cpp
+//
+// Copyright (c) 2011-2016 Ciphrex Corp.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+//
+// Compares what JsonWriter appends with the JSON expected for nesting,
+// separators, string escaping, integer limits and hex values.
+//
+
+#include "jsonwriter.h"
+
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace stdutils;
+using namespace std;
+
+namespace
+{
+
+unsigned int g_failed = 0;
+unsigned int g_passed = 0;
+
+void check(bool condition, const string& name)
+{
+    if (condition)
+    {
+        g_passed++;
+        return;
+    }
+
+    g_failed++;
+    cerr << "FAILED: " << name << endl;
+}
+
+void testNesting()
+{
+    JsonWriter json;
+    json.beginArray();
+    json.beginObject().field("id", 1).key("txins").beginArray().endArray().key("txouts").beginArray().value(2).value(3).endArray().endObject();
+    json.beginObject().nullField("label").field("change", true).endObject();
+    json.endArray();
+    check(json.str() == "[{\"id\":1,\"txins\":[],\"txouts\":[2,3]},{\"label\":null,\"change\":true}]", "separators between values only");
+
+    JsonWriter empty;
+    empty.beginObject().endObject();
+    check(empty.str() == "{}", "empty object");
+}
+
+void testStrings()
+{
+    JsonWriter json;
+    json.beginObject().field("label", "quote \" backslash \\ tab \t newline \n bell \x07 end").endObject();
+    check(json.str() == "{\"label\":\"quote \\\" backslash \\\\ tab \\t newline \\n bell \\u0007 end\"}", "strings escaped");
+
+    JsonWriter keys;
+    keys.beginObject().key(string("a\"b")).value(string("\xc3\xa9")).endObject();
+    check(keys.str() == "{\"a\\\"b\":\"\xc3\xa9\"}", "keys escaped and utf-8 passed through");
+
+    string withNul("a\0b", 3);
+    JsonWriter nul;
+    nul.value(withNul);
+    check(nul.str() == "\"a\\u0000b\"", "embedded nul escaped");
+}
+
+void testIntegers()
+{
+    JsonWriter json;
+    json.beginArray()
+        .value(0).value(-1)
+        .value(numeric_limits<int>::min())
+        .value(numeric_limits<long long>::min())
+        .value(numeric_limits<unsigned long long>::max())
+        .value(4294967295u)
+        .endArray();
+    check(json.str() == "[0,-1,-2147483648,-9223372036854775808,18446744073709551615,4294967295]", "integer limits");
+}
+
+void testHexAndRaw()
+{
+    vector<unsigned char> hash = { 0x00, 0x0f, 0xa0, 0xff };
+    JsonWriter json;
+    json.beginObject().hexField("hash", hash).key("script").hex(vector<unsigned char>()).key("tx").raw("{\"v\":1}").endObject();
+    check(json.str() == "{\"hash\":\"000fa0ff\",\"script\":\"\",\"tx\":{\"v\":1}}", "hex and raw values");
+}
+
+void testRelease()
+{
+    JsonWriter json;
+    json.beginArray().value(1).endArray();
+    string released = json.release();
+    check(released == "[1]", "release hands over the buffer");
+    check(json.str().empty(), "release leaves the writer empty");
+
+    json.value(2);
+    check(json.str() == "2", "no separator after release");
+
+    json.clear();
+    json.value(3);
+    check(json.str() == "3", "no separator after clear");
+}
+
+}
+
+int main()
+{
+    try
+    {
+        testNesting();
+        testStrings();
+        testIntegers();
+        testHexAndRaw();
+        testRelease();
+    }
+    catch (const exception& e)
+    {
+        cerr << "Error: " << e.what() << endl;
+        return -2;
+    }
+
+    cout << g_passed << " passed, " << g_failed << " failed." << endl;
+    return g_failed ? -1 : 0;
+}
@@ -0,0 +1,259 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// RequestScheduler.h
+//
+// Copyright (c) 2011-2016 Ciphrex Corp.
+//
+// All Rights Reserved.
+//
+// Runs requests on a pool of worker threads. Requests that read a vault may run alongside each
+// other, requests that change a vault run alone on it. Requests on the same vault start in the
+// order they arrived, so a write is never starved by a stream of reads.
+//
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+class RequestScheduler
+{
+public:
+    enum access_t
+    {
+        UNLOCKED,   // no vault, or a vault read in short transactions that must not hold up writers
+        READ,
+        WRITE
+    };
+
+    typedef std::chrono::steady_clock clock_t;
+
+    // Runs the request. Called on a worker thread.
+    typedef std::function<void()> job_t;
+
+    // Called instead of the job when a request times out before it could start or the scheduler stops.
+    typedef std::function<void(const std::string& /*error*/)> reject_t;
+
+    struct Stats
+    {
+        std::size_t threads;
+        std::size_t queued;
+        std::size_t running;
+        uint64_t rejected;      // queue was full
+        uint64_t timedOut;      // waited longer than the timeout to start
+    };
+
+    // A timeout of zero lets requests wait indefinitely.
+    RequestScheduler(std::size_t threads, std::size_t maxQueued, unsigned int timeoutSeconds) :
+        threads_(threads), maxQueued_(maxQueued), timeout_(timeoutSeconds), bRunning(false), running_(0), rejected_(0), timedOut_(0)
+    {
+        if (threads_ == 0) throw std::runtime_error("RequestScheduler - at least one thread is required.");
+    }
+
+    ~RequestScheduler() { stop(); }
+
+    void start()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (bRunning) throw std::runtime_error("RequestScheduler - already started.");
+        bRunning = true;
+        for (std::size_t i = 0; i < threads_; i++) { workers_.push_back(std::thread(&RequestScheduler::work, this)); }
+    }
+
+    // Requests still queued are rejected. Running requests are allowed to finish.
+    void stop()
+    {
+        std::deque<Request> dropped;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!bRunning) return;
+            bRunning = false;
+            dropped.swap(queue_);
+        }
+        cond_.notify_all();
+        for (auto& worker: workers_) { worker.join(); }
+        workers_.clear();
+
+        for (auto& request: dropped) { request.reject("Server is shutting down."); }
+    }
+
+    // Returns false without queueing the request if the queue is full or the scheduler is stopped.
+    // The vault is ignored for UNLOCKED requests.
+    bool submit(const std::string& vault, access_t access, job_t job, reject_t reject)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!bRunning) return false;
+            if (queue_.size() >= maxQueued_)
+            {
+                rejected_++;
+                return false;
+            }
+
+            Request request;
+            request.vault = vault;
+            request.access = access;
+            request.job = job;
+            request.reject = reject;
+            request.deadline = timeout_.count() ? clock_t::now() + timeout_ : clock_t::time_point::max();
+            queue_.push_back(request);
+        }
+        cond_.notify_one();
+        return true;
+    }
+
+    Stats getStats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Stats stats;
+        stats.threads = threads_;
+        stats.queued = queue_.size();
+        stats.running = running_;
+        stats.rejected = rejected_;
+        stats.timedOut = timedOut_;
+        return stats;
+    }
+
+private:
+    struct Request
+    {
+        std::string vault;
+        access_t access;
+        job_t job;
+        reject_t reject;
+        clock_t::time_point deadline;
+    };
+
+    struct VaultState
+    {
+        VaultState() : readers(0), bWriter(false) { }
+
+        unsigned int readers;
+        bool bWriter;
+    };
+
+    std::size_t threads_;
+    std::size_t maxQueued_;
+    std::chrono::seconds timeout_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cond_;
+    bool bRunning;
+    std::vector<std::thread> workers_;
+    std::deque<Request> queue_;
+    std::map<std::string, VaultState> vaults_;  // only vaults with requests running
+    std::size_t running_;
+    uint64_t rejected_;
+    uint64_t timedOut_;
+
+    // Removes and returns the first request that can start, taking its vault. Requests that timed
+    // out are moved to expired.
+    bool next(Request& request, std::vector<Request>& expired)
+    {
+        clock_t::time_point now = clock_t::now();
+        std::map<std::string, access_t> blocked;    // strongest access queued ahead for each vault
+
+        auto it = queue_.begin();
+        while (it != queue_.end())
+        {
+            if (it->deadline <= now)
+            {
+                expired.push_back(*it);
+                it = queue_.erase(it);
+                timedOut_++;
+                continue;
+            }
+
+            if (it->access == UNLOCKED)
+            {
+                request = *it;
+                queue_.erase(it);
+                return true;
+            }
+
+            auto b = blocked.find(it->vault);
+            bool bBlockedAhead = b != blocked.end() && (b->second == WRITE || it->access == WRITE);
+
+            auto v = vaults_.find(it->vault);
+            bool bBusy = v != vaults_.end() && (v->second.bWriter || (it->access == WRITE && v->second.readers > 0));
+
+            if (!bBlockedAhead && !bBusy)
+            {
+                VaultState& state = vaults_[it->vault];
+                if (it->access == WRITE)    { state.bWriter = true; }
+                else                        { state.readers++; }
+
+                request = *it;
+                queue_.erase(it);
+                return true;
+            }
+
+            access_t& strongest = blocked[it->vault];
+            if (b == blocked.end() || it->access == WRITE) { strongest = it->access; }
+            ++it;
+        }
+
+        return false;
+    }
+
+    void release(const Request& request)
+    {
+        if (request.access == UNLOCKED) return;
+
+        auto v = vaults_.find(request.vault);
+        if (request.access == WRITE)    { v->second.bWriter = false; }
+        else                            { v->second.readers--; }
+        if (!v->second.bWriter && v->second.readers == 0) { vaults_.erase(v); }
+    }
+
+    void work()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (bRunning)
+        {
+            Request request;
+            std::vector<Request> expired;
+            bool bFound = next(request, expired);
+
+            if (!expired.empty())
+            {
+                lock.unlock();
+                for (auto& r: expired) { r.reject("Request timed out before it could start."); }
+                lock.lock();
+            }
+
+            if (!bFound)
+            {
+                // Wake up now and then to time out requests stuck behind a long one.
+                if (expired.empty()) { cond_.wait_for(lock, std::chrono::seconds(1)); }
+                continue;
+            }
+
+            running_++;
+            lock.unlock();
+            try
+            {
+                request.job();
+            }
+            catch (...)
+            {
+                // Jobs report their own errors; one that escapes must not take the worker down.
+            }
+            lock.lock();
+            running_--;
+            release(request);
+
+            // Finishing may unblock requests for this vault that other workers passed over.
+            cond_.notify_all();
+        }
+    }
+};
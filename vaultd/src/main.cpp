@@ -9,12 +9,16 @@
 // vaultd - headless daemon with WebSockets API
 //
 
+#include "RequestScheduler.h"
+
 #include <WebSocketServer.h>
 #include <cli.hpp>
 
 #include <formatting.h>
 
 #include <Vault.h>
+#include <VaultMetrics.h>
+#include <VaultJson.h>
 #include <Schema-odb.hxx>
 
 #include <random.h>
@@ -25,6 +29,12 @@
 
 #include <thread>
 #include <chrono>
+#include <algorithm>
+#include <array>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
 
 #include <iostream>
 #include <sstream>
@@ -33,6 +43,8 @@
 
 #include <signal.h>
 
+#include <boost/filesystem.hpp>
+
 using namespace std;
 using namespace odb::core;
 using namespace CoinDB;
@@ -84,7 +96,7 @@ cli::result_t cmd_keychainexists(const cli::params_t& params)
 cli::result_t cmd_newkeychain(const cli::params_t& params)
 {
     Vault vault(params[0], false);
-    vault.newKeychain(params[1], random_bytes(32));
+    vault.newKeychain(params[1], secure_random_bytes(32));
 
     stringstream ss;
     ss << "Added keychain " << params[1] << " to vault " << params[0] << ".";
@@ -202,16 +214,15 @@ cli::result_t cmd_exportbip32(const cli::params_t& params)
     bool export_privkey = params.size() > 2;
 
     Vault vault(params[0], false);
-    vault.unlockChainCodes(uchar_vector("1234"));
     if (export_privkey)
     {
-        secure_bytes_t unlock_key = sha256_2(params[2]);
+        secure_bytes_t unlock_key = to_secure_bytes(sha256_2(params[2]));
         vault.unlockKeychain(params[1], unlock_key);
     }
-    secure_bytes_t extkey = vault.getKeychainExtendedKey(params[1], export_privkey);
+    secure_bytes_t extkey = vault.exportBIP32(params[1], export_privkey);
 
     stringstream ss;
-    ss << toBase58Check(extkey);
+    ss << toBase58Check(to_bytes(extkey));
     return ss.str();
 }
 
@@ -222,15 +233,15 @@ cli::result_t cmd_importbip32(const cli::params_t& params)
     bytes_t salt;
     if (import_privkey)
     {
-        lock_key = sha256_2(params[3]);
+        lock_key = to_secure_bytes(sha256_2(params[3]));
         // TODO: add salt
     }
 
-    secure_bytes_t extkey;
+    bytes_t extkey;
     if (!fromBase58Check(params[2], extkey)) throw std::runtime_error("Invalid BIP32.");
 
     Vault vault(params[0], false);
-    std::shared_ptr<Keychain> keychain = vault.importKeychainExtendedKey(params[1], extkey, import_privkey, lock_key);
+    std::shared_ptr<Keychain> keychain = vault.importBIP32(params[1], to_secure_bytes(extkey), lock_key);
 
     stringstream ss;
     ss << (keychain->isPrivate() ? "Private" : "Public") << " keychain " << keychain->name() << " imported from BIP32.";
@@ -260,7 +271,6 @@ cli::result_t cmd_newaccount(const cli::params_t& params)
         keychain_names.push_back(params[i]);
 
     Vault vault(params[0], false);
-    vault.unlockChainCodes(secure_bytes_t());
     vault.newAccount(params[1], minsigs, keychain_names);
 
     stringstream ss;
@@ -311,19 +321,25 @@ cli::result_t cmd_listaccounts(const cli::params_t& params)
     return ss.str();
 }
 
-cli::result_t cmd_exportaccount(const cli::params_t& params)
+cli::result_t cmd_listaccountsjson(const cli::params_t& params)
 {
     Vault vault(params[0], false);
+    vector<AccountInfo> accounts = vault.getAllAccountInfo();
 
-    secure_bytes_t exportChainCodeUnlockKey;
-    if (params.size() > 2 && !params[2].empty())
-        exportChainCodeUnlockKey = sha256_2(params[2]);
+    stdutils::JsonWriter json(accounts.size() * 256);
+    json.beginArray();
+    for (auto& account: accounts)
+        writeJson(json, account);
+    json.endArray();
+    return json.release();
+}
 
-    if (params.size() > 3 && !params[3].empty())
-        vault.unlockChainCodes(sha256_2(params[3]));
+cli::result_t cmd_exportaccount(const cli::params_t& params)
+{
+    Vault vault(params[0], false);
 
-    std::string output_file = params.size() > 4 ? params[4] : (params[1] + ".account");
-    vault.exportAccount(params[1], output_file, true, exportChainCodeUnlockKey);
+    std::string output_file = params.size() > 2 ? params[2] : (params[1] + ".account");
+    vault.exportAccount(params[1], output_file, true);
 
     stringstream ss;
     ss << "Account " << params[1] << " exported to " << output_file << ".";
@@ -336,14 +352,7 @@ cli::result_t cmd_importaccount(const cli::params_t& params)
 
     unsigned int privkeycount = 1;
 
-    secure_bytes_t chainCodeUnlockKey;
-    if (params.size() > 2 && !params[2].empty())
-        chainCodeUnlockKey = sha256_2(params[2]);
-
-    if (params.size() > 3 && !params[3].empty())
-        vault.unlockChainCodes(sha256_2(params[3]));
-
-    std::shared_ptr<Account> account = vault.importAccount(params[1], privkeycount, chainCodeUnlockKey);
+    std::shared_ptr<Account> account = vault.importAccount(params[1], privkeycount);
 
     stringstream ss;
     ss << "Account " << account->name() << " imported from " << params[1] << ".";
@@ -354,7 +363,6 @@ cli::result_t cmd_newaccountbin(const cli::params_t& params)
 {
     Vault vault(params[0], false);
     AccountInfo accountInfo = vault.getAccountInfo(params[1]);
-    vault.unlockChainCodes(secure_bytes_t());
     vault.addAccountBin(params[1], params[2]);
 
     stringstream ss;
@@ -406,14 +414,37 @@ cli::result_t cmd_listscripts(const cli::params_t& params)
     
     Vault vault(params[0], false);
     vector<SigningScriptView> scriptViews = vault.getSigningScriptViews(account_name, bin_name, flags);
+    CoinQ::NetworkSelector networkSelector(vault.getNetwork());
 
     stringstream ss;
     ss << formattedScriptHeader();
     for (auto& scriptView: scriptViews)
-        ss << endl << formattedScript(scriptView);
+        ss << endl << formattedScript(scriptView, networkSelector.getCoinParams());
     return ss.str();
 }
 
+cli::result_t cmd_listscriptsjson(const cli::params_t& params)
+{
+    std::string account_name = params.size() > 1 ? params[1] : std::string("@all");
+    if (account_name == "@all") account_name = "";
+
+    std::string bin_name = params.size() > 2 ? params[2] : std::string("@all");
+    if (bin_name == "@all") bin_name = "";
+
+    int flags = params.size() > 3 ? (int)strtoul(params[3].c_str(), NULL, 0) : ((int)SigningScript::ISSUED | (int)SigningScript::USED);
+    
+    Vault vault(params[0], false);
+    CoinQ::NetworkSelector networkSelector(vault.getNetwork());
+    vector<SigningScriptView> scriptViews = vault.getSigningScriptViews(account_name, bin_name, flags);
+
+    stdutils::JsonWriter json(scriptViews.size() * 512);
+    json.beginArray();
+    for (auto& scriptView: scriptViews)
+        writeJson(json, scriptView, networkSelector.getCoinParams());
+    json.endArray();
+    return json.release();
+}
+
 cli::result_t cmd_history(const cli::params_t& params)
 {
     std::string account_name = params.size() > 1 ? params[1] : std::string("@all");
@@ -427,18 +458,58 @@ cli::result_t cmd_history(const cli::params_t& params)
     Vault vault(params[0], false);
     uint32_t best_height = vault.getBestHeight();
     vector<TxOutView> txOutViews = vault.getTxOutViews(account_name, bin_name, TxOut::ROLE_BOTH, TxOut::BOTH, Tx::ALL, hide_change);
+    CoinQ::NetworkSelector networkSelector(vault.getNetwork());
     stringstream ss;
     ss << formattedTxOutViewHeader();
     for (auto& txOutView: txOutViews)
-        ss << endl << formattedTxOutView(txOutView, best_height);
+        ss << endl << formattedTxOutView(txOutView, best_height, networkSelector.getCoinParams());
     return ss.str();
 }
 
+cli::result_t cmd_historyjson(const cli::params_t& params)
+{
+    std::string account_name = params.size() > 1 ? params[1] : std::string("@all");
+    if (account_name == "@all") account_name = "";
+
+    std::string bin_name = params.size() > 2 ? params[2] : std::string("@all");
+    if (bin_name == "@all") bin_name = "";
+
+    bool hide_change = params.size() > 3 ? params[3] == "true" : true;
+    
+    Vault vault(params[0], false);
+    CoinQ::NetworkSelector networkSelector(vault.getNetwork());
+    uint32_t best_height = vault.getBestHeight();
+    vector<TxOutView> txOutViews = vault.getTxOutViews(account_name, bin_name, TxOut::ROLE_BOTH, TxOut::BOTH, Tx::ALL, hide_change);
+
+    stdutils::JsonWriter json(txOutViews.size() * 512);
+    json.beginArray();
+    for (auto& txOutView: txOutViews)
+        writeJson(json, txOutView, best_height, networkSelector.getCoinParams());
+    json.endArray();
+    return json.release();
+}
+
+cli::result_t cmd_unspentjson(const cli::params_t& params)
+{
+    uint32_t min_confirmations = params.size() > 2 ? strtoul(params[2].c_str(), NULL, 0) : 0;
+
+    Vault vault(params[0], false);
+    CoinQ::NetworkSelector networkSelector(vault.getNetwork());
+    uint32_t best_height = vault.getBestHeight();
+    vector<TxOutView> txOutViews = vault.getUnspentTxOutViews(params[1], min_confirmations);
+
+    stdutils::JsonWriter json(txOutViews.size() * 512);
+    json.beginArray();
+    for (auto& txOutView: txOutViews)
+        writeJson(json, txOutView, best_height, networkSelector.getCoinParams());
+    json.endArray();
+    return json.release();
+}
+
 cli::result_t cmd_refillaccountpool(const cli::params_t& params)
 {
     Vault vault(params[0], false);
     AccountInfo accountInfo = vault.getAccountInfo(params[1]);
-    vault.unlockChainCodes(secure_bytes_t());
     vault.refillAccountPool(params[1]);
 
     stringstream ss;
@@ -452,14 +523,8 @@ cli::result_t cmd_exportbin(const cli::params_t& params)
     Vault vault(params[0], false);
 
     string export_name = params.size() > 3 ? params[3] : (params[1].empty() ? params[2] : params[1] + "-" + params[2]);
-    secure_bytes_t exportChainCodeUnlockKey;
-    if (params.size() > 4 && !params[4].empty())
-        exportChainCodeUnlockKey = sha256_2(params[4]);
-
-    vault.unlockChainCodes(secure_bytes_t());
-
-    string output_file = params.size() > 5 ? params[5] : (export_name + ".bin");
-    vault.exportAccountBin(params[1], params[2], export_name, output_file, exportChainCodeUnlockKey);
+    string output_file = params.size() > 4 ? params[4] : (export_name + ".bin");
+    vault.exportAccountBin(params[1], params[2], export_name, output_file);
 
     stringstream ss;
     ss << "Account bin " << export_name << " exported to " << output_file << ".";
@@ -470,13 +535,7 @@ cli::result_t cmd_importbin(const cli::params_t& params)
 {
     Vault vault(params[0], false);
 
-    secure_bytes_t importChainCodeUnlockKey;
-    if (params.size() > 2 && !params[2].empty())
-        importChainCodeUnlockKey = sha256_2(params[2]);
-
-    vault.unlockChainCodes(uchar_vector("1234"));
-
-    std::shared_ptr<AccountBin> bin = vault.importAccountBin(params[1], importChainCodeUnlockKey);
+    std::shared_ptr<AccountBin> bin = vault.importAccountBin(params[1]);
 
     stringstream ss;
     ss << "Account bin " << bin->name() << " imported from " << params[1] << ".";
@@ -490,6 +549,7 @@ cli::result_t cmd_txinfo(const cli::params_t& params)
 
     Vault vault(params[0], false);
     std::shared_ptr<Tx> tx = vault.getTx(uchar_vector(params[1]));
+    CoinQ::NetworkSelector networkSelector(vault.getNetwork());
 
     if (raw) return uchar_vector(tx->raw()).getHex();
 
@@ -508,11 +568,39 @@ cli::result_t cmd_txinfo(const cli::params_t& params)
 
     ss << endl << endl << formattedTxOutHeader();
     for (auto& txout: tx->txouts())
-        ss << endl << formattedTxOut(txout);
+        ss << endl << formattedTxOut(txout, networkSelector.getCoinParams());
     
     return ss.str();
 }
 
+cli::result_t cmd_txjson(const cli::params_t& params)
+{
+    Vault vault(params[0], false);
+    CoinQ::NetworkSelector networkSelector(vault.getNetwork());
+    std::shared_ptr<Tx> tx = vault.getTx(uchar_vector(params[1]));
+
+    stdutils::JsonWriter json;
+    writeJson(json, tx->toCoinCore(), networkSelector.getCoinParams());
+    return json.release();
+}
+
+cli::result_t cmd_listtxsjson(const cli::params_t& params)
+{
+    int tx_status_flags = params.size() > 1 && params[1] == "unsigned" ? Tx::UNSIGNED : Tx::ALL;
+    uint32_t minheight = params.size() > 2 ? strtoul(params[2].c_str(), NULL, 0) : 0;
+
+    Vault vault(params[0], false);
+    uint32_t best_height = vault.getBestHeight();
+    std::vector<TxView> txViews = vault.getTxViews(tx_status_flags, 0, -1, minheight);
+
+    stdutils::JsonWriter json(txViews.size() * 384);
+    json.beginArray();
+    for (auto& txView: txViews)
+        writeJson(json, txView, best_height);
+    json.endArray();
+    return json.release();
+}
+
 cli::result_t cmd_insertrawtx(const cli::params_t& params)
 {
     Vault vault(params[0], false);
@@ -600,7 +688,6 @@ cli::result_t cmd_signingrequest(const cli::params_t& params)
 cli::result_t cmd_signtx(const cli::params_t& params)
 {
     Vault vault(params[0], false);
-    vault.unlockChainCodes(uchar_vector("1234"));
     vault.unlockKeychain(params[2], secure_bytes_t());
 
     stringstream ss;
@@ -661,7 +748,7 @@ cli::result_t cmd_blockinfo(const cli::params_t& params)
     Vault vault(params[0], false);
     std::shared_ptr<BlockHeader> blockheader = vault.getBlockHeader(height);
 
-    return blockheader->toCoinClasses().toIndentedString();
+    return blockheader->toCoinCore().toIndentedString();
 }
 
 cli::result_t cmd_rawblockheader(const cli::params_t& params)
@@ -707,7 +794,7 @@ cli::result_t cmd_insertrawmerkleblock(const cli::params_t& params)
 
     uchar_vector rawmerkleblock(params[1]);
     std::shared_ptr<MerkleBlock> merkleblock(new MerkleBlock());
-    merkleblock->fromCoinClasses(rawmerkleblock, height);
+    merkleblock->fromCoinCore(Coin::MerkleBlock(rawmerkleblock), height);
 
     Vault vault(params[0], false);
     bool rval = (bool)vault.insertMerkleBlock(merkleblock);
@@ -728,6 +815,73 @@ cli::result_t cmd_deleteblock(const cli::params_t& params)
     return ss.str();
 }
 
+// Change log operations
+// Clients long-poll the same databases over and over, so each one is opened once and kept.
+std::mutex g_changeVaultsMutex;
+std::map<string, std::shared_ptr<Vault>> g_changeVaults;
+
+std::shared_ptr<Vault> getChangeVault(const string& dbname)
+{
+    std::lock_guard<std::mutex> lock(g_changeVaultsMutex);
+    auto it = g_changeVaults.find(dbname);
+    if (it != g_changeVaults.end()) return it->second;
+
+    // Only databases that open get an entry, so bad names cannot grow the table.
+    std::shared_ptr<Vault> vault = std::make_shared<Vault>(dbname, false);
+    g_changeVaults[dbname] = vault;
+    return vault;
+}
+
+cli::result_t cmd_changes(const cli::params_t& params)
+{
+    unsigned long sequence = params.size() > 1 ? strtoul(params[1].c_str(), NULL, 0) : 0;
+    unsigned int limit = params.size() > 2 ? strtoul(params[2].c_str(), NULL, 0) : 100;
+    unsigned int wait = params.size() > 3 ? strtoul(params[3].c_str(), NULL, 0) : 0;
+
+    // Each long-poll holds a worker thread, so keep them short.
+    const unsigned int MAX_WAIT = 30;
+    if (wait > MAX_WAIT) wait = MAX_WAIT;
+
+    std::shared_ptr<Vault> vault = getChangeVault(params[0]);
+    if (wait > 0) { vault->waitForChanges(sequence, wait * 1000); }
+    return changesToJson(vault->getChangesSince(sequence, limit));
+}
+
+// Profiling
+cli::result_t cmd_stats(const cli::params_t& params)
+{
+    string action = params.size() > 0 ? params[0] : "show";
+    if (action == "enable")
+    {
+        Vault::enableProfiling(true);
+        return "Profiling enabled.";
+    }
+    else if (action == "disable")
+    {
+        Vault::enableProfiling(false);
+        return "Profiling disabled.";
+    }
+    else if (action == "reset")
+    {
+        Vault::resetStats();
+        return "Profiling stats reset.";
+    }
+    else if (action != "show")
+    {
+        throw std::runtime_error("Invalid action.");
+    }
+
+    stringstream ss;
+    bool bNewLine = false;
+    for (auto& stats: Vault::getStats())
+    {
+        if (bNewLine)   { ss << endl; }
+        else            { bNewLine = true; }
+        ss << stats.toJson();
+    }
+    return ss.str();
+}
+
 cli::result_t cmd_randombytes(const cli::params_t& params)
 {
     uchar_vector bytes = random_bytes(strtoul(params[0].c_str(), NULL, 0));
@@ -748,13 +902,123 @@ void closeCallback(WebSocket::Server& server, websocketpp::connection_hdl hdl)
 using namespace cli;
 Shell shell("vaultd by Eric Lombrozo v0.0.1");
 
-void requestCallback(WebSocket::Server& server, const WebSocket::Server::client_request_t& req)
+// Scheduling
+//
+// Commands that only read the vault in their db file may run alongside each other. Commands that
+// take no db file run whenever a worker is free, as does changes, which reads in short transactions
+// while it long-polls and must not hold up writers. Anything else is assumed to write.
+const std::set<string> READ_COMMANDS = {
+    "info", "keychainexists", "keychaininfo", "keychains", "exportkeychain", "exportbip32",
+    "accountexists", "accountinfo", "listaccounts", "listaccountsjson", "exportaccount",
+    "listscripts", "listscriptsjson", "history", "historyjson", "unspentjson",
+    "listbins", "exportbin", "txinfo", "txjson", "listtxsjson", "signingrequest",
+    "bestheight", "horizonheight", "horizontimestamp", "blockinfo"
+};
+
+const std::set<string> UNLOCKED_COMMANDS = {
+    "rawblockheader", "rawmerkleblock", "changes", "stats", "randombytes"
+};
+
+RequestScheduler::access_t getAccess(const string& cmdname, const params_t& params)
+{
+    if (params.empty() || !shell.has(cmdname) || UNLOCKED_COMMANDS.count(cmdname)) return RequestScheduler::UNLOCKED;
+    if (READ_COMMANDS.count(cmdname)) return RequestScheduler::READ;
+    return RequestScheduler::WRITE;
+}
+
+const unsigned int DEFAULT_THREADS = 4;
+const unsigned int DEFAULT_MAX_QUEUED = 256;
+const unsigned int DEFAULT_TIMEOUT = 60; // seconds a request may wait to start
+
+std::unique_ptr<RequestScheduler> g_scheduler;
+
+// Metrics
+const double LATENCY_BUCKETS[] = { 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30 };
+const std::size_t LATENCY_BUCKET_COUNT = sizeof(LATENCY_BUCKETS) / sizeof(LATENCY_BUCKETS[0]);
+
+struct RequestMetrics
+{
+    RequestMetrics() : requests(0), errors(0), seconds(0), queueSeconds(0) { buckets.fill(0); }
+
+    uint64_t requests;
+    uint64_t errors;
+    double seconds;
+    double queueSeconds;
+    std::array<uint64_t, LATENCY_BUCKET_COUNT> buckets;
+};
+
+std::mutex g_requestMetricsMutex;
+std::map<string, RequestMetrics> g_requestMetrics;
+
+void recordRequest(const string& cmdname, bool bError, double queueSeconds, double seconds)
+{
+    // Unknown commands are counted together so clients cannot grow the table.
+    std::lock_guard<std::mutex> lock(g_requestMetricsMutex);
+    RequestMetrics& metrics = g_requestMetrics[shell.has(cmdname) ? cmdname : "unknown"];
+    metrics.requests++;
+    if (bError) { metrics.errors++; }
+    metrics.seconds += seconds;
+    metrics.queueSeconds += queueSeconds;
+    std::size_t b = std::lower_bound(LATENCY_BUCKETS, LATENCY_BUCKETS + LATENCY_BUCKET_COUNT, seconds) - LATENCY_BUCKETS;
+    if (b < LATENCY_BUCKET_COUNT) { metrics.buckets[b]++; }
+}
+
+string renderMetrics()
+{
+    CoinQ::MetricsWriter writer;
+
+    RequestScheduler::Stats scheduler = g_scheduler->getStats();
+    writer.gauge("vaultd_worker_threads", "Threads serving requests.", scheduler.threads);
+    writer.gauge("vaultd_requests_queued", "Requests waiting to start.", scheduler.queued);
+    writer.gauge("vaultd_requests_running", "Requests being served.", scheduler.running);
+    writer.counter("vaultd_requests_rejected_total", "Requests turned away because the queue was full.", scheduler.rejected);
+    writer.counter("vaultd_requests_timed_out_total", "Requests that waited too long to start.", scheduler.timedOut);
+
+    {
+        std::lock_guard<std::mutex> lock(g_requestMetricsMutex);
+        writer.family("vaultd_requests_total", CoinQ::MetricsWriter::COUNTER, "Requests served.");
+        for (auto& item: g_requestMetrics) { writer.sample("vaultd_requests_total", item.second.requests, {{"command", item.first}}); }
+
+        writer.family("vaultd_request_errors_total", CoinQ::MetricsWriter::COUNTER, "Requests that returned an error.");
+        for (auto& item: g_requestMetrics) { writer.sample("vaultd_request_errors_total", item.second.errors, {{"command", item.first}}); }
+
+        writer.family("vaultd_request_queue_seconds_total", CoinQ::MetricsWriter::COUNTER, "Time requests spent waiting to start.");
+        for (auto& item: g_requestMetrics) { writer.sample("vaultd_request_queue_seconds_total", item.second.queueSeconds, {{"command", item.first}}); }
+
+        writer.family("vaultd_request_duration_seconds", CoinQ::MetricsWriter::HISTOGRAM, "Time spent serving requests, queueing excluded.");
+        for (auto& item: g_requestMetrics)
+        {
+            const RequestMetrics& metrics = item.second;
+            uint64_t count = 0;
+            for (std::size_t b = 0; b < LATENCY_BUCKET_COUNT; b++)
+            {
+                count += metrics.buckets[b];
+                stringstream le;
+                le << LATENCY_BUCKETS[b];
+                writer.sample("vaultd_request_duration_seconds_bucket", count, {{"command", item.first}, {"le", le.str()}});
+            }
+            writer.sample("vaultd_request_duration_seconds_bucket", metrics.requests, {{"command", item.first}, {"le", "+Inf"}});
+            writer.sample("vaultd_request_duration_seconds_sum", metrics.seconds, {{"command", item.first}});
+            writer.sample("vaultd_request_duration_seconds_count", metrics.requests, {{"command", item.first}});
+        }
+    }
+
+    writeVaultMetrics(writer);
+    CoinQ::writeProcessMetrics(writer);
+    return writer.str();
+}
+
+// Runs on a worker thread.
+void serveRequest(WebSocket::Server& server, const WebSocket::Server::client_request_t& req, RequestScheduler::clock_t::time_point queued)
 {
     JsonRpc::Response response;
 
     const string& cmdname = req.second.getMethod();
     params_t params;
-    for (auto& param: req.second.getParams()) { params.push_back(param.get_str()); }
+    for (auto& param: req.second.getParams().get_array()) { params.push_back(param.get_str()); }
+
+    RequestScheduler::clock_t::time_point start = RequestScheduler::clock_t::now();
+    bool bError = false;
     try
     {
         result_t result = shell.exec(cmdname, params);
@@ -763,15 +1027,88 @@ void requestCallback(WebSocket::Server& server, const WebSocket::Server::client_
     catch (const std::exception& e)
     {
         response.setError(e.what(), req.second.getId());        
+        bError = true;
     }
 
+    RequestScheduler::clock_t::time_point finish = RequestScheduler::clock_t::now();
+    recordRequest(cmdname, bError, std::chrono::duration<double>(start - queued).count(), std::chrono::duration<double>(finish - start).count());
+
+    server.send(req.first, response);
+}
+
+void rejectRequest(WebSocket::Server& server, const WebSocket::Server::client_request_t& req, const string& error)
+{
+    JsonRpc::Response response;
+    response.setError(error, req.second.getId());
     server.send(req.first, response);
 }
 
+void requestCallback(WebSocket::Server& server, const WebSocket::Server::client_request_t& req)
+{
+    const string& cmdname = req.second.getMethod();
+    params_t params;
+    for (auto& param: req.second.getParams().get_array()) { params.push_back(param.get_str()); }
+
+    RequestScheduler::access_t access = getAccess(cmdname, params);
+    string vault = access == RequestScheduler::UNLOCKED ? string() : boost::filesystem::absolute(params[0]).string();
+
+    RequestScheduler::clock_t::time_point queued = RequestScheduler::clock_t::now();
+    WebSocket::Server* pServer = &server;
+    WebSocket::Server::client_request_t request(req);
+    bool bQueued = g_scheduler->submit(vault, access,
+        [=]() { serveRequest(*pServer, request, queued); },
+        [=](const string& error) { rejectRequest(*pServer, request, error); });
+
+    if (!bQueued) { rejectRequest(server, req, "Server busy."); }
+}
+
 int main(int argc, char* argv[])
 {
     INIT_LOGGER("vaultd.log");
 
+    // vaultd [--metricsport=<port>] [--threads=<n>] [--maxqueued=<n>] [--timeout=<seconds>]
+    unsigned short metricsPort = 0;
+    unsigned int threads = DEFAULT_THREADS;
+    unsigned int maxQueued = DEFAULT_MAX_QUEUED;
+    unsigned int timeout = DEFAULT_TIMEOUT;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg(argv[i]);
+        if (arg.compare(0, 14, "--metricsport=") == 0)
+        {
+            metricsPort = strtoul(arg.c_str() + 14, NULL, 0);
+        }
+        else if (arg.compare(0, 10, "--threads=") == 0)
+        {
+            threads = strtoul(arg.c_str() + 10, NULL, 0);
+        }
+        else if (arg.compare(0, 12, "--maxqueued=") == 0)
+        {
+            maxQueued = strtoul(arg.c_str() + 12, NULL, 0);
+        }
+        else if (arg.compare(0, 10, "--timeout=") == 0)
+        {
+            timeout = strtoul(arg.c_str() + 10, NULL, 0);
+        }
+        else
+        {
+            cerr << "Usage: " << argv[0] << " [--metricsport=<port>] [--threads=<n>] [--maxqueued=<n>] [--timeout=<seconds>]" << endl;
+            return 1;
+        }
+    }
+
+    try
+    {
+        g_scheduler.reset(new RequestScheduler(threads, maxQueued, timeout));
+        g_scheduler->start();
+        LOGGER(debug) << "Serving requests on " << threads << " threads." << endl;
+    }
+    catch (const std::exception& e)
+    {
+        LOGGER(error) << "Error starting request scheduler: " << e.what() << endl;
+        return 1;
+    }
+
     signal(SIGINT, &finish);
 
     // Global operations
@@ -795,22 +1132,29 @@ int main(int argc, char* argv[])
     shell.add(command(&cmd_renameaccount, "renameaccount", "rename an account", command::params(3, "db file", "old name", "new name")));
     shell.add(command(&cmd_accountinfo, "accountinfo", "display account information", command::params(2, "db file", "account name")));
     shell.add(command(&cmd_listaccounts, "listaccounts", "display list of accounts", command::params(1, "db file")));
-    shell.add(command(&cmd_exportaccount, "exportaccount", "export account to file", command::params(2, "db file", "account name"), command::params(3, "export chain code passphrase", "native chain code passphrase", "output file = *.account")));
-    shell.add(command(&cmd_importaccount, "importaccount", "import account from file", command::params(2, "db file", "account file"), command::params(2, "import chain code passphrase", "native chain code passphrase"))); 
+    shell.add(command(&cmd_listaccountsjson, "listaccountsjson", "display list of accounts in json format", command::params(1, "db file")));
+    shell.add(command(&cmd_exportaccount, "exportaccount", "export account to file", command::params(2, "db file", "account name"), command::params(1, "output file = *.account")));
+    shell.add(command(&cmd_importaccount, "importaccount", "import account from file", command::params(2, "db file", "account file")));
     shell.add(command(&cmd_newaccountbin, "newaccountbin", "add a new account bin", command::params(3, "db file", "account name", "bin name")));
     shell.add(command(&cmd_issuescript, "issuescript", "issue a new signing script", command::params(2, "db file", "account name"), command::params(1, (std::string("bin name = ") + DEFAULT_BIN_NAME).c_str())));
     shell.add(command(&cmd_listscripts, "listscripts", "display list of signing scripts (flags: UNUSED=1, CHANGE=2, PENDING=4, RECEIVED=8, CANCELED=16)", command::params(1, "db file"),
         command::params(3, "account name = @all", "bin name = @all", "flags = PENDING | RECEIVED")));
+    shell.add(command(&cmd_listscriptsjson, "listscriptsjson", "display list of signing scripts in json format (flags: UNUSED=1, CHANGE=2, PENDING=4, RECEIVED=8, CANCELED=16)", command::params(1, "db file"),
+        command::params(3, "account name = @all", "bin name = @all", "flags = PENDING | RECEIVED")));
     shell.add(command(&cmd_history, "history", "display transaction history", command::params(1, "db file"), command::params(3, "account name = @all", "bin name = @all", "hide change = true")));
+    shell.add(command(&cmd_historyjson, "historyjson", "display transaction history in json format", command::params(1, "db file"), command::params(3, "account name = @all", "bin name = @all", "hide change = true")));
+    shell.add(command(&cmd_unspentjson, "unspentjson", "display unspent outputs in json format", command::params(2, "db file", "account name"), command::params(1, "minimum confirmations = 0")));
     shell.add(command(&cmd_refillaccountpool, "refillaccountpool", "refill signing script pool for account", command::params(2, "db file", "account name")));
 
     // Account bin operations
     shell.add(command(&cmd_listbins, "listbins", "display list of bins", command::params(1, "db file")));
-    shell.add(command(&cmd_exportbin, "exportbin", "export account bin to file", command::params(3, "db file", "account name", "bin name"), command::params(3, "export name = account_name-bin_name", "export chain code passphrase", "output file = *.bin")));
-    shell.add(command(&cmd_importbin, "importbin", "import account bin from file", command::params(2, "db file", "bin file"), command::params(1, "import chain code passphrase")));
+    shell.add(command(&cmd_exportbin, "exportbin", "export account bin to file", command::params(3, "db file", "account name", "bin name"), command::params(2, "export name = account_name-bin_name", "output file = *.bin")));
+    shell.add(command(&cmd_importbin, "importbin", "import account bin from file", command::params(2, "db file", "bin file")));
 
     // Tx operations
     shell.add(command(&cmd_txinfo, "txinfo", "display transaction information", command::params(2, "db file", "tx hash"), command::params(1, "raw hex = false")));
+    shell.add(command(&cmd_txjson, "txjson", "display transaction inputs and outputs in json format", command::params(2, "db file", "tx hash")));
+    shell.add(command(&cmd_listtxsjson, "listtxsjson", "list transactions in json format", command::params(1, "db file"), command::params(2, "all | unsigned (default: all)", "minheight (default:0)")));
     shell.add(command(&cmd_insertrawtx, "insertrawtx", "insert a raw hex transaction into database", command::params(2, "db file", "tx raw hex")));
     shell.add(command(&cmd_newrawtx, "newrawtx", "create a new raw transaction", command::params(4, "db file", "account name", "address 1", "value 1"), command::params(6, "address 2", "value 2", "...", "fee = 0", "version = 1", "locktime = 0")));
     shell.add(command(&cmd_deletetx, "deletetx", "delete a transaction", command::params(2, "db file", "tx hash")));
@@ -827,9 +1171,31 @@ int main(int argc, char* argv[])
     shell.add(command(&cmd_insertrawmerkleblock, "insertrawmerkleblock", "insert raw merkle block into database", command::params(2, "db file", "raw merkle block"), command::params(1, "height = 0")));
     shell.add(command(&cmd_deleteblock, "deleteblock", "delete merkle block including all descendants", command::params(1, "db file"), command::params(1, "height = 0")));
 
+    // Change log operations
+    shell.add(command(&cmd_changes, "changes", "display vault changes logged after a sequence number, optionally waiting for new ones", command::params(1, "db file"), command::params(3, "sequence = 0", "limit = 100", "wait seconds = 0")));
+
+    // Profiling
+    shell.add(command(&cmd_stats, "stats", "show, enable, disable or reset per-method vault profiling", command::params(0), command::params(1, "action = show")));
+
     // Miscellaneous
     shell.add(command(&cmd_randombytes, "randombytes", "output random bytes in hex", command::params(1, "length")));
 
+    CoinQ::MetricsServer metricsServer(&renderMetrics);
+    if (metricsPort)
+    {
+        try
+        {
+            Vault::enableProfiling();
+            metricsServer.start(metricsPort);
+            LOGGER(debug) << "Serving metrics on port " << metricsPort << "." << endl;
+        }
+        catch (const std::exception& e)
+        {
+            LOGGER(error) << "Error starting metrics server: " << e.what() << endl;
+            return 1;
+        }
+    }
+
     WebSocket::Server wsServer(WS_PORT);
     wsServer.setOpenCallback(&openCallback);
     wsServer.setCloseCallback(&closeCallback);
@@ -849,6 +1215,15 @@ int main(int argc, char* argv[])
 
     while (!g_bShutdown) { std::this_thread::sleep_for(std::chrono::microseconds(200)); }
 
+    // Answers queued requests while clients can still be reached.
+    LOGGER(debug) << "Stopping request scheduler..." << endl;
+    g_scheduler->stop();
+
+    {
+        std::lock_guard<std::mutex> lock(g_changeVaultsMutex);
+        g_changeVaults.clear();
+    }
+
     try
     {
         LOGGER(debug) << "Stopping websocket server..." << endl;
@@ -0,0 +1,280 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// request scheduler tests
+//
+// requestscheduler_test.cpp
+//
+// Copyright (c) 2011-2016 Ciphrex Corp.
+//
+// All Rights Reserved.
+//
+// Holds requests open on gates to check which ones RequestScheduler lets run
+// alongside each other, the order requests on one vault start in, and how
+// requests are rejected when the queue is full, when they wait past the
+// timeout and when the scheduler stops.
+//
+
+#include "RequestScheduler.h"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+
+// Waits are bounded so a scheduling bug fails the test instead of hanging it.
+const chrono::seconds WAIT_TIMEOUT(5);
+
+unsigned int g_failed = 0;
+unsigned int g_passed = 0;
+
+void check(bool condition, const string& name)
+{
+    if (condition)
+    {
+        g_passed++;
+        return;
+    }
+
+    g_failed++;
+    cerr << "FAILED: " << name << endl;
+}
+
+template<typename F>
+bool throws(F f)
+{
+    try
+    {
+        f();
+    }
+    catch (const exception&)
+    {
+        return true;
+    }
+    return false;
+}
+
+// What the jobs did, in the order they did it.
+class EventLog
+{
+public:
+    void add(const string& event)
+    {
+        {
+            lock_guard<mutex> lock(mutex_);
+            events_.push_back(event);
+        }
+        cond_.notify_all();
+    }
+
+    bool has(const string& event) const
+    {
+        lock_guard<mutex> lock(mutex_);
+        return find(events_.begin(), events_.end(), event) != events_.end();
+    }
+
+    bool waitFor(const string& event)
+    {
+        unique_lock<mutex> lock(mutex_);
+        return cond_.wait_for(lock, WAIT_TIMEOUT, [&]() { return find(events_.begin(), events_.end(), event) != events_.end(); });
+    }
+
+    vector<string> events() const
+    {
+        lock_guard<mutex> lock(mutex_);
+        return events_;
+    }
+
+private:
+    mutable mutex mutex_;
+    condition_variable cond_;
+    vector<string> events_;
+};
+
+// Keeps the jobs waiting on it running until it is opened.
+class Gate
+{
+public:
+    Gate() : bOpen(false) { }
+
+    void open()
+    {
+        {
+            lock_guard<mutex> lock(mutex_);
+            bOpen = true;
+        }
+        cond_.notify_all();
+    }
+
+    void wait()
+    {
+        unique_lock<mutex> lock(mutex_);
+        cond_.wait_for(lock, WAIT_TIMEOUT, [&]() { return bOpen; });
+    }
+
+private:
+    mutex mutex_;
+    condition_variable cond_;
+    bool bOpen;
+};
+
+RequestScheduler::job_t logJob(EventLog& log, const string& name)
+{
+    return [&log, name]() { log.add(name); };
+}
+
+RequestScheduler::job_t gatedJob(EventLog& log, const string& name, Gate& gate)
+{
+    return [&log, name, &gate]() { log.add(name + " start"); gate.wait(); log.add(name + " end"); };
+}
+
+RequestScheduler::reject_t logReject(EventLog& log, const string& name)
+{
+    return [&log, name](const string& error) { log.add(name + " rejected: " + error); };
+}
+
+void testConstruction()
+{
+    check(throws([]() { RequestScheduler scheduler(0, 10, 0); }), "no threads throws");
+
+    RequestScheduler scheduler(1, 10, 0);
+    EventLog log;
+    check(!scheduler.submit("a", RequestScheduler::READ, logJob(log, "r"), logReject(log, "r")), "submit before start is refused");
+
+    scheduler.start();
+    check(throws([&]() { scheduler.start(); }), "second start throws");
+}
+
+void testReadersShareVault()
+{
+    RequestScheduler scheduler(4, 10, 0);
+    scheduler.start();
+
+    EventLog log;
+    Gate gate;
+    scheduler.submit("a", RequestScheduler::READ, gatedJob(log, "r1", gate), logReject(log, "r1"));
+    scheduler.submit("a", RequestScheduler::READ, gatedJob(log, "r2", gate), logReject(log, "r2"));
+    check(log.waitFor("r1 start") && log.waitFor("r2 start"), "readers of one vault run together");
+
+    gate.open();
+    scheduler.stop();
+}
+
+void testWriterOrder()
+{
+    RequestScheduler scheduler(4, 10, 0);
+    scheduler.start();
+
+    EventLog log;
+    Gate gate;
+    scheduler.submit("a", RequestScheduler::READ, gatedJob(log, "r1", gate), logReject(log, "r1"));
+    check(log.waitFor("r1 start"), "first reader starts");
+
+    // Threads are free, but the writer waits for r1 and r2 waits for the writer.
+    scheduler.submit("a", RequestScheduler::WRITE, logJob(log, "w"), logReject(log, "w"));
+    scheduler.submit("a", RequestScheduler::READ, logJob(log, "r2"), logReject(log, "r2"));
+    scheduler.submit("b", RequestScheduler::WRITE, logJob(log, "other vault"), logReject(log, "other vault"));
+    scheduler.submit("a", RequestScheduler::UNLOCKED, logJob(log, "unlocked"), logReject(log, "unlocked"));
+    check(log.waitFor("other vault"), "other vaults are not held up");
+    check(log.waitFor("unlocked"), "unlocked requests are not held up");
+
+    this_thread::sleep_for(chrono::milliseconds(200));
+    check(!log.has("w"), "writer waits for the running reader");
+    check(!log.has("r2"), "reader queued behind a writer waits for it");
+    check(scheduler.getStats().queued == 2 && scheduler.getStats().running == 1, "stats count queued and running requests");
+
+    gate.open();
+    check(log.waitFor("r2"), "queued requests run once the vault is free");
+
+    vector<string> events = log.events();
+    auto at = [&](const string& event) { return find(events.begin(), events.end(), event) - events.begin(); };
+    check(at("r1 end") < at("w") && at("w") < at("r2"), "requests on a vault start in the order they arrived");
+
+    scheduler.stop();
+}
+
+void testTimeout()
+{
+    // Two threads, so one is free to notice the queued request timing out.
+    RequestScheduler scheduler(2, 10, 1);
+    scheduler.start();
+
+    EventLog log;
+    Gate gate;
+    scheduler.submit("a", RequestScheduler::WRITE, gatedJob(log, "w", gate), logReject(log, "w"));
+    check(log.waitFor("w start"), "writer starts");
+
+    scheduler.submit("a", RequestScheduler::READ, logJob(log, "r"), logReject(log, "r"));
+    check(log.waitFor("r rejected: Request timed out before it could start."), "request stuck behind a writer times out");
+    check(scheduler.getStats().timedOut == 1, "timeout counted");
+
+    gate.open();
+    check(log.waitFor("w end"), "writer finishes");
+    scheduler.stop();
+    check(!log.has("r"), "timed out request never runs");
+}
+
+void testQueueFullAndStop()
+{
+    RequestScheduler scheduler(1, 1, 0);
+    scheduler.start();
+
+    EventLog log;
+    Gate gate;
+    scheduler.submit("a", RequestScheduler::WRITE, gatedJob(log, "w", gate), logReject(log, "w"));
+    check(log.waitFor("w start"), "writer starts");
+
+    check(scheduler.submit("b", RequestScheduler::READ, logJob(log, "queued"), logReject(log, "queued")), "request queued while threads are busy");
+    check(!scheduler.submit("b", RequestScheduler::READ, logJob(log, "full"), logReject(log, "full")), "request refused when the queue is full");
+    check(scheduler.getStats().rejected == 1, "refusal counted");
+
+    // stop() drops the queue at once but waits for the running writer.
+    thread stopper([&]() { scheduler.stop(); });
+    while (scheduler.getStats().queued != 0) { this_thread::yield(); }
+    check(!scheduler.submit("b", RequestScheduler::READ, logJob(log, "late"), logReject(log, "late")), "request refused once stopping");
+
+    gate.open();
+    stopper.join();
+    check(log.has("w end"), "running request finishes on stop");
+    check(log.has("queued rejected: Server is shutting down.") && !log.has("queued"), "queued request rejected on stop");
+}
+
+void testThrowingJob()
+{
+    RequestScheduler scheduler(1, 10, 0);
+    scheduler.start();
+
+    EventLog log;
+    scheduler.submit("a", RequestScheduler::WRITE, []() { throw runtime_error("job failed"); }, logReject(log, "throws"));
+    scheduler.submit("a", RequestScheduler::WRITE, logJob(log, "after"), logReject(log, "after"));
+    check(log.waitFor("after"), "worker survives a throwing job and releases its vault");
+    scheduler.stop();
+}
+
+}
+
+int main()
+{
+    try
+    {
+        testConstruction();
+        testReadersShareVault();
+        testWriterOrder();
+        testTimeout();
+        testQueueFullAndStop();
+        testThrowingJob();
+    }
+    catch (const exception& e)
+    {
+        cerr << "Error: " << e.what() << endl;
+        return -2;
+    }
+
+    cout << g_passed << " passed, " << g_failed << " failed." << endl;
+    return g_failed ? -1 : 0;
+}